@@ -0,0 +1,540 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Layout of a backup directory:
+//    meta/<id>             -- files of backup <id>, see below
+//    shared/<name>         -- table files, shared by the backups
+//    shared/<n>.cf/<name>  -- table files of column family <n>
+//    private/<id>/         -- MANIFEST and CURRENT of backup <id>, and
+//                             of its column families in <n>.cf/
+//
+// A table file NNNNNN.ldb of size S is stored as NNNNNN_S.ldb, so that a
+// file is copied again if a DB reuses its number.  A backup exists once
+// its meta file is written:
+//    meta := timestamp '\n' count '\n' file[count]
+//    file := path ' ' size ' ' crc32c '\n'
+// with the paths relative to the backup directory, the table files
+// first and the CURRENT files last.
+
+#include "leveldb/backup_engine.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+
+#include "db/db_impl.h"
+#include "db/filename.h"
+#include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "port/port.h"
+#include "util/crc32c.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+// A utility routine: write "data" to the named file and Sync() it.
+Status WriteStringToFileSync(Env* env, const Slice& data,
+                             const std::string& fname);
+
+BackupEngineOptions::BackupEngineOptions() : env(Env::Default()) {}
+
+BackupEngine::~BackupEngine() = default;
+
+namespace {
+
+struct FileInfo {
+  uint64_t size;
+  uint32_t checksum;  // crc32c of the contents
+};
+
+struct BackupMeta {
+  int64_t timestamp;
+  std::vector<std::string> files;  // Relative to the backup directory
+};
+
+// Copy src to dst, or only read src if dst is empty, and store the size
+// and checksum of its contents in *info.
+Status CopyFile(Env* env, const std::string& src, const std::string& dst,
+                FileInfo* info) {
+  info->size = 0;
+  info->checksum = 0;
+  SequentialFile* sfile;
+  Status s = env->NewSequentialFile(src, &sfile);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* dfile = nullptr;
+  if (!dst.empty()) {
+    s = env->NewWritableFile(dst, &dfile);
+    if (!s.ok()) {
+      delete sfile;
+      return s;
+    }
+  }
+
+  const size_t kBufferSize = 65536;
+  char* buffer = new char[kBufferSize];
+  while (s.ok()) {
+    Slice data;
+    s = sfile->Read(kBufferSize, &data, buffer);
+    if (!s.ok() || data.empty()) {
+      break;
+    }
+    info->size += data.size();
+    info->checksum = crc32c::Extend(info->checksum, data.data(), data.size());
+    if (dfile != nullptr) {
+      s = dfile->Append(data);
+    }
+  }
+  delete[] buffer;
+  delete sfile;
+  if (dfile != nullptr) {
+    if (s.ok()) {
+      s = dfile->Sync();
+    }
+    if (s.ok()) {
+      s = dfile->Close();
+    }
+    delete dfile;
+    if (!s.ok()) {
+      env->RemoveFile(dst);
+    }
+  }
+  return s;
+}
+
+// Name under "shared" of the table file "fname" of size "size".
+std::string SharedFileName(const std::string& fname, uint64_t size) {
+  const size_t dot = fname.rfind('.');
+  return fname.substr(0, dot) + "_" + NumberToString(size) + fname.substr(dot);
+}
+
+// Path in a restored DB of the backup file "path".
+std::string RestoredFileName(const std::string& path) {
+  Slice rest(path);
+  if (rest.starts_with("shared/")) {
+    rest.remove_prefix(strlen("shared/"));
+    std::string result = rest.ToString();
+    const size_t underscore = result.rfind('_');
+    const size_t dot = result.rfind('.');
+    return result.erase(underscore, dot - underscore);
+  }
+  // private/<id>/<name>
+  rest.remove_prefix(strlen("private/"));
+  const char* slash =
+      static_cast<const char*>(memchr(rest.data(), '/', rest.size()));
+  rest.remove_prefix(slash - rest.data() + 1);
+  return rest.ToString();
+}
+
+bool ParseBackupId(const std::string& name, uint32_t* id) {
+  Slice in(name);
+  uint64_t value;
+  if (!ConsumeDecimalNumber(&in, &value) || !in.empty() || value == 0 ||
+      value > UINT32_MAX) {
+    return false;
+  }
+  *id = static_cast<uint32_t>(value);
+  return true;
+}
+
+class BackupEngineImpl : public BackupEngine {
+ public:
+  BackupEngineImpl(const BackupEngineOptions& options,
+                   const std::string& backup_dir)
+      : env_(options.env), options_(options), backup_dir_(backup_dir) {}
+
+  ~BackupEngineImpl() override = default;
+
+  // Read the meta files and remove the files of no backup.
+  Status Initialize();
+
+  Status CreateNewBackup(DB* db, uint32_t* backup_id) override;
+  void GetBackupInfo(std::vector<BackupInfo>* backup_info) override;
+  Status DeleteBackup(uint32_t backup_id) override;
+  Status VerifyBackup(uint32_t backup_id) override;
+  Status RestoreDBFromBackup(uint32_t backup_id,
+                             const std::string& db_dir) override;
+
+ private:
+  struct VerifyState;
+
+  static void VerifyFiles(void* arg);
+
+  std::string MetaFileName(uint32_t backup_id) const {
+    return backup_dir_ + "/meta/" + NumberToString(backup_id);
+  }
+
+  Status ReadMeta(uint32_t backup_id, BackupMeta* meta);
+  Status WriteMeta(uint32_t backup_id, const BackupMeta& meta);
+
+  // Remove the files in "dir" (relative to backup_dir_) and its column
+  // family directories that are not in "used".
+  void RemoveUnusedFiles(const std::string& dir,
+                         const std::set<std::string>& used);
+
+  // Remove the files that no backup uses.
+  void GarbageCollect();
+
+  Env* const env_;
+  const BackupEngineOptions options_;
+  const std::string backup_dir_;
+  std::map<uint32_t, BackupMeta> backups_;
+  std::map<std::string, FileInfo> files_;  // Files of the backups
+};
+
+Status BackupEngineImpl::Initialize() {
+  env_->CreateDir(backup_dir_);  // In case it does not exist
+  env_->CreateDir(backup_dir_ + "/meta");
+  env_->CreateDir(backup_dir_ + "/shared");
+  env_->CreateDir(backup_dir_ + "/private");
+
+  std::vector<std::string> names;
+  Status s = env_->GetChildren(backup_dir_ + "/meta", &names);
+  for (size_t i = 0; s.ok() && i < names.size(); i++) {
+    uint32_t backup_id;
+    if (ParseBackupId(names[i], &backup_id)) {
+      s = ReadMeta(backup_id, &backups_[backup_id]);
+    } else if (names[i] != "." && names[i] != "..") {
+      // Meta file of an incomplete backup
+      env_->RemoveFile(backup_dir_ + "/meta/" + names[i]);
+    }
+  }
+  if (s.ok()) {
+    GarbageCollect();
+  }
+  return s;
+}
+
+Status BackupEngineImpl::ReadMeta(uint32_t backup_id, BackupMeta* meta) {
+  std::string contents;
+  Status s = ReadFileToString(env_, MetaFileName(backup_id), &contents);
+  if (!s.ok()) {
+    return s;
+  }
+  Slice in(contents);
+  uint64_t timestamp, count;
+  bool ok = ConsumeDecimalNumber(&in, &timestamp) && in.starts_with("\n");
+  in.remove_prefix(ok ? 1 : 0);
+  ok = ok && ConsumeDecimalNumber(&in, &count) && in.starts_with("\n");
+  in.remove_prefix(ok ? 1 : 0);
+  meta->timestamp = timestamp;
+  meta->files.clear();
+  for (uint64_t i = 0; ok && i < count; i++) {
+    const char* space =
+        static_cast<const char*>(memchr(in.data(), ' ', in.size()));
+    uint64_t size, checksum;
+    ok = (space != nullptr);
+    if (ok) {
+      meta->files.emplace_back(in.data(), space - in.data());
+      in.remove_prefix(space - in.data() + 1);
+      ok = ConsumeDecimalNumber(&in, &size) && in.starts_with(" ");
+    }
+    if (ok) {
+      in.remove_prefix(1);
+      ok = ConsumeDecimalNumber(&in, &checksum) && in.starts_with("\n") &&
+           checksum <= UINT32_MAX;
+    }
+    if (ok) {
+      in.remove_prefix(1);
+      files_[meta->files.back()] = FileInfo{size,
+                                            static_cast<uint32_t>(checksum)};
+    }
+  }
+  if (!ok || !in.empty()) {
+    return Status::Corruption("bad backup meta file",
+                              MetaFileName(backup_id));
+  }
+  return Status::OK();
+}
+
+Status BackupEngineImpl::WriteMeta(uint32_t backup_id, const BackupMeta& meta) {
+  std::string contents = NumberToString(meta.timestamp) + "\n" +
+                         NumberToString(meta.files.size()) + "\n";
+  for (const std::string& path : meta.files) {
+    const FileInfo& info = files_[path];
+    contents += path + " " + NumberToString(info.size) + " " +
+                NumberToString(info.checksum) + "\n";
+  }
+  const std::string fname = MetaFileName(backup_id);
+  Status s = WriteStringToFileSync(env_, contents, fname + ".tmp");
+  if (s.ok()) {
+    s = env_->RenameFile(fname + ".tmp", fname);
+  }
+  return s;
+}
+
+void BackupEngineImpl::RemoveUnusedFiles(const std::string& dir,
+                                         const std::set<std::string>& used) {
+  std::vector<std::string> names;
+  env_->GetChildren(backup_dir_ + "/" + dir, &names);
+  uint64_t number;
+  FileType type;
+  for (const std::string& name : names) {
+    const std::string path = dir + "/" + name;
+    if (name == "." || name == "..") {
+      continue;
+    } else if (ParseFileName(name, &number, &type) &&
+               type == kColumnFamilyDir) {
+      RemoveUnusedFiles(path, used);
+    } else if (used.count(path) == 0) {
+      env_->RemoveFile(backup_dir_ + "/" + path);
+    }
+  }
+}
+
+void BackupEngineImpl::GarbageCollect() {
+  std::set<std::string> used;
+  for (const auto& backup : backups_) {
+    used.insert(backup.second.files.begin(), backup.second.files.end());
+  }
+  for (auto it = files_.begin(); it != files_.end();) {
+    if (used.count(it->first) == 0) {
+      it = files_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  RemoveUnusedFiles("shared", used);
+
+  // The private directories of deleted or incomplete backups have the
+  // layout of a DB directory.
+  std::vector<std::string> names;
+  env_->GetChildren(backup_dir_ + "/private", &names);
+  Options options;
+  options.env = env_;
+  for (const std::string& name : names) {
+    uint32_t backup_id;
+    if (name != "." && name != ".." &&
+        (!ParseBackupId(name, &backup_id) || backups_.count(backup_id) == 0)) {
+      DestroyDB(backup_dir_ + "/private/" + name, options);
+    }
+  }
+}
+
+Status BackupEngineImpl::CreateNewBackup(DB* db, uint32_t* backup_id) {
+  *backup_id = 0;
+  const uint32_t id = backups_.empty() ? 1 : backups_.rbegin()->first + 1;
+  std::vector<LiveFiles> live;
+  Status s = db->GetLiveFiles(&live);
+  if (!s.ok()) {
+    return s;
+  }
+
+  BackupMeta meta;
+  meta.timestamp = env_->NowMicros() / 1000000;
+  std::vector<std::string> current_files;
+  const std::string private_dir = "private/" + NumberToString(id);
+  s = env_->CreateDir(backup_dir_ + "/" + private_dir);
+  for (size_t i = 0; s.ok() && i < live.size(); i++) {
+    const LiveFiles& files = live[i];
+    std::string shared_dir = "shared";
+    std::string dir = private_dir;
+    if (files.column_family_id != 0) {
+      shared_dir = ColumnFamilyDirName(shared_dir, files.column_family_id);
+      dir = ColumnFamilyDirName(dir, files.column_family_id);
+      env_->CreateDir(backup_dir_ + "/" + shared_dir);
+      s = env_->CreateDir(backup_dir_ + "/" + dir);
+    }
+
+    // Copy the table files that no backup has yet.
+    for (size_t j = 0; s.ok() && j < files.table_files.size(); j++) {
+      const std::string src = files.dbname + "/" + files.table_files[j];
+      uint64_t size;
+      s = env_->GetFileSize(src, &size);
+      if (!s.ok()) {
+        break;
+      }
+      const std::string path =
+          shared_dir + "/" + SharedFileName(files.table_files[j], size);
+      if (files_.count(path) == 0) {
+        const std::string dst = backup_dir_ + "/" + path;
+        FileInfo info;
+        s = CopyFile(env_, src, dst + ".tmp", &info);
+        if (s.ok()) {
+          s = env_->RenameFile(dst + ".tmp", dst);
+        }
+        if (s.ok()) {
+          files_[path] = info;
+        }
+      }
+      meta.files.push_back(path);
+    }
+
+    // A descriptor of only the backed up files.
+    if (s.ok()) {
+      s = WriteDescriptor(env_, backup_dir_ + "/" + dir,
+                          files.descriptor_number, files.descriptor);
+    }
+    const std::string descriptor_path =
+        DescriptorFileName(dir, files.descriptor_number);
+    const std::string current_path = CurrentFileName(dir);
+    if (s.ok()) {
+      s = CopyFile(env_, backup_dir_ + "/" + descriptor_path, "",
+                   &files_[descriptor_path]);
+    }
+    if (s.ok()) {
+      s = CopyFile(env_, backup_dir_ + "/" + current_path, "",
+                   &files_[current_path]);
+    }
+    meta.files.push_back(descriptor_path);
+    current_files.push_back(current_path);
+  }
+  db->ReleaseLiveFiles(&live);
+
+  meta.files.insert(meta.files.end(), current_files.begin(),
+                    current_files.end());
+  if (s.ok()) {
+    s = WriteMeta(id, meta);
+  }
+  if (s.ok()) {
+    backups_[id] = meta;
+    *backup_id = id;
+  } else {
+    GarbageCollect();
+  }
+  return s;
+}
+
+void BackupEngineImpl::GetBackupInfo(std::vector<BackupInfo>* backup_info) {
+  backup_info->clear();
+  for (const auto& backup : backups_) {
+    BackupInfo info;
+    info.backup_id = backup.first;
+    info.timestamp = backup.second.timestamp;
+    info.size = 0;
+    info.number_files = backup.second.files.size();
+    for (const std::string& path : backup.second.files) {
+      info.size += files_[path].size;
+    }
+    backup_info->push_back(info);
+  }
+}
+
+Status BackupEngineImpl::DeleteBackup(uint32_t backup_id) {
+  if (backups_.count(backup_id) == 0) {
+    return Status::NotFound("backup", NumberToString(backup_id));
+  }
+  Status s = env_->RemoveFile(MetaFileName(backup_id));
+  if (s.ok()) {
+    backups_.erase(backup_id);
+    GarbageCollect();
+  }
+  return s;
+}
+
+struct BackupEngineImpl::VerifyState {
+  VerifyState(BackupEngineImpl* engine, const BackupMeta& meta)
+      : engine(engine), meta(meta), cv(&mu), next(0), running(0) {}
+
+  BackupEngineImpl* const engine;
+  const BackupMeta& meta;
+  port::Mutex mu;
+  port::CondVar cv GUARDED_BY(mu);
+  size_t next GUARDED_BY(mu);  // Next file to check
+  int running GUARDED_BY(mu);  // Threads still checking files
+  Status status GUARDED_BY(mu);
+};
+
+void BackupEngineImpl::VerifyFiles(void* arg) {
+  VerifyState* state = reinterpret_cast<VerifyState*>(arg);
+  BackupEngineImpl* engine = state->engine;
+  MutexLock l(&state->mu);
+  while (state->status.ok() && state->next < state->meta.files.size()) {
+    const std::string& path = state->meta.files[state->next++];
+    const FileInfo& expected = engine->files_.find(path)->second;
+    FileInfo info;
+    state->mu.Unlock();
+    Status s = CopyFile(engine->env_, engine->backup_dir_ + "/" + path, "",
+                        &info);
+    if (s.ok() &&
+        (info.size != expected.size || info.checksum != expected.checksum)) {
+      s = Status::Corruption("backup file checksum mismatch", path);
+    }
+    state->mu.Lock();
+    if (state->status.ok()) {
+      state->status = s;
+    }
+  }
+  state->running--;
+  state->cv.SignalAll();
+}
+
+Status BackupEngineImpl::VerifyBackup(uint32_t backup_id) {
+  auto backup = backups_.find(backup_id);
+  if (backup == backups_.end()) {
+    return Status::NotFound("backup", NumberToString(backup_id));
+  }
+
+  // files_ is not changed while the threads read it.
+  VerifyState state(this, backup->second);
+  const int threads = std::max(
+      1, std::min<int>(options_.max_background_operations,
+                       backup->second.files.size()));
+  MutexLock l(&state.mu);
+  state.running = threads;
+  for (int i = 0; i < threads; i++) {
+    env_->StartThread(&BackupEngineImpl::VerifyFiles, &state);
+  }
+  while (state.running > 0) {
+    state.cv.Wait();
+  }
+  return state.status;
+}
+
+Status BackupEngineImpl::RestoreDBFromBackup(uint32_t backup_id,
+                                             const std::string& db_dir) {
+  auto backup = backups_.find(backup_id);
+  if (backup == backups_.end()) {
+    return Status::NotFound("backup", NumberToString(backup_id));
+  }
+  if (env_->FileExists(CurrentFileName(db_dir))) {
+    return Status::InvalidArgument(db_dir, "exists");
+  }
+
+  env_->CreateDir(db_dir);  // In case it does not exist
+  Status s;
+  std::set<std::string> dirs;
+  for (size_t i = 0; s.ok() && i < backup->second.files.size(); i++) {
+    const std::string& path = backup->second.files[i];
+    const std::string name = RestoredFileName(path);
+    const size_t slash = name.rfind('/');
+    if (slash != std::string::npos) {
+      const std::string dir = name.substr(0, slash);
+      if (dirs.insert(dir).second) {
+        env_->CreateDir(db_dir + "/" + dir);
+      }
+    }
+    FileInfo info;
+    s = CopyFile(env_, backup_dir_ + "/" + path, db_dir + "/" + name, &info);
+    const FileInfo& expected = files_[path];
+    if (s.ok() &&
+        (info.size != expected.size || info.checksum != expected.checksum)) {
+      s = Status::Corruption("backup file checksum mismatch", path);
+    }
+  }
+  return s;
+}
+
+}  // namespace
+
+Status BackupEngine::Open(const BackupEngineOptions& options,
+                          const std::string& backup_dir,
+                          BackupEngine** backup_engine) {
+  *backup_engine = nullptr;
+  BackupEngineImpl* impl = new BackupEngineImpl(options, backup_dir);
+  Status s = impl->Initialize();
+  if (s.ok()) {
+    *backup_engine = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,250 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/backup_engine.h"
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+#include "db/filename.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static bool IsTableFile(const std::string& name) {
+  return name.size() > 4 && name.compare(name.size() - 4, 4, ".ldb") == 0;
+}
+
+class BackupEngineTest : public testing::Test {
+ public:
+  BackupEngineTest()
+      : env_(Env::Default()),
+        dbname_(testing::TempDir() + "backup_engine_test"),
+        backup_dir_(dbname_ + "_backups"),
+        restore_dir_(dbname_ + "_restore"),
+        db_(nullptr),
+        family_(nullptr) {
+    options_.create_if_missing = true;
+    DestroyDB(dbname_, options_);
+    DestroyDB(restore_dir_, options_);
+    DestroyBackups();
+    EXPECT_LEVELDB_OK(DB::Open(options_, dbname_, &db_));
+    EXPECT_LEVELDB_OK(db_->CreateColumnFamily(options_, "family", &family_));
+  }
+
+  ~BackupEngineTest() {
+    delete db_;
+    DestroyDB(dbname_, options_);
+    DestroyDB(restore_dir_, options_);
+    DestroyBackups();
+  }
+
+  // Remove every file below "dir" and "dir" itself.
+  void RemoveDir(const std::string& dir) {
+    std::vector<std::string> names;
+    env_->GetChildren(dir, &names);
+    for (const std::string& name : names) {
+      if (name != "." && name != "..") {
+        const std::string path = dir + "/" + name;
+        if (!env_->RemoveFile(path).ok()) {
+          RemoveDir(path);
+        }
+      }
+    }
+    env_->RemoveDir(dir);
+  }
+
+  void DestroyBackups() { RemoveDir(backup_dir_); }
+
+  // Number of table files in the shared directory of the backups.
+  int CountSharedFiles() {
+    int count = 0;
+    for (const std::string& dir :
+         {backup_dir_ + "/shared",
+          ColumnFamilyDirName(backup_dir_ + "/shared", 1)}) {
+      std::vector<std::string> names;
+      env_->GetChildren(dir, &names);
+      for (const std::string& name : names) {
+        if (IsTableFile(name)) {
+          count++;
+        }
+      }
+    }
+    return count;
+  }
+
+  // Restore "backup_id" and return the contents of the restored DB and
+  // of its column family.
+  std::string Restore(BackupEngine* engine, uint32_t backup_id) {
+    DestroyDB(restore_dir_, options_);
+    Status s = engine->RestoreDBFromBackup(backup_id, restore_dir_);
+    if (!s.ok()) {
+      return s.ToString();
+    }
+    std::vector<ColumnFamilyDescriptor> families;
+    families.emplace_back("family", options_);
+    std::vector<ColumnFamilyHandle*> handles;
+    DB* db;
+    s = DB::Open(options_, restore_dir_, families, &handles, &db);
+    if (!s.ok()) {
+      return s.ToString();
+    }
+    Iterator* iters[2] = {db->NewIterator(ReadOptions()),
+                          db->NewIterator(ReadOptions(), handles[0])};
+    std::string result;
+    for (Iterator* iter : iters) {
+      result += "(";
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        result += iter->key().ToString() + "->" + iter->value().ToString();
+        result += ",";
+      }
+      result += ")";
+      delete iter;
+    }
+    delete db;
+    return result;
+  }
+
+  Env* env_;
+  const std::string dbname_;
+  const std::string backup_dir_;
+  const std::string restore_dir_;
+  Options options_;
+  DB* db_;
+  ColumnFamilyHandle* family_;
+};
+
+TEST_F(BackupEngineTest, IncrementalBackups) {
+  BackupEngine* engine;
+  ASSERT_LEVELDB_OK(
+      BackupEngine::Open(BackupEngineOptions(), backup_dir_, &engine));
+
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), "a", "v1"));
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), family_, "f", "v1"));
+  uint32_t id1;
+  ASSERT_LEVELDB_OK(engine->CreateNewBackup(db_, &id1));
+  ASSERT_EQ(1, id1);
+  const int shared1 = CountSharedFiles();
+  ASSERT_EQ(2, shared1);
+
+  // The second backup copies only the new table file.
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), "b", "v2"));
+  uint32_t id2;
+  ASSERT_LEVELDB_OK(engine->CreateNewBackup(db_, &id2));
+  ASSERT_EQ(2, id2);
+  ASSERT_EQ(shared1 + 1, CountSharedFiles());
+
+  std::vector<BackupInfo> info;
+  engine->GetBackupInfo(&info);
+  ASSERT_EQ(2, info.size());
+  ASSERT_EQ(id1, info[0].backup_id);
+  ASSERT_EQ(id2, info[1].backup_id);
+  ASSERT_EQ(info[0].number_files + 1, info[1].number_files);
+  ASSERT_LT(info[0].size, info[1].size);
+
+  ASSERT_LEVELDB_OK(engine->VerifyBackup(id1));
+  ASSERT_LEVELDB_OK(engine->VerifyBackup(id2));
+  ASSERT_TRUE(engine->VerifyBackup(3).IsNotFound());
+
+  // Later changes of the DB do not affect the backups.
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), "a", "v3"));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("(a->v1,)(f->v1,)", Restore(engine, id1));
+  ASSERT_EQ("(a->v1,b->v2,)(f->v1,)", Restore(engine, id2));
+  ASSERT_TRUE(
+      engine->RestoreDBFromBackup(id1, restore_dir_).IsInvalidArgument());
+
+  // Deleting the first backup keeps the files the second one uses.
+  ASSERT_LEVELDB_OK(engine->DeleteBackup(id1));
+  ASSERT_TRUE(engine->DeleteBackup(id1).IsNotFound());
+  ASSERT_EQ(shared1 + 1, CountSharedFiles());
+  ASSERT_LEVELDB_OK(engine->VerifyBackup(id2));
+  delete engine;
+
+  ASSERT_LEVELDB_OK(
+      BackupEngine::Open(BackupEngineOptions(), backup_dir_, &engine));
+  engine->GetBackupInfo(&info);
+  ASSERT_EQ(1, info.size());
+  ASSERT_EQ(id2, info[0].backup_id);
+  ASSERT_LEVELDB_OK(engine->VerifyBackup(id2));
+  ASSERT_EQ("(a->v1,b->v2,)(f->v1,)", Restore(engine, id2));
+
+  // New backup ids follow the largest existing one.
+  uint32_t id3;
+  ASSERT_LEVELDB_OK(engine->CreateNewBackup(db_, &id3));
+  ASSERT_EQ(3, id3);
+  ASSERT_EQ("(a->v3,b->v2,)(f->v1,)", Restore(engine, id3));
+  delete engine;
+}
+
+// A DB that implements only what the DB interface requires.
+class MinimalDB : public DB {
+ public:
+  Status Put(const WriteOptions&, const Slice&, const Slice&) override {
+    return Status::NotSupported("Put");
+  }
+  Status Delete(const WriteOptions&, const Slice&) override {
+    return Status::NotSupported("Delete");
+  }
+  Status Write(const WriteOptions&, WriteBatch*) override {
+    return Status::NotSupported("Write");
+  }
+  Status Get(const ReadOptions&, const Slice&, std::string*) override {
+    return Status::NotSupported("Get");
+  }
+  Iterator* NewIterator(const ReadOptions&) override {
+    return NewEmptyIterator();
+  }
+  const Snapshot* GetSnapshot() override { return nullptr; }
+  void ReleaseSnapshot(const Snapshot*) override {}
+  bool GetProperty(const Slice&, std::string*) override { return false; }
+  void GetApproximateSizes(const Range*, int n, uint64_t* sizes) override {
+    std::fill(sizes, sizes + n, 0);
+  }
+  void CompactRange(const Slice*, const Slice*) override {}
+};
+
+TEST_F(BackupEngineTest, OtherDBNotSupported) {
+  BackupEngine* engine;
+  ASSERT_LEVELDB_OK(
+      BackupEngine::Open(BackupEngineOptions(), backup_dir_, &engine));
+  MinimalDB db;
+  uint32_t id;
+  ASSERT_TRUE(engine->CreateNewBackup(&db, &id).IsNotSupportedError());
+  std::vector<BackupInfo> info;
+  engine->GetBackupInfo(&info);
+  ASSERT_TRUE(info.empty());
+  delete engine;
+}
+
+TEST_F(BackupEngineTest, DetectsCorruption) {
+  BackupEngine* engine;
+  ASSERT_LEVELDB_OK(
+      BackupEngine::Open(BackupEngineOptions(), backup_dir_, &engine));
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), "a", "v1"));
+  uint32_t id;
+  ASSERT_LEVELDB_OK(engine->CreateNewBackup(db_, &id));
+
+  std::vector<std::string> names;
+  ASSERT_LEVELDB_OK(env_->GetChildren(backup_dir_ + "/shared", &names));
+  std::string table;
+  for (const std::string& name : names) {
+    if (IsTableFile(name)) {
+      table = backup_dir_ + "/shared/" + name;
+    }
+  }
+  ASSERT_NE("", table);
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, table, &contents));
+  contents[0] ^= 0x80;
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, contents, table));
+
+  ASSERT_TRUE(engine->VerifyBackup(id).IsCorruption());
+  ASSERT_TRUE(engine->RestoreDBFromBackup(id, restore_dir_).IsCorruption());
+  delete engine;
+}
+
+}  // namespace leveldb
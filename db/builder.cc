@@ -17,13 +17,22 @@ namespace leveldb {
  * 
 */
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->num_range_deletions = 0;
+  meta->num_entries = 0;
+  meta->num_deletions = 0;
   iter->SeekToFirst();
+  if (range_del_iter != nullptr) {
+    range_del_iter->SeekToFirst();
+  }
+  const bool has_range_del =
+      (range_del_iter != nullptr && range_del_iter->Valid());
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || has_range_del) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
@@ -31,16 +40,46 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    bool has_bounds = iter->Valid();
+    if (has_bounds) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     Slice key;
+    ParsedInternalKey ikey;
     for (; iter->Valid(); iter->Next()) {
       key = iter->key();
       builder->Add(key, iter->value());
+      meta->num_entries++;
+      if (ParseInternalKey(key, &ikey) && ikey.type == kTypeDeletion) {
+        meta->num_deletions++;
+      }
     }
     if (!key.empty()) {
       meta->largest.DecodeFrom(key);
     }
 
+    // The file's key range must include every range it deletes.
+    for (; has_range_del && range_del_iter->Valid(); range_del_iter->Next()) {
+      InternalKey begin, end;
+      begin.DecodeFrom(range_del_iter->key());
+      end.SetFrom(ParsedInternalKey(range_del_iter->value(),
+                                    kMaxSequenceNumber, kTypeRangeDeletion));
+      if (!has_bounds ||
+          options.comparator->Compare(begin.Encode(), meta->smallest.Encode()) <
+              0) {
+        meta->smallest = begin;
+      }
+      if (!has_bounds ||
+          options.comparator->Compare(end.Encode(), meta->largest.Encode()) >
+              0) {
+        meta->largest = end;
+      }
+      has_bounds = true;
+      builder->AddRangeTombstone(range_del_iter->key(),
+                                 range_del_iter->value());
+      meta->num_range_deletions++;
+    }
+
     // Finish and check for builder errors
     s = builder->Finish();
     if (s.ok()) {
@@ -71,6 +110,8 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
   // Check for input iterator errors
   if (!iter->status().ok()) {
     s = iter->status();
+  } else if (range_del_iter != nullptr && !range_del_iter->status().ok()) {
+    s = range_del_iter->status();
   }
 
   if (s.ok() && meta->file_size > 0) {
@@ -11,6 +11,8 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -18,15 +20,20 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <limits>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
+#include "leveldb/write_buffer_manager.h"
 
 #include "port/port.h"
 #include "table/block.h"
@@ -58,13 +65,18 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    uint64_t num_entries;
+    uint64_t num_deletions;
+    uint64_t num_range_deletions;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
 
-  explicit CompactionState(Compaction* c)
+  CompactionState(Compaction* c, const Comparator* user_comparator)
       : compaction(c),
         smallest_snapshot(0),
+        tombstones(user_comparator),
+        has_range_del_lower(false),
         outfile(nullptr),
         builder(nullptr),
         total_bytes(0) {}
@@ -77,6 +89,12 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Range tombstones of the compaction inputs.  Each output file gets the
+  // part of them that lies in its key range, starting at range_del_lower.
+  RangeTombstoneList tombstones;
+  std::string range_del_lower;
+  bool has_range_del_lower;
+
   std::vector<Output> outputs;
 
   // State kept for output being generated
@@ -101,8 +119,45 @@ Options SanitizeOptions(const std::string& dbname,
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
+  ClipToRange(&result.max_write_buffer_number, 2, 64);
+  if (result.max_total_wal_size == 0) {
+    result.max_total_wal_size = 4 * static_cast<uint64_t>(
+        result.write_buffer_size * result.max_write_buffer_number);
+  }
+  ClipToRange(&result.memtable_hash_bucket_count, 1, 1 << 20);
+  if (result.memtable_huge_page_size > result.write_buffer_size / 4) {
+    // A memtable would be flushed after its first chunk.
+    result.memtable_huge_page_size = 0;
+  }
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.num_levels, 2, config::kMaxNumLevels);
+  ClipToRange(&result.level0_file_num_compaction_trigger, 1, 1 << 10);
+  ClipToRange(&result.level0_slowdown_writes_trigger,
+              result.level0_file_num_compaction_trigger, 1 << 10);
+  ClipToRange(&result.level0_stop_writes_trigger,
+              result.level0_slowdown_writes_trigger, 1 << 10);
+  ClipToRange(&result.delayed_write_rate, uint64_t{1} << 10,
+              uint64_t{1} << 30);
+  if (result.soft_pending_compaction_bytes_limit > 0 &&
+      result.hard_pending_compaction_bytes_limit > 0 &&
+      result.hard_pending_compaction_bytes_limit <
+          result.soft_pending_compaction_bytes_limit) {
+    result.hard_pending_compaction_bytes_limit =
+        result.soft_pending_compaction_bytes_limit;
+  }
+  ClipToRange(&result.max_bytes_for_level_base, 1 << 20, 1 << 30);
+  ClipToRange(&result.max_bytes_for_level_multiplier, 1.0, 1000.0);
+  ClipToRange(&result.universal_size_ratio, 0, 1000);
+  ClipToRange(&result.universal_min_merge_width, 2, 1000);
+  ClipToRange(&result.universal_max_merge_width,
+              result.universal_min_merge_width, 1000);
+  ClipToRange(&result.universal_max_size_amplification_percent, 1, 1 << 20);
+  if (result.compaction_style == kCompactionStyleFIFO) {
+    // Level-0 is never compacted, so its file count must not stall writes.
+    result.level0_slowdown_writes_trigger = std::numeric_limits<int>::max();
+    result.level0_stop_writes_trigger = std::numeric_limits<int>::max();
+  }
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -124,7 +179,8 @@ static int TableCacheSize(const Options& sanitized_options) {
   return sanitized_options.max_open_files - kNumNonTableCacheFiles;
 }
 
-DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
+DBImpl::DBImpl(const Options& raw_options, const std::string& dbname,
+               DBImpl* owner)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
@@ -133,20 +189,26 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
+      owner_(owner),
       table_cache_(new TableCache(dbname_, options_, TableCacheSize(options_))),
       db_lock_(nullptr),
+      mutex_((owner != nullptr) ? owner->mutex_ : own_mutex_),
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
       mem_(nullptr),
-      imm_(nullptr),
       has_imm_(false),
       logfile_(nullptr),
       logfile_number_(0),
+      logfile_size_(0),
       log_(nullptr),
       seed_(0),
       tmp_batch_(new WriteBatch),
       background_compaction_scheduled_(false),
+      age_timer_running_(false),
+      age_timer_signal_(&mutex_),
+      ingesting_file_(false),
       manual_compaction_(nullptr),
+      exclusive_manual_compactions_(0),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
                                &internal_comparator_)) {}
 /**
@@ -160,22 +222,41 @@ DBImpl::~DBImpl() {
    * 删除log相关以及TableCache对象
    * 删除options的block_cache以及info_log对象
    */
-  // Wait for background work to finish.
+  // Wait for background work to finish, including that of the column
+  // families: a family's memtable compaction reads every other family in
+  // RemoveObsoleteFiles() of this DB.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
   // 发布 要求前面的读写不会跑到后面
-  while (background_compaction_scheduled_) {
+  for (ColumnFamilyHandleImpl* family : families_) {
+    family->family()->shutting_down_.store(true, std::memory_order_release);
+  }
+  age_timer_signal_.SignalAll();
+  while (background_compaction_scheduled_ || age_timer_running_) {
     background_work_finished_signal_.Wait();
   }
+  for (ColumnFamilyHandleImpl* family : families_) {
+    DBImpl* const db = family->family();
+    while (db->background_compaction_scheduled_) {
+      db->background_work_finished_signal_.Wait();
+    }
+  }
   mutex_.Unlock();
 
+  // Column families use the mutex, log and files of this DB, so they go
+  // before the rest of it.
+  for (ColumnFamilyHandleImpl* family : families_) {
+    delete family->family();
+    delete family;
+  }
+
   if (db_lock_ != nullptr) {
     env_->UnlockFile(db_lock_);
   }
 
   delete versions_;
   if (mem_ != nullptr) mem_->Unref();
-  if (imm_ != nullptr) imm_->Unref();
+  for (const ImmutableMemTable& imm : imm_) imm.mem->Unref();
   delete tmp_batch_;
   delete log_;
   delete logfile_;
@@ -248,6 +329,8 @@ void DBImpl::RemoveObsoleteFiles() {
   std::set<uint64_t> live = pending_outputs_;
   versions_->AddLiveFiles(&live);
 
+  const uint64_t min_log = MinLogNumber();
+
   std::vector<std::string> filenames;
   env_->GetChildren(dbname_, &filenames);  // Ignoring errors on purpose
   uint64_t number;
@@ -258,7 +341,7 @@ void DBImpl::RemoveObsoleteFiles() {
       bool keep = true;
       switch (type) {
         case kLogFile:
-          keep = ((number >= versions_->LogNumber()) ||
+          keep = ((number >= min_log) ||
                   (number == versions_->PrevLogNumber()));
           break;
         case kDescriptorFile:
@@ -277,6 +360,7 @@ void DBImpl::RemoveObsoleteFiles() {
         case kCurrentFile:
         case kDBLockFile:
         case kInfoLogFile:
+        case kColumnFamilyDir:
           keep = true;
           break;
       }
@@ -308,7 +392,9 @@ void DBImpl::RemoveObsoleteFiles() {
  * 回放log，更新db数据。回放期间db可能会dump新的level
  * 0文件，因此需要把db元信息的变动记录到edit中返回。函数逻辑如下：
  */
-Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
+Status DBImpl::Recover(
+    VersionEdit* edit, bool* save_manifest,
+    const std::vector<ColumnFamilyDescriptor>& column_families) {
   mutex_.AssertHeld();
 
   // Ignore error from CreateDir since the creation of the DB is
@@ -356,6 +442,14 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   if (!s.ok()) {
     return s;
   }
+  if (owner_ != nullptr) {
+    // The logs of a column family are replayed by its DB.
+    return s;
+  }
+  s = OpenColumnFamilies(column_families, edit, save_manifest);
+  if (!s.ok()) {
+    return s;
+  }
 
   /**
    * 下面的阶段
@@ -374,8 +468,11 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   // attention to it in case we are recovering a database
   // produced by an older version of leveldb.
   // 这里先找出所有满足条件的log文件：比manifest文件记录的log编号更新。
-  const uint64_t min_log = versions_->LogNumber();
+  uint64_t min_log = versions_->LogNumber();
   const uint64_t prev_log = versions_->PrevLogNumber();
+  for (ColumnFamilyHandleImpl* family : families_) {
+    min_log = std::min(min_log, family->family()->versions_->LogNumber());
+  }
   std::vector<std::string> filenames;
   s = env_->GetChildren(dbname_, &filenames);
   if (!s.ok()) {
@@ -424,9 +521,143 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   if (versions_->LastSequence() < max_sequence) {
     versions_->SetLastSequence(max_sequence);
   }
+  if (families_.empty()) {
+    return Status::OK();
+  }
+
+  // All column families continue from the same sequence number.
+  for (ColumnFamilyHandleImpl* family : families_) {
+    max_sequence = std::max(max_sequence,
+                            family->family()->versions_->LastSequence());
+  }
+  versions_->SetLastSequence(max_sequence);
+  for (ColumnFamilyHandleImpl* family : families_) {
+    family->family()->versions_->SetLastSequence(max_sequence);
+  }
 
+  // Flush what the column families recovered so that they need none of
+  // the current logs.  The new log gets a larger number than log_number.
+  const uint64_t log_number = versions_->NewFileNumber();
+  *save_manifest = true;
+  for (ColumnFamilyHandleImpl* family : families_) {
+    s = family->family()->FlushRecoveredMemTable(log_number);
+    if (!s.ok()) {
+      return s;
+    }
+  }
   return Status::OK();
 }
+
+Status DBImpl::OpenColumnFamilies(
+    const std::vector<ColumnFamilyDescriptor>& column_families,
+    VersionEdit* edit, bool* save_manifest) {
+  mutex_.AssertHeld();
+  std::map<std::string, const ColumnFamilyDescriptor*> unopened;
+  for (const ColumnFamilyDescriptor& descriptor : column_families) {
+    if (!unopened.emplace(descriptor.name, &descriptor).second) {
+      return Status::InvalidArgument(descriptor.name,
+                                     "column family listed twice");
+    }
+  }
+
+  // Column family ids are handed out in order, starting at 1.
+  uint32_t next_id = 1;
+  Status s;
+  for (const auto& family : versions_->column_families()) {
+    auto it = unopened.find(family.second);
+    if (family.first != next_id) {
+      return Status::Corruption(family.second, "bad column family id");
+    } else if (it == unopened.end()) {
+      return Status::InvalidArgument(family.second,
+                                     "column family must be opened");
+    }
+    s = OpenColumnFamily(family.first, family.second, it->second->options,
+                         false);
+    if (!s.ok()) {
+      return s;
+    }
+    unopened.erase(it);
+    next_id++;
+  }
+
+  for (const ColumnFamilyDescriptor& descriptor : column_families) {
+    if (unopened.count(descriptor.name) == 0) {
+      continue;
+    }
+    s = OpenColumnFamily(next_id, descriptor.name, descriptor.options, true);
+    if (!s.ok()) {
+      return s;
+    }
+    edit->AddColumnFamily(next_id, descriptor.name);
+    *save_manifest = true;
+    next_id++;
+  }
+  return s;
+}
+
+Status DBImpl::OpenColumnFamily(uint32_t id, const std::string& name,
+                                const Options& options, bool create) {
+  mutex_.AssertHeld();
+  assert(owner_ == nullptr);
+  assert(id == families_.size() + 1);
+  if (options.enable_ttl != options_.enable_ttl) {
+    // Values are stamped with their expiry time by the shared write path.
+    return Status::InvalidArgument(
+        name, "enable_ttl of a column family must match its DB");
+  } else if (options.enable_ttl && options.merge_operator != nullptr) {
+    return Status::InvalidArgument(
+        name, "merge_operator does not support enable_ttl");
+  }
+
+  Options family_options = options;
+  family_options.env = env_;
+  family_options.create_if_missing = create;
+  family_options.error_if_exists = false;
+  if (family_options.info_log == nullptr) {
+    family_options.info_log = options_.info_log;
+  }
+  if (family_options.block_cache == nullptr) {
+    family_options.block_cache = options_.block_cache;
+  }
+  if (family_options.write_buffer_manager == nullptr) {
+    family_options.write_buffer_manager = options_.write_buffer_manager;
+  }
+  DBImpl* family =
+      new DBImpl(family_options, ColumnFamilyDirName(dbname_, id), this);
+  VersionEdit unused_edit;
+  bool unused_save_manifest = false;
+  Status s = family->Recover(&unused_edit, &unused_save_manifest,
+                             std::vector<ColumnFamilyDescriptor>());
+  if (!s.ok()) {
+    // The column family shares mutex_, which its destructor locks.
+    mutex_.Unlock();
+    delete family;
+    mutex_.Lock();
+    return s;
+  }
+  family->mem_ =
+      new MemTable(family->internal_comparator_, family->options_);
+  family->mem_->Ref();
+  families_.push_back(new ColumnFamilyHandleImpl(id, name, family));
+  return s;
+}
+
+Status DBImpl::FlushRecoveredMemTable(uint64_t log_number) {
+  mutex_.AssertHeld();
+  VersionEdit edit;
+  Status s = WriteLevel0Table(mem_, &edit, nullptr);
+  if (s.ok()) {
+    mem_->Unref();
+    mem_ = new MemTable(internal_comparator_, options_);
+    mem_->Ref();
+    if (log_number != 0) {
+      versions_->MarkFileNumberUsed(log_number);
+      edit.SetLogNumber(log_number);
+    }
+    s = versions_->LogAndApply(&edit, &mutex_);
+  }
+  return s;
+}
 /**
  * 参数说明：log_number是指定的log文件编号
  * @edit记录db元信息的变化——sstable文件变动 max_sequence
@@ -477,6 +708,18 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long)log_number);
 
+  // The log is shared with the column families, each of which skips the
+  // logs that its tables already cover.
+  const bool replay = (log_number >= versions_->LogNumber()) ||
+                      (log_number == versions_->PrevLogNumber());
+  std::vector<MemTable*> memtables(families_.size() + 1, nullptr);
+  for (size_t i = 0; i < families_.size(); i++) {
+    DBImpl* family = families_[i]->family();
+    if (log_number >= family->versions_->LogNumber()) {
+      memtables[i + 1] = family->mem_;
+    }
+  }
+
   // Read all the records and add to a memtable
   std::string scratch;
   Slice record;
@@ -491,11 +734,12 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     }
     WriteBatchInternal::SetContents(&batch, record);
 
-    if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+    if (mem == nullptr && replay) {
+      mem = new MemTable(internal_comparator_, options_);
       mem->Ref();
     }
-    status = WriteBatchInternal::InsertInto(&batch, mem);
+    memtables[0] = mem;
+    status = WriteBatchInternal::InsertInto(&batch, memtables);
     MaybeIgnoreError(&status);
     if (!status.ok()) {
       break;
@@ -506,7 +750,21 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
       *max_sequence = last_seq;
     }
 
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
+    for (size_t i = 0; status.ok() && i < families_.size(); i++) {
+      DBImpl* family = families_[i]->family();
+      if (memtables[i + 1] != nullptr &&
+          family->mem_->ApproximateMemoryUsage() >
+              family->options_.write_buffer_size) {
+        status = family->FlushRecoveredMemTable(0);
+        memtables[i + 1] = family->mem_;
+      }
+    }
+    if (!status.ok()) {
+      break;
+    }
+
+    if (mem != nullptr &&
+        mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
       status = WriteLevel0Table(mem, edit, nullptr);
@@ -524,7 +782,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   delete file;
 
   // See if we should keep reusing the last log file.
-  if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
+  if (status.ok() && options_.reuse_logs && last_log && compactions == 0 &&
+      families_.empty()) {
     assert(logfile_ == nullptr);
     assert(log_ == nullptr);
     assert(mem_ == nullptr);
@@ -539,7 +798,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = new MemTable(internal_comparator_, options_);
         mem_->Ref();
       }
     }
@@ -559,6 +818,11 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 // 将Immutable MemTable转储为SSTable
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
                                 Version* base) {
+  return WriteLevel0Table(std::vector<MemTable*>(1, mem), edit, base);
+}
+
+Status DBImpl::WriteLevel0Table(const std::vector<MemTable*>& mems,
+                                VersionEdit* edit, Version* base) {
   /**
    * 其获取了需要转储的MemTable的迭代器，并传给BuildTable方法。
    * BuildTable方法会通过TableBuilder来构造SSTable文件然后写入
@@ -568,16 +832,35 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
-  Iterator* iter = mem->NewIterator();
-  Log(options_.info_log, "Level-0 table #%llu: started",
-      (unsigned long long)meta.number);
+  Iterator* iter;
+  Iterator* range_del_iter;
+  if (mems.size() == 1) {
+    iter = mems[0]->NewIterator();
+    range_del_iter = mems[0]->NewRangeTombstoneIterator();
+  } else {
+    std::vector<Iterator*> iters;
+    std::vector<Iterator*> range_del_iters;
+    for (MemTable* mem : mems) {
+      iters.push_back(mem->NewIterator());
+      range_del_iters.push_back(mem->NewRangeTombstoneIterator());
+    }
+    iter = NewMergingIterator(&internal_comparator_, iters.data(),
+                              static_cast<int>(iters.size()));
+    range_del_iter = NewMergingIterator(&internal_comparator_,
+                                        range_del_iters.data(),
+                                        static_cast<int>(mems.size()));
+  }
+  Log(options_.info_log, "Level-0 table #%llu: started from %d memtables",
+      (unsigned long long)meta.number, static_cast<int>(mems.size()));
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, range_del_iter,
+                   &meta);
     mutex_.Lock();
   }
+  delete range_del_iter;
 
   Log(options_.info_log, "Level-0 table #%llu: %lld bytes %s",
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
@@ -594,8 +877,8 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     if (base != nullptr) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
-    edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+    versions_->SetNewFileStats(&meta);
+    edit->AddFile(level, meta);
   }
 
   CompactionStats stats;
@@ -619,14 +902,22 @@ void DBImpl::CompactMemTable() {
    * MemTable的引用，并通过RemoveObsoleteFiles方法回收不再需要保留的文件。
    */
   mutex_.AssertHeld();
-  assert(imm_ != nullptr);
+  assert(!imm_.empty());
 
-  // Save the contents of the memtable as a new Table
+  // Save the contents of the oldest memtables as a new Table.  Only this
+  // thread removes entries from imm_, so the first n stay put while the
+  // mutex is released.
+  const size_t n = options_.merge_write_buffers ? imm_.size() : 1;
+  std::vector<MemTable*> mems;
+  for (size_t i = 0; i < n; i++) {
+    mems.push_back(imm_[i].mem);
+  }
+  const uint64_t log_number = imm_[n - 1].log_number;
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
   //会把此次新的file添加到edit里面
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  Status s = WriteLevel0Table(mems, &edit, base);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -636,24 +927,64 @@ void DBImpl::CompactMemTable() {
   // Replace immutable memtable with the generated Table
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
+    edit.SetLogNumber(log_number);  // Earlier logs no longer needed
     s = versions_->LogAndApply(&edit, &mutex_);
   }
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = nullptr;
-    has_imm_.store(false, std::memory_order_release);
+    for (size_t i = 0; i < n; i++) {
+      imm_.front().mem->Unref();
+      imm_.pop_front();
+    }
+    has_imm_.store(!imm_.empty(), std::memory_order_release);
     RemoveObsoleteFiles();
+    if (owner_ != nullptr) {
+      owner_->RemoveObsoleteFiles();  // The shared logs
+    }
   } else {
     RecordBackgroundError(s);
   }
 }
+// Return true if "mem" has an entry or a range tombstone for a user key
+// in [*begin,*end].  A null bound is treated as unbounded.
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice* begin, const Slice* end) {
+  Iterator* iter = mem->NewIterator();
+  if (begin == nullptr) {
+    iter->SeekToFirst();
+  } else {
+    InternalKey start(*begin, kMaxSequenceNumber, kValueTypeForSeek);
+    iter->Seek(start.Encode());
+  }
+  bool overlap = iter->Valid() &&
+                 (end == nullptr ||
+                  ucmp->Compare(ExtractUserKey(iter->key()), *end) <= 0);
+  delete iter;
+
+  iter = mem->NewRangeTombstoneIterator();
+  for (iter->SeekToFirst(); !overlap && iter->Valid(); iter->Next()) {
+    // Range tombstones exclude their end key.
+    overlap = (end == nullptr ||
+               ucmp->Compare(ExtractUserKey(iter->key()), *end) <= 0) &&
+              (begin == nullptr || ucmp->Compare(iter->value(), *begin) > 0);
+  }
+  delete iter;
+  return overlap;
+}
+
 /**
  * 触发手动compact
  */
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
+  CompactRangeOptions options;
+  options.exclusive_manual_compaction = false;
+  options.bottommost_level_compaction = kBottommostLevelSkip;
+  CompactRange(options, begin, end);
+}
+
+Status DBImpl::CompactRange(const CompactRangeOptions& options,
+                            const Slice* begin, const Slice* end) {
   /**
    * 其所知Compaction的范围信息最少，只知道需要Compact的起始与终止key，
    * 甚至不知道发生Compaction的level。这也意味着，需要Compact的key范围，
@@ -662,31 +993,82 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
 LevelDB为了确保用户给出的key范围都能够被Compact，其首先强制触发Minor
 Compaction，然后按照给定的key范围进行Major Compaction。
   */
+  if (options.target_level >= options_.num_levels) {
+    return Status::InvalidArgument("target_level must be less than num_levels");
+  }
+
+  bool flush;
+  {
+    MutexLock l(&mutex_);
+    if (options.exclusive_manual_compaction) {
+      exclusive_manual_compactions_++;
+    }
+    flush = !imm_.empty() ||
+            MemTableOverlaps(mem_, user_comparator(), begin, end);
+  }
+  Status s;
+  if (flush) {
+    s = Flush(FlushOptions());
+  }
+
+  // The memtable may have been written below level-0, so the levels are
+  // checked after the flush.
   int max_level_with_files = 1;
   {
     MutexLock l(&mutex_);
     Version* base = versions_->current();
-    for (int level = 1; level < config::kNumLevels; level++) {
+    for (int level = 1; level < options_.num_levels; level++) {
       if (base->OverlapInLevel(level, begin, end)) {
         max_level_with_files = level;
       }
     }
   }
-  TEST_CompactMemTable();  // TODO(sanjay): Skip if memtable does not overlap
-  for (int level = 0; level < max_level_with_files; level++) {
-    TEST_CompactRange(level, begin, end);
+  const int target_level = (options.target_level < 0) ? max_level_with_files
+                                                      : options.target_level;
+  for (int level = 0; s.ok() && level < target_level; level++) {
+    s = RunManualCompaction(level, begin, end, false);
+  }
+
+  // Files of the deepest level are only rewritten where the level above
+  // overlapped them, so the rest is compacted in place.
+  bool bottommost = false;
+  switch (options.bottommost_level_compaction) {
+    case kBottommostLevelSkip:
+      break;
+    case kBottommostLevelIfHaveCompactionFilter:
+      bottommost =
+          (options_.compaction_filter != nullptr || options_.enable_ttl);
+      break;
+    case kBottommostLevelForce:
+      bottommost = true;
+      break;
+  }
+  if (s.ok() && bottommost && target_level == max_level_with_files) {
+    s = RunManualCompaction(target_level, begin, end, true);
+  }
+
+  if (options.exclusive_manual_compaction) {
+    MutexLock l(&mutex_);
+    exclusive_manual_compactions_--;
+    MaybeScheduleCompaction();
   }
+  return s;
 }
 
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,
                                const Slice* end) {
   assert(level >= 0);
-  assert(level + 1 < config::kNumLevels);
+  assert(level + 1 < options_.num_levels);
+  RunManualCompaction(level, begin, end, false);
+}
 
+Status DBImpl::RunManualCompaction(int level, const Slice* begin,
+                                   const Slice* end, bool in_place) {
   InternalKey begin_storage, end_storage;
 
   ManualCompaction manual;
   manual.level = level;
+  manual.in_place = in_place;
   manual.done = false;
   if (begin == nullptr) {
     manual.begin = nullptr;
@@ -715,6 +1097,30 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
     // Cancel my manual compaction since we aborted early for some reason.
     manual_compaction_ = nullptr;
   }
+  if (!bg_error_.ok()) {
+    return bg_error_;
+  } else if (!manual.done) {
+    return Status::IOError("Deleting DB during manual compaction");
+  }
+  return Status::OK();
+}
+
+Status DBImpl::Flush(const FlushOptions& options) {
+  bool empty;
+  {
+    MutexLock l(&mutex_);
+    empty = mem_->IsEmpty();
+  }
+  // nullptr batch switches the memtable once earlier writes are done
+  Status s = empty ? Status::OK() : Write(WriteOptions(), nullptr);
+  if (s.ok() && options.wait) {
+    MutexLock l(&mutex_);
+    while (!imm_.empty() && bg_error_.ok()) {
+      background_work_finished_signal_.Wait();
+    }
+    s = bg_error_;
+  }
+  return s;
 }
 
 Status DBImpl::TEST_CompactMemTable() {
@@ -723,10 +1129,10 @@ Status DBImpl::TEST_CompactMemTable() {
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != nullptr && bg_error_.ok()) {
+    while (!imm_.empty() && bg_error_.ok()) {
       background_work_finished_signal_.Wait();
     }
-    if (imm_ != nullptr) {
+    if (!imm_.empty()) {
       s = bg_error_;
     }
   }
@@ -749,8 +1155,11 @@ void DBImpl::MaybeScheduleCompaction() {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
+  } else if (ingesting_file_) {
+    // IngestExternalFile() schedules compactions once it is done
+  } else if (imm_.empty() && manual_compaction_ == nullptr &&
+             (exclusive_manual_compactions_ > 0 ||
+              !versions_->NeedsCompaction())) {
     // No work to be done
   } else {
     background_compaction_scheduled_ = true;
@@ -791,6 +1200,58 @@ void DBImpl::BackgroundCall() {
   background_work_finished_signal_.SignalAll();
 }
 
+void DBImpl::LogUserObjects() const {
+  if (options_.compaction_filter != nullptr) {
+    Log(options_.info_log, "%s: compaction filter %s", dbname_.c_str(),
+        options_.compaction_filter->Name());
+  }
+  if (options_.merge_operator != nullptr) {
+    Log(options_.info_log, "%s: merge operator %s", dbname_.c_str(),
+        options_.merge_operator->Name());
+  }
+}
+
+void DBImpl::MaybeStartAgeTimer() {
+  mutex_.AssertHeld();
+  if (!age_timer_running_ && versions_->MaxFileAge() > 0) {
+    age_timer_running_ = true;
+    env_->StartThread(&DBImpl::AgeTimerWork, this);
+  }
+}
+
+void DBImpl::AgeTimerWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->AgeTimerCall();
+}
+
+void DBImpl::AgeTimerCall() {
+  // Wake up at least this often, e.g. for very large age limits.
+  const uint64_t kMaxWaitMicros = uint64_t{3600} * 1000000;
+  MutexLock l(&mutex_);
+  assert(age_timer_running_);
+  while (!shutting_down_.load(std::memory_order_acquire)) {
+    const uint64_t now = env_->NowMicros();
+    uint64_t wait_micros = kMaxWaitMicros;
+    const uint64_t due = versions_->NextFileAgeDue();
+    if (due == 0) {
+      // Files written from now on are due no sooner than MaxFileAge().
+      const uint64_t max_age = versions_->MaxFileAge();
+      if (max_age < kMaxWaitMicros / 1000000) {
+        wait_micros = max_age * 1000000;
+      }
+    } else if (due <= now / 1000000) {
+      // The compaction replaces the oldest file, so check again once it
+      // had time to.  Ages are only kept in seconds.
+      MaybeScheduleCompaction();
+      wait_micros = 1000000;
+    } else if (due - now / 1000000 < kMaxWaitMicros / 1000000) {
+      wait_micros = due * 1000000 - now;
+    }
+    age_timer_signal_.TimedWait(wait_micros);
+  }
+  age_timer_running_ = false;
+  background_work_finished_signal_.SignalAll();
+}
+
 void DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
   /**
@@ -799,7 +1260,7 @@ void DBImpl::BackgroundCompaction() {
    * 如果存在则通过DBImpl::CompactionMemTable方法来执行Minor
    * Comapction并返回。
    */
-  if (imm_ != nullptr) {
+  if (!imm_.empty()) {
     //1.首先写imm
     CompactMemTable();
     return;
@@ -810,8 +1271,9 @@ void DBImpl::BackgroundCompaction() {
   InternalKey manual_end;
   if (is_manual) {
     ManualCompaction* m = manual_compaction_;
-    c = versions_->CompactRange(m->level, m->begin, m->end);
-    m->done = (c == nullptr);
+    c = versions_->CompactRange(m->level, m->begin, m->end, m->in_place);
+    // An in-place compaction takes the whole range at once.
+    m->done = (c == nullptr || m->in_place);
     if (c != nullptr) {
       manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
     }
@@ -820,6 +1282,8 @@ void DBImpl::BackgroundCompaction() {
         m->level, (m->begin ? m->begin->DebugString().c_str() : "(begin)"),
         (m->end ? m->end->DebugString().c_str() : "(end)"),
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
+  } else if (exclusive_manual_compactions_ > 0) {
+    c = nullptr;  // Wait for the manual compaction
   } else {
     c = versions_->PickCompaction();
   }
@@ -848,8 +1312,7 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
+    c->edit()->AddFile(c->level() + 1, *f);
     status = versions_->LogAndApply(c->edit(), &mutex_);
     if (!status.ok()) {
       RecordBackgroundError(status);
@@ -859,8 +1322,21 @@ void DBImpl::BackgroundCompaction() {
         static_cast<unsigned long long>(f->number), c->level() + 1,
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
+  } else if (c->IsDeletionOnly()) {
+    // Drop the input files without reading them.
+    c->AddInputDeletions(c->edit());
+    status = versions_->LogAndApply(c->edit(), &mutex_);
+    if (!status.ok()) {
+      RecordBackgroundError(status);
+    }
+    VersionSet::LevelSummaryStorage tmp;
+    Log(options_.info_log, "Deleted %d files from level-%d %s: %s\n",
+        c->num_input_files(0), c->level(), status.ToString().c_str(),
+        versions_->LevelSummary(&tmp));
+    c->ReleaseInputs();
+    RemoveObsoleteFiles();
   } else {
-    CompactionState* compact = new CompactionState(c);
+    CompactionState* compact = new CompactionState(c, user_comparator());
     status = DoCompactionWork(compact);
     if (!status.ok()) {
       RecordBackgroundError(status);
@@ -917,12 +1393,19 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   uint64_t file_number;
   {
     mutex_.Lock();
-    file_number = versions_->NewFileNumber();
+    if (compact->outputs.empty() && compact->compaction->output_number() != 0) {
+      file_number = compact->compaction->output_number();
+    } else {
+      file_number = versions_->NewFileNumber();
+    }
     pending_outputs_.insert(file_number);
     CompactionState::Output out;
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.num_entries = 0;
+    out.num_deletions = 0;
+    out.num_range_deletions = 0;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -936,8 +1419,72 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   return s;
 }
 
+void DBImpl::AddRangeTombstonesToOutput(CompactionState* compact,
+                                        const Slice* next_user_key) {
+  const Comparator* ucmp = user_comparator();
+  Compaction* const c = compact->compaction;
+  CompactionState::Output* out = compact->current_output();
+  bool has_bounds = compact->builder->NumEntries() > 0;
+
+  std::vector<RangeTombstone> clipped;
+  for (const RangeTombstone& t : compact->tombstones.tombstones()) {
+    if (next_user_key != nullptr &&
+        ucmp->Compare(t.begin, *next_user_key) >= 0) {
+      break;
+    }
+    if (t.sequence <= compact->smallest_snapshot &&
+        c->IsBaseLevelForRange(t.begin, t.end)) {
+      // Nothing older is left for the tombstone to delete.
+      continue;
+    }
+    RangeTombstone r = t;
+    if (compact->has_range_del_lower &&
+        ucmp->Compare(r.begin, compact->range_del_lower) < 0) {
+      r.begin = compact->range_del_lower;
+    }
+    if (next_user_key != nullptr && ucmp->Compare(r.end, *next_user_key) > 0) {
+      r.end = next_user_key->ToString();
+    }
+    if (ucmp->Compare(r.begin, r.end) < 0) {
+      clipped.push_back(std::move(r));
+    }
+  }
+
+  // The tombstone block is ordered by internal key.
+  std::sort(clipped.begin(), clipped.end(),
+            [ucmp](const RangeTombstone& a, const RangeTombstone& b) {
+              int r = ucmp->Compare(a.begin, b.begin);
+              return r < 0 || (r == 0 && a.sequence > b.sequence);
+            });
+  for (size_t i = 0; i < clipped.size(); i++) {
+    const RangeTombstone& r = clipped[i];
+    if (i > 0 && r.sequence == clipped[i - 1].sequence &&
+        ucmp->Compare(r.begin, clipped[i - 1].begin) == 0) {
+      continue;  // Same tombstone read from two input files
+    }
+    InternalKey begin(r.begin, r.sequence, kTypeRangeDeletion);
+    InternalKey end(r.end, kMaxSequenceNumber, kTypeRangeDeletion);
+    compact->builder->AddRangeTombstone(begin.Encode(), r.end);
+    if (!has_bounds || internal_comparator_.Compare(begin, out->smallest) < 0) {
+      out->smallest = begin;
+    }
+    if (!has_bounds || internal_comparator_.Compare(end, out->largest) > 0) {
+      out->largest = end;
+    }
+    has_bounds = true;
+    out->num_range_deletions++;
+  }
+
+  if (next_user_key != nullptr) {
+    compact->range_del_lower.assign(next_user_key->data(),
+                                    next_user_key->size());
+    compact->has_range_del_lower = true;
+  }
+}
+
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* next_user_key) {
   assert(compact != nullptr);
   assert(compact->outfile != nullptr);
   assert(compact->builder != nullptr);
@@ -945,9 +1492,14 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   const uint64_t output_number = compact->current_output()->number;
   assert(output_number != 0);
 
+  if (!compact->tombstones.empty()) {
+    AddRangeTombstonesToOutput(compact, next_user_key);
+  }
+
   // Check for iterator errors
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
+  compact->current_output()->num_entries = current_entries;
   if (s.ok()) {
     s = compact->builder->Finish();
   } else {
@@ -989,16 +1541,28 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
   Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
       compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1), compact->compaction->level() + 1,
+      compact->compaction->num_input_files(1),
+      compact->compaction->output_level(),
       static_cast<long long>(compact->total_bytes));
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+    if (out.num_entries == 0 && out.num_range_deletions == 0) {
+      continue;  // Every range tombstone was dropped
+    }
+    FileMetaData f;
+    f.number = out.number;
+    f.file_size = out.file_size;
+    f.smallest = out.smallest;
+    f.largest = out.largest;
+    f.num_range_deletions = out.num_range_deletions;
+    f.num_entries = out.num_entries;
+    f.num_deletions = out.num_deletions;
+    versions_->SetNewFileStats(&f);
+    compact->compaction->edit()->AddFile(level, f);
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
 }
@@ -1013,16 +1577,32 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
       compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+      compact->compaction->output_level());
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == nullptr);
   assert(compact->outfile == nullptr);
-  if (snapshots_.empty()) {
+  // Only the newest value of each key is passed to the compaction filter,
+  // and only if no snapshot can read it.  Without snapshots that includes
+  // values whose sequence number was zeroed.
+  const SnapshotList& snapshots = log_owner()->snapshots_;
+  const bool has_snapshots = !snapshots.empty();
+  SequenceNumber newest_snapshot = 0;
+  if (!has_snapshots) {
     compact->smallest_snapshot = versions_->LastSequence();
   } else {
-    compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+    compact->smallest_snapshot = snapshots.oldest()->sequence_number();
+    newest_snapshot = snapshots.newest()->sequence_number();
+  }
+
+  Status status = versions_->CollectRangeTombstones(
+      compact->compaction, compact->smallest_snapshot, &compact->tombstones);
+  if (!status.ok()) {
+    return status;
   }
+  // The input is sorted, so tombstones are looked up in step with it.
+  compact->tombstones.Fragment();
+  RangeTombstoneList::Cursor tombstone_cursor(&compact->tombstones);
 
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
   // 通过MakeInputIterator方法生成了所有参与Major
@@ -1038,17 +1618,30 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
    * 在处理完所有key后，根据状态判断是否需要返回错误
    * ，同时通过FinishCompactionOutputFile方法关闭最后一个写入的SSTable。
    */
-  Status status;
+  // Expired values are checked against the time the compaction started.
+  const uint64_t now =
+      options_.enable_ttl ? env_->NowMicros() / 1000000 : 0;
+  const CompactionFilter* const filter = options_.compaction_filter;
+  std::string removed_key;
+  std::string new_value;
+  std::vector<std::string> merge_keys;    // Internal keys, newest first
+  std::vector<std::string> merge_values;  // Merge operands, newest first
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  std::string zeroed_key;
+  // A deletion marker that a snapshot still needs, for a key without data
+  // in older levels.  It is written only if an older entry for the key
+  // follows; otherwise there is nothing for it to hide from any snapshot.
+  std::string pending_deletion;
+  bool has_pending_deletion = false;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
     // Prioritize immutable compaction work
     if (has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (!imm_.empty()) {
         CompactMemTable();
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
@@ -1058,18 +1651,50 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
-        compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
-      // 同时通过FinishCompactionOutputFile方法关闭最后一个写入的SSTable。
-      if (!status.ok()) {
-        break;
+    const bool parsed = ParseInternalKey(key, &ikey);
+    if (has_pending_deletion) {
+      has_pending_deletion = false;
+      if (parsed && user_comparator()->Compare(
+                        ikey.user_key, ExtractUserKey(pending_deletion)) == 0) {
+        if (compact->builder == nullptr) {
+          status = OpenCompactionOutputFile(compact);
+          if (!status.ok()) {
+            break;
+          }
+        }
+        if (compact->builder->NumEntries() == 0) {
+          compact->current_output()->smallest.DecodeFrom(pending_deletion);
+        }
+        compact->current_output()->largest.DecodeFrom(pending_deletion);
+        compact->builder->Add(pending_deletion, Slice());
+        compact->current_output()->num_deletions++;
+      }
+    }
+    if (compact->compaction->ShouldStopBefore(key) ||
+        (compact->builder != nullptr &&
+         compact->builder->FileSize() >=
+             compact->compaction->MaxOutputFileSize())) {
+      // Close the current output file, but never between two entries for
+      // the same user key: the range tombstones of each output file are
+      // clipped at user key boundaries.
+      if (compact->builder != nullptr && parsed &&
+          !(has_current_user_key &&
+            user_comparator()->Compare(ikey.user_key,
+                                       Slice(current_user_key)) == 0)) {
+        status = FinishCompactionOutputFile(compact, input, &ikey.user_key);
+        // 同时通过FinishCompactionOutputFile方法关闭最后一个写入的SSTable。
+        if (!status.ok()) {
+          break;
+        }
       }
     }
 
     // Handle key/value, add to state, etc.
     bool drop = false;
-    if (!ParseInternalKey(key, &ikey)) {
+    bool to_deletion = false;
+    bool value_changed = false;
+    bool merge = false;
+    if (!parsed) {
       // Do not hide error keys
       current_user_key.clear();
       has_current_user_key = false;
@@ -1098,6 +1723,55 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (tombstone_cursor.ShouldDelete(ikey.user_key, ikey.sequence,
+                                               compact->smallest_snapshot)) {
+        // Deleted by a range tombstone that every snapshot can see.
+        drop = true;
+      } else if (ikey.type == kTypeMerge &&
+                 ikey.sequence <= compact->smallest_snapshot &&
+                 options_.merge_operator != nullptr) {
+        // Every snapshot sees this operand and the older ones below it,
+        // so they can be combined ahead of reads.
+        merge = true;
+      } else if (ikey.type == kTypeValue) {
+        bool remove = false;
+        if (now != 0 && IsExpiredValue(input->value(), now)) {
+          remove = true;
+        } else if (filter != nullptr &&
+                   (!has_snapshots || ikey.sequence > newest_snapshot) &&
+                   last_sequence_for_key == kMaxSequenceNumber) {
+          const Slice value = (now != 0) ? StripValueExpiry(input->value())
+                                         : input->value();
+          new_value.clear();
+          switch (filter->Filter(compact->compaction->output_level(),
+                                 ikey.user_key, value, &new_value)) {
+            case CompactionFilter::kKeep:
+              break;
+            case CompactionFilter::kRemove:
+              remove = true;
+              break;
+            case CompactionFilter::kChangeValue:
+              if (now != 0) {
+                // Keep the original expiry time.
+                const Slice expiry = input->value();
+                new_value.append(expiry.data() + value.size(),
+                                 kValueExpiryLength);
+              }
+              value_changed = true;
+              break;
+          }
+        }
+        if (remove) {
+          // A removed value hides older entries for the key just like a
+          // deletion, so it is dropped under the same conditions and
+          // otherwise replaced by a deletion marker.
+          if (ikey.sequence <= compact->smallest_snapshot &&
+              compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+            drop = true;
+          } else {
+            to_deletion = true;
+          }
+        }
       }
       /**
        * 判断当前是否丢弃当前key/value：
@@ -1118,6 +1792,89 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
+    if (merge) {
+      // Collect the operands of the key down to the value or deletion they
+      // apply to.  input is left at the first entry after the operands.
+      merge_keys.clear();
+      merge_values.clear();
+      bool base_found = false;
+      bool has_base = false;
+      std::string base;
+      for (; input->Valid(); input->Next()) {
+        if (!ParseInternalKey(input->key(), &ikey) ||
+            user_comparator()->Compare(ikey.user_key,
+                                       Slice(current_user_key)) != 0) {
+          break;
+        }
+        if (ikey.type == kTypeMerge &&
+            !tombstone_cursor.ShouldDelete(ikey.user_key, ikey.sequence,
+                                           compact->smallest_snapshot)) {
+          merge_keys.push_back(input->key().ToString());
+          merge_values.push_back(input->value().ToString());
+          last_sequence_for_key = ikey.sequence;
+          continue;
+        }
+        // The entry is dropped by rule (A) on the next iteration.
+        base_found = true;
+        if (ikey.type == kTypeValue &&
+            !tombstone_cursor.ShouldDelete(ikey.user_key, ikey.sequence,
+                                           compact->smallest_snapshot)) {
+          has_base = true;
+          base = input->value().ToString();
+        }
+        break;
+      }
+      if (base_found ||
+          compact->compaction->IsBaseLevelForKey(current_user_key)) {
+        // No older entry of the key survives the compaction, so the
+        // operands collapse into a value at the newest operand's sequence.
+        Slice base_slice(base);
+        status = MergeOperands(options_.merge_operator, current_user_key,
+                               has_base ? &base_slice : nullptr, merge_values,
+                               &new_value);
+        if (!status.ok()) {
+          break;
+        }
+        ParsedInternalKey newest;
+        ParseInternalKey(merge_keys[0], &newest);
+        std::string merged_key;
+        AppendInternalKey(&merged_key,
+                          ParsedInternalKey(current_user_key, newest.sequence,
+                                            kTypeValue));
+        merge_keys.assign(1, merged_key);
+        merge_values.assign(1, new_value);
+      }
+      for (size_t i = 0; i < merge_keys.size(); i++) {
+        if (compact->builder == nullptr) {
+          status = OpenCompactionOutputFile(compact);
+          if (!status.ok()) {
+            break;
+          }
+        }
+        const Slice merge_key(merge_keys[i]);
+        if (compact->builder->NumEntries() == 0) {
+          compact->current_output()->smallest.DecodeFrom(merge_key);
+        }
+        compact->current_output()->largest.DecodeFrom(merge_key);
+        compact->builder->Add(merge_key, merge_values[i]);
+      }
+      if (!status.ok()) {
+        break;
+      }
+      continue;  // input is already past the operands
+    }
+
+    if (!drop && parsed &&
+        (to_deletion || ikey.type == kTypeDeletion) &&
+        compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+      pending_deletion.clear();
+      AppendInternalKey(&pending_deletion,
+                        ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                          kTypeDeletion));
+      has_pending_deletion = true;
+      drop = true;
+    }
+
     if (!drop) {
       // Open output file if necessary
       if (compact->builder == nullptr) {
@@ -1126,19 +1883,38 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
           break;
         }
       }
+      Slice value = input->value();
+      if (to_deletion) {
+        removed_key.clear();
+        AppendInternalKey(&removed_key, ParsedInternalKey(ikey.user_key,
+                                                          ikey.sequence,
+                                                          kTypeDeletion));
+        key = removed_key;
+        value = Slice();
+      } else if (value_changed) {
+        value = new_value;
+      }
+      if (parsed && ikey.type == kTypeValue && !to_deletion &&
+          ikey.sequence != 0 && ikey.sequence <= compact->smallest_snapshot &&
+          compact->compaction->IsBaseLevelForKey(ikey.user_key) &&
+          !tombstone_cursor.ShouldDelete(ikey.user_key, 0,
+                                         kMaxSequenceNumber)) {
+        // Every snapshot sees this value and nothing older survives, so
+        // its sequence number is no longer needed.  Zero compresses and
+        // prefix-encodes better.  A range tombstone over the key, even an
+        // older one, would delete the value once its sequence is zero.
+        zeroed_key.clear();
+        AppendInternalKey(&zeroed_key,
+                          ParsedInternalKey(ikey.user_key, 0, kTypeValue));
+        key = zeroed_key;
+      }
       if (compact->builder->NumEntries() == 0) {
         compact->current_output()->smallest.DecodeFrom(key);
       }
       compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
-
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+      compact->builder->Add(key, value);
+      if (to_deletion || (parsed && ikey.type == kTypeDeletion)) {
+        compact->current_output()->num_deletions++;
       }
     }
 
@@ -1148,8 +1924,13 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok() && compact->builder == nullptr &&
+      !compact->tombstones.empty()) {
+    // Range tombstones past the last key written still need a file.
+    status = OpenCompactionOutputFile(compact);
+  }
   if (status.ok() && compact->builder != nullptr) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, nullptr);
   }
   if (status.ok()) {
     status = input->status();
@@ -1169,7 +1950,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   }
 
   mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
+  stats_[compact->compaction->output_level()].Add(stats);
 
   if (status.ok()) {
     status = InstallCompactionResults(compact);
@@ -1188,17 +1969,17 @@ struct IterState {
   port::Mutex* const mu;
   Version* const version GUARDED_BY(mu);
   MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
+  std::vector<MemTable*> imm GUARDED_BY(mu);
 
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
-      : mu(mutex), version(version), mem(mem), imm(imm) {}
+  IterState(port::Mutex* mutex, MemTable* mem, Version* version)
+      : mu(mutex), version(version), mem(mem) {}
 };
 
 static void CleanupIteratorState(void* arg1, void* arg2) {
   IterState* state = reinterpret_cast<IterState*>(arg1);
   state->mu->Lock();
   state->mem->Unref();
-  if (state->imm != nullptr) state->imm->Unref();
+  for (MemTable* imm : state->imm) imm->Unref();
   state->version->Unref();
   state->mu->Unlock();
   delete state;
@@ -1208,7 +1989,8 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+                                      uint32_t* seed,
+                                      RangeTombstoneSet* tombstones) {
   /**
    * 函数NewInternalIterator有一些处理逻辑，就是收集所有能用到的iterator，生产一个Merging
    * Iterator。这包括MemTable，Immutable MemTable，以及各sstable。
@@ -1217,25 +1999,45 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
   *latest_snapshot = versions_->LastSequence();
 
   // Collect together all needed child iterators
+  IterState* cleanup = new IterState(&mutex_, mem_, versions_->current());
+  std::vector<MemTable*> mems;  // Kept alive by the cleanup
   std::vector<Iterator*> list;
   list.push_back(mem_->NewIterator());
   mem_->Ref();
-  if (imm_ != nullptr) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
-  }
+  mems.push_back(mem_);
+  for (const ImmutableMemTable& imm : imm_) {
+    list.push_back(imm.mem->NewIterator());
+    imm.mem->Ref();
+    cleanup->imm.push_back(imm.mem);
+    mems.push_back(imm.mem);
+  }
+  Version* const current = versions_->current();
   versions_->current()->AddIterators(options, &list);
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
   versions_->current()->Ref();
 
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
   /**
    * 这里为什么需要清理？是因为迭代器固化了一些资源吗？
    */
   *seed = ++seed_;
   mutex_.Unlock();
+
+  // The iterator keeps the memtables and the version alive, so their range
+  // tombstones are looked up without the mutex: that may open tables.
+  if (tombstones != nullptr) {
+    for (MemTable* mem : mems) {
+      if (mem->HasRangeTombstones()) {
+        tombstones->AddMemTable(mem);
+      }
+    }
+    Status s = current->AddRangeTombstones(tombstones);
+    if (!s.ok()) {
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+  }
   return internal_iter;
 }
 
@@ -1270,10 +2072,13 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   }
 
   MemTable* mem = mem_;
-  MemTable* imm = imm_;
+  std::vector<MemTable*> imm;  // Newest first
   Version* current = versions_->current();
   mem->Ref();
-  if (imm != nullptr) imm->Ref();
+  for (auto it = imm_.rbegin(); it != imm_.rend(); ++it) {
+    imm.push_back(it->mem);
+    it->mem->Ref();
+  }
   current->Ref();
 
   bool have_stat_update = false;
@@ -1282,16 +2087,32 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   // Unlock while reading from files and memtables
   {
     mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
+    // First look in the memtable, then in the immutable memtables from
+    // newest to oldest.
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
+    std::vector<std::string> operands;  // Merge operands, newest first
+    bool done = mem->Get(lkey, value, &s, &operands);
+    for (size_t i = 0; !done && i < imm.size(); i++) {
+      done = imm[i]->Get(lkey, value, &s, &operands);
+    }
+    if (!done) {
+      s = current->Get(options, lkey, value, &stats, &operands);
       have_stat_update = true;
     }
+    if (!operands.empty() && (s.ok() || s.IsNotFound())) {
+      const std::string base = s.ok() ? *value : std::string();
+      const Slice base_slice(base);
+      s = MergeOperands(options_.merge_operator, key,
+                        s.ok() ? &base_slice : nullptr, operands, value);
+    }
+    if (s.ok() && options_.enable_ttl) {
+      if (IsExpiredValue(*value, env_->NowMicros() / 1000000)) {
+        value->clear();
+        s = Status::NotFound(Slice());
+      } else {
+        value->resize(StripValueExpiry(*value).size());
+      }
+    }
     mutex_.Lock();
   }
 
@@ -1299,7 +2120,7 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     MaybeScheduleCompaction();
   }
   mem->Unref();
-  if (imm != nullptr) imm->Unref();
+  for (MemTable* m : imm) m->Unref();
   current->Unref();
   return s;
 }
@@ -1310,13 +2131,21 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  RangeTombstoneSet* tombstones = new RangeTombstoneSet;
+  Iterator* iter =
+      NewInternalIterator(options, &latest_snapshot, &seed, tombstones);
+  if (tombstones->empty()) {
+    delete tombstones;
+    tombstones = nullptr;
+  }
   return NewDBIterator(this, user_comparator(), iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, tombstones,
+                       options_.enable_ttl ? env_->NowMicros() / 1000000 : 0,
+                       options_.merge_operator);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1326,6 +2155,30 @@ void DBImpl::RecordReadSample(Slice key) {
   }
 }
 
+void DBImpl::RecordHiddenEntries(Slice key, SequenceNumber max_sequence) {
+  MutexLock l(&mutex_);
+  // Compactions keep whatever a snapshot can still read.
+  const SnapshotList& snapshots = log_owner()->snapshots_;
+  if (!snapshots.empty() &&
+      max_sequence > snapshots.oldest()->sequence_number()) {
+    return;
+  }
+
+  // Finding the file that holds the entries reads it, so do that unlocked.
+  Version* current = versions_->current();
+  current->Ref();
+  FileMetaData* f;
+  int level;
+  mutex_.Unlock();
+  const bool found = current->FindFileWithEntry(key, &f, &level);
+  mutex_.Lock();
+  if (found && current == versions_->current() &&
+      current->RecordHiddenEntries(key, f, level)) {
+    MaybeScheduleCompaction();
+  }
+  current->Unref();
+}
+
 const Snapshot* DBImpl::GetSnapshot() {
   MutexLock l(&mutex_);
   return snapshots_.New(versions_->LastSequence());
@@ -1346,28 +2199,106 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
 }
 
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
-  Writer w(&mutex_);
-  w.batch = updates;
-  w.sync = options.sync;
-  w.done = false;
-
-  MutexLock l(&mutex_);
-  writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
+  if (owner_ != nullptr) {
+    // Column families are written through their DB; only the null batches
+    // that switch their memtable come here.
+    assert(updates == nullptr);
+    return owner_->WriteImpl(options, nullptr, this);
+  }
+
+  WriteBatch stamped;
+  if (options_.enable_ttl && updates != nullptr) {
+    // Values are logged with their expiry time so that recovery does not
+    // extend their lifetime.
+    const uint64_t expiry =
+        (options.ttl_seconds == 0)
+            ? 0
+            : env_->NowMicros() / 1000000 + options.ttl_seconds;
+    Status s = WriteBatchInternal::AppendWithExpiry(&stamped, updates, expiry);
+    if (!s.ok()) {
+      return s;
+    }
+    updates = &stamped;
+  }
+  return WriteImpl(options, updates, this);
+}
+
+Status DBImpl::WriteImpl(const WriteOptions& options, WriteBatch* updates,
+                         DBImpl* force) {
+  uint32_t max_column_family = 0;
+  if (updates != nullptr) {
+    Status s = WriteBatchInternal::ColumnFamilies(updates, &max_column_family,
+                                                  nullptr);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
+  Writer w(&mutex_);
+  w.batch = updates;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  // Column families are never dropped, so a batch that is valid now
+  // stays valid until it is applied.
+  if (max_column_family > families_.size()) {
+    return Status::InvalidArgument("unknown column family");
+  }
+  writers_.push_back(&w);
+  while (!w.done && &w != writers_.front()) {
     w.cv.Wait();
   }
   if (w.done) {
     return w.status;
   }
 
-  // May temporarily unlock and wait.
-  Status status = MakeRoomForWrite(updates == nullptr);
+  // Switch the memtable that a null batch asks for, or the largest one if
+  // the write buffer manager is over budget.
+  if (updates != nullptr) {
+    force = MemTableOverBudget();
+  }
+
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
-  if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+  WriteBatch* write_batch = nullptr;
+  // touched[0] is this DB and touched[i] the column family families_[i-1].
+  std::vector<bool> touched;
+  Status status;
+  if (updates != nullptr) {  // nullptr batch is for compactions
+    write_batch = BuildBatchGroup(&last_writer);
+    if (families_.empty()) {
+      touched.push_back(true);
+    } else {
+      uint32_t unused_max_id;
+      status = WriteBatchInternal::ColumnFamilies(write_batch, &unused_max_id,
+                                                  &touched);
+    }
+  }
+  touched.resize(families_.size() + 1);
+
+  // May temporarily unlock and wait.  Only the column families written to
+  // make room, so that one that is behind does not hold up the others.
+  if (status.ok()) {
+    status = (touched[0] || force == this) ? MakeRoomForWrite(force == this)
+                                           : bg_error_;
+  }
+  for (size_t i = 0; status.ok() && i < families_.size(); i++) {
+    DBImpl* family = families_[i]->family();
+    if (touched[i + 1] || force == family) {
+      status = family->MakeRoomForWrite(force == family);
+    }
+  }
+  if (status.ok() && write_batch != nullptr) {
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(write_batch);
+    std::vector<MemTable*> memtables;
+    if (!families_.empty()) {
+      memtables.push_back(mem_);
+      for (ColumnFamilyHandleImpl* family : families_) {
+        memtables.push_back(family->family()->mem_);
+      }
+    }
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1384,7 +2315,11 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         }
       }
       if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(write_batch, mem_);
+        if (memtables.empty()) {
+          status = WriteBatchInternal::InsertInto(write_batch, mem_);
+        } else {
+          status = WriteBatchInternal::InsertInto(write_batch, memtables);
+        }
       }
       mutex_.Lock();
       if (sync_error) {
@@ -1394,10 +2329,28 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         RecordBackgroundError(status);
       }
     }
-    if (write_batch == tmp_batch_) tmp_batch_->Clear();
+    if (status.ok()) {
+      // Pace the following writes to the column families written to if
+      // these have to be delayed.
+      const size_t bytes = WriteBatchInternal::ByteSize(write_batch);
+      const uint64_t now_micros = env_->NowMicros();
+      logfile_size_ += bytes;
+      if (touched[0]) {
+        write_controller_.Charge(bytes, now_micros);
+      }
+      for (size_t i = 0; i < families_.size(); i++) {
+        if (touched[i + 1]) {
+          families_[i]->family()->write_controller_.Charge(bytes, now_micros);
+        }
+      }
+    }
 
     versions_->SetLastSequence(last_sequence);
+    for (ColumnFamilyHandleImpl* family : families_) {
+      family->family()->versions_->SetLastSequence(last_sequence);
+    }
   }
+  if (write_batch == tmp_batch_) tmp_batch_->Clear();
 
   while (true) {
     Writer* ready = writers_.front();
@@ -1447,22 +2400,26 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
-    if (w->batch != nullptr) {
-      size += WriteBatchInternal::ByteSize(w->batch);
-      if (size > max_size) {
-        // Do not make batch too big
-        break;
-      }
+    if (w->batch == nullptr) {
+      // Memtable switches and column family creation must be done by
+      // their own writer at the front of the queue.
+      break;
+    }
 
-      // Append to *result
-      if (result == first->batch) {
-        // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
-        assert(WriteBatchInternal::Count(result) == 0);
-        WriteBatchInternal::Append(result, first->batch);
-      }
-      WriteBatchInternal::Append(result, w->batch);
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+
+    // Append to *result
+    if (result == first->batch) {
+      // Switch to temporary batch instead of disturbing caller's batch
+      result = tmp_batch_;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
     }
+    WriteBatchInternal::Append(result, w->batch);
     *last_writer = w;
   }
   return result;
@@ -1475,8 +2432,8 @@ Status DBImpl::MakeRoomForWrite(bool force) {
    * 通过断言确保当前持有着锁。
 如果后台线程报错，退出执行。
 如果当前level-0中的SSTable数即将超过最大限制（默认为8，而当level-0的SSTable数达到4时即可触发Minor
-Compaction），这可能是写入过快导致的。此时会开启流控，将每条写入都推迟1ms，以给Minor
-Compaction留出时间。如果调用该方法时参数force为true，则不会触发流控。
+Compaction），或Compaction落后的字节数超过软限制，这可能是写入过快导致的。此时会开启流控，
+按照write_controller_计算出的速率推迟写入，以给Compaction留出时间。如果调用该方法时参数force为true，则不会触发流控。
 如果force为false且MemTable估算的大小没有超过限制（默认为4MB），则直接退出，不需要进行Minor
 Compaction。 如果此时有未完成Minor Compaction的Immutable
 MemTable，此时循环等待Minor Compaction执行完成再执行。
@@ -1488,80 +2445,246 @@ Immutable，调用MaybeScheduleCompaction方法尝试通过后台线程调度Com
 Compaction）。
   */
   mutex_.AssertHeld();
-  assert(!writers_.empty());
+  assert(!log_owner()->writers_.empty());
   bool allow_delay = !force;
+  WriteStallCause waiting = kNumWriteStallCauses;  // Last cause waited for
   Status s;
   while (true) {
+    const WriteStallCause delay_cause =
+        allow_delay ? UpdateDelayedWriteRate() : kNumWriteStallCauses;
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
+    } else if (delay_cause != kNumWriteStallCauses) {
       // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
+      // L0 files or on the bytes compactions are behind.  Rather than
+      // delaying a single write by several seconds when we hit the hard
+      // limit, space out writes at a rate that falls as we get closer
+      // to it, to reduce latency variance.  Also, this delay hands over
+      // some CPU to the compaction thread in case it is sharing the same
+      // core as the writer.
       allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
+      const uint64_t start_micros = env_->NowMicros();
+      const uint64_t delay = write_controller_.GetDelay(start_micros);
+      if (delay > 0) {
+        mutex_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(
+            std::min<uint64_t>(delay, std::numeric_limits<int>::max())));
+        mutex_.Lock();
+        stall_stats_[delay_cause].count++;
+        stall_stats_[delay_cause].micros += env_->NowMicros() - start_micros;
+      }
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
       break;
-    } else if (imm_ != nullptr) {
-      // We have filled up the current memtable, but the previous
-      // one is still being compacted, so we wait.
+    } else if (imm_.size() + 1 >=
+               static_cast<size_t>(options_.max_write_buffer_number)) {
+      // We have filled up the current memtable, but as many older ones
+      // as allowed are still waiting to be compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
-      background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+      WaitForBackgroundWork(kStallMemTableLimit, &waiting);
+    } else if (versions_->NumLevelFiles(0) >=
+               options_.level0_stop_writes_trigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
-      background_work_finished_signal_.Wait();
+      WaitForBackgroundWork(kStallLevel0Stop, &waiting);
+    } else if (options_.hard_pending_compaction_bytes_limit > 0 &&
+               versions_->PendingCompactionBytes() >=
+                   options_.hard_pending_compaction_bytes_limit) {
+      // Compactions are too far behind.
+      Log(options_.info_log, "Too many pending compaction bytes; waiting...\n");
+      WaitForBackgroundWork(kStallPendingCompactionBytesStop, &waiting);
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
-      assert(versions_->PrevLogNumber() == 0);
-      uint64_t new_log_number = versions_->NewFileNumber();
-      WritableFile* lfile = nullptr;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      DBImpl* const db = log_owner();
+      const uint64_t closed_log_number = db->logfile_number_;
+      s = db->NewLogFile();
       if (!s.ok()) {
-        // Avoid chewing through file number space in a tight loop.
-        versions_->ReuseFileNumber(new_log_number);
         break;
       }
-
-      delete log_;
-
-      s = logfile_->Close();
-      if (!s.ok()) {
-        // We may have lost some data written to the previous log file.
-        // Switch to the new log file anyway, but record as a background
-        // error so we do not attempt any more writes.
-        //
-        // We could perhaps attempt to save the memtable corresponding
-        // to log file and suppress the error if that works, but that
-        // would add more complexity in a critical code path.
-        RecordBackgroundError(s);
+      SwitchMemTable();
+      if (db->LiveLogSize() > db->options_.max_total_wal_size) {
+        db->SwitchStaleMemTables(closed_log_number);
       }
-      delete logfile_;
-
-      logfile_ = lfile;
-      logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
-      imm_ = mem_;
-      has_imm_.store(true, std::memory_order_release);
-      mem_ = new MemTable(internal_comparator_);
-      mem_->Ref();
       force = false;  // Do not force another compaction if have room
-      MaybeScheduleCompaction();
     }
   }
   return s;
 }
 
+DBImpl::WriteStallCause DBImpl::UpdateDelayedWriteRate() {
+  mutex_.AssertHeld();
+  // How close each limit is, from 0 at the slowdown point to 1 at the
+  // stop point.
+  WriteStallCause cause = kNumWriteStallCauses;
+  double pressure = 0;
+  const int level0_files = versions_->NumLevelFiles(0);
+  const int slowdown = options_.level0_slowdown_writes_trigger;
+  if (level0_files >= slowdown) {
+    const int range = options_.level0_stop_writes_trigger - slowdown;
+    cause = kStallLevel0Slowdown;
+    pressure = (range > 0)
+                   ? static_cast<double>(level0_files - slowdown) / range
+                   : 1;
+  }
+  const uint64_t soft_limit = options_.soft_pending_compaction_bytes_limit;
+  const uint64_t hard_limit = options_.hard_pending_compaction_bytes_limit;
+  const uint64_t pending_bytes = versions_->PendingCompactionBytes();
+  if (soft_limit > 0 && pending_bytes >= soft_limit) {
+    const double bytes_pressure =
+        (hard_limit > soft_limit)
+            ? static_cast<double>(pending_bytes - soft_limit) /
+                  (hard_limit - soft_limit)
+            : 1;
+    if (cause == kNumWriteStallCauses || bytes_pressure > pressure) {
+      cause = kStallPendingCompactionBytesSlowdown;
+      pressure = bytes_pressure;
+    }
+  }
+
+  if (cause == kNumWriteStallCauses) {
+    write_controller_.SetDelayedWriteRate(0);
+  } else {
+    const uint64_t max_rate = options_.delayed_write_rate;
+    const uint64_t rate =
+        static_cast<uint64_t>(max_rate * (1 - std::min(pressure, 1.0)));
+    write_controller_.SetDelayedWriteRate(std::max(rate, max_rate / 16));
+  }
+  return cause;
+}
+
+void DBImpl::WaitForBackgroundWork(WriteStallCause cause,
+                                   WriteStallCause* last_cause) {
+  mutex_.AssertHeld();
+  const uint64_t start_micros = env_->NowMicros();
+  background_work_finished_signal_.Wait();
+  if (*last_cause != cause) {
+    stall_stats_[cause].count++;
+    *last_cause = cause;
+  }
+  stall_stats_[cause].micros += env_->NowMicros() - start_micros;
+}
+
+DBImpl* DBImpl::MemTableOverBudget() {
+  mutex_.AssertHeld();
+  WriteBufferManager* manager = options_.write_buffer_manager;
+  if (manager == nullptr || !manager->ShouldFlush()) {
+    return nullptr;
+  }
+  // Memtables being compacted are freed soon and empty ones free nothing.
+  DBImpl* largest = nullptr;
+  size_t largest_usage = 0;
+  std::vector<DBImpl*> dbs(1, this);
+  for (ColumnFamilyHandleImpl* family : families_) {
+    dbs.push_back(family->family());
+  }
+  for (DBImpl* db : dbs) {
+    if (db->imm_.empty() && !db->mem_->IsEmpty()) {
+      const size_t usage = db->mem_->ApproximateMemoryUsage();
+      if (usage > largest_usage) {
+        largest = db;
+        largest_usage = usage;
+      }
+    }
+  }
+  if (largest != nullptr) {
+    Log(options_.info_log,
+        "Write buffers use %llu of %llu bytes; switching memtable of %s\n",
+        static_cast<unsigned long long>(manager->memory_usage()),
+        static_cast<unsigned long long>(manager->buffer_size()),
+        largest->dbname_.c_str());
+  }
+  return largest;
+}
+
+Status DBImpl::NewLogFile() {
+  mutex_.AssertHeld();
+  assert(owner_ == nullptr);
+  assert(versions_->PrevLogNumber() == 0);
+  uint64_t new_log_number = versions_->NewFileNumber();
+  WritableFile* lfile = nullptr;
+  Status s =
+      env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+  if (!s.ok()) {
+    // Avoid chewing through file number space in a tight loop.
+    versions_->ReuseFileNumber(new_log_number);
+    return s;
+  }
+
+  delete log_;
+
+  closed_logs_.emplace_back(logfile_number_, logfile_size_);
+  logfile_size_ = 0;
+  s = logfile_->Close();
+  if (!s.ok()) {
+    // We may have lost some data written to the previous log file.
+    // Switch to the new log file anyway, but record as a background
+    // error so we do not attempt any more writes.
+    //
+    // We could perhaps attempt to save the memtable corresponding
+    // to log file and suppress the error if that works, but that
+    // would add more complexity in a critical code path.
+    RecordBackgroundError(s);
+  }
+  delete logfile_;
+
+  logfile_ = lfile;
+  logfile_number_ = new_log_number;
+  log_ = new log::Writer(lfile);
+  return Status::OK();
+}
+
+void DBImpl::SwitchMemTable() {
+  mutex_.AssertHeld();
+  // The entries of the new memtable go to the current log and later ones.
+  const uint64_t log_number = log_owner()->logfile_number_;
+  versions_->MarkFileNumberUsed(log_number);  // Numbered by the owner
+  imm_.push_back(ImmutableMemTable{mem_, log_number});
+  has_imm_.store(true, std::memory_order_release);
+  mem_ = new MemTable(internal_comparator_, options_);
+  mem_->Ref();
+  MaybeScheduleCompaction();
+}
+
+void DBImpl::SwitchStaleMemTables(uint64_t log_number) {
+  mutex_.AssertHeld();
+  if (imm_.empty() && versions_->LogNumber() < log_number) {
+    SwitchMemTable();
+  }
+  for (ColumnFamilyHandleImpl* handle : families_) {
+    DBImpl* family = handle->family();
+    if (family->imm_.empty() &&
+        family->versions_->LogNumber() < log_number) {
+      family->SwitchMemTable();
+    }
+  }
+}
+
+uint64_t DBImpl::MinLogNumber() const {
+  mutex_.AssertHeld();
+  // Column families replay the shared log from their own log numbers.
+  uint64_t min_log = versions_->LogNumber();
+  for (ColumnFamilyHandleImpl* family : families_) {
+    min_log = std::min(min_log, family->family()->versions_->LogNumber());
+  }
+  return min_log;
+}
+
+uint64_t DBImpl::LiveLogSize() {
+  mutex_.AssertHeld();
+  const uint64_t min_log = MinLogNumber();
+  while (!closed_logs_.empty() && closed_logs_.front().first < min_log) {
+    closed_logs_.pop_front();
+  }
+  uint64_t size = logfile_size_;
+  for (const std::pair<uint64_t, uint64_t>& log : closed_logs_) {
+    size += log.second;
+  }
+  return size;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   value->clear();
 
@@ -1575,7 +2698,7 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     in.remove_prefix(strlen("num-files-at-level"));
     uint64_t level;
     bool ok = ConsumeDecimalNumber(&in, &level) && in.empty();
-    if (!ok || level >= config::kNumLevels) {
+    if (!ok || level >= static_cast<uint64_t>(options_.num_levels)) {
       return false;
     } else {
       char buf[100];
@@ -1591,7 +2714,7 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   "Level  Files Size(MB) Time(sec) Read(MB) Write(MB)\n"
                   "--------------------------------------------------\n");
     value->append(buf);
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < options_.num_levels; level++) {
       int files = versions_->NumLevelFiles(level);
       if (stats_[level].micros > 0 || files > 0) {
         std::snprintf(buf, sizeof(buf), "%3d %8d %8.0f %9.0f %8.0f %9.0f\n",
@@ -1611,14 +2734,46 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     if (mem_) {
       total_usage += mem_->ApproximateMemoryUsage();
     }
-    if (imm_) {
-      total_usage += imm_->ApproximateMemoryUsage();
+    for (const ImmutableMemTable& imm : imm_) {
+      total_usage += imm.mem->ApproximateMemoryUsage();
     }
     char buf[50];
     std::snprintf(buf, sizeof(buf), "%llu",
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "write-stall-stats") {
+    static const char* const kCauseNames[kNumWriteStallCauses] = {
+        "level0-slowdown", "pending-compaction-bytes-slowdown",
+        "memtable-limit", "level0-stop", "pending-compaction-bytes-stop"};
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Cause                              Count Time(sec)\n"
+                  "--------------------------------------------------\n");
+    value->append(buf);
+    for (int i = 0; i < kNumWriteStallCauses; i++) {
+      std::snprintf(buf, sizeof(buf), "%-33s %6lld %9.3f\n", kCauseNames[i],
+                    static_cast<long long>(stall_stats_[i].count),
+                    stall_stats_[i].micros / 1e6);
+      value->append(buf);
+    }
+    std::snprintf(buf, sizeof(buf), "Delayed write rate: %llu bytes/s\n",
+                  static_cast<unsigned long long>(
+                      write_controller_.delayed_write_rate()));
+    value->append(buf);
+    return true;
+  } else if (in == "estimate-pending-compaction-bytes") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(
+                      versions_->PendingCompactionBytes()));
+    value->append(buf);
+    return true;
+  } else if (in == "num-immutable-mem-table") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%d", static_cast<int>(imm_.size()));
+    value->append(buf);
+    return true;
   }
 
   return false;
@@ -1642,6 +2797,588 @@ void DBImpl::GetApproximateSizes(const Range* range, int n, uint64_t* sizes) {
   v->Unref();
 }
 
+Status DBImpl::CreateColumnFamily(const Options& options,
+                                  const std::string& name,
+                                  ColumnFamilyHandle** handle) {
+  *handle = nullptr;
+  if (owner_ != nullptr) {
+    return Status::NotSupported("column family of a column family");
+  }
+
+  // Writers read families_ unlocked, so take the front of the queue.
+  Writer w(&mutex_);
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  Status s = bg_error_;
+  for (ColumnFamilyHandleImpl* family : families_) {
+    if (s.ok() && family->GetName() == name) {
+      s = Status::InvalidArgument(name, "column family already exists");
+    }
+  }
+  const uint32_t id = families_.size() + 1;
+  if (s.ok()) {
+    s = OpenColumnFamily(id, name, options, true);
+  }
+  if (s.ok()) {
+    // The new column family needs none of the older logs.
+    DBImpl* family = families_.back()->family();
+    VersionEdit family_edit;
+    family->versions_->MarkFileNumberUsed(logfile_number_);
+    family_edit.SetLogNumber(logfile_number_);
+    s = family->versions_->LogAndApply(&family_edit, &mutex_);
+    if (s.ok()) {
+      VersionEdit edit;
+      edit.AddColumnFamily(id, name);
+      s = versions_->LogAndApply(&edit, &mutex_);
+    }
+    if (s.ok()) {
+      *handle = families_.back();
+      family->LogUserObjects();
+      family->MaybeScheduleCompaction();
+      family->MaybeStartAgeTimer();
+    } else {
+      delete families_.back();
+      families_.pop_back();
+      mutex_.Unlock();
+      delete family;
+      mutex_.Lock();
+    }
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
+// Return the column family of "handle"; handles belong to their DB.
+static DBImpl* ColumnFamilyOf(ColumnFamilyHandle* handle) {
+  return static_cast<ColumnFamilyHandleImpl*>(handle)->family();
+}
+
+Status DBImpl::Put(const WriteOptions& options,
+                   ColumnFamilyHandle* column_family, const Slice& key,
+                   const Slice& value) {
+  return DB::Put(options, column_family, key, value);
+}
+
+Status DBImpl::Delete(const WriteOptions& options,
+                      ColumnFamilyHandle* column_family, const Slice& key) {
+  return DB::Delete(options, column_family, key);
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   ColumnFamilyHandle* column_family, const Slice& key,
+                   std::string* value) {
+  if (column_family == nullptr) {
+    return Get(options, key, value);
+  }
+  return ColumnFamilyOf(column_family)->Get(options, key, value);
+}
+
+Iterator* DBImpl::NewIterator(const ReadOptions& options,
+                              ColumnFamilyHandle* column_family) {
+  if (column_family == nullptr) {
+    return NewIterator(options);
+  }
+  return ColumnFamilyOf(column_family)->NewIterator(options);
+}
+
+bool DBImpl::GetProperty(ColumnFamilyHandle* column_family,
+                         const Slice& property, std::string* value) {
+  if (column_family == nullptr) {
+    return GetProperty(property, value);
+  }
+  return ColumnFamilyOf(column_family)->GetProperty(property, value);
+}
+
+void DBImpl::CompactRange(ColumnFamilyHandle* column_family,
+                          const Slice* begin, const Slice* end) {
+  if (column_family == nullptr) {
+    CompactRange(begin, end);
+  } else {
+    ColumnFamilyOf(column_family)->CompactRange(begin, end);
+  }
+}
+
+Status DBImpl::CompactRange(const CompactRangeOptions& options,
+                            ColumnFamilyHandle* column_family,
+                            const Slice* begin, const Slice* end) {
+  if (column_family == nullptr) {
+    return CompactRange(options, begin, end);
+  }
+  return ColumnFamilyOf(column_family)->CompactRange(options, begin, end);
+}
+
+Status DBImpl::Flush(const FlushOptions& options,
+                     ColumnFamilyHandle* column_family) {
+  if (column_family == nullptr) {
+    return Flush(options);
+  }
+  return ColumnFamilyOf(column_family)->Flush(options);
+}
+
+namespace {
+// Iterator over the entries of a file written by SstFileWriter, with
+// their sequence number replaced by "sequence".
+class SequenceAssigningIterator : public Iterator {
+ public:
+  SequenceAssigningIterator(Iterator* iter, SequenceNumber sequence)
+      : iter_(iter), sequence_(sequence) {}
+
+  ~SequenceAssigningIterator() override { delete iter_; }
+
+  bool Valid() const override { return status_.ok() && iter_->Valid(); }
+  void SeekToFirst() override { iter_->SeekToFirst(); }
+  void SeekToLast() override { iter_->SeekToLast(); }
+  void Seek(const Slice& target) override { iter_->Seek(target); }
+  void Next() override { iter_->Next(); }
+  void Prev() override { iter_->Prev(); }
+  Slice key() const override {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter_->key(), &ikey) || ikey.type != kTypeValue) {
+      status_ = Status::Corruption("bad key in external file");
+      return iter_->key();
+    }
+    key_.clear();
+    AppendInternalKey(&key_,
+                      ParsedInternalKey(ikey.user_key, sequence_, kTypeValue));
+    return key_;
+  }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override {
+    return status_.ok() ? iter_->status() : status_;
+  }
+
+ private:
+  Iterator* const iter_;
+  const SequenceNumber sequence_;
+  mutable std::string key_;
+  mutable Status status_;
+};
+}  // namespace
+
+// Store the first and last keys of "table", a file written by
+// SstFileWriter, in *smallest and *largest.
+static Status GetExternalFileRange(const std::string& file, Table* table,
+                                   InternalKey* smallest,
+                                   InternalKey* largest) {
+  Status s;
+  Iterator* iter = table->NewRangeTombstoneIterator(ReadOptions());
+  iter->SeekToFirst();
+  if (iter->Valid()) {
+    s = Status::InvalidArgument(file, "external file has range tombstones");
+  }
+  delete iter;
+  if (!s.ok()) {
+    return s;
+  }
+
+  iter = table->NewIterator(ReadOptions());
+  ParsedInternalKey first, last;
+  iter->SeekToFirst();
+  if (iter->Valid()) {
+    smallest->DecodeFrom(iter->key());
+    iter->SeekToLast();
+  }
+  if (iter->Valid()) {
+    largest->DecodeFrom(iter->key());
+  }
+  if (!iter->status().ok()) {
+    s = iter->status();
+  } else if (!iter->Valid()) {
+    s = Status::InvalidArgument(file, "external file is empty");
+  } else if (!ParseInternalKey(smallest->Encode(), &first) ||
+             !ParseInternalKey(largest->Encode(), &last) ||
+             first.sequence != 0 || first.type != kTypeValue ||
+             last.sequence != 0 || last.type != kTypeValue) {
+    s = Status::InvalidArgument(file, "not written by SstFileWriter");
+  }
+  delete iter;
+  return s;
+}
+
+static Status CopyFile(Env* env, const std::string& src,
+                       const std::string& dst) {
+  SequentialFile* sfile;
+  Status s = env->NewSequentialFile(src, &sfile);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* dfile;
+  s = env->NewWritableFile(dst, &dfile);
+  if (!s.ok()) {
+    delete sfile;
+    return s;
+  }
+
+  const size_t kBufferSize = 65536;
+  char* buffer = new char[kBufferSize];
+  while (s.ok()) {
+    Slice data;
+    s = sfile->Read(kBufferSize, &data, buffer);
+    if (!s.ok() || data.empty()) {
+      break;
+    }
+    s = dfile->Append(data);
+  }
+  delete[] buffer;
+  delete sfile;
+  if (s.ok()) {
+    s = dfile->Sync();
+  }
+  if (s.ok()) {
+    s = dfile->Close();
+  }
+  delete dfile;
+  if (!s.ok()) {
+    env->RemoveFile(dst);
+  }
+  return s;
+}
+
+Status DBImpl::IngestExternalFile(const IngestExternalFileOptions& options,
+                                  const std::string& file) {
+  /**
+   * 文件的key范围与DB中任何数据都不重叠且没有snapshot时，保留文件中的
+   * sequence 0，直接放到最底层（move或copy，不重写）；否则分配一个新的
+   * sequence，重写文件中的key后放到不与之重叠的最低层。
+   * move或copy在进入writer队列之前完成，队列中只做选层、分配sequence
+   * （需要时重写）和LogAndApply。
+   */
+  uint64_t file_size = 0;
+  RandomAccessFile* rfile = nullptr;
+  Table* table = nullptr;
+  InternalKey smallest, largest;
+  Status s = env_->GetFileSize(file, &file_size);
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(file, &rfile);
+  }
+  if (s.ok()) {
+    s = Table::Open(options_, rfile, file_size, &table);
+  }
+  if (s.ok()) {
+    s = GetExternalFileRange(file, table, &smallest, &largest);
+  }
+  delete table;
+  delete rfile;
+  if (!s.ok()) {
+    return s;
+  }
+  const Slice smallest_user_key = smallest.user_key();
+  const Slice largest_user_key = largest.user_key();
+
+  // Bring the file into the DB directory before taking the writer queue,
+  // so that writes are not held up by the copy.
+  FileMetaData meta;
+  meta.file_size = file_size;
+  meta.smallest = smallest;
+  meta.largest = largest;
+  mutex_.Lock();
+  meta.number = versions_->NewFileNumber();
+  pending_outputs_.insert(meta.number);
+  mutex_.Unlock();
+  const std::string fname = TableFileName(dbname_, meta.number);
+  const bool moved = options.move_files && env_->RenameFile(file, fname).ok();
+  if (!moved) {
+    s = CopyFile(env_, file, fname);
+  }
+  if (s.ok()) {
+    // Verify that the table is usable
+    Iterator* it = table_cache_->NewIterator(ReadOptions(), meta.number,
+                                             meta.file_size);
+    s = it->status();
+    delete it;
+  }
+
+  DBImpl* const db = log_owner();
+  Writer w(&mutex_);
+  MutexLock l(&mutex_);
+  int level = (options_.compaction_style == kCompactionStyleLevel)
+                  ? options_.num_levels - 1
+                  : 0;
+  SequenceNumber sequence = 0;
+  FileMetaData rewritten;  // The copy with sequence set, if one is assigned
+  rewritten.number = 0;
+  if (s.ok()) {
+    // Take the front of the writer queue so that no write is ordered
+    // between the sequence number of the file and its installation.
+    db->writers_.push_back(&w);
+    while (&w != db->writers_.front()) {
+      w.cv.Wait();
+    }
+
+    // The memtables are read before any file, so overlapping entries in
+    // them must be flushed first.
+    s = bg_error_;
+    if (s.ok() && MemTableOverlaps(mem_, user_comparator(),
+                                   &smallest_user_key, &largest_user_key)) {
+      s = MakeRoomForWrite(true /* force memtable switch */);
+    }
+    while (s.ok() && !imm_.empty()) {
+      background_work_finished_signal_.Wait();
+      s = bg_error_;
+    }
+    // A running compaction could write files that overlap the new file at
+    // the level picked for it.
+    ingesting_file_ = true;
+    while (s.ok() && background_compaction_scheduled_) {
+      background_work_finished_signal_.Wait();
+      s = bg_error_;
+    }
+
+    // Place the file above the first level it overlaps, or at the bottom
+    // level if it overlaps none.  Files that overlap nothing keep sequence
+    // number zero unless a snapshot must not see them.
+    if (s.ok()) {
+      Version* base = versions_->current();
+      bool overlap = false;
+      for (int i = 0; i < options_.num_levels && !overlap; i++) {
+        if (base->OverlapInLevel(i, &smallest_user_key, &largest_user_key)) {
+          overlap = true;
+          level = std::min(level, std::max(i - 1, 0));
+        }
+      }
+      if (overlap || !db->snapshots_.empty()) {
+        sequence = db->versions_->LastSequence() + 1;
+      }
+    }
+
+    if (s.ok() && sequence != 0) {
+      rewritten.number = versions_->NewFileNumber();
+      pending_outputs_.insert(rewritten.number);
+      mutex_.Unlock();
+      Iterator* iter = new SequenceAssigningIterator(
+          table_cache_->NewIterator(ReadOptions(), meta.number,
+                                    meta.file_size),
+          sequence);
+      s = BuildTable(dbname_, env_, options_, table_cache_, iter, nullptr,
+                     &rewritten);
+      delete iter;
+      mutex_.Lock();
+    }
+
+    if (s.ok()) {
+      if (sequence != 0) {
+        db->versions_->SetLastSequence(sequence);
+        for (ColumnFamilyHandleImpl* family : db->families_) {
+          family->family()->versions_->SetLastSequence(sequence);
+        }
+      }
+      FileMetaData* const installed = (sequence != 0) ? &rewritten : &meta;
+      versions_->SetNewFileStats(installed);
+      VersionEdit edit;
+      edit.AddFile(level, *installed);
+      s = versions_->LogAndApply(&edit, &mutex_);
+    }
+
+    ingesting_file_ = false;
+    MaybeScheduleCompaction();
+    db->writers_.pop_front();
+    if (!db->writers_.empty()) {
+      db->writers_.front()->cv.Signal();
+    }
+  }
+
+  pending_outputs_.erase(meta.number);
+  if (rewritten.number != 0) {
+    pending_outputs_.erase(rewritten.number);
+    if (!s.ok()) {
+      env_->RemoveFile(TableFileName(dbname_, rewritten.number));
+    }
+  }
+  if (!s.ok() || sequence != 0) {
+    // The copy was not installed.
+    table_cache_->Evict(meta.number);
+    if (!s.ok() && moved) {
+      env_->RenameFile(fname, file);
+    } else {
+      env_->RemoveFile(fname);
+    }
+  }
+  Log(options_.info_log, "Ingested %s as #%llu at level %d, sequence %llu: %s",
+      file.c_str(),
+      static_cast<unsigned long long>((sequence != 0) ? rewritten.number
+                                                      : meta.number),
+      level, static_cast<unsigned long long>(sequence), s.ToString().c_str());
+  return s;
+}
+
+Status DBImpl::IngestExternalFile(ColumnFamilyHandle* column_family,
+                                  const IngestExternalFileOptions& options,
+                                  const std::string& file) {
+  if (column_family == nullptr) {
+    return IngestExternalFile(options, file);
+  }
+  return ColumnFamilyOf(column_family)->IngestExternalFile(options, file);
+}
+
+Status DBImpl::WaitForMemTableCompactions() {
+  mutex_.AssertHeld();
+  std::vector<DBImpl*> dbs(1, this);
+  for (ColumnFamilyHandleImpl* family : families_) {
+    dbs.push_back(family->family());
+  }
+  for (DBImpl* db : dbs) {
+    while (!db->imm_.empty() && db->bg_error_.ok()) {
+      db->background_work_finished_signal_.Wait();
+    }
+    if (!db->bg_error_.ok()) {
+      return db->bg_error_;
+    }
+  }
+  return Status::OK();
+}
+
+Status DBImpl::GetLiveFiles(std::vector<LiveFiles>* live) {
+  /**
+   * S1 取得writer队列的队首，flush所有memtable（包括column family），
+   *    这样这些文件不需要任何log
+   * S2 Ref当前version，保护其文件不被RemoveObsoleteFiles删除，并生成
+   *    只含当前version的MANIFEST记录，然后放开writer队列
+   * S3 放开锁之后再检查每个table文件的名字是.ldb还是.sst
+   */
+  live->clear();
+  if (owner_ != nullptr) {
+    return Status::NotSupported("live files of a column family");
+  }
+
+  Writer w(&mutex_);
+  mutex_.Lock();
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  // Flush every memtable, so that no log is needed.
+  Status s = WaitForMemTableCompactions();
+  if (s.ok()) {
+    s = NewLogFile();
+  }
+  if (s.ok()) {
+    SwitchStaleMemTables(logfile_number_);
+    s = WaitForMemTableCompactions();
+  }
+
+  std::vector<std::vector<uint64_t>> numbers;  // Table files of each DB
+  if (s.ok()) {
+    // Each column family is a DB in its own directory.
+    std::vector<DBImpl*> dbs(1, this);
+    live->resize(1 + families_.size());
+    numbers.resize(live->size());
+    for (size_t i = 0; i < families_.size(); i++) {
+      dbs.push_back(families_[i]->family());
+      (*live)[i + 1].column_family_id = families_[i]->GetID();
+    }
+    for (size_t i = 0; i < dbs.size(); i++) {
+      LiveFiles* files = &(*live)[i];
+      VersionSet* const versions = dbs[i]->versions_;
+      VersionEdit edit;
+      versions->SaveSnapshot(&edit);
+      edit.EncodeTo(&files->descriptor);
+      files->descriptor_number = versions->ManifestFileNumber();
+      files->dbname = dbs[i]->dbname_;
+      Version* const version = versions->current();
+      version->Ref();
+      files->pinned = version;
+
+      std::vector<FileMetaData*> metas;
+      for (int level = 0; level < versions->NumLevels(); level++) {
+        version->GetOverlappingInputs(level, nullptr, nullptr, &metas);
+        for (const FileMetaData* meta : metas) {
+          numbers[i].push_back(meta->number);
+        }
+      }
+    }
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  mutex_.Unlock();
+
+  // The referenced versions keep the table files in place, so look up
+  // their names without holding up other threads.
+  for (size_t i = 0; i < numbers.size(); i++) {
+    LiveFiles* files = &(*live)[i];
+    for (uint64_t number : numbers[i]) {
+      std::string fname = TableFileName(files->dbname, number);
+      if (!env_->FileExists(fname)) {
+        fname = SSTTableFileName(files->dbname, number);
+      }
+      files->table_files.push_back(fname.substr(files->dbname.size() + 1));
+    }
+  }
+  return s;
+}
+
+void DBImpl::ReleaseLiveFiles(std::vector<LiveFiles>* live) {
+  MutexLock l(&mutex_);
+  for (LiveFiles& files : *live) {
+    static_cast<Version*>(files.pinned)->Unref();
+  }
+  live->clear();
+}
+
+Status DBImpl::CreateCheckpoint(const std::string& checkpoint_dir) {
+  /**
+   * 在临时目录中硬链接（不支持时copy）live文件，写MANIFEST和CURRENT，
+   * 最后rename成checkpoint_dir
+   */
+  if (env_->FileExists(checkpoint_dir)) {
+    return Status::InvalidArgument(checkpoint_dir, "exists");
+  }
+  std::vector<LiveFiles> live;
+  Status s = GetLiveFiles(&live);
+  if (!s.ok()) {
+    return s;
+  }
+
+  const std::string tmp_dir = checkpoint_dir + ".tmp";
+  s = env_->CreateDir(tmp_dir);
+  for (size_t i = 0; s.ok() && i < live.size(); i++) {
+    const LiveFiles& files = live[i];
+    std::string dir = tmp_dir;
+    if (files.column_family_id != 0) {
+      dir = ColumnFamilyDirName(tmp_dir, files.column_family_id);
+      s = env_->CreateDir(dir);
+    }
+    for (size_t j = 0; s.ok() && j < files.table_files.size(); j++) {
+      const std::string src = files.dbname + "/" + files.table_files[j];
+      const std::string dst = dir + "/" + files.table_files[j];
+      s = env_->LinkFile(src, dst);
+      if (!s.ok()) {
+        // Fall back to a copy, e.g. if the Env does not support links
+        // or the checkpoint is on another file system.
+        s = CopyFile(env_, src, dst);
+      }
+    }
+    if (s.ok()) {
+      s = WriteDescriptor(env_, dir, files.descriptor_number,
+                          files.descriptor);
+    }
+  }
+  if (s.ok()) {
+    s = env_->RenameFile(tmp_dir, checkpoint_dir);
+  }
+  if (!s.ok()) {
+    // Also removes the directories of the column families and the links
+    // in them.
+    DestroyDB(tmp_dir, options_);
+  }
+  Log(options_.info_log, "Checkpoint %s: %s", checkpoint_dir.c_str(),
+      s.ToString().c_str());
+
+  ReleaseLiveFiles(&live);
+  return s;
+}
+
 // Default implementations of convenience methods that subclasses of DB
 // can call if they wish
 Status DB::Put(const WriteOptions& opt, const Slice& key, const Slice& value) {
@@ -1656,19 +3393,147 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin_key,
+                       const Slice& end_key) {
+  WriteBatch batch;
+  batch.DeleteRange(begin_key, end_key);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::CreateColumnFamily(const Options& options, const std::string& name,
+                              ColumnFamilyHandle** handle) {
+  *handle = nullptr;
+  return Status::NotSupported("CreateColumnFamily");
+}
+
+Status DB::Put(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+               const Slice& key, const Slice& value) {
+  WriteBatch batch;
+  batch.Put(column_family, key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Delete(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+                  const Slice& key) {
+  WriteBatch batch;
+  batch.Delete(column_family, key);
+  return Write(opt, &batch);
+}
+
+Status DB::Get(const ReadOptions& options, ColumnFamilyHandle* column_family,
+               const Slice& key, std::string* value) {
+  if (column_family == nullptr) {
+    return Get(options, key, value);
+  }
+  return Status::NotSupported("column families");
+}
+
+Iterator* DB::NewIterator(const ReadOptions& options,
+                          ColumnFamilyHandle* column_family) {
+  if (column_family == nullptr) {
+    return NewIterator(options);
+  }
+  return NewErrorIterator(Status::NotSupported("column families"));
+}
+
+bool DB::GetProperty(ColumnFamilyHandle* column_family, const Slice& property,
+                     std::string* value) {
+  return (column_family == nullptr) && GetProperty(property, value);
+}
+
+void DB::CompactRange(ColumnFamilyHandle* column_family, const Slice* begin,
+                      const Slice* end) {
+  if (column_family == nullptr) {
+    CompactRange(begin, end);
+  }
+}
+
+Status DB::CompactRange(const CompactRangeOptions& options,
+                        const Slice* begin, const Slice* end) {
+  return Status::NotSupported("CompactRange with options");
+}
+
+Status DB::Flush(const FlushOptions& options) {
+  return Status::NotSupported("Flush");
+}
+
+Status DB::CompactRange(const CompactRangeOptions& options,
+                        ColumnFamilyHandle* column_family, const Slice* begin,
+                        const Slice* end) {
+  if (column_family == nullptr) {
+    return CompactRange(options, begin, end);
+  }
+  return Status::NotSupported("column families");
+}
+
+Status DB::Flush(const FlushOptions& options,
+                 ColumnFamilyHandle* column_family) {
+  if (column_family == nullptr) {
+    return Flush(options);
+  }
+  return Status::NotSupported("column families");
+}
+
+Status DB::IngestExternalFile(const IngestExternalFileOptions& options,
+                              const std::string& file) {
+  return Status::NotSupported("IngestExternalFile");
+}
+
+Status DB::CreateCheckpoint(const std::string& checkpoint_dir) {
+  return Status::NotSupported("CreateCheckpoint");
+}
+
+Status DB::GetLiveFiles(std::vector<LiveFiles>* live) {
+  live->clear();
+  return Status::NotSupported("GetLiveFiles");
+}
+
+void DB::ReleaseLiveFiles(std::vector<LiveFiles>* live) { live->clear(); }
+
+Status DB::IngestExternalFile(ColumnFamilyHandle* column_family,
+                              const IngestExternalFileOptions& options,
+                              const std::string& file) {
+  if (column_family == nullptr) {
+    return IngestExternalFile(options, file);
+  }
+  return Status::NotSupported("column families");
+}
+
 DB::~DB() = default;
+
+ColumnFamilyHandle::~ColumnFamilyHandle() = default;
 /**
  * 打开文件
  */
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
+  std::vector<ColumnFamilyHandle*> handles;
+  return Open(options, dbname, std::vector<ColumnFamilyDescriptor>(),
+              &handles, dbptr);
+}
+
+Status DB::Open(const Options& options, const std::string& dbname,
+                const std::vector<ColumnFamilyDescriptor>& column_families,
+                std::vector<ColumnFamilyHandle*>* handles, DB** dbptr) {
   *dbptr = nullptr;
+  handles->clear();
+  if (options.enable_ttl && options.merge_operator != nullptr) {
+    return Status::InvalidArgument(
+        dbname, "merge_operator does not support enable_ttl");
+  }
 
   DBImpl* impl = new DBImpl(options, dbname);
   impl->mutex_.Lock();
   VersionEdit edit;
   // Recover handles create_if_missing, error_if_exists
   bool save_manifest = false;
-  Status s = impl->Recover(&edit, &save_manifest);
+  Status s = impl->Recover(&edit, &save_manifest, column_families);
   if (s.ok() && impl->mem_ == nullptr) {
     // Create new log and a corresponding memtable.
     /**
@@ -1684,7 +3549,8 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->mem_ =
+          new MemTable(impl->internal_comparator_, impl->options_);
       impl->mem_->Ref();
     }
     // 新建logfile成功
@@ -1699,11 +3565,25 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   if (s.ok()) {
     // 如果VersionSet::LogAndApply返回成功，则删除过期文件，检查是否需要执行compaction，最终返回创建的DBImpl对象。
     impl->RemoveObsoleteFiles();
+    impl->LogUserObjects();
     impl->MaybeScheduleCompaction();
+    impl->MaybeStartAgeTimer();
+    for (ColumnFamilyHandleImpl* family : impl->families_) {
+      family->family()->LogUserObjects();
+      family->family()->MaybeScheduleCompaction();
+      family->family()->MaybeStartAgeTimer();
+    }
   }
   impl->mutex_.Unlock();
   if (s.ok()) {
     assert(impl->mem_ != nullptr);
+    for (const ColumnFamilyDescriptor& descriptor : column_families) {
+      for (ColumnFamilyHandleImpl* family : impl->families_) {
+        if (family->GetName() == descriptor.name) {
+          handles->push_back(family);
+        }
+      }
+    }
     *dbptr = impl;
   } else {
     delete impl;
@@ -1742,7 +3622,9 @@ Status DestroyDB(const std::string& dbname, const Options& options) {
     for (size_t i = 0; i < filenames.size(); i++) {
       if (ParseFileName(filenames[i], &number, &type) && type != kDBLockFile) {
         // Lock file will be deleted at end
-        Status del = env->RemoveFile(dbname + "/" + filenames[i]);
+        Status del = (type == kColumnFamilyDir)
+                         ? DestroyDB(dbname + "/" + filenames[i], options)
+                         : env->RemoveFile(dbname + "/" + filenames[i]);
         if (result.ok() && !del.ok()) {
           // 删除除了lock之外的leveldb文件吗？
           // 话说levedldb使用哪些文件
@@ -1757,4 +3639,29 @@ Status DestroyDB(const std::string& dbname, const Options& options) {
   return result;
 }
 
+Status WriteDescriptor(Env* env, const std::string& dbname,
+                       uint64_t descriptor_number, const Slice& record) {
+  const std::string fname = DescriptorFileName(dbname, descriptor_number);
+  WritableFile* file;
+  Status s = env->NewWritableFile(fname, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  log::Writer log(file);
+  s = log.AddRecord(record);
+  if (s.ok()) {
+    s = file->Sync();
+  }
+  if (s.ok()) {
+    s = file->Close();
+  }
+  delete file;
+  if (s.ok()) {
+    s = SetCurrentFile(env, dbname, descriptor_number);
+  } else {
+    env->RemoveFile(fname);
+  }
+  return s;
+}
+
 }  // namespace leveldb
@@ -8,10 +8,12 @@
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include <atomic>
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "leveldb/db.h"
 #include "leveldb/env.h"
@@ -22,14 +24,20 @@
 namespace leveldb {
 
 class MemTable;
+class RangeTombstoneSet;
 class TableCache;
 class Version;
 class VersionEdit;
 class VersionSet;
+class ColumnFamilyHandleImpl;
 
 class DBImpl : public DB {
  public:
-  DBImpl(const Options& options, const std::string& dbname);
+  // A non-null "owner" makes this DB a column family of "owner": it keeps
+  // its own memtables, files and options but writes through the log,
+  // writer queue and mutex of "owner" and shares its snapshots.
+  DBImpl(const Options& options, const std::string& dbname,
+         DBImpl* owner = nullptr);
 
   DBImpl(const DBImpl&) = delete;
   DBImpl& operator=(const DBImpl&) = delete;
@@ -49,6 +57,36 @@ class DBImpl : public DB {
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
+  Status CompactRange(const CompactRangeOptions& options, const Slice* begin,
+                      const Slice* end) override;
+  Status Flush(const FlushOptions& options) override;
+  Status CreateColumnFamily(const Options& options, const std::string& name,
+                            ColumnFamilyHandle** handle) override;
+  Status Put(const WriteOptions& options, ColumnFamilyHandle* column_family,
+             const Slice& key, const Slice& value) override;
+  Status Delete(const WriteOptions& options, ColumnFamilyHandle* column_family,
+                const Slice& key) override;
+  Status Get(const ReadOptions& options, ColumnFamilyHandle* column_family,
+             const Slice& key, std::string* value) override;
+  Iterator* NewIterator(const ReadOptions& options,
+                        ColumnFamilyHandle* column_family) override;
+  bool GetProperty(ColumnFamilyHandle* column_family, const Slice& property,
+                   std::string* value) override;
+  void CompactRange(ColumnFamilyHandle* column_family, const Slice* begin,
+                    const Slice* end) override;
+  Status CompactRange(const CompactRangeOptions& options,
+                      ColumnFamilyHandle* column_family, const Slice* begin,
+                      const Slice* end) override;
+  Status Flush(const FlushOptions& options,
+               ColumnFamilyHandle* column_family) override;
+  Status IngestExternalFile(const IngestExternalFileOptions& options,
+                            const std::string& file) override;
+  Status CreateCheckpoint(const std::string& checkpoint_dir) override;
+  Status GetLiveFiles(std::vector<LiveFiles>* live) override;
+  void ReleaseLiveFiles(std::vector<LiveFiles>* live) override;
+  Status IngestExternalFile(ColumnFamilyHandle* column_family,
+                            const IngestExternalFileOptions& options,
+                            const std::string& file) override;
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -72,6 +110,12 @@ class DBImpl : public DB {
   // bytes.
   void RecordReadSample(Slice key);
 
+  // Record that an iterator skipped config::kIterHiddenEntriesTrigger
+  // consecutive hidden entries, whose sequence numbers are at most
+  // "max_sequence".  "key" is the internal key of the last deletion marker
+  // among them, or of the last entry if there was none.
+  void RecordHiddenEntries(Slice key, SequenceNumber max_sequence);
+
  private:
   friend class DB;
   struct CompactionState;
@@ -80,6 +124,7 @@ class DBImpl : public DB {
   // Information for a manual compaction
   struct ManualCompaction {
     int level;
+    bool in_place;  // Rewrite the files of "level" into "level"
     bool done;
     const InternalKey* begin;  // null means beginning of key range
     const InternalKey* end;    // null means end of key range
@@ -102,18 +147,62 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
+  // Reasons for writes to be slowed down or to wait.
+  enum WriteStallCause {
+    kStallLevel0Slowdown,
+    kStallPendingCompactionBytesSlowdown,
+    kStallMemTableLimit,
+    kStallLevel0Stop,
+    kStallPendingCompactionBytesStop,
+    kNumWriteStallCauses
+  };
+
+  struct WriteStallStats {
+    WriteStallStats() : count(0), micros(0) {}
+
+    int64_t count;
+    int64_t micros;
+  };
+
+  // If "tombstones" is non-null, the range tombstones of the same
+  // memtables and files are added to it.
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeTombstoneSet* tombstones = nullptr);
 
   Status NewDB();
 
   // Recover the descriptor from persistent storage.  May do a significant
   // amount of work to recover recently logged updates.  Any changes to
-  // be made to the descriptor are added to *edit.
-  Status Recover(VersionEdit* edit, bool* save_manifest)
+  // be made to the descriptor are added to *edit.  The recorded column
+  // families are opened with the options in "column_families", which must
+  // list all of them; listed column families that do not exist are
+  // created.  Column families only recover their descriptor.
+  Status Recover(VersionEdit* edit, bool* save_manifest,
+                 const std::vector<ColumnFamilyDescriptor>& column_families)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  Status OpenColumnFamilies(
+      const std::vector<ColumnFamilyDescriptor>& column_families,
+      VersionEdit* edit, bool* save_manifest) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Open the column family "name" with the given id, creating it if
+  // "create" is set, and add it to families_.
+  Status OpenColumnFamily(uint32_t id, const std::string& name,
+                          const Options& options, bool create)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Write the memtable of this column family, filled by log recovery, to a
+  // level-0 table and start a new one.  If "log_number" is non-zero, the
+  // logs before it are no longer needed by this column family.
+  Status FlushRecoveredMemTable(uint64_t log_number)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // The DB whose log and writer queue this DB uses: owner_ for a column
+  // family, else this DB itself.
+  DBImpl* log_owner() { return (owner_ != nullptr) ? owner_ : this; }
+
   void MaybeIgnoreError(Status* s) const;
 
   // Delete any unneeded files and stale in-memory entries.
@@ -130,9 +219,63 @@ class DBImpl : public DB {
 
   Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Write the entries of all of "mems" to a single table.
+  Status WriteLevel0Table(const std::vector<MemTable*>& mems,
+                          VersionEdit* edit, Version* base)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Apply "updates" to this DB and its column families.  A null batch
+  // switches the memtable of "force", this DB or one of its column
+  // families.
+  Status WriteImpl(const WriteOptions& options, WriteBatch* updates,
+                   DBImpl* force);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Set the rate of write_controller_ from the number of level-0 files
+  // and the bytes compactions are behind by.  Returns why writes are
+  // slowed down, or kNumWriteStallCauses if they are not.
+  WriteStallCause UpdateDelayedWriteRate() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Wait for background work to finish, counting the time towards
+  // "cause", and a new stall unless *last_cause is "cause" already.
+  void WaitForBackgroundWork(WriteStallCause cause,
+                             WriteStallCause* last_cause)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // If options_.write_buffer_manager is over its budget, return this DB
+  // or the column family with the largest memtable that can be switched.
+  // Else return nullptr.
+  DBImpl* MemTableOverBudget() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Close the current log and continue in a new one.  Errors closing the
+  // old log are recorded in bg_error_.
+  Status NewLogFile() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Make the memtable immutable and schedule its compaction.
+  void SwitchMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Switch the memtables of this DB and its column families that still
+  // need logs before "log_number" and are not being compacted, so that an
+  // idle column family does not keep old logs alive.
+  void SwitchStaleMemTables(uint64_t log_number)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Oldest log that this DB or one of its column families still needs.
+  uint64_t MinLogNumber() const EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Total size of the logs that are still needed.
+  uint64_t LiveLogSize() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Run a manual compaction of the files in "level" that overlap
+  // [*begin,*end] into "level"+1, or into "level" itself if "in_place".
+  Status RunManualCompaction(int level, const Slice* begin, const Slice* end,
+                             bool in_place);
+
+  // Wait until this DB and its column families have no immutable
+  // memtable, or return the background error that stopped a compaction.
+  Status WaitForMemTableCompactions() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   WriteBatch* BuildBatchGroup(Writer** last_writer)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -141,6 +284,17 @@ class DBImpl : public DB {
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
   void BackgroundCall();
+
+  // Files that reach the age limit of VersionSet::MaxFileAge() need a
+  // compaction even if nothing is written any more.  If there is a limit,
+  // start a thread that schedules one whenever the oldest file is due.
+  void MaybeStartAgeTimer() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Log the names of the user objects in options_ that decide what the
+  // DB stores, so that the info log shows which ones wrote its files.
+  void LogUserObjects() const;
+  static void AgeTimerWork(void* db);
+  void AgeTimerCall();
   void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -148,7 +302,13 @@ class DBImpl : public DB {
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // Finish the current output file.  "next_user_key" is the first user key
+  // of the next output file, or null if this is the last one; range
+  // tombstones are clipped to the key range between the two.
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* next_user_key);
+  void AddRangeTombstonesToOutput(CompactionState* compact,
+                                  const Slice* next_user_key);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -166,6 +326,7 @@ class DBImpl : public DB {
   const bool owns_info_log_;
   const bool owns_cache_;
   const std::string dbname_;
+  DBImpl* const owner_;  // DB of this column family, or null
 
   // table_cache_ provides its own synchronization
   TableCache* const table_cache_;  // Table cache，线程安全的
@@ -173,18 +334,32 @@ class DBImpl : public DB {
   // Lock over the persistent DB state.  Non-null iff successfully acquired.
   FileLock* db_lock_;  // 锁db文件，persistent state，直到leveldb进程结束
 
-  // State below is protected by mutex_
-  port::Mutex mutex_;  // 互斥锁
+  // State below is protected by mutex_, which column families share with
+  // their DB.
+  port::Mutex own_mutex_;
+  port::Mutex& mutex_;  // 互斥锁
   std::atomic<bool> shutting_down_;
   // 在background work结束时激发
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
   MemTable* mem_;
-  MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
-  std::atomic<bool> has_imm_;  // BGthread 用来检查是否是非NULL的imm_
+  // A full memtable waiting to be compacted, with the first log holding
+  // entries newer than it: older logs are no longer needed once it and
+  // the memtables before it are compacted.
+  struct ImmutableMemTable {
+    MemTable* mem;
+    uint64_t log_number;
+  };
+  // Memtables being compacted or waiting for it, oldest first.
+  std::deque<ImmutableMemTable> imm_ GUARDED_BY(mutex_);
+  std::atomic<bool> has_imm_;  // BGthread 用来检查imm_是否非空
   // 这三个是log相关的
   WritableFile* logfile_;  // log文件
   // log文件编号
   uint64_t logfile_number_ GUARDED_BY(mutex_);
+  uint64_t logfile_size_ GUARDED_BY(mutex_);  // Bytes written to logfile_
+  // Numbers and sizes of the closed logs that may still be needed, oldest
+  // first.
+  std::deque<std::pair<uint64_t, uint64_t>> closed_logs_ GUARDED_BY(mutex_);
   // log writer
   log::Writer* log_;
   uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
@@ -195,6 +370,10 @@ class DBImpl : public DB {
   // snapshot列表
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
+  // Column families, indexed by id - 1.  Only changed by the writer at
+  // the front of writers_, so that writers may read it unlocked.
+  std::vector<ColumnFamilyHandleImpl*> families_;
+
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   // 待copact的文件列表，保护以防误删
@@ -202,15 +381,45 @@ class DBImpl : public DB {
   // 是否有后台compaction在调度或者运行?
   // Has a background compaction been scheduled or is running?
   bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Is the thread started by MaybeStartAgeTimer() running?  It waits on
+  // age_timer_signal_ between checks.
+  bool age_timer_running_ GUARDED_BY(mutex_);
+  port::CondVar age_timer_signal_ GUARDED_BY(mutex_);
+  // Set while IngestExternalFile() picks the level of a file and installs
+  // it; no compaction is scheduled meanwhile.
+  bool ingesting_file_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
+  // Number of running CompactRange() calls that hold off automatic
+  // compactions.
+  int exclusive_manual_compactions_ GUARDED_BY(mutex_);
   // 多版本DB文件，又一个庞然大物
   VersionSet* const versions_ GUARDED_BY(mutex_);
   // paranoid mode下是否有后台错误?
   // Have we encountered a background error in paranoid mode?
   Status bg_error_ GUARDED_BY(mutex_);
   // compaction状态
-  CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+  CompactionStats stats_[config::kMaxNumLevels] GUARDED_BY(mutex_);
+
+  // Paces writes while compactions are behind.
+  WriteController write_controller_ GUARDED_BY(mutex_);
+  WriteStallStats stall_stats_[kNumWriteStallCauses] GUARDED_BY(mutex_);
+};
+
+class ColumnFamilyHandleImpl : public ColumnFamilyHandle {
+ public:
+  ColumnFamilyHandleImpl(uint32_t id, const std::string& name, DBImpl* family)
+      : id_(id), name_(name), family_(family) {}
+
+  const std::string& GetName() const override { return name_; }
+  uint32_t GetID() const override { return id_; }
+
+  DBImpl* family() const { return family_; }
+
+ private:
+  const uint32_t id_;
+  const std::string name_;
+  DBImpl* const family_;
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
@@ -220,6 +429,11 @@ Options SanitizeOptions(const std::string& db,
                         const InternalFilterPolicy* ipolicy,
                         const Options& src);
 
+// Write a MANIFEST file with the given number that holds only "record"
+// to the directory dbname, and make CURRENT point to it.
+Status WriteDescriptor(Env* env, const std::string& dbname,
+                       uint64_t descriptor_number, const Slice& record);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_DB_IMPL_H_
@@ -7,6 +7,10 @@
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
+#include <algorithm>
+#include <vector>
 
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -45,34 +49,48 @@ class DBIter : public Iterator {
   //     the exact entry that yields this->key(), this->value()
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
+  // A key whose newest entry is a merge operand is yielded from saved_key_
+  // and saved_value_ in both directions; moving forward, the internal
+  // iterator is then positioned past the operands that were combined.
   enum Direction { kForward, kReverse };
   /**
    * 在调用MergingItertor的系列seek函数后，DBIter
    * 还要处理key的删除标记。否则，遍历时会把已删除的key列举出来。
    */
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, RangeTombstoneSet* tombstones, uint64_t now,
+         const MergeOperator* merge_operator)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
+        tombstones_(tombstones),
+        now_(now),
+        merge_operator_(merge_operator),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        merged_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
 
-  ~DBIter() override { delete iter_; }
+  ~DBIter() override {
+    delete iter_;
+    delete tombstones_;
+  }
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : saved_key_;
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    Slice v =
+        (direction_ == kForward && !merged_) ? iter_->value() : saved_value_;
+    return (now_ != 0) ? StripValueExpiry(v) : v;
   }
   Status status() const override {
     if (status_.ok()) {
@@ -91,8 +109,17 @@ class DBIter : public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  void MergeForward();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Is the value at iter_ deleted by a range tombstone or expired?
+  bool IsHidden(const ParsedInternalKey& ikey) const {
+    return (tombstones_ != nullptr &&
+            tombstones_->ShouldDelete(ikey.user_key, ikey.sequence,
+                                      sequence_)) ||
+           (now_ != 0 && IsExpiredValue(iter_->value(), now_));
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -106,6 +133,32 @@ class DBIter : public Iterator {
     }
   }
 
+  // Entries skipped in a row without being yielded.
+  struct HiddenEntries {
+    HiddenEntries() : count(0), max_sequence(0) {}
+
+    int count;
+    SequenceNumber max_sequence;
+    std::string deletion;  // Internal key of the last deletion marker
+  };
+
+  // Counts the entry "ikey" at iter_ as skipped, and asks for a compaction
+  // once too many entries were skipped in a row.
+  void CountHiddenEntry(const ParsedInternalKey& ikey,
+                        HiddenEntries* hidden) {
+    hidden->max_sequence = std::max(hidden->max_sequence, ikey.sequence);
+    if (ikey.type == kTypeDeletion) {
+      SaveKey(iter_->key(), &hidden->deletion);
+    }
+    if (++hidden->count == config::kIterHiddenEntriesTrigger) {
+      // The file that holds the deletion markers is the one to compact.
+      db_->RecordHiddenEntries(
+          hidden->deletion.empty() ? iter_->key() : Slice(hidden->deletion),
+          hidden->max_sequence);
+      *hidden = HiddenEntries();
+    }
+  }
+
   // Picks the number of bytes that can be read until a compaction is scheduled.
   size_t RandomCompactionPeriod() {
     return rnd_.Uniform(2 * config::kReadBytesPeriod);
@@ -114,12 +167,16 @@ class DBIter : public Iterator {
   DBImpl* db_;
   const Comparator* const user_comparator_;
   Iterator* const iter_;
+  RangeTombstoneSet* const tombstones_;  // Null if there are none
+  const uint64_t now_;  // Time used for expiry checks, 0 if disabled
+  const MergeOperator* const merge_operator_;
   SequenceNumber const sequence_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool merged_;  // Current entry was combined from merge operands
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -166,6 +223,14 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // iter_ is already past the merge operands of saved_key_.
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -193,6 +258,7 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(direction_ == kForward);
   // 在进入FindNextUserEntry时，iter_刚好定位在this->key(),
   // this->value()这条记录上
+  HiddenEntries hidden;
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
@@ -209,13 +275,32 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // // 这是一个被删除覆盖的entry，或者user key比指定的key小，跳过
             // Entry hidden
+          } else if (IsHidden(ikey)) {
+            // The older entries for this key are deleted as well.
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
           } else {
             valid_ = true;
             saved_key_.clear();
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else if (IsHidden(ikey)) {
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
+          } else {
+            MergeForward();
+            return;
+          }
+          break;
+        case kTypeRangeDeletion:
+          break;  // Range tombstones are not part of iter_
       }
+      CountHiddenEntry(ikey, &hidden);
     }
     iter_->Next();
   } while (iter_->Valid());
@@ -223,14 +308,58 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+// iter_ is at the newest visible merge operand of its key.  Combine it
+// with the older operands and the value they apply to, leaving iter_ past
+// them.
+void DBIter::MergeForward() {
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  std::vector<std::string> operands;  // Newest first
+  operands.push_back(iter_->value().ToString());
+  std::string base;
+  bool has_base = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey)) {
+      valid_ = false;
+      return;
+    }
+    if (user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (IsHidden(ikey) || ikey.type == kTypeDeletion) {
+      break;  // Older entries are deleted as well
+    }
+    if (ikey.type == kTypeValue) {
+      base.assign(iter_->value().data(), iter_->value().size());
+      has_base = true;
+      break;
+    }
+    operands.push_back(iter_->value().ToString());
+  }
+  Slice base_slice(base);
+  status_ = MergeOperands(merge_operator_, saved_key_,
+                          has_base ? &base_slice : nullptr, operands,
+                          &saved_value_);
+  valid_ = status_.ok();
+  merged_ = valid_;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    if (merged_) {
+      // saved_key_ already holds the key; iter_ is past its operands.
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -256,6 +385,11 @@ void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
   ValueType value_type = kTypeDeletion;
+  // Merge operands seen after the value in saved_value_ (if has_base).
+  std::vector<std::string> operands;  // Oldest first
+  bool has_base = false;
+  // Entries seen so far; all but the ones of the yielded key are hidden.
+  HiddenEntries hidden;
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
@@ -266,13 +400,23 @@ void DBIter::FindPrevUserEntry() {
           // 此时Key()将返回saved_key，saved key非空；
           break;
         }
-        value_type = ikey.type;
+        value_type = ((ikey.type == kTypeValue || ikey.type == kTypeMerge) &&
+                      IsHidden(ikey))
+                         ? kTypeDeletion
+                         : ikey.type;
         // 根据类型，如果是Deletion则清空saved key和saved value
         // 否则，把iter_的user key和value赋给saved key和saved value
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+          operands.clear();
+          has_base = false;
+        } else if (value_type == kTypeMerge) {
+          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          operands.push_back(iter_->value().ToString());
         } else {
+          operands.clear();
+          has_base = true;
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
             std::string empty;
@@ -282,6 +426,7 @@ void DBIter::FindPrevUserEntry() {
           SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
           saved_value_.assign(raw_value.data(), raw_value.size());
         }
+        CountHiddenEntry(ikey, &hidden);
       }
       iter_->Prev();
     } while (iter_->Valid());
@@ -293,6 +438,13 @@ void DBIter::FindPrevUserEntry() {
     saved_key_.clear();
     ClearSavedValue();
     direction_ = kForward;
+  } else if (value_type == kTypeMerge) {
+    std::reverse(operands.begin(), operands.end());
+    Slice base(saved_value_);
+    status_ = MergeOperands(merge_operator_, saved_key_,
+                            has_base ? &base : nullptr, operands,
+                            &saved_value_);
+    valid_ = status_.ok();
   } else {
     valid_ = true;
   }
@@ -300,6 +452,7 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
@@ -315,6 +468,7 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -326,6 +480,7 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
@@ -336,8 +491,10 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed, RangeTombstoneSet* tombstones,
+                        uint64_t now, const MergeOperator* merge_operator) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    tombstones, now, merge_operator);
 }
 
 }  // namespace leveldb
@@ -13,13 +13,21 @@
 namespace leveldb {
 
 class DBImpl;
+class MergeOperator;
+class RangeTombstoneSet;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Entries deleted by one of "*tombstones"
+// are hidden as well.  Takes ownership of "tombstones", which may be null.
+// If "now" is non-zero, values carry an expiry time (see
+// Options::enable_ttl); it is removed from the values returned and values
+// that expired at time "now" are hidden.  Merge operands are combined with
+// "merge_operator" as the iterator reaches their key.
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed, RangeTombstoneSet* tombstones,
+                        uint64_t now, const MergeOperator* merge_operator);
 
 }  // namespace leveldb
 
@@ -0,0 +1,1980 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/db.h"
+
+#include <atomic>
+#include <map>
+
+#include "gtest/gtest.h"
+#include "db/db_impl.h"
+#include "db/filename.h"
+#include "db/log_reader.h"
+#include "db/version_edit.h"
+#include "db/version_set.h"
+#include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
+#include "leveldb/env.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/sst_file_writer.h"
+#include "leveldb/write_batch.h"
+#include "leveldb/write_buffer_manager.h"
+#include "util/logging.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static std::string RandomString(Random* rnd, int len) {
+  std::string r;
+  test::RandomString(rnd, len, &r);
+  return r;
+}
+
+static std::string Key(int i) {
+  char buf[100];
+  std::snprintf(buf, sizeof(buf), "key%06d", i);
+  return std::string(buf);
+}
+
+class DBTest : public testing::Test {
+ public:
+  std::string dbname_;
+  Env* env_;
+  DB* db_;
+
+  Options last_options_;
+
+  DBTest() : env_(Env::Default()), db_(nullptr) {
+    dbname_ = testing::TempDir() + "db_test";
+    DestroyDB(dbname_, Options());
+    Reopen();
+  }
+
+  ~DBTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+  }
+
+  DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+  Options CurrentOptions() {
+    Options options;
+    options.reuse_logs = false;
+    return options;
+  }
+
+  void Reopen(Options* options = nullptr) {
+    ASSERT_LEVELDB_OK(TryReopen(options));
+  }
+
+  void Close() {
+    delete db_;
+    db_ = nullptr;
+  }
+
+  void DestroyAndReopen(Options* options = nullptr) {
+    delete db_;
+    db_ = nullptr;
+    DestroyDB(dbname_, Options());
+    ASSERT_LEVELDB_OK(TryReopen(options));
+  }
+
+  Status TryReopen(Options* options) {
+    delete db_;
+    db_ = nullptr;
+    Options opts;
+    if (options != nullptr) {
+      opts = *options;
+    } else {
+      opts = CurrentOptions();
+      opts.create_if_missing = true;
+    }
+    last_options_ = opts;
+
+    return DB::Open(opts, dbname_, &db_);
+  }
+
+  Status Put(const std::string& k, const std::string& v) {
+    return db_->Put(WriteOptions(), k, v);
+  }
+
+  Status Delete(const std::string& k) { return db_->Delete(WriteOptions(), k); }
+
+  std::string Get(const std::string& k, const Snapshot* snapshot = nullptr) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::string result;
+    Status s = db_->Get(options, k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  std::string Get(ColumnFamilyHandle* column_family, const std::string& k,
+                  const Snapshot* snapshot = nullptr) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::string result;
+    Status s = db_->Get(options, column_family, k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  // Return a string that contains all key,value pairs in order,
+  // formatted like "(k1->v1)(k2->v2)".
+  std::string Contents() {
+    std::vector<std::string> forward;
+    std::string result;
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      std::string s = IterStatus(iter);
+      result.push_back('(');
+      result.append(s);
+      result.push_back(')');
+      forward.push_back(s);
+    }
+
+    // Check reverse iteration results are the reverse of forward results
+    size_t matched = 0;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      EXPECT_LT(matched, forward.size());
+      EXPECT_EQ(IterStatus(iter), forward[forward.size() - matched - 1]);
+      matched++;
+    }
+    EXPECT_EQ(matched, forward.size());
+
+    delete iter;
+    return result;
+  }
+
+  // Return every entry for "user_key" in the DB, newest first, formatted
+  // like "[ v2@5, DEL@4, v1@0 ]".
+  std::string AllEntriesFor(const Slice& user_key) {
+    Iterator* iter = dbfull()->TEST_NewInternalIterator();
+    InternalKey target(user_key, kMaxSequenceNumber, kTypeValue);
+    iter->Seek(target.Encode());
+    std::string result = "[ ";
+    bool first = true;
+    for (; iter->Valid(); iter->Next()) {
+      ParsedInternalKey ikey;
+      if (!ParseInternalKey(iter->key(), &ikey)) {
+        result += "CORRUPTED";
+        break;
+      }
+      if (last_options_.comparator->Compare(ikey.user_key, user_key) != 0) {
+        break;
+      }
+      if (!first) {
+        result += ", ";
+      }
+      first = false;
+      result += (ikey.type == kTypeDeletion) ? "DEL" : iter->value().ToString();
+      result += "@" + NumberToString(ikey.sequence);
+    }
+    result += first ? "]" : " ]";
+    if (!iter->status().ok()) {
+      result = iter->status().ToString();
+    }
+    delete iter;
+    return result;
+  }
+
+  int NumTableFilesAtLevel(int level) {
+    std::string property;
+    EXPECT_TRUE(db_->GetProperty(
+        "leveldb.num-files-at-level" + NumberToString(level), &property));
+    return std::stoi(property);
+  }
+
+  int TotalTableFiles() {
+    int result = 0;
+    for (int level = 0; level < last_options_.num_levels; level++) {
+      result += NumTableFilesAtLevel(level);
+    }
+    return result;
+  }
+
+  // Return spread of files per level
+  std::string FilesPerLevel() {
+    std::string result;
+    int last_non_zero_offset = 0;
+    for (int level = 0; level < last_options_.num_levels; level++) {
+      int f = NumTableFilesAtLevel(level);
+      char buf[100];
+      std::snprintf(buf, sizeof(buf), "%s%d", (level ? "," : ""), f);
+      result += buf;
+      if (f > 0) {
+        last_non_zero_offset = result.size();
+      }
+    }
+    result.resize(last_non_zero_offset);
+    return result;
+  }
+
+  uint64_t Size(const Slice& start, const Slice& limit) {
+    Range r(start, limit);
+    uint64_t size;
+    db_->GetApproximateSizes(&r, 1, &size);
+    return size;
+  }
+
+  std::string IterStatus(Iterator* iter) {
+    std::string result;
+    if (iter->Valid()) {
+      result = iter->key().ToString() + "->" + iter->value().ToString();
+    } else {
+      result = "(invalid)";
+    }
+    return result;
+  }
+};
+
+TEST_F(DBTest, Empty) {
+  ASSERT_TRUE(db_ != nullptr);
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+}
+
+TEST_F(DBTest, ConfigurableNumLevels) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.num_levels = 3;
+  DestroyAndReopen(&options);
+
+  std::string value;
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-files-at-level2", &value));
+  ASSERT_FALSE(db_->GetProperty("leveldb.num-files-at-level3", &value));
+
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("z", "vz"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // Fewer levels than the existing layout needs is rejected.
+  options.num_levels = 2;
+  Status s = TryReopen(&options);
+  ASSERT_TRUE(s.IsInvalidArgument()) << s.ToString();
+
+  options.num_levels = 5;
+  Reopen(&options);
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vz", Get("z"));
+}
+
+TEST_F(DBTest, ConfigurableL0CompactionTrigger) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.level0_file_num_compaction_trigger = 2;
+  DestroyAndReopen(&options);
+
+  // Each flush overlaps the previous ones; the first two are pushed
+  // below level-0 and the rest pile up in level-0.
+  for (int i = 0; i < 4; i++) {
+    ASSERT_LEVELDB_OK(Put("a", "va" + NumberToString(i)));
+    ASSERT_LEVELDB_OK(Put("z", "vz" + NumberToString(i)));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  // Two level-0 files reach the trigger; wait for the compaction.
+  for (int i = 0; i < 100 && NumTableFilesAtLevel(0) > 0; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_EQ("va3", Get("a"));
+  ASSERT_EQ("vz3", Get("z"));
+}
+
+TEST_F(DBTest, SanitizesL0Triggers) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.level0_file_num_compaction_trigger = 6;
+  options.level0_slowdown_writes_trigger = 2;
+  options.level0_stop_writes_trigger = 1;
+  options.max_bytes_for_level_multiplier = 0;
+
+  InternalKeyComparator icmp(options.comparator);
+  Options sanitized = SanitizeOptions(dbname_, &icmp, nullptr, options);
+  ASSERT_EQ(6, sanitized.level0_file_num_compaction_trigger);
+  ASSERT_GE(sanitized.level0_slowdown_writes_trigger,
+            sanitized.level0_file_num_compaction_trigger);
+  ASSERT_GE(sanitized.level0_stop_writes_trigger,
+            sanitized.level0_slowdown_writes_trigger);
+  ASSERT_GE(sanitized.max_bytes_for_level_multiplier, 1.0);
+  if (sanitized.info_log != options.info_log) {
+    delete sanitized.info_log;
+  }
+  if (sanitized.block_cache != options.block_cache) {
+    delete sanitized.block_cache;
+  }
+
+  DestroyAndReopen(&options);
+  Random rnd(301);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 200; i++) {
+    ASSERT_NE("NOT_FOUND", Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, DynamicLevelBytes) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.num_levels = 4;
+  options.write_buffer_size = 100 * 1024;
+  options.max_bytes_for_level_base = 1 << 20;
+  options.level_compaction_dynamic_level_bytes = true;
+  DestroyAndReopen(&options);
+
+  // With an empty last level every target collapses to the base size, so
+  // data is pushed all the way down instead of filling the middle levels.
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 4000; i++) {
+    values.push_back(RandomString(&rnd, 1000));
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  for (int i = 0; i < 500 && NumTableFilesAtLevel(3) == 0; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_GT(NumTableFilesAtLevel(3), 0) << FilesPerLevel();
+
+  Reopen(&options);
+  for (int i = 0; i < 4000; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, UniversalCompaction) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.compaction_style = kCompactionStyleUniversal;
+  options.level0_file_num_compaction_trigger = 3;
+  DestroyAndReopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values(200);
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 200; i++) {
+      values[i] = RandomString(&rnd, 100);
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+    if (round == 5) {
+      // Deletions must not be dropped while older runs still hold the key.
+      for (int i = 0; i < 200; i += 2) {
+        ASSERT_LEVELDB_OK(Delete(Key(i)));
+        values[i] = "NOT_FOUND";
+      }
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    for (int i = 0; i < 100 && NumTableFilesAtLevel(0) >= 3; i++) {
+      env_->SleepForMicroseconds(10000);
+    }
+    ASSERT_LT(NumTableFilesAtLevel(0), 3);
+    // Runs are merged within level-0 rather than pushed down.
+    ASSERT_EQ(NumTableFilesAtLevel(0), TotalTableFiles());
+    for (int i = 0; i < 200; i++) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+  }
+
+  Reopen(&options);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, FIFOCompactionSizeLimit) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.compaction_style = kCompactionStyleFIFO;
+  options.fifo_max_table_files_size = 200 * 1024;
+  DestroyAndReopen(&options);
+
+  // Every round writes a ~50KB file of fresh keys.
+  Random rnd(301);
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(round * 100 + i), RandomString(&rnd, 500)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  for (int i = 0; i < 100 && Size("", Key(1000)) > 200 * 1024; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_LE(Size("", Key(1000)), 200 * 1024);
+  ASSERT_EQ(NumTableFilesAtLevel(0), TotalTableFiles());
+  ASSERT_GT(TotalTableFiles(), 1);
+
+  // The oldest files were deleted, the newest one is intact.
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  for (int i = 900; i < 1000; i++) {
+    ASSERT_NE("NOT_FOUND", Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, FIFOCompactionTTL) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.compaction_style = kCompactionStyleFIFO;
+  options.fifo_ttl_seconds = 1;
+  DestroyAndReopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("old", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, NumTableFilesAtLevel(0));
+  env_->SleepForMicroseconds(2000000);
+
+  // Installing the next flush notices the expired file.
+  ASSERT_LEVELDB_OK(Put("new", "v2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 100 && Get("old") != "NOT_FOUND"; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_EQ("NOT_FOUND", Get("old"));
+  ASSERT_EQ("v2", Get("new"));
+  ASSERT_EQ(1, NumTableFilesAtLevel(0));
+}
+
+TEST_F(DBTest, FIFOCompactionTTLWhileIdle) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.compaction_style = kCompactionStyleFIFO;
+  options.fifo_ttl_seconds = 1;
+  DestroyAndReopen(&options);
+  ASSERT_LEVELDB_OK(Put("old", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, NumTableFilesAtLevel(0));
+
+  // Nothing else is written, yet the file is deleted once it expired.
+  for (int i = 0; i < 400 && NumTableFilesAtLevel(0) > 0; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_EQ("NOT_FOUND", Get("old"));
+}
+
+TEST_F(DBTest, DeletionTriggeredCompaction) {
+  for (double ratio : {0.0, 0.5}) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.deletion_compaction_ratio = ratio;
+    DestroyAndReopen(&options);
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("0,0,1", FilesPerLevel());
+
+    // The deletions stop above the values they delete.  Without a
+    // compaction they would stay there while nothing else is written.
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    if (ratio == 0) {
+      ASSERT_EQ("0,1,1", FilesPerLevel());
+      continue;
+    }
+    for (int i = 0; i < 100 && TotalTableFiles() > 0; i++) {
+      env_->SleepForMicroseconds(10000);
+    }
+    ASSERT_EQ("", FilesPerLevel());
+    ASSERT_EQ("", Contents());
+  }
+}
+
+TEST_F(DBTest, HiddenEntriesTriggerCompaction) {
+  const int kNum = config::kIterHiddenEntriesTrigger + 100;
+  for (bool reverse : {false, true}) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+    for (int i = 0; i < kNum; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    for (int i = 0; i < kNum; i++) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("0,1,1", FilesPerLevel());
+
+    // Skipping over the deletions and the values they hide marks the file
+    // with the deletions for compaction.
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    if (reverse) {
+      iter->SeekToLast();
+    } else {
+      iter->SeekToFirst();
+    }
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    for (int i = 0; i < 100 && TotalTableFiles() > 0; i++) {
+      env_->SleepForMicroseconds(10000);
+    }
+    ASSERT_EQ("", FilesPerLevel());
+  }
+}
+
+TEST_F(DBTest, HiddenEntriesCompactSingleFile) {
+  const int kNum = config::kIterHiddenEntriesTrigger + 1000;
+  // With 3 levels the flushed file is in the last level, where it is
+  // rewritten in place.
+  for (int num_levels : {7, 3}) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.num_levels = num_levels;
+    DestroyAndReopen(&options);
+    for (int i = 0; i < kNum; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+    }
+    for (int i = 0; i < kNum; i++) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("0,0,1", FilesPerLevel());
+
+    // The deletions hide values of the same file, so moving the file down
+    // unchanged would never drop them, even in the last level.
+    for (int scan = 0; scan < num_levels && TotalTableFiles() > 0; scan++) {
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      iter->SeekToFirst();
+      ASSERT_TRUE(!iter->Valid());
+      ASSERT_LEVELDB_OK(iter->status());
+      delete iter;
+      for (int i = 0; i < 100 && TotalTableFiles() > 0; i++) {
+        env_->SleepForMicroseconds(10000);
+      }
+    }
+    ASSERT_EQ("", FilesPerLevel());
+  }
+}
+
+TEST_F(DBTest, HiddenEntriesNotDroppable) {
+  const int kNum = config::kIterHiddenEntriesTrigger + 1000;
+  for (bool snapshot : {false, true}) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.num_levels = 3;
+    DestroyAndReopen(&options);
+    for (int i = 0; i < kNum; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+    }
+    // Either a snapshot keeps the values, or the deletions are still in
+    // the memtable.
+    const Snapshot* s = nullptr;
+    if (snapshot) {
+      s = db_->GetSnapshot();
+    } else {
+      ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    }
+    for (int i = 0; i < kNum; i++) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+    }
+    if (snapshot) {
+      ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    }
+    std::string before;
+    ASSERT_TRUE(db_->GetProperty("leveldb.sstables", &before));
+
+    // Compacting the last level file would drop nothing, so it must not
+    // be rewritten over and over by the scans.
+    for (int scan = 0; scan < 3; scan++) {
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      iter->SeekToFirst();
+      ASSERT_TRUE(!iter->Valid());
+      ASSERT_LEVELDB_OK(iter->status());
+      delete iter;
+      env_->SleepForMicroseconds(100000);
+    }
+    std::string after;
+    ASSERT_TRUE(db_->GetProperty("leveldb.sstables", &after));
+    ASSERT_EQ(before, after);
+    if (s != nullptr) {
+      db_->ReleaseSnapshot(s);
+    }
+  }
+}
+
+TEST_F(DBTest, PeriodicCompaction) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.periodic_compaction_seconds = 1;
+  DestroyAndReopen(&options);
+  ASSERT_LEVELDB_OK(Put("a", "v"));
+  ASSERT_LEVELDB_OK(Delete("b"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  env_->SleepForMicroseconds(2000000);
+
+  // Opening the DB notices the old file, which is rewritten one level
+  // down, dropping the deletion that has nothing left to delete.
+  Reopen(&options);
+  for (int i = 0; i < 100 && NumTableFilesAtLevel(2) > 0; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_EQ(0, NumTableFilesAtLevel(2));
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_EQ("(a->v)", Contents());
+}
+
+TEST_F(DBTest, FileStatsOnlyInManifestWhenUsed) {
+  for (uint64_t seconds : {uint64_t{0}, uint64_t{1000}}) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.periodic_compaction_seconds = seconds;
+    DestroyAndReopen(&options);
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    for (int i = 0; i < 100; i += 2) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    db_->CompactRange(nullptr, nullptr);
+
+    // Older versions of leveldb cannot read the MANIFEST if it records
+    // creation times or entry counts.
+    std::string current;
+    ASSERT_LEVELDB_OK(
+        ReadFileToString(env_, CurrentFileName(dbname_), &current));
+    ASSERT_TRUE(!current.empty() && current.back() == '\n');
+    current.resize(current.size() - 1);
+    SequentialFile* file;
+    ASSERT_LEVELDB_OK(env_->NewSequentialFile(dbname_ + "/" + current, &file));
+    log::Reader reader(file, nullptr, true, 0);
+    Slice record;
+    std::string scratch;
+    std::string edits;
+    while (reader.ReadRecord(&record, &scratch)) {
+      VersionEdit edit;
+      ASSERT_LEVELDB_OK(edit.DecodeFrom(record));
+      edits += edit.DebugString();
+    }
+    delete file;
+    ASSERT_NE(std::string::npos, edits.find("AddFile"));
+    // Creation times follow the largest key as " @<seconds>".
+    bool has_creation_time = false;
+    for (size_t pos = edits.find(" @"); pos != std::string::npos;
+         pos = edits.find(" @", pos + 1)) {
+      has_creation_time |= (edits[pos + 2] != ' ');
+    }
+    ASSERT_EQ(seconds != 0, has_creation_time) << edits;
+    ASSERT_EQ(std::string::npos, edits.find("deletions:")) << edits;
+  }
+}
+
+TEST_F(DBTest, PeriodicCompactionWhileIdle) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.periodic_compaction_seconds = 1;
+  DestroyAndReopen(&options);
+  ASSERT_LEVELDB_OK(Put("a", "v"));
+  ASSERT_LEVELDB_OK(Delete("b"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  std::string before;
+  ASSERT_TRUE(db_->GetProperty("leveldb.sstables", &before));
+
+  // Nothing else is written, yet the file is rewritten once it is old
+  // enough.
+  std::string after = before;
+  for (int i = 0; i < 400 && after == before; i++) {
+    env_->SleepForMicroseconds(10000);
+    ASSERT_TRUE(db_->GetProperty("leveldb.sstables", &after));
+  }
+  ASSERT_NE(before, after);
+  ASSERT_EQ("(a->v)", Contents());
+}
+
+TEST_F(DBTest, LearnedIndex) {
+  // 16-byte big-endian integers.
+  auto key = [](uint64_t i) {
+    std::string result(8, '\0');
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      result.push_back(static_cast<char>(i >> shift));
+    }
+    return result;
+  };
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.learned_index = true;
+  options.block_size = 256;
+  DestroyAndReopen(&options);
+  for (int i = 0; i < 5000; i++) {
+    ASSERT_LEVELDB_OK(Put(key(i), "v" + std::to_string(i)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, TotalTableFiles());
+  for (int i = 0; i < 5000; i++) {
+    ASSERT_EQ("v" + std::to_string(i), Get(key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(key(i) + "x"));
+  }
+  ASSERT_EQ("NOT_FOUND", Get(""));
+  ASSERT_EQ("NOT_FOUND", Get("\xff"));
+}
+
+TEST_F(DBTest, HashSkipListFlushManyBuckets) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.memtable_type = kHashSkipListMemTable;
+  options.memtable_prefix_length = 16;
+  options.memtable_hash_bucket_count = 1 << 16;
+  DestroyAndReopen(&options);
+  // Most keys get a bucket of their own.
+  for (int i = 0; i < 20000; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v" + std::to_string(i)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_GT(TotalTableFiles(), 0);
+  for (int i = 0; i < 20000; i += 97) {
+    ASSERT_EQ("v" + std::to_string(i), Get(Key(i)));
+  }
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(20000, count);
+  delete iter;
+}
+
+TEST_F(DBTest, MemTableTypes) {
+  for (MemTableType type :
+       {kSkipListMemTable, kHashSkipListMemTable, kVectorMemTable}) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.memtable_type = type;
+    options.memtable_prefix_length = 4;
+    DestroyAndReopen(&options);
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "v" + std::to_string(i)));
+    }
+    ASSERT_LEVELDB_OK(Delete(Key(7)));
+    ASSERT_EQ("v5", Get(Key(5)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(7)));
+    ASSERT_LEVELDB_OK(Put(Key(5), "new"));
+    ASSERT_EQ("new", Get(Key(5)));
+
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    ASSERT_EQ(999, count);
+    iter->Seek(Key(500));
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(Key(500), iter->key().ToString());
+    iter->Prev();
+    ASSERT_EQ(Key(499), iter->key().ToString());
+    delete iter;
+
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("new", Get(Key(5)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(7)));
+    Reopen(&options);
+    ASSERT_EQ("v999", Get(Key(999)));
+  }
+}
+
+TEST_F(DBTest, MemTableHugePages) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.memtable_huge_page_size = 2 << 20;
+  options.memtable_numa_node = 0;
+  DestroyAndReopen(&options);
+  const std::string big(100000, 'x');
+  for (int i = 0; i < 200; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), (i % 10 == 0) ? big : Key(i)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ((i % 10 == 0) ? big : Key(i), Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, WriteBufferManager) {
+  WriteBufferManager manager(256 << 10);
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.write_buffer_manager = &manager;
+  options.level0_file_num_compaction_trigger = 100;  // Keep every flush
+  DestroyAndReopen(&options);
+
+  // A second database shares the budget.
+  const std::string other_name = dbname_ + "_other";
+  DestroyDB(other_name, options);
+  DB* other = nullptr;
+  ASSERT_LEVELDB_OK(DB::Open(options, other_name, &other));
+  ASSERT_LEVELDB_OK(other->Put(WriteOptions(), "a", std::string(200000, 'a')));
+  ASSERT_GE(manager.memory_usage(), 200000);
+
+  // The memtables are far below write_buffer_size, but together they are
+  // over budget, so this database flushes.
+  const std::string value(1000, 'x');
+  for (int i = 0; i < 300; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), value));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_GT(TotalTableFiles(), 1);
+  for (int i = 0; i < 300; i++) {
+    ASSERT_EQ(value, Get(Key(i)));
+  }
+
+  delete other;
+  DestroyDB(other_name, options);
+  Close();
+  ASSERT_EQ(0, manager.memory_usage());
+}
+
+// Keeps the background thread of Env::Default() busy until Release().
+class BackgroundBlocker {
+ public:
+  BackgroundBlocker() : blocked_(true), done_(false) {
+    Env::Default()->Schedule(&BackgroundBlocker::Run, this);
+  }
+  ~BackgroundBlocker() { Release(); }
+
+  void Release() {
+    blocked_.store(false, std::memory_order_release);
+    while (!done_.load(std::memory_order_acquire)) {
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+  }
+
+ private:
+  static void Run(void* arg) {
+    BackgroundBlocker* blocker = reinterpret_cast<BackgroundBlocker*>(arg);
+    while (blocker->blocked_.load(std::memory_order_acquire)) {
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+    blocker->done_.store(true, std::memory_order_release);
+  }
+
+  std::atomic<bool> blocked_;
+  std::atomic<bool> done_;
+};
+
+TEST_F(DBTest, ImmutableMemTables) {
+  for (bool merge : {true, false}) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.write_buffer_size = 64 << 10;
+    options.max_write_buffer_number = 5;
+    options.merge_write_buffers = merge;
+    options.level0_file_num_compaction_trigger = 100;  // Keep every flush
+    DestroyAndReopen(&options);
+
+    // While no memtable can be compacted, writes fill several of them
+    // without waiting, and reads see all of them.
+    BackgroundBlocker blocker;
+    const std::string value(1000, 'x');
+    for (int i = 0; i < 150; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), value));
+    }
+    ASSERT_LEVELDB_OK(Delete(Key(0)));
+    FlushOptions flush_options;
+    flush_options.wait = false;
+    ASSERT_LEVELDB_OK(db_->Flush(flush_options));
+    std::string num;
+    ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table", &num));
+    const int num_imm = std::stoi(num);
+    ASSERT_GE(num_imm, 3);
+    ASSERT_LT(num_imm, options.max_write_buffer_number);
+    ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+    for (int i = 1; i < 150; i++) {
+      ASSERT_EQ(value, Get(Key(i)));
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    ASSERT_EQ(149, count);
+
+    // They are written to a single file unless merging is off.
+    blocker.Release();
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table", &num));
+    ASSERT_EQ("0", num);
+    ASSERT_EQ(merge ? 1 : num_imm, TotalTableFiles());
+
+    Reopen(&options);
+    ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+    for (int i = 1; i < 150; i++) {
+      ASSERT_EQ(value, Get(Key(i)));
+    }
+  }
+}
+
+TEST_F(DBTest, DelayedWrites) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.level0_file_num_compaction_trigger = 2;
+  options.level0_slowdown_writes_trigger = 2;
+  options.level0_stop_writes_trigger = 100;
+  options.delayed_write_rate = 1 << 20;
+  DestroyAndReopen(&options);
+
+  const std::string value(10 << 10, 'x');
+  ASSERT_LEVELDB_OK(Put("a", value));
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-stats", &stats));
+  ASSERT_TRUE(stats.find("Delayed write rate: 0 bytes/s") !=
+              std::string::npos)
+      << stats;
+  // Flushes go to deeper levels until one overlaps with them.
+  while (NumTableFilesAtLevel(0) == 0) {
+    ASSERT_LEVELDB_OK(Put("a", value));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+
+  // Write a second level-0 file, and keep the compaction it triggers
+  // behind "compaction_blocker".
+  ASSERT_LEVELDB_OK(Put("a", value));
+  BackgroundBlocker flush_blocker;
+  FlushOptions flush_options;
+  flush_options.wait = false;
+  ASSERT_LEVELDB_OK(db_->Flush(flush_options));
+  BackgroundBlocker compaction_blocker;
+  flush_blocker.Release();
+  while (NumTableFilesAtLevel(0) < 2) {
+    env_->SleepForMicroseconds(1000);
+  }
+
+  // Writes of 10KB at 1MB/s take about 10ms each.
+  const uint64_t start_micros = env_->NowMicros();
+  for (int i = 0; i < 11; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), value));
+  }
+  ASSERT_GE(env_->NowMicros() - start_micros, 90000);
+  for (int i = 0; i < 11; i++) {
+    ASSERT_EQ(value, Get(Key(i)));
+  }
+
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-stats", &stats));
+  ASSERT_TRUE(stats.find("Delayed write rate: 1048576 bytes/s") !=
+              std::string::npos)
+      << stats;
+  const size_t pos = stats.find("level0-slowdown");
+  ASSERT_TRUE(pos != std::string::npos) << stats;
+  int count;
+  double seconds;
+  ASSERT_EQ(2, std::sscanf(stats.c_str() + pos, "level0-slowdown %d %lf",
+                           &count, &seconds))
+      << stats;
+  ASSERT_GE(count, 9);
+  ASSERT_GE(seconds, 0.08);
+
+  // Once compactions catch up, writes are no longer delayed.
+  compaction_blocker.Release();
+  while (NumTableFilesAtLevel(0) >= 2) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_LEVELDB_OK(Put("b", value));
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-stats", &stats));
+  ASSERT_TRUE(stats.find("Delayed write rate: 0 bytes/s") !=
+              std::string::npos)
+      << stats;
+}
+
+TEST_F(DBTest, EstimatePendingCompactionBytes) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.level0_file_num_compaction_trigger = 2;
+  DestroyAndReopen(&options);
+
+  std::string pending;
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &pending));
+  ASSERT_EQ("0", pending);
+
+  // Flushes go to deeper levels until one overlaps with them.
+  const std::string value(10 << 10, 'x');
+  while (NumTableFilesAtLevel(0) == 0) {
+    ASSERT_LEVELDB_OK(Put("a", value));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &pending));
+  ASSERT_EQ("0", pending);
+
+  // A second level-0 file calls for a compaction of both of them and of
+  // level-1, which "compaction_blocker" holds back.
+  ASSERT_LEVELDB_OK(Put("a", value));
+  BackgroundBlocker flush_blocker;
+  FlushOptions flush_options;
+  flush_options.wait = false;
+  ASSERT_LEVELDB_OK(db_->Flush(flush_options));
+  BackgroundBlocker compaction_blocker;
+  flush_blocker.Release();
+  while (NumTableFilesAtLevel(0) < 2) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &pending));
+  ASSERT_GE(std::stoull(pending), 3 * value.size());
+
+  compaction_blocker.Release();
+  while (NumTableFilesAtLevel(0) > 0) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &pending));
+  ASSERT_EQ("0", pending);
+}
+
+TEST_F(DBTest, ZeroSequenceAtBaseLevel) {
+  // Rewrite the files in the last level as well.
+  CompactRangeOptions compact_options;
+  compact_options.bottommost_level_compaction = kBottommostLevelForce;
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb1"));
+  ASSERT_LEVELDB_OK(Put("b", "vb2"));
+  ASSERT_EQ("[ vb2@3, vb1@2 ]", AllEntriesFor("b"));
+  ASSERT_LEVELDB_OK(db_->CompactRange(compact_options, nullptr, nullptr));
+  ASSERT_EQ("[ va@0 ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ vb2@0 ]", AllEntriesFor("b"));
+
+  // Entries a snapshot must not see keep their sequence numbers, and so
+  // does the deletion that hides "a" from the snapshot.  The deletion of
+  // "z" hides nothing, so it is dropped although it is newer than the
+  // snapshot.
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Delete("a"));
+  ASSERT_LEVELDB_OK(Put("b", "vb3"));
+  ASSERT_LEVELDB_OK(Delete("z"));
+  ASSERT_LEVELDB_OK(db_->CompactRange(compact_options, nullptr, nullptr));
+  ASSERT_EQ("[ DEL@4, va@0 ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ vb3@5, vb2@0 ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ ]", AllEntriesFor("z"));
+  ASSERT_EQ("va", Get("a", snapshot));
+  ASSERT_EQ("vb2", Get("b", snapshot));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("vb3", Get("b"));
+
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_LEVELDB_OK(db_->CompactRange(compact_options, nullptr, nullptr));
+  ASSERT_EQ("[ ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ vb3@0 ]", AllEntriesFor("b"));
+
+  // A value under an older range tombstone keeps its sequence number,
+  // which keeps it out of the tombstone's reach.
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "c", "e"));
+  ASSERT_LEVELDB_OK(Put("d", "vd"));
+  ASSERT_LEVELDB_OK(db_->CompactRange(compact_options, nullptr, nullptr));
+  ASSERT_EQ("vd", Get("d"));
+  ASSERT_EQ("(b->vb3)(d->vd)", Contents());
+}
+
+TEST_F(DBTest, DeleteRange) {
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  ASSERT_LEVELDB_OK(Put("d", "vd"));
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_EQ("vd", Get("d"));
+  ASSERT_EQ("(a->va)(d->vd)", Contents());
+
+  // Newer writes inside the range are visible again.
+  ASSERT_LEVELDB_OK(Put("c", "vc2"));
+  ASSERT_EQ("vc2", Get("c"));
+  ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("vc2", Get("c"));
+  ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+
+  Reopen();
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+}
+
+TEST_F(DBTest, DeleteRangeAfterIterator) {
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "b"));
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("d", "vd"));
+
+  // Iterators search the memtable tombstones as they are when the key is
+  // reached, but ignore those newer than their snapshot.
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "e"));
+  std::string result;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    result += iter->key().ToString();
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  ASSERT_EQ("bcd", result);
+  ASSERT_EQ("", Contents());
+}
+
+TEST_F(DBTest, DeleteRangeCompaction) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.write_buffer_size = 100 * 1024;
+  DestroyAndReopen(&options);
+
+  Random rnd(301);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 500)));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  const uint64_t initial_size = Size("", Key(1000));
+
+  // Compaction drops the deleted entries.
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), Key(100), Key(500)));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_LT(Size("", Key(1000)), initial_size * 3 / 4);
+  for (int i = 0; i < 1000; i += 50) {
+    ASSERT_EQ(i >= 100 && i < 500, Get(Key(i)) == "NOT_FOUND") << i;
+  }
+
+  // But not those a snapshot can still see.
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), Key(500), Key(900)));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  for (int i = 0; i < 1000; i += 50) {
+    ASSERT_EQ(i >= 100 && i < 900, Get(Key(i)) == "NOT_FOUND") << i;
+    ASSERT_EQ(i >= 100 && i < 500, Get(Key(i), snapshot) == "NOT_FOUND") << i;
+  }
+  db_->ReleaseSnapshot(snapshot);
+
+  int count = 0;
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(200, count);
+
+  Reopen(&options);
+  for (int i = 0; i < 1000; i += 50) {
+    ASSERT_EQ(i >= 100 && i < 900, Get(Key(i)) == "NOT_FOUND") << i;
+  }
+}
+
+TEST_F(DBTest, DeleteRangeRandomized) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.write_buffer_size = 20 * 1024;
+  options.max_file_size = 20 * 1024;
+  DestroyAndReopen(&options);
+
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int step = 0; step < 40000; step++) {
+    const int k = rnd.Uniform(500);
+    if (rnd.OneIn(20)) {
+      const int limit = k + 1 + rnd.Uniform(100);
+      ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), Key(k), Key(limit)));
+      model.erase(model.lower_bound(Key(k)), model.lower_bound(Key(limit)));
+    } else if (rnd.OneIn(5)) {
+      ASSERT_LEVELDB_OK(Delete(Key(k)));
+      model.erase(Key(k));
+    } else {
+      std::string v = RandomString(&rnd, 200);
+      ASSERT_LEVELDB_OK(Put(Key(k), v));
+      model[Key(k)] = v;
+    }
+    if (step % 7000 == 6999) {
+      Reopen(&options);
+    }
+  }
+
+  std::string expected;
+  for (const auto& kv : model) {
+    expected += "(" + kv.first + "->" + kv.second + ")";
+  }
+  ASSERT_EQ(expected, Contents());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(expected, Contents());
+  for (int i = 0; i < 500; i++) {
+    auto it = model.find(Key(i));
+    ASSERT_EQ(it == model.end() ? "NOT_FOUND" : it->second, Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, ValueTTL) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.enable_ttl = true;
+  DestroyAndReopen(&options);
+
+  WriteOptions short_lived;
+  short_lived.ttl_seconds = 1;
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_LEVELDB_OK(db_->Put(short_lived, "b", "vb2"));
+  ASSERT_LEVELDB_OK(db_->Put(short_lived, "c", "vc"));
+  ASSERT_EQ("vb2", Get("b"));
+  ASSERT_EQ("(a->va)(b->vb2)(c->vc)", Contents());
+
+  // The expired value of "b" also hides the older one.
+  env_->SleepForMicroseconds(2000000);
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_EQ("(a->va)", Contents());
+
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("(a->va)", Contents());
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("(a->va)", Contents());
+}
+
+namespace {
+class PrefixCompactionFilter : public CompactionFilter {
+ public:
+  const char* Name() const override { return "PrefixCompactionFilter"; }
+  Decision Filter(int level, const Slice& key, const Slice& existing_value,
+                  std::string* new_value) const override {
+    if (key.starts_with("drop")) {
+      return kRemove;
+    }
+    if (key.starts_with("change")) {
+      *new_value = existing_value.ToString() + "+";
+      return kChangeValue;
+    }
+    return kKeep;
+  }
+};
+}  // namespace
+
+TEST_F(DBTest, CompactionFilter) {
+  PrefixCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.compaction_filter = &filter;
+  DestroyAndReopen(&options);
+  std::string info_log;
+  ASSERT_LEVELDB_OK(
+      ReadFileToString(env_, InfoLogFileName(dbname_), &info_log));
+  ASSERT_NE(std::string::npos, info_log.find("PrefixCompactionFilter"));
+
+  // Files covering the whole key range at the bottom make the next memtable
+  // compactions stop above it, so CompactRange() rewrites their contents.
+  ASSERT_LEVELDB_OK(Put("a", ""));
+  ASSERT_LEVELDB_OK(Put("z", ""));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+
+  ASSERT_LEVELDB_OK(Put("change1", "v"));
+  ASSERT_LEVELDB_OK(Put("drop1", "old"));
+  ASSERT_LEVELDB_OK(Put("keep1", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("(a->)(change1->v+)(keep1->v)(z->)", Contents());
+
+  // Values a snapshot can read are left alone.
+  ASSERT_LEVELDB_OK(Put("drop2", "v"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("v", Get("drop2"));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Removing the newest value hides the older ones.
+  ASSERT_LEVELDB_OK(Put("drop3", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_LEVELDB_OK(Put("drop1", "new"));
+  ASSERT_LEVELDB_OK(Put("drop3", "new"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("NOT_FOUND", Get("drop1"));
+  ASSERT_EQ("NOT_FOUND", Get("drop2"));
+  ASSERT_EQ("NOT_FOUND", Get("drop3"));
+  ASSERT_EQ("(a->)(change1->v+++)(keep1->v)(z->)", Contents());
+}
+
+namespace {
+// Appends the operands to the value, separated by commas.
+class AppendMergeOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "AppendMergeOperator"; }
+  bool FullMerge(const Slice& key, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    new_value->clear();
+    if (existing_value != nullptr) {
+      new_value->assign(existing_value->data(), existing_value->size());
+    }
+    for (const Slice& operand : operands) {
+      if (!new_value->empty()) new_value->push_back(',');
+      new_value->append(operand.data(), operand.size());
+    }
+    return true;
+  }
+};
+}  // namespace
+
+TEST_F(DBTest, Merge) {
+  AppendMergeOperator merge_operator;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.merge_operator = &merge_operator;
+  DestroyAndReopen(&options);
+  std::string info_log;
+  ASSERT_LEVELDB_OK(
+      ReadFileToString(env_, InfoLogFileName(dbname_), &info_log));
+  ASSERT_NE(std::string::npos, info_log.find("AppendMergeOperator"));
+
+  ASSERT_LEVELDB_OK(Put("a", ""));
+  ASSERT_LEVELDB_OK(Put("z", ""));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "k", "1"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "k", "2"));
+  ASSERT_LEVELDB_OK(Put("p", "x"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "p", "y"));
+  ASSERT_EQ("1,2", Get("k"));
+  ASSERT_EQ("x,y", Get("p"));
+  ASSERT_EQ("(a->)(k->1,2)(p->x,y)(z->)", Contents());
+
+  // Operands spread over the memtable and several files.
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "k", "3"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "p", "z"));
+  ASSERT_EQ("1,2,3", Get("k"));
+  ASSERT_EQ("x,y,z", Get("p"));
+  ASSERT_EQ("(a->)(k->1,2,3)(p->x,y,z)(z->)", Contents());
+
+  // Changing direction around a combined entry.
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("k");
+  ASSERT_EQ("k->1,2,3", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("p->x,y,z", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("k->1,2,3", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("p->x,y,z", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("z->", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("p->x,y,z", IterStatus(iter));
+  delete iter;
+
+  // A snapshot keeps reading the operands it saw.
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "k", "4"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("1,2,3", Get("k", snapshot));
+  ASSERT_EQ("1,2,3,4", Get("k"));
+  db_->ReleaseSnapshot(snapshot);
+
+  // A deletion hides the value and operands before it.
+  ASSERT_LEVELDB_OK(Delete("p"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "p", "w"));
+  ASSERT_EQ("w", Get("p"));
+  ASSERT_EQ("(a->)(k->1,2,3,4)(p->w)(z->)", Contents());
+
+  // Compaction combines the operands into plain values, which can be read
+  // without a merge operator.
+  ASSERT_LEVELDB_OK(Put("b", ""));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("(a->)(b->)(k->1,2,3,4)(p->w)(z->)", Contents());
+  options.merge_operator = nullptr;
+  Reopen(&options);
+  ASSERT_EQ("1,2,3,4", Get("k"));
+  ASSERT_EQ("w", Get("p"));
+
+  // Operands cannot be read without a merge operator.
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "k", "5"));
+  std::string value;
+  ASSERT_TRUE(db_->Get(ReadOptions(), "k", &value).IsNotSupportedError());
+}
+
+TEST_F(DBTest, ColumnFamilies) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  ASSERT_LEVELDB_OK(Put("k", "default"));
+  Close();
+
+  std::vector<ColumnFamilyDescriptor> families;
+  families.emplace_back("one", options);
+  Options two_options = options;
+  two_options.write_buffer_size = 100000;
+  families.emplace_back("two", two_options);
+  std::vector<ColumnFamilyHandle*> handles;
+  ASSERT_LEVELDB_OK(DB::Open(options, dbname_, families, &handles, &db_));
+  ASSERT_EQ(2, handles.size());
+  ASSERT_EQ("one", handles[0]->GetName());
+  ASSERT_EQ(1, handles[0]->GetID());
+  ASSERT_EQ("two", handles[1]->GetName());
+  ASSERT_EQ(2, handles[1]->GetID());
+
+  // Each column family has its own keys; one batch updates several.
+  WriteBatch batch;
+  batch.Put(handles[0], "k", "one");
+  batch.Put(handles[1], "k", "two");
+  batch.Delete("k");
+  batch.Put("x", "default");
+  ASSERT_LEVELDB_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_EQ("NOT_FOUND", Get("k"));
+  ASSERT_EQ("one", Get(handles[0], "k"));
+  ASSERT_EQ("two", Get(handles[1], "k"));
+  ASSERT_EQ("NOT_FOUND", Get(handles[0], "x"));
+  ASSERT_EQ("(x->default)", Contents());
+
+  // Snapshots cover all column families.
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), handles[1], "k", "two2"));
+  ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), handles[0], "k"));
+  ASSERT_EQ("two", Get(handles[1], "k", snapshot));
+  ASSERT_EQ("one", Get(handles[0], "k", snapshot));
+  ASSERT_EQ("two2", Get(handles[1], "k"));
+  ASSERT_EQ("NOT_FOUND", Get(handles[0], "k"));
+  db_->ReleaseSnapshot(snapshot);
+  Iterator* iter = db_->NewIterator(ReadOptions(), handles[1]);
+  iter->SeekToFirst();
+  ASSERT_EQ("k->two2", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  delete iter;
+
+  // Enough writes to switch the memtable and the log several times.
+  for (int i = 0; i < 500; i++) {
+    ASSERT_LEVELDB_OK(
+        db_->Put(WriteOptions(), handles[1], Key(i), std::string(1000, 'v')));
+  }
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), handles[0], "a", "one"));
+
+  // Everything is recovered from the shared log and the files of each
+  // column family.
+  Close();
+  ASSERT_LEVELDB_OK(DB::Open(options, dbname_, families, &handles, &db_));
+  ASSERT_EQ("(x->default)", Contents());
+  ASSERT_EQ("one", Get(handles[0], "a"));
+  ASSERT_EQ("NOT_FOUND", Get(handles[0], "k"));
+  ASSERT_EQ("two2", Get(handles[1], "k"));
+  for (int i = 0; i < 500; i++) {
+    ASSERT_EQ(std::string(1000, 'v'), Get(handles[1], Key(i)));
+  }
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty(handles[1], "leveldb.sstables", &property));
+  ASSERT_NE("", property);
+
+  // The recovered logs are no longer needed.
+  std::vector<std::string> filenames;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &filenames));
+  int logs = 0;
+  uint64_t number;
+  FileType type;
+  for (const std::string& filename : filenames) {
+    if (ParseFileName(filename, &number, &type) && type == kLogFile) {
+      logs++;
+    }
+  }
+  ASSERT_EQ(1, logs);
+
+  // Every column family must be opened.
+  Close();
+  ASSERT_TRUE(DB::Open(options, dbname_, &db_).IsInvalidArgument());
+  ASSERT_TRUE(db_ == nullptr);
+  Options ttl_options = options;
+  ttl_options.enable_ttl = true;
+  families[0].options = ttl_options;
+  ASSERT_TRUE(DB::Open(options, dbname_, families, &handles, &db_)
+                  .IsInvalidArgument());
+  families[0].options = options;
+
+  // Column families can be added while the DB is open.
+  ASSERT_LEVELDB_OK(DB::Open(options, dbname_, families, &handles, &db_));
+  ColumnFamilyHandle* three;
+  ASSERT_LEVELDB_OK(db_->CreateColumnFamily(options, "three", &three));
+  ASSERT_EQ(3, three->GetID());
+  ColumnFamilyHandle* duplicate;
+  ASSERT_TRUE(db_->CreateColumnFamily(options, "three", &duplicate)
+                  .IsInvalidArgument());
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), three, "k", "three"));
+  db_->CompactRange(three, nullptr, nullptr);
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), three, "l", "three"));
+  Close();
+  families.emplace_back("three", options);
+  ASSERT_LEVELDB_OK(DB::Open(options, dbname_, families, &handles, &db_));
+  ASSERT_EQ(3, handles.size());
+  ASSERT_EQ("three", Get(handles[2], "k"));
+  ASSERT_EQ("three", Get(handles[2], "l"));
+  ASSERT_EQ("one", Get(handles[0], "a"));
+}
+
+TEST_F(DBTest, IdleColumnFamilyFlushedOverWalLimit) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  for (uint64_t limit : {uint64_t{0}, uint64_t{250000}}) {
+    options.max_total_wal_size = limit;
+    DestroyAndReopen(&options);
+    Options busy_options = options;
+    busy_options.write_buffer_size = 100000;
+    ColumnFamilyHandle* busy;
+    ASSERT_LEVELDB_OK(db_->CreateColumnFamily(busy_options, "busy", &busy));
+    ASSERT_LEVELDB_OK(Put("idle", "v"));
+    // Enough writes to switch the memtable and the log several times.
+    for (int i = 0; i < 500; i++) {
+      ASSERT_LEVELDB_OK(
+          db_->Put(WriteOptions(), busy, Key(i), std::string(1000, 'v')));
+    }
+
+    // The idle memtable is only written out once its logs take too much
+    // space.
+    for (int i = 0; i < 200 && TotalTableFiles() == 0 && limit != 0; i++) {
+      env_->SleepForMicroseconds(10000);
+    }
+    ASSERT_EQ(limit == 0, TotalTableFiles() == 0) << limit;
+    ASSERT_EQ("v", Get("idle"));
+  }
+}
+
+TEST_F(DBTest, CloseWithColumnFamilyFlushes) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  for (int round = 0; round < 5; round++) {
+    DestroyAndReopen(&options);
+    std::vector<ColumnFamilyHandle*> handles(4);
+    for (size_t i = 0; i < handles.size(); i++) {
+      ASSERT_LEVELDB_OK(db_->CreateColumnFamily(
+          options, "family" + NumberToString(i), &handles[i]));
+    }
+    // Close while the families write their memtables, which also
+    // cleans up the files of the other families.
+    FlushOptions flush_options;
+    flush_options.wait = false;
+    for (ColumnFamilyHandle* handle : handles) {
+      ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), handle, "k", "v"));
+      ASSERT_LEVELDB_OK(db_->Flush(flush_options, handle));
+    }
+    Close();
+  }
+}
+
+namespace {
+class UnknownColumnFamily : public ColumnFamilyHandle {
+ public:
+  const std::string& GetName() const override { return name_; }
+  uint32_t GetID() const override { return 5; }
+
+ private:
+  const std::string name_ = "unknown";
+};
+
+
+// Fails the creation of writable files whose names contain "pattern".
+class FailNewWritableFileEnv : public EnvWrapper {
+ public:
+  explicit FailNewWritableFileEnv(const std::string& pattern)
+      : EnvWrapper(Env::Default()), pattern_(pattern) {}
+
+  Status NewWritableFile(const std::string& fname,
+                         WritableFile** result) override {
+    if (fname.find(pattern_) != std::string::npos) {
+      *result = nullptr;
+      return Status::IOError(fname, "injected failure");
+    }
+    return target()->NewWritableFile(fname, result);
+  }
+
+ private:
+  const std::string pattern_;
+};
+}  // namespace
+
+TEST_F(DBTest, FailedColumnFamily) {
+  FailNewWritableFileEnv env(".cf/MANIFEST-");
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.env = &env;
+  DestroyAndReopen(&options);
+  ColumnFamilyHandle* family;
+  ASSERT_TRUE(db_->CreateColumnFamily(options, "family", &family).IsIOError());
+  ASSERT_TRUE(family == nullptr);
+  ASSERT_LEVELDB_OK(Put("a", "v"));
+  ASSERT_EQ("v", Get("a"));
+  Close();
+}
+
+TEST_F(DBTest, UnknownColumnFamily) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  ColumnFamilyHandle* family;
+  ASSERT_LEVELDB_OK(db_->CreateColumnFamily(options, "family", &family));
+
+  // Nothing of a batch for an unknown column family is applied or logged.
+  UnknownColumnFamily unknown;
+  WriteBatch batch;
+  batch.Put("a", "va");
+  batch.Put(family, "b", "vb");
+  batch.Put(&unknown, "c", "vc");
+  ASSERT_TRUE(db_->Write(WriteOptions(), &batch).IsInvalidArgument());
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get(family, "b"));
+
+  Close();
+  std::vector<ColumnFamilyDescriptor> families;
+  families.emplace_back("family", options);
+  std::vector<ColumnFamilyHandle*> handles;
+  ASSERT_LEVELDB_OK(DB::Open(options, dbname_, families, &handles, &db_));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get(handles[0], "b"));
+}
+
+TEST_F(DBTest, StalledColumnFamily) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  Options family_options = options;
+  family_options.write_buffer_size = 64 << 10;
+  family_options.max_write_buffer_number = 2;
+  ColumnFamilyHandle* family;
+  ASSERT_LEVELDB_OK(
+      db_->CreateColumnFamily(family_options, "family", &family));
+
+  // Fill the memtable of the family while its full one cannot be written
+  // out, so that its next write has to wait.
+  BackgroundBlocker blocker;
+  const std::string value(1000, 'x');
+  std::string num = "0";
+  for (int i = 0; num == "0"; i++) {
+    ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), family, Key(i), value));
+    ASSERT_TRUE(db_->GetProperty(family, "leveldb.num-immutable-mem-table",
+                                 &num));
+  }
+  ASSERT_LEVELDB_OK(
+      db_->Put(WriteOptions(), family, "big", std::string(100 << 10, 'x')));
+
+  // Writes to the other column families do not wait for it.
+  ASSERT_LEVELDB_OK(Put("k", "v"));
+  ASSERT_EQ("v", Get("k"));
+  blocker.Release();
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), family, "after", "v"));
+  ASSERT_EQ("v", Get(family, "after"));
+}
+
+TEST_F(DBTest, DelayedColumnFamily) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  Options family_options = options;
+  family_options.level0_file_num_compaction_trigger = 2;
+  family_options.level0_slowdown_writes_trigger = 2;
+  family_options.level0_stop_writes_trigger = 100;
+  family_options.delayed_write_rate = 100 << 10;
+  ColumnFamilyHandle* family;
+  ASSERT_LEVELDB_OK(
+      db_->CreateColumnFamily(family_options, "family", &family));
+  auto family_level0_files = [&]() {
+    std::string property;
+    EXPECT_TRUE(
+        db_->GetProperty(family, "leveldb.num-files-at-level0", &property));
+    return std::stoi(property);
+  };
+
+  // Give the family two level-0 files, and keep the compaction they
+  // trigger behind "compaction_blocker".
+  const std::string value(100 << 10, 'x');
+  while (family_level0_files() == 0) {
+    ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), family, "a", value));
+    ASSERT_LEVELDB_OK(db_->Flush(FlushOptions(), family));
+  }
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), family, "a", value));
+  BackgroundBlocker flush_blocker;
+  FlushOptions flush_options;
+  flush_options.wait = false;
+  ASSERT_LEVELDB_OK(db_->Flush(flush_options, family));
+  BackgroundBlocker compaction_blocker;
+  flush_blocker.Release();
+  while (family_level0_files() < 2) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), family, "b", "v"));
+
+  // Writes to the default column family are not delayed, and do not
+  // count against the rate of the family: 1MB at 100KB/s would take
+  // about 10s.
+  const uint64_t start_micros = env_->NowMicros();
+  for (int i = 0; i < 10; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), value));
+  }
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), family, "c", "v"));
+  ASSERT_LT(env_->NowMicros() - start_micros, 5000000);
+  ASSERT_EQ("v", Get(family, "c"));
+}
+
+TEST_F(DBTest, IngestExternalFile) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  const std::string file = dbname_ + "_external.ldb";
+
+  SstFileWriter writer(options);
+  ASSERT_LEVELDB_OK(writer.Open(file));
+  ASSERT_LEVELDB_OK(writer.Put("a", "va"));
+  ASSERT_LEVELDB_OK(writer.Put("c", "vc"));
+  ASSERT_TRUE(writer.Put("b", "vb").IsInvalidArgument());
+  ASSERT_LEVELDB_OK(writer.Finish());
+  ASSERT_GT(writer.FileSize(), 0);
+
+  // A file that overlaps nothing is moved to the bottom level as is.
+  IngestExternalFileOptions ingest_options;
+  ingest_options.move_files = true;
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(ingest_options, file));
+  ASSERT_TRUE(!env_->FileExists(file));
+  ASSERT_EQ(1, NumTableFilesAtLevel(options.num_levels - 1));
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vc", Get("c"));
+
+  // An overlapping file is newer than the data it overlaps, but not
+  // visible to earlier snapshots.
+  ASSERT_LEVELDB_OK(Put("b", "old"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(writer.Open(file));
+  ASSERT_LEVELDB_OK(writer.Put("b", "new"));
+  ASSERT_LEVELDB_OK(writer.Put("d", "vd"));
+  ASSERT_LEVELDB_OK(writer.Finish());
+  ASSERT_LEVELDB_OK(
+      db_->IngestExternalFile(IngestExternalFileOptions(), file));
+  ASSERT_TRUE(env_->FileExists(file));
+  ASSERT_EQ("new", Get("b"));
+  ASSERT_EQ("vd", Get("d"));
+  ASSERT_EQ("old", Get("b", snapshot));
+  ASSERT_EQ("NOT_FOUND", Get("d", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_EQ("(a->va)(b->new)(c->vc)(d->vd)", Contents());
+
+  // Ingested files are recovered, and later writes are newer.
+  Reopen(&options);
+  ASSERT_EQ("(a->va)(b->new)(c->vc)(d->vd)", Contents());
+  ASSERT_LEVELDB_OK(Put("d", "newer"));
+  ASSERT_EQ("newer", Get("d"));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("(a->va)(b->new)(c->vc)(d->newer)", Contents());
+
+  ASSERT_TRUE(!db_->IngestExternalFile(IngestExternalFileOptions(),
+                                       dbname_ + "_missing.ldb")
+                   .ok());
+  ASSERT_LEVELDB_OK(env_->RemoveFile(file));
+}
+
+TEST_F(DBTest, Flush) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  ColumnFamilyHandle* family;
+  ASSERT_LEVELDB_OK(db_->CreateColumnFamily(options, "family", &family));
+  auto family_files = [&]() {
+    int files = 0;
+    for (int level = 0; level < options.num_levels; level++) {
+      std::string property;
+      EXPECT_TRUE(db_->GetProperty(
+          family, "leveldb.num-files-at-level" + NumberToString(level),
+          &property));
+      files += std::stoi(property);
+    }
+    return files;
+  };
+
+  // An empty memtable is not written.
+  ASSERT_LEVELDB_OK(db_->Flush(FlushOptions()));
+  ASSERT_EQ(0, TotalTableFiles());
+
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), family, "a", "f1"));
+  ASSERT_LEVELDB_OK(db_->Flush(FlushOptions()));
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_EQ(0, family_files());
+  ASSERT_EQ("v1", Get("a"));
+
+  // Without waiting the memtable is written in the background.
+  ASSERT_LEVELDB_OK(Put("b", "v2"));
+  FlushOptions no_wait;
+  no_wait.wait = false;
+  ASSERT_LEVELDB_OK(db_->Flush(no_wait));
+  ASSERT_LEVELDB_OK(db_->Flush(FlushOptions()));
+  ASSERT_EQ(2, TotalTableFiles());
+  ASSERT_EQ("v2", Get("b"));
+
+  ASSERT_LEVELDB_OK(db_->Flush(FlushOptions(), family));
+  ASSERT_EQ(1, family_files());
+  ASSERT_EQ("f1", Get(family, "a"));
+}
+
+TEST_F(DBTest, CompactRangeOptions) {
+  PrefixCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.compaction_filter = &filter;
+  DestroyAndReopen(&options);
+
+  // Memtables without overlapping files are written to level-2.
+  ASSERT_LEVELDB_OK(Put("a", "v"));
+  ASSERT_LEVELDB_OK(Put("drop1", "v"));
+  ASSERT_LEVELDB_OK(Put("z", "v"));
+  ASSERT_LEVELDB_OK(db_->Flush(FlushOptions()));
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // Files of the deepest level are left alone unless asked for.
+  CompactRangeOptions skip;
+  skip.bottommost_level_compaction = kBottommostLevelSkip;
+  ASSERT_LEVELDB_OK(db_->CompactRange(skip, nullptr, nullptr));
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("v", Get("drop1"));
+
+  // The compaction filter runs over the deepest level by default.
+  ASSERT_LEVELDB_OK(db_->CompactRange(CompactRangeOptions(), nullptr, nullptr));
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get("drop1"));
+  ASSERT_EQ("v", Get("a"));
+
+  // The range can be moved to a deeper level ...
+  CompactRangeOptions deep;
+  deep.target_level = 4;
+  ASSERT_LEVELDB_OK(db_->CompactRange(deep, nullptr, nullptr));
+  ASSERT_EQ("0,0,0,0,1", FilesPerLevel());
+
+  // ... and levels below the target level are not compacted.
+  ASSERT_LEVELDB_OK(Put("m", "v"));
+  ASSERT_LEVELDB_OK(db_->Flush(FlushOptions()));
+  ASSERT_EQ("0,0,1,0,1", FilesPerLevel());
+  CompactRangeOptions shallow;
+  shallow.target_level = 3;
+  ASSERT_LEVELDB_OK(db_->CompactRange(shallow, nullptr, nullptr));
+  ASSERT_EQ("0,0,0,1,1", FilesPerLevel());
+  ASSERT_EQ("(a->v)(m->v)(z->v)", Contents());
+
+  CompactRangeOptions invalid;
+  invalid.target_level = options.num_levels;
+  ASSERT_TRUE(
+      db_->CompactRange(invalid, nullptr, nullptr).IsInvalidArgument());
+}
+
+TEST_F(DBTest, Checkpoint) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  const std::string checkpoint_dir = dbname_ + "_checkpoint";
+  DestroyDB(checkpoint_dir, options);
+
+  ColumnFamilyHandle* family;
+  ASSERT_LEVELDB_OK(db_->CreateColumnFamily(options, "family", &family));
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("b", "v1"));
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), family, "c", "v1"));
+  ASSERT_LEVELDB_OK(db_->CreateCheckpoint(checkpoint_dir));
+  ASSERT_TRUE(db_->CreateCheckpoint(checkpoint_dir).IsInvalidArgument());
+
+  // Later changes and compactions of the DB do not affect the checkpoint.
+  ASSERT_LEVELDB_OK(Put("a", "v2"));
+  ASSERT_LEVELDB_OK(Delete("b"));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("(a->v2)", Contents());
+
+  std::vector<ColumnFamilyDescriptor> families;
+  families.emplace_back("family", options);
+  std::vector<ColumnFamilyHandle*> handles;
+  DB* checkpoint = nullptr;
+  ASSERT_LEVELDB_OK(
+      DB::Open(options, checkpoint_dir, families, &handles, &checkpoint));
+  std::string value;
+  ASSERT_LEVELDB_OK(checkpoint->Get(ReadOptions(), "a", &value));
+  ASSERT_EQ("v1", value);
+  ASSERT_LEVELDB_OK(checkpoint->Get(ReadOptions(), "b", &value));
+  ASSERT_EQ("v1", value);
+  ASSERT_LEVELDB_OK(checkpoint->Get(ReadOptions(), handles[0], "c", &value));
+  ASSERT_EQ("v1", value);
+  delete checkpoint;
+  ASSERT_LEVELDB_OK(DestroyDB(checkpoint_dir, options));
+}
+
+TEST_F(DBTest, FailedCheckpointIsRemoved) {
+  const std::string checkpoint_dir = dbname_ + "_checkpoint";
+  FailNewWritableFileEnv env(checkpoint_dir + ".tmp/000001.cf/MANIFEST-");
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.env = &env;
+  DestroyAndReopen(&options);
+  DestroyDB(checkpoint_dir, options);
+
+  ColumnFamilyHandle* family;
+  ASSERT_LEVELDB_OK(db_->CreateColumnFamily(options, "family", &family));
+  ASSERT_LEVELDB_OK(Put("a", "v"));
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), family, "b", "v"));
+  ASSERT_LEVELDB_OK(db_->Flush(FlushOptions()));
+  ASSERT_TRUE(db_->CreateCheckpoint(checkpoint_dir).IsIOError());
+  ASSERT_TRUE(!env_->FileExists(checkpoint_dir));
+  ASSERT_TRUE(!env_->FileExists(checkpoint_dir + ".tmp"));
+  Close();
+}
+
+TEST_F(DBTest, CheckpointDeeperColumnFamily) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.num_levels = 3;
+  DestroyAndReopen(&options);
+  const std::string checkpoint_dir = dbname_ + "_checkpoint";
+  DestroyDB(checkpoint_dir, options);
+
+  // The files of a column family are found on all of its levels, not
+  // only on as many as the DB has.
+  Options family_options = options;
+  family_options.num_levels = 7;
+  ColumnFamilyHandle* family;
+  ASSERT_LEVELDB_OK(
+      db_->CreateColumnFamily(family_options, "family", &family));
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), family, "a", "v1"));
+  CompactRangeOptions compact_options;
+  compact_options.target_level = 6;
+  ASSERT_LEVELDB_OK(
+      db_->CompactRange(compact_options, family, nullptr, nullptr));
+  std::string property;
+  ASSERT_TRUE(
+      db_->GetProperty(family, "leveldb.num-files-at-level6", &property));
+  ASSERT_EQ("1", property);
+  ASSERT_LEVELDB_OK(db_->CreateCheckpoint(checkpoint_dir));
+
+  std::vector<ColumnFamilyDescriptor> families;
+  families.emplace_back("family", family_options);
+  std::vector<ColumnFamilyHandle*> handles;
+  DB* checkpoint = nullptr;
+  ASSERT_LEVELDB_OK(
+      DB::Open(options, checkpoint_dir, families, &handles, &checkpoint));
+  std::string value;
+  ASSERT_LEVELDB_OK(checkpoint->Get(ReadOptions(), handles[0], "a", &value));
+  ASSERT_EQ("v1", value);
+  delete checkpoint;
+  ASSERT_LEVELDB_OK(DestroyDB(checkpoint_dir, options));
+}
+
+}  // namespace leveldb
@@ -19,19 +19,14 @@
 
 namespace leveldb {
 
-// Grouping of constants.  We may want to make some of these
-// parameters set via options.
+// Grouping of constants.  The level count and level-0 triggers are set
+// via Options; the values here are defaults and hard bounds.
 namespace config {
+// Default number of levels.  Options::num_levels overrides this per DB.
 static const int kNumLevels = 7;
 
-// Level-0 compaction is started when we hit this many files.
-static const int kL0_CompactionTrigger = 4;
-
-// Soft limit on number of level-0 files.  We slow down writes at this point.
-static const int kL0_SlowdownWritesTrigger = 8;
-
-// Maximum number of level-0 files.  We stop writes at this point.
-static const int kL0_StopWritesTrigger = 12;
+// Upper bound on Options::num_levels.  Per-level arrays are sized by this.
+static const int kMaxNumLevels = 20;
 
 // Maximum level to which a new compacted memtable is pushed if it
 // does not create overlap.  We try to push to level 2 to avoid the
@@ -44,6 +39,10 @@ static const int kMaxMemCompactLevel = 2;
 // Approximate gap in bytes between samples of data read during iteration.
 static const int kReadBytesPeriod = 1048576;
 
+// Number of consecutive hidden entries (deletion markers and the entries
+// they hide) an iterator skips before it asks for a compaction of them.
+static const int kIterHiddenEntriesTrigger = 4096;
+
 }  // namespace config
 
 class InternalKey;
@@ -51,14 +50,23 @@ class InternalKey;
 // Value types encoded as the last component of internal keys.
 // DO NOT CHANGE THESE ENUM VALUES: they are embedded in the on-disk
 // data structures.
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+enum ValueType {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  // Deletes every user key in [user key, value) written before it.  Kept
+  // apart from point entries, see db/range_del.h.
+  kTypeRangeDeletion = 0x2,
+  // An operand combined with the older values of the key by the
+  // Options::merge_operator.
+  kTypeMerge = 0x3
+};
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeMerge;
 
 typedef uint64_t SequenceNumber;
 
@@ -180,7 +188,27 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<uint8_t>(kTypeValue));
+  return (c <= static_cast<uint8_t>(kTypeMerge));
+}
+
+// If Options::enable_ttl is set, every stored value is followed by its
+// expiry time: a fixed64 number of seconds since the epoch, or 0 if the
+// value never expires.
+static const size_t kValueExpiryLength = 8;
+
+// Return true if "value" (as stored, with its expiry time) has expired
+// at time "now" (seconds since the epoch).
+inline bool IsExpiredValue(const Slice& value, uint64_t now) {
+  if (value.size() < kValueExpiryLength) return false;
+  const uint64_t expiry =
+      DecodeFixed64(value.data() + value.size() - kValueExpiryLength);
+  return expiry != 0 && expiry <= now;
+}
+
+// Return the user value of a stored value by removing its expiry time.
+inline Slice StripValueExpiry(const Slice& value) {
+  if (value.size() < kValueExpiryLength) return value;
+  return Slice(value.data(), value.size() - kValueExpiryLength);
 }
 
 // A helper class useful for DBImpl::Get()
@@ -88,6 +88,28 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     r += "'\n";
     dst_->Append(r);
   }
+  void DeleteRange(const Slice& begin_key, const Slice& end_key) override {
+    std::string r = "  delrange '";
+    AppendEscapedStringTo(&r, begin_key);
+    r += "' '";
+    AppendEscapedStringTo(&r, end_key);
+    r += "'\n";
+    dst_->Append(r);
+  }
+  void Merge(const Slice& key, const Slice& value) override {
+    std::string r = "  merge '";
+    AppendEscapedStringTo(&r, key);
+    r += "' '";
+    AppendEscapedStringTo(&r, value);
+    r += "'\n";
+    dst_->Append(r);
+  }
+  void SetColumnFamily(uint32_t column_family_id) override {
+    std::string r = "  column family ";
+    AppendNumberTo(&r, column_family_id);
+    r += "\n";
+    dst_->Append(r);
+  }
 
   WritableFile* dst_;
 };
@@ -189,6 +211,8 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
         r += "del";
       } else if (key.type == kTypeValue) {
         r += "val";
+      } else if (key.type == kTypeMerge) {
+        r += "merge";
       } else {
         AppendNumberTo(&r, key.type);
       }
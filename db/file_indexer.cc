@@ -0,0 +1,96 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/file_indexer.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+// The first eight bytes of "user_key" as a big-endian number, padded with
+// zeros.  If KeyPrefix(a) < KeyPrefix(b) then a < b in bytewise order.
+static uint64_t KeyPrefix(const Slice& user_key) {
+  uint64_t result = 0;
+  for (size_t i = 0; i < sizeof(result); i++) {
+    result <<= 8;
+    if (i < user_key.size()) {
+      result |= static_cast<uint8_t>(user_key[i]);
+    }
+  }
+  return result;
+}
+
+void FileIndexer::Build(const InternalKeyComparator* icmp,
+                        const std::vector<FileMetaData*>* files,
+                        int num_levels) {
+  icmp_ = icmp;
+  files_ = files;
+  num_levels_ = num_levels;
+  levels_.clear();
+  levels_.resize(num_levels);
+  const bool bytewise = (icmp->user_comparator() == BytewiseComparator());
+  for (int level = 1; level < num_levels; level++) {
+    const std::vector<FileMetaData*>& current = files[level];
+    LevelIndex* index = &levels_[level];
+    if (bytewise) {
+      index->prefixes.reserve(current.size());
+      for (FileMetaData* f : current) {
+        index->prefixes.push_back(KeyPrefix(f->largest.user_key()));
+      }
+    }
+    if (level + 1 < num_levels) {
+      // Both levels are sorted, so one merge pass finds every bound.
+      const std::vector<FileMetaData*>& next = files[level + 1];
+      index->next_level.reserve(current.size());
+      uint32_t j = 0;
+      for (FileMetaData* f : current) {
+        while (j < next.size() &&
+               icmp->Compare(next[j]->largest, f->largest) < 0) {
+          j++;
+        }
+        index->next_level.push_back(j);
+      }
+    }
+  }
+}
+
+uint32_t FileIndexer::FindFile(int level, const Slice& internal_key,
+                               uint32_t left, uint32_t right) const {
+  assert(level > 0 && level < num_levels_);
+  const std::vector<FileMetaData*>& files = files_[level];
+  const std::vector<uint64_t>& prefixes = levels_[level].prefixes;
+  if (!prefixes.empty()) {
+    // Files with a smaller prefix end before the key and files with a
+    // larger one end after it.  Only equal prefixes need a comparison.
+    const uint64_t prefix = KeyPrefix(ExtractUserKey(internal_key));
+    std::vector<uint64_t>::const_iterator first = prefixes.begin();
+    left = std::lower_bound(first + left, first + right, prefix) - first;
+    right = std::upper_bound(first + left, first + right, prefix) - first;
+  }
+  while (left < right) {
+    uint32_t mid = (left + right) / 2;
+    if (icmp_->Compare(files[mid]->largest.Encode(), internal_key) < 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return right;
+}
+
+void FileIndexer::NextLevelBounds(int level, uint32_t index, uint32_t* left,
+                                  uint32_t* right) const {
+  // Files of the next level before the bound of file index - 1 end before
+  // the largest key of that file, so before the key.  The file at the
+  // bound of file index ends at or after the largest key of file index,
+  // so at or after the key.
+  const std::vector<uint32_t>& next = levels_[level].next_level;
+  *left = (index == 0 || next.empty()) ? 0 : next[index - 1];
+  *right = (index < next.size()) ? next[index] : NumFiles(level + 1);
+}
+
+}  // namespace leveldb
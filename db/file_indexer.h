@@ -0,0 +1,79 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A FileIndexer finds the file of a level > 0 that may contain a key
+// faster than a plain binary search over the FileMetaData pointers:
+//
+// (1) With the bytewise comparator, the first eight bytes of the largest
+//     user key of every file are kept in one contiguous array.  Comparing
+//     these integers settles most steps of the search without touching
+//     a FileMetaData or calling the comparator.
+// (2) For every file it records where the file's largest key falls in the
+//     next level.  The position of a key in one level then bounds its
+//     position in the next one (fractional cascading), so the search
+//     there only looks at the files between two neighbouring bounds.
+//
+// A FileIndexer is built once for a Version and is immutable afterwards.
+
+#ifndef STORAGE_LEVELDB_DB_FILE_INDEXER_H_
+#define STORAGE_LEVELDB_DB_FILE_INDEXER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/version_edit.h"
+
+namespace leveldb {
+
+class FileIndexer {
+ public:
+  FileIndexer() : icmp_(nullptr), files_(nullptr), num_levels_(0) {}
+
+  FileIndexer(const FileIndexer&) = delete;
+  FileIndexer& operator=(const FileIndexer&) = delete;
+
+  // Index files[0 .. num_levels-1].  The files of each level > 0 must be
+  // sorted and must not overlap.  "icmp" and "files" must outlive *this.
+  void Build(const InternalKeyComparator* icmp,
+             const std::vector<FileMetaData*>* files, int num_levels);
+
+  // Return the index of the first file in "level" among the files
+  // [left, right) whose largest key is >= "internal_key", or "right" if
+  // there is none.  The result is the same as the one of FindFile() if
+  // the key falls in the bounds.
+  // REQUIRES: level > 0 and Build() was called.
+  uint32_t FindFile(int level, const Slice& internal_key, uint32_t left,
+                    uint32_t right) const;
+
+  // FindFile() returned "index" for a key in "level".  Store in *left and
+  // *right the bounds that FindFile() needs in level + 1 for that key.
+  void NextLevelBounds(int level, uint32_t index, uint32_t* left,
+                       uint32_t* right) const;
+
+  // Number of files in "level", 0 for levels past the last one.
+  uint32_t NumFiles(int level) const {
+    return (level < num_levels_) ? files_[level].size() : 0;
+  }
+
+ private:
+  struct LevelIndex {
+    // Prefixes of the largest user keys of the files.  Empty unless the
+    // user comparator is the bytewise comparator.
+    std::vector<uint64_t> prefixes;
+
+    // next_level[i] is the index of the first file in the next level
+    // whose largest key is >= the largest key of file i.
+    std::vector<uint32_t> next_level;
+  };
+
+  const InternalKeyComparator* icmp_;
+  const std::vector<FileMetaData*>* files_;
+  int num_levels_;
+  std::vector<LevelIndex> levels_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_FILE_INDEXER_H_
@@ -0,0 +1,146 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/file_indexer.h"
+
+#include "gtest/gtest.h"
+#include "db/version_set.h"
+#include "leveldb/comparator.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+namespace {
+// Same order as the bytewise comparator, but not recognized as it.
+class WrappedComparator : public Comparator {
+ public:
+  const char* Name() const override { return "test.WrappedComparator"; }
+  int Compare(const Slice& a, const Slice& b) const override {
+    return BytewiseComparator()->Compare(a, b);
+  }
+  void FindShortestSeparator(std::string* start,
+                             const Slice& limit) const override {}
+  void FindShortSuccessor(std::string* key) const override {}
+};
+}  // namespace
+
+class FileIndexerTest : public testing::Test {
+ public:
+  static const int kNumLevels = 4;
+
+  ~FileIndexerTest() {
+    for (int level = 0; level < kNumLevels; level++) {
+      for (FileMetaData* f : files_[level]) {
+        delete f;
+      }
+    }
+  }
+
+  void Add(int level, const std::string& smallest,
+           const std::string& largest) {
+    FileMetaData* f = new FileMetaData;
+    f->smallest = InternalKey(smallest, 100, kTypeValue);
+    f->largest = InternalKey(largest, 100, kTypeValue);
+    files_[level].push_back(f);
+  }
+
+  // Fill the levels > 0 with random disjoint files whose keys share long
+  // prefixes, so that many prefixes compare equal.
+  void AddRandomFiles(Random* rnd) {
+    for (int level = 1; level < kNumLevels; level++) {
+      const int num_files = rnd->Uniform(level * 20);
+      int key = 0;
+      for (int i = 0; i < num_files; i++) {
+        key += 1 + rnd->Uniform(10);
+        const int smallest = key;
+        key += rnd->Uniform(10);
+        Add(level, MakeKey(smallest), MakeKey(key));
+      }
+    }
+  }
+
+  static std::string MakeKey(int i) {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "keyprefix%04d", i);
+    return buf;
+  }
+
+  // Check that searching every level with the bounds of the level above
+  // finds the same files as FindFile().
+  void CheckAllKeys(const Comparator* ucmp) {
+    InternalKeyComparator icmp(ucmp);
+    FileIndexer indexer;
+    indexer.Build(&icmp, files_, kNumLevels);
+    for (int k = 0; k < 2000; k++) {
+      InternalKey target(MakeKey(k), 100, kTypeValue);
+      uint32_t left = 0;
+      uint32_t right = indexer.NumFiles(1);
+      for (int level = 1; level < kNumLevels; level++) {
+        const uint32_t expected = FindFile(icmp, files_[level],
+                                           target.Encode());
+        ASSERT_LE(left, expected) << "key " << k << " level " << level;
+        ASSERT_LE(expected, right) << "key " << k << " level " << level;
+        ASSERT_EQ(expected,
+                  indexer.FindFile(level, target.Encode(), left, right));
+        indexer.NextLevelBounds(level, expected, &left, &right);
+      }
+    }
+  }
+
+  std::vector<FileMetaData*> files_[kNumLevels];
+};
+
+TEST_F(FileIndexerTest, Empty) {
+  CheckAllKeys(BytewiseComparator());
+}
+
+TEST_F(FileIndexerTest, EmptyMiddleLevel) {
+  Add(1, MakeKey(10), MakeKey(20));
+  Add(1, MakeKey(30), MakeKey(40));
+  Add(3, MakeKey(5), MakeKey(15));
+  Add(3, MakeKey(25), MakeKey(35));
+  Add(3, MakeKey(45), MakeKey(50));
+  CheckAllKeys(BytewiseComparator());
+}
+
+TEST_F(FileIndexerTest, ShortKeys) {
+  // "a" and "a\0" have the same prefix.
+  Add(1, "a", "a");
+  Add(1, std::string("a\0", 2), "b");
+  Add(2, "", "a");
+  Add(2, std::string("a\0\0", 3), "abcdefghij");
+  Add(2, "abcdefghik", "z");
+  InternalKeyComparator icmp(BytewiseComparator());
+  FileIndexer indexer;
+  indexer.Build(&icmp, files_, kNumLevels);
+  for (const std::string& key :
+       {std::string(""), std::string("a"), std::string("a\0", 2),
+        std::string("abcdefghij"), std::string("abcdefghijk"),
+        std::string("zz")}) {
+    InternalKey target(key, 100, kTypeValue);
+    for (int level = 1; level < 3; level++) {
+      ASSERT_EQ(FindFile(icmp, files_[level], target.Encode()),
+                indexer.FindFile(level, target.Encode(), 0,
+                                 indexer.NumFiles(level)));
+    }
+  }
+}
+
+TEST_F(FileIndexerTest, Random) {
+  Random rnd(301);
+  for (int i = 0; i < 20; i++) {
+    AddRandomFiles(&rnd);
+    CheckAllKeys(BytewiseComparator());
+    WrappedComparator wrapped;
+    CheckAllKeys(&wrapped);
+    for (int level = 0; level < kNumLevels; level++) {
+      for (FileMetaData* f : files_[level]) {
+        delete f;
+      }
+      files_[level].clear();
+    }
+  }
+}
+
+}  // namespace leveldb
@@ -59,6 +59,11 @@ std::string TempFileName(const std::string& dbname, uint64_t number) {
   return MakeFileName(dbname, number, "dbtmp");
 }
 
+std::string ColumnFamilyDirName(const std::string& dbname, uint32_t id) {
+  assert(id > 0);
+  return MakeFileName(dbname, id, "cf");
+}
+
 std::string InfoLogFileName(const std::string& dbname) {
   return dbname + "/LOG";
 }
@@ -75,6 +80,7 @@ std::string OldInfoLogFileName(const std::string& dbname) {
 //    dbname/LOG.old
 //    dbname/MANIFEST-[0-9]+
 //    dbname/[0-9]+.(log|sst|ldb)
+//    dbname/[0-9]+.cf
 bool ParseFileName(const std::string& filename, uint64_t* number,
                    FileType* type) {
   Slice rest(filename);
@@ -112,6 +118,8 @@ bool ParseFileName(const std::string& filename, uint64_t* number,
       *type = kTableFile;
     } else if (suffix == Slice(".dbtmp")) {
       *type = kTempFile;
+    } else if (suffix == Slice(".cf")) {
+      *type = kColumnFamilyDir;
     } else {
       return false;
     }
@@ -25,7 +25,8 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile  // Either the current one, or an old one
+  kInfoLogFile,  // Either the current one, or an old one
+  kColumnFamilyDir
 };
 
 // Return the name of the log file with the specified number
@@ -61,6 +62,11 @@ std::string LockFileName(const std::string& dbname);
 // The result will be prefixed with "dbname".
 std::string TempFileName(const std::string& dbname, uint64_t number);
 
+// Return the name of the directory holding the column family with the
+// specified id in the db named by "dbname".  The result will be prefixed
+// with "dbname".
+std::string ColumnFamilyDirName(const std::string& dbname, uint32_t id);
+
 // Return the name of the info log file for "dbname".
 std::string InfoLogFileName(const std::string& dbname);
 
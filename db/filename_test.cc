@@ -32,6 +32,7 @@ TEST(FileNameTest, Parse) {
       {"MANIFEST-7", 7, kDescriptorFile},
       {"LOG", 0, kInfoLogFile},
       {"LOG.old", 0, kInfoLogFile},
+      {"000003.cf", 3, kColumnFamilyDir},
       {"18446744073709551615.log", 18446744073709551615ull, kLogFile},
   };
   for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
@@ -111,6 +112,12 @@ TEST(FileNameTest, Construction) {
   ASSERT_EQ(999, number);
   ASSERT_EQ(kTempFile, type);
 
+  fname = ColumnFamilyDirName("foo", 7);
+  ASSERT_EQ("foo/", std::string(fname.data(), 4));
+  ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
+  ASSERT_EQ(7, number);
+  ASSERT_EQ(kColumnFamilyDir, type);
+
   fname = InfoLogFileName("foo");
   ASSERT_EQ("foo/", std::string(fname.data(), 4));
   ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
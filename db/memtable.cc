@@ -5,10 +5,12 @@
 #include "db/memtable.h"
 
 #include "db/dbformat.h"
+#include "db/range_del.h"
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/write_buffer_manager.h"
 
 #include "util/coding.h"
 
@@ -22,60 +24,62 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 }
 
 MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
-
-MemTable::~MemTable() { assert(refs_ == 0); }
-
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
-
-int MemTable::KeyComparator::operator()(const char* aptr,
-                                        const char* bptr) const {
-  // Internal keys are encoded as length-prefixed strings.
-  Slice a = GetLengthPrefixedSlice(aptr);
-  Slice b = GetLengthPrefixedSlice(bptr);
-  return comparator.Compare(a, b);
+    : MemTable(comparator, Options()) {}
+
+MemTable::MemTable(const InternalKeyComparator& comparator,
+                   const Options& options)
+    : comparator_(comparator),
+      refs_(0),
+      arena_(options.memtable_huge_page_size, options.memtable_numa_node),
+      range_del_table_(comparator_, &arena_),
+      tombstones_(nullptr),
+      tombstone_readers_(0),
+      write_buffer_manager_(options.write_buffer_manager),
+      charged_(0) {
+  switch (options.memtable_type) {
+    case kHashSkipListMemTable:
+      table_ = NewHashSkipListRep(comparator_, &arena_,
+                                  options.memtable_prefix_length,
+                                  options.memtable_hash_bucket_count,
+                                  options.memtable_inline_keys);
+      break;
+    case kVectorMemTable:
+      table_ = NewVectorRep(comparator_, &arena_);
+      break;
+    default:
+      table_ = NewSkipListRep(comparator_, &arena_,
+                              options.memtable_inline_keys);
+      break;
+  }
 }
 
-// Encode a suitable internal key target for "target" and return it.
-// Uses *scratch as scratch space, and the returned pointer will point
-// into this scratch space.
-// 把target的大小和data 附加到scratch后面
-static const char* EncodeKey(std::string* scratch, const Slice& target) {
-  scratch->clear();
-  PutVarint32(scratch, target.size());
-  scratch->append(target.data(), target.size());
-  return scratch->data();
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  delete table_;
+  delete tombstones_.load(std::memory_order_relaxed);
+  for (const RangeTombstoneList* list : retired_tombstones_) {
+    delete list;
+  }
+  if (write_buffer_manager_ != nullptr) {
+    write_buffer_manager_->FreeMem(charged_);
+  }
 }
 
-class MemTableIterator : public Iterator {
- public:
-  explicit MemTableIterator(MemTable::Table* table) : iter_(table) {}
-
-  MemTableIterator(const MemTableIterator&) = delete;
-  MemTableIterator& operator=(const MemTableIterator&) = delete;
-
-  ~MemTableIterator() override = default;
-
-  bool Valid() const override { return iter_.Valid(); }
-  void Seek(const Slice& k) override { iter_.Seek(EncodeKey(&tmp_, k)); }
-  void SeekToFirst() override { iter_.SeekToFirst(); }
-  void SeekToLast() override { iter_.SeekToLast(); }
-  void Next() override { iter_.Next(); }
-  void Prev() override { iter_.Prev(); }
-  Slice key() const override { return GetLengthPrefixedSlice(iter_.key()); }
-  Slice value() const override {
-    Slice key_slice = GetLengthPrefixedSlice(iter_.key());
-    return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
-  }
+size_t MemTable::ApproximateMemoryUsage() {
+  return arena_.MemoryUsage() + table_->ApproximateMemoryUsage();
+}
 
-  Status status() const override { return Status::OK(); }
+bool MemTable::IsEmpty() {
+  MemTableSkipList::Iterator range_del_iter(&range_del_table_);
+  range_del_iter.SeekToFirst();
+  return table_->IsEmpty() && !range_del_iter.Valid();
+}
 
- private:
-  MemTable::Table::Iterator iter_;
-  std::string tmp_;  // For passing to EncodeKey
-};
+Iterator* MemTable::NewIterator() { return table_->NewIterator(); }
 
-Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  return new MemTableSkipListIterator(&range_del_table_);
+}
 
 void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
                    const Slice& value) {
@@ -86,13 +90,19 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   //  tag          : uint64((sequence << 8) | type)
   //  value_size   : varint32 of value.size()
   //  value bytes  : char[value.size()]
+  if (type == kTypeRangeDeletion &&
+      comparator_.comparator.user_comparator()->Compare(key, value) >= 0) {
+    return;  // Empty range
+  }
   size_t key_size = key.size();
   size_t val_size = value.size();
   size_t internal_key_size = key_size + 8;
   const size_t encoded_len = VarintLength(internal_key_size) +
                              internal_key_size + VarintLength(val_size) +
                              val_size;
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = (type == kTypeRangeDeletion)
+                  ? arena_.Allocate(encoded_len)
+                  : table_->Allocate(encoded_len, key);
   //哦哦是从arena里获得的内存
   char* p = EncodeVarint32(buf, internal_key_size);
   std::memcpy(p, key.data(), key_size);
@@ -103,41 +113,140 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_.Insert(buf);
+    AddTombstone(key, value, s);
+  } else {
+    table_->Insert(buf);
+  }
+  if (write_buffer_manager_ != nullptr) {
+    const size_t usage = ApproximateMemoryUsage();
+    if (usage > charged_) {
+      write_buffer_manager_->ReserveMem(usage - charged_);
+      charged_ = usage;
+    }
+  }
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
-  Slice memkey = key.memtable_key();
-  Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
-    // entry format is:
-    //    klength  varint32
-    //    userkey  char[klength]
-    //    tag      uint64
-    //    vlength  varint32
-    //    value    char[vlength]
-    // Check that it belongs to same user key.  We do not check the
-    // sequence number since the Seek() call above should have skipped
-    // all entries with overly large sequence numbers.
-    const char* entry = iter.key();
-    uint32_t key_length;
-    const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
-    if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
-          return true;
-        }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
-      }
+void MemTable::AddTombstone(const Slice& begin, const Slice& end,
+                            SequenceNumber s) {
+  // Writers are serialized, so only readers race with this.
+  const RangeTombstoneList* old = tombstones_.load(std::memory_order_relaxed);
+  RangeTombstoneList* list =
+      (old != nullptr)
+          ? new RangeTombstoneList(*old)
+          : new RangeTombstoneList(comparator_.comparator.user_comparator());
+  list->Insert(begin, end, s);
+  tombstones_.store(list);
+  if (old != nullptr) {
+    retired_tombstones_.push_back(old);
+  }
+  // A reader that registers after this load sees the new list, so the old
+  // ones are unreachable if no reader is registered now.
+  if (tombstone_readers_.load() == 0) {
+    for (const RangeTombstoneList* retired : retired_tombstones_) {
+      delete retired;
     }
+    retired_tombstones_.clear();
+  }
+}
+
+SequenceNumber MemTable::MaxCoveringTombstoneSequence(const Slice& user_key,
+                                                      SequenceNumber snapshot) {
+  if (!HasRangeTombstones()) {
+    return 0;  // Never changes back once a tombstone was added
+  }
+  tombstone_readers_.fetch_add(1);
+  const SequenceNumber result =
+      tombstones_.load()->MaxCoveringSequence(user_key, snapshot);
+  tombstone_readers_.fetch_sub(1);
+  return result;
+}
+
+namespace {
+struct Saver {
+  const Comparator* user_comparator;
+  Slice user_key;
+  SequenceNumber tombstone_seq;
+  std::string* value;
+  Status* status;
+  std::vector<std::string>* merge_operands;
+  bool found;
+};
+}  // namespace
+
+// Merge operands are collected until an older value or deletion of the
+// key is found.
+static bool SaveEntry(void* arg, const char* entry) {
+  Saver* saver = reinterpret_cast<Saver*>(arg);
+  // entry format is:
+  //    klength  varint32
+  //    userkey  char[klength]
+  //    tag      uint64
+  //    vlength  varint32
+  //    value    char[vlength]
+  // Check that it belongs to same user key.  We do not check the
+  // sequence number since MemTableRep::Get() starts past all entries
+  // with overly large sequence numbers.
+  uint32_t key_length;
+  const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
+  if (saver->user_comparator->Compare(Slice(key_ptr, key_length - 8),
+                                      saver->user_key) != 0) {
+    return false;
+  }
+  // Correct user key
+  const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+  if ((tag >> 8) < saver->tombstone_seq) {
+    *saver->status = Status::NotFound(Slice());
+    saver->found = true;
+    return false;
+  }
+  switch (static_cast<ValueType>(tag & 0xff)) {
+    case kTypeValue: {
+      Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+      saver->value->assign(v.data(), v.size());
+      saver->found = true;
+      return false;
+    }
+    case kTypeDeletion:
+      *saver->status = Status::NotFound(Slice());
+      saver->found = true;
+      return false;
+    case kTypeMerge: {
+      Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+      saver->merge_operands->push_back(v.ToString());
+      break;
+    }
+    case kTypeRangeDeletion:
+      break;  // Never stored in table_
+  }
+  return true;
+}
+
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   std::vector<std::string>* merge_operands) {
+  // Everything older than the newest covering tombstone is deleted.
+  Slice internal_key = key.internal_key();
+  const SequenceNumber snapshot =
+      DecodeFixed64(internal_key.data() + internal_key.size() - 8) >> 8;
+  const SequenceNumber tombstone_seq =
+      MaxCoveringTombstoneSequence(key.user_key(), snapshot);
+
+  Saver saver;
+  saver.user_comparator = comparator_.comparator.user_comparator();
+  saver.user_key = key.user_key();
+  saver.tombstone_seq = tombstone_seq;
+  saver.value = value;
+  saver.status = s;
+  saver.merge_operands = merge_operands;
+  saver.found = false;
+  table_->Get(key.memtable_key().data(), &saver, SaveEntry);
+  if (saver.found) {
+    return true;
+  }
+  if (tombstone_seq > 0) {
+    *s = Status::NotFound(Slice());
+    return true;
   }
   return false;
 }
@@ -5,17 +5,20 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
-#include "db/skiplist.h"
+#include "db/memtable_rep.h"
+#include "db/range_del.h"
 #include "leveldb/db.h"
+#include "leveldb/options.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
 class InternalKeyComparator;
-class MemTableIterator;
 
 class MemTable {
  public:
@@ -23,6 +26,10 @@ class MemTable {
   // is zero and the caller must call Ref() at least once.
   explicit MemTable(const InternalKeyComparator& comparator);
 
+  // Same as above, but with the data structure selected by
+  // options.memtable_type.
+  MemTable(const InternalKeyComparator& comparator, const Options& options);
+
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
 
@@ -42,6 +49,9 @@ class MemTable {
   // data structure. It is safe to call when MemTable is being modified.
   size_t ApproximateMemoryUsage();
 
+  // Returns true if no entry or range tombstone was added.
+  bool IsEmpty();
+
   // Return an iterator that yields the contents of the memtable.
   //
   // The caller must ensure that the underlying MemTable remains live
@@ -50,36 +60,59 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones in the memtable.  Keys
+  // are internal keys holding each tombstone's begin key and values are
+  // the matching end keys.  The same lifetime rules as NewIterator() apply.
+  Iterator* NewRangeTombstoneIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  For
+  // type==kTypeRangeDeletion, key and value are the bounds of the deleted
+  // range; empty ranges are ignored.
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, or a range tombstone covering
+  // key that is newer than its value, store a NotFound() error in *status
+  // and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  // Merge operands newer than the value or deletion are appended to
+  // *merge_operands, newest first.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           std::vector<std::string>* merge_operands);
+
+  // Return the largest sequence number among the range tombstones that
+  // cover "user_key" and are visible at "snapshot", or 0 if there are none.
+  // Safe to call while the memtable is being modified.
+  SequenceNumber MaxCoveringTombstoneSequence(const Slice& user_key,
+                                              SequenceNumber snapshot);
+
+  // Returns true if a range tombstone was added.
+  bool HasRangeTombstones() const {
+    return tombstones_.load(std::memory_order_acquire) != nullptr;
+  }
 
  private:
-  friend class MemTableIterator;
-  friend class MemTableBackwardIterator;
-
-  struct KeyComparator {
-    const InternalKeyComparator comparator;
-    explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) {}
-    int operator()(const char* a, const char* b) const;
-  };
-
-  typedef SkipList<const char*, KeyComparator> Table;
-
   ~MemTable();  // Private since only Unref() should be used to delete it
 
-  KeyComparator comparator_;
+  void AddTombstone(const Slice& begin, const Slice& end, SequenceNumber s);
+
+  MemTableKeyComparator comparator_;
   int refs_;
   Arena arena_;  //为啥持有的是arena
-  Table table_;  //skiplist
+  MemTableRep* table_;  //skiplist, or see Options::memtable_type
+  MemTableSkipList range_del_table_;  // Range tombstones, kept apart
+  // The range tombstones again, split into fragments for Get().  Add()
+  // publishes a new list on every range deletion.  Readers count
+  // themselves in tombstone_readers_ while they use a list, and Add()
+  // frees the lists it replaced only when it sees no reader.
+  std::atomic<const RangeTombstoneList*> tombstones_;
+  std::atomic<int> tombstone_readers_;
+  std::vector<const RangeTombstoneList*> retired_tombstones_;
+  WriteBufferManager* const write_buffer_manager_;
+  size_t charged_;  // Bytes reserved with write_buffer_manager_
 };
 
 }  // namespace leveldb
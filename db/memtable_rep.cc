@@ -0,0 +1,349 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/memtable_rep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+static Slice GetLengthPrefixedSlice(const char* data) {
+  uint32_t len;
+  const char* p = data;
+  p = GetVarint32Ptr(p, p + 5, &len);  // +5: we assume "p" is not corrupted
+  return Slice(p, len);
+}
+
+// Encode a suitable internal key target for "target" and return it.
+// Uses *scratch as scratch space, and the returned pointer will point
+// into this scratch space.
+static const char* EncodeKey(std::string* scratch, const Slice& target) {
+  scratch->clear();
+  PutVarint32(scratch, target.size());
+  scratch->append(target.data(), target.size());
+  return scratch->data();
+}
+
+static Slice EntryValue(const char* entry) {
+  Slice key = GetLengthPrefixedSlice(entry);
+  return GetLengthPrefixedSlice(key.data() + key.size());
+}
+
+int MemTableKeyComparator::operator()(const char* aptr,
+                                      const char* bptr) const {
+  // Internal keys are encoded as length-prefixed strings.
+  Slice a = GetLengthPrefixedSlice(aptr);
+  Slice b = GetLengthPrefixedSlice(bptr);
+  return comparator.Compare(a, b);
+}
+
+void MemTableSkipListIterator::Seek(const Slice& k) {
+  iter_.Seek(EncodeKey(&tmp_, k));
+}
+
+Slice MemTableSkipListIterator::key() const {
+  return GetLengthPrefixedSlice(iter_.key());
+}
+
+Slice MemTableSkipListIterator::value() const {
+  return EntryValue(iter_.key());
+}
+
+MemTableRep::~MemTableRep() = default;
+
+char* MemTableRep::Allocate(size_t size, const Slice& user_key) {
+  return arena_->Allocate(size);
+}
+
+static void GetFromSkipList(const MemTableSkipList* list, const char* memkey,
+                            void* arg,
+                            bool (*callback)(void* arg, const char* entry)) {
+  MemTableSkipList::Iterator iter(list);
+  for (iter.Seek(memkey); iter.Valid(); iter.Next()) {
+    if (!(*callback)(arg, iter.key())) {
+      break;
+    }
+  }
+}
+
+namespace {
+
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const MemTableKeyComparator& cmp, Arena* arena,
+              bool inline_keys)
+      : MemTableRep(arena), list_(cmp, arena), inline_keys_(inline_keys) {}
+
+  char* Allocate(size_t size, const Slice& user_key) override {
+    return inline_keys_ ? list_.AllocateKey(size) : arena_->Allocate(size);
+  }
+
+  void Insert(const char* entry) override { list_.Insert(entry); }
+
+  bool IsEmpty() override {
+    MemTableSkipList::Iterator iter(&list_);
+    iter.SeekToFirst();
+    return !iter.Valid();
+  }
+
+  void Get(const char* memkey, void* arg,
+           bool (*callback)(void* arg, const char* entry)) override {
+    GetFromSkipList(&list_, memkey, arg, callback);
+  }
+
+  Iterator* NewIterator() override {
+    return new MemTableSkipListIterator(&list_);
+  }
+
+ private:
+  MemTableSkipList list_;
+  const bool inline_keys_;
+};
+
+class HashSkipListRep : public MemTableRep {
+ public:
+  HashSkipListRep(const MemTableKeyComparator& cmp, Arena* arena,
+                  size_t prefix_length, size_t bucket_count, bool inline_keys)
+      : MemTableRep(arena),
+        cmp_(cmp),
+        prefix_length_(prefix_length),
+        bucket_count_(bucket_count),
+        inline_keys_(inline_keys) {
+    char* mem =
+        arena->AllocateAligned(sizeof(std::atomic<MemTableSkipList*>) *
+                               bucket_count);
+    buckets_ = reinterpret_cast<std::atomic<MemTableSkipList*>*>(mem);
+    for (size_t i = 0; i < bucket_count; i++) {
+      new (&buckets_[i]) std::atomic<MemTableSkipList*>(nullptr);
+    }
+  }
+
+  // The skiplists live in the arena and own nothing else.
+  ~HashSkipListRep() override = default;
+
+  char* Allocate(size_t size, const Slice& user_key) override {
+    return inline_keys_ ? List(user_key)->AllocateKey(size)
+                        : arena_->Allocate(size);
+  }
+
+  void Insert(const char* entry) override {
+    List(ExtractUserKey(GetLengthPrefixedSlice(entry)))->Insert(entry);
+  }
+
+  bool IsEmpty() override {
+    for (size_t i = 0; i < bucket_count_; i++) {
+      if (buckets_[i].load(std::memory_order_acquire) != nullptr) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Get(const char* memkey, void* arg,
+           bool (*callback)(void* arg, const char* entry)) override {
+    // All entries of a user key are in the skiplist of its prefix.
+    MemTableSkipList* list =
+        Bucket(ExtractUserKey(GetLengthPrefixedSlice(memkey)))
+            ->load(std::memory_order_acquire);
+    if (list != nullptr) {
+      GetFromSkipList(list, memkey, arg, callback);
+    }
+  }
+
+  // Iterates over a sorted copy of the entries of all buckets, since
+  // merging the buckets would compare each entry with every bucket.
+  Iterator* NewIterator() override;
+
+ private:
+  std::atomic<MemTableSkipList*>* Bucket(const Slice& user_key) const {
+    const size_t n = std::min(user_key.size(), prefix_length_);
+    return &buckets_[Hash(user_key.data(), n, 0) % bucket_count_];
+  }
+
+  // The skiplist of "user_key", created if needed.  Only called by writers.
+  MemTableSkipList* List(const Slice& user_key) {
+    std::atomic<MemTableSkipList*>* bucket = Bucket(user_key);
+    MemTableSkipList* list = bucket->load(std::memory_order_relaxed);
+    if (list == nullptr) {
+      char* mem = arena_->AllocateAligned(sizeof(MemTableSkipList));
+      list = new (mem) MemTableSkipList(cmp_, arena_);
+      // Readers must see an initialized list.
+      bucket->store(list, std::memory_order_release);
+    }
+    return list;
+  }
+
+  const MemTableKeyComparator cmp_;
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+  const bool inline_keys_;
+  std::atomic<MemTableSkipList*>* buckets_;  // Allocated in *arena_
+};
+
+typedef std::vector<const char*> Entries;
+
+class VectorIterator : public Iterator {
+ public:
+  VectorIterator(std::shared_ptr<const Entries> entries,
+                 const MemTableKeyComparator* cmp)
+      : entries_(std::move(entries)), cmp_(cmp), index_(entries_->size()) {}
+
+  bool Valid() const override { return index_ < entries_->size(); }
+  void Seek(const Slice& k) override {
+    const char* target = EncodeKey(&tmp_, k);
+    index_ = std::lower_bound(entries_->begin(), entries_->end(), target,
+                              [this](const char* a, const char* b) {
+                                return (*cmp_)(a, b) < 0;
+                              }) -
+             entries_->begin();
+  }
+  void SeekToFirst() override { index_ = 0; }
+  void SeekToLast() override {
+    index_ = entries_->empty() ? 0 : entries_->size() - 1;
+  }
+  void Next() override {
+    assert(Valid());
+    index_++;
+  }
+  void Prev() override {
+    assert(Valid());
+    index_ = (index_ == 0) ? entries_->size() : index_ - 1;
+  }
+  Slice key() const override {
+    assert(Valid());
+    return GetLengthPrefixedSlice((*entries_)[index_]);
+  }
+  Slice value() const override {
+    assert(Valid());
+    return EntryValue((*entries_)[index_]);
+  }
+  Status status() const override { return Status::OK(); }
+
+ private:
+  const std::shared_ptr<const Entries> entries_;
+  const MemTableKeyComparator* const cmp_;
+  size_t index_;
+  std::string tmp_;  // For passing to EncodeKey
+};
+
+Iterator* HashSkipListRep::NewIterator() {
+  Entries* entries = new Entries;
+  for (size_t i = 0; i < bucket_count_; i++) {
+    MemTableSkipList* list = buckets_[i].load(std::memory_order_acquire);
+    if (list != nullptr) {
+      MemTableSkipList::Iterator iter(list);
+      for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        entries->push_back(iter.key());
+      }
+    }
+  }
+  std::sort(entries->begin(), entries->end(),
+            [this](const char* a, const char* b) { return cmp_(a, b) < 0; });
+  return new VectorIterator(std::shared_ptr<const Entries>(entries), &cmp_);
+}
+
+class VectorRep : public MemTableRep {
+ public:
+  VectorRep(const MemTableKeyComparator& cmp, Arena* arena)
+      : MemTableRep(arena),
+        cmp_(cmp), sorted_(std::make_shared<const Entries>()), usage_(0) {}
+
+  void Insert(const char* entry) override {
+    MutexLock l(&mutex_);
+    unsorted_.push_back(entry);
+    UpdateUsage();
+  }
+
+  bool IsEmpty() override {
+    MutexLock l(&mutex_);
+    return sorted_->empty() && unsorted_.empty();
+  }
+
+  void Get(const char* memkey, void* arg,
+           bool (*callback)(void* arg, const char* entry)) override {
+    std::shared_ptr<const Entries> entries = Sorted();
+    Entries::const_iterator iter = std::lower_bound(
+        entries->begin(), entries->end(), memkey,
+        [this](const char* a, const char* b) { return cmp_(a, b) < 0; });
+    for (; iter != entries->end(); ++iter) {
+      if (!(*callback)(arg, *iter)) {
+        break;
+      }
+    }
+  }
+
+  Iterator* NewIterator() override {
+    return new VectorIterator(Sorted(), &cmp_);
+  }
+
+  size_t ApproximateMemoryUsage() override {
+    return usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Sort the entries added since the last call into the sorted ones and
+  // return all of them.  Readers share the result, so a new vector is
+  // built whenever entries were added.
+  std::shared_ptr<const Entries> Sorted() {
+    MutexLock l(&mutex_);
+    if (!unsorted_.empty()) {
+      auto less = [this](const char* a, const char* b) {
+        return cmp_(a, b) < 0;
+      };
+      std::sort(unsorted_.begin(), unsorted_.end(), less);
+      std::shared_ptr<Entries> merged = std::make_shared<Entries>();
+      merged->reserve(sorted_->size() + unsorted_.size());
+      std::merge(sorted_->begin(), sorted_->end(), unsorted_.begin(),
+                 unsorted_.end(), std::back_inserter(*merged), less);
+      sorted_ = std::move(merged);
+      unsorted_.clear();
+      UpdateUsage();
+    }
+    return sorted_;
+  }
+
+  void UpdateUsage() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    usage_.store((sorted_->capacity() + unsorted_.capacity()) *
+                     sizeof(const char*),
+                 std::memory_order_relaxed);
+  }
+
+  const MemTableKeyComparator cmp_;
+  port::Mutex mutex_;
+  std::shared_ptr<const Entries> sorted_ GUARDED_BY(mutex_);
+  Entries unsorted_ GUARDED_BY(mutex_);  // Added after sorted_ was built
+  std::atomic<size_t> usage_;
+};
+
+}  // namespace
+
+MemTableRep* NewSkipListRep(const MemTableKeyComparator& cmp, Arena* arena,
+                            bool inline_keys) {
+  return new SkipListRep(cmp, arena, inline_keys);
+}
+
+MemTableRep* NewHashSkipListRep(const MemTableKeyComparator& cmp,
+                                Arena* arena, size_t prefix_length,
+                                size_t bucket_count, bool inline_keys) {
+  return new HashSkipListRep(cmp, arena, prefix_length, bucket_count,
+                             inline_keys);
+}
+
+MemTableRep* NewVectorRep(const MemTableKeyComparator& cmp, Arena* arena) {
+  return new VectorRep(cmp, arena);
+}
+
+}  // namespace leveldb
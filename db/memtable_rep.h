@@ -0,0 +1,120 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MemTableRep is the data structure that holds the entries of a
+// MemTable.  Entries are encoded by MemTable::Add() and ordered by their
+// internal keys.  Options::memtable_type picks one of the implementations
+// below.
+//
+// Thread safety: like SkipList, Insert() requires external
+// synchronization but may run concurrently with reads.
+
+#ifndef STORAGE_LEVELDB_DB_MEMTABLE_REP_H_
+#define STORAGE_LEVELDB_DB_MEMTABLE_REP_H_
+
+#include <cstddef>
+#include <string>
+
+#include "db/dbformat.h"
+#include "db/skiplist.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+class Arena;
+
+// Orders memtable entries by the internal keys they start with.
+struct MemTableKeyComparator {
+  const InternalKeyComparator comparator;
+  explicit MemTableKeyComparator(const InternalKeyComparator& c)
+      : comparator(c) {}
+  int operator()(const char* a, const char* b) const;
+};
+
+typedef SkipList<const char*, MemTableKeyComparator> MemTableSkipList;
+
+// Iterates over the entries of a MemTableSkipList.  Keys are the internal
+// keys of the entries and values their values.
+class MemTableSkipListIterator : public Iterator {
+ public:
+  explicit MemTableSkipListIterator(const MemTableSkipList* list)
+      : iter_(list) {}
+
+  MemTableSkipListIterator(const MemTableSkipListIterator&) = delete;
+  MemTableSkipListIterator& operator=(const MemTableSkipListIterator&) =
+      delete;
+
+  ~MemTableSkipListIterator() override = default;
+
+  bool Valid() const override { return iter_.Valid(); }
+  void Seek(const Slice& k) override;
+  void SeekToFirst() override { iter_.SeekToFirst(); }
+  void SeekToLast() override { iter_.SeekToLast(); }
+  void Next() override { iter_.Next(); }
+  void Prev() override { iter_.Prev(); }
+  Slice key() const override;
+  Slice value() const override;
+  Status status() const override { return Status::OK(); }
+
+ private:
+  MemTableSkipList::Iterator iter_;
+  std::string tmp_;  // For passing to EncodeKey
+};
+
+class MemTableRep {
+ public:
+  // Entries are allocated from "*arena" by default.
+  explicit MemTableRep(Arena* arena) : arena_(arena) {}
+
+  MemTableRep(const MemTableRep&) = delete;
+  MemTableRep& operator=(const MemTableRep&) = delete;
+
+  virtual ~MemTableRep();
+
+  // Return "size" bytes of memory for an entry of "user_key".
+  // REQUIRES: the next call to Insert() adds the entry stored there.
+  virtual char* Allocate(size_t size, const Slice& user_key);
+
+  // Add "entry", which must stay live as long as this object.
+  // REQUIRES: nothing that compares equal to entry is already present.
+  virtual void Insert(const char* entry) = 0;
+
+  // Returns true if no entry was added.
+  virtual bool IsEmpty() = 0;
+
+  // Call (*callback)(arg, entry) for the entries >= "memkey" in order,
+  // starting at the first one, until it returns false.  "memkey" is
+  // LookupKey::memtable_key(); entries of other user keys may be skipped.
+  virtual void Get(const char* memkey, void* arg,
+                   bool (*callback)(void* arg, const char* entry)) = 0;
+
+  // Return an iterator over all entries.  Keys are the internal keys of
+  // the entries and values their values.  The iterator need not see
+  // entries added after it was created.
+  virtual Iterator* NewIterator() = 0;
+
+  // Bytes in use outside of the arena passed at creation.
+  virtual size_t ApproximateMemoryUsage() { return 0; }
+
+ protected:
+  Arena* const arena_;
+};
+
+// A single skiplist.  If "inline_keys" is true, each entry is stored right
+// after the links of its node.
+MemTableRep* NewSkipListRep(const MemTableKeyComparator& cmp, Arena* arena,
+                            bool inline_keys);
+
+// One skiplist per hash bucket of the first "prefix_length" bytes of the
+// user keys.  "inline_keys" is as for NewSkipListRep().
+MemTableRep* NewHashSkipListRep(const MemTableKeyComparator& cmp,
+                                Arena* arena, size_t prefix_length,
+                                size_t bucket_count, bool inline_keys);
+
+// An unsorted vector, sorted the first time it is read.
+MemTableRep* NewVectorRep(const MemTableKeyComparator& cmp, Arena* arena);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MEMTABLE_REP_H_
@@ -0,0 +1,206 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "db/dbformat.h"
+#include "db/memtable.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static const MemTableType kTypes[] = {kSkipListMemTable,
+                                      kHashSkipListMemTable, kVectorMemTable};
+
+namespace {
+// Orders internal keys like the memtable.
+struct InternalKeyLess {
+  bool operator()(const std::string& a, const std::string& b) const {
+    return InternalKeyComparator(BytewiseComparator()).Compare(a, b) < 0;
+  }
+};
+typedef std::map<std::string, std::string, InternalKeyLess> Model;
+}  // namespace
+
+class MemTableRepTest : public testing::Test {
+ public:
+  MemTableRepTest() : icmp_(BytewiseComparator()) {}
+
+  // Fill a memtable of "type" with random puts and deletions of keys with
+  // few distinct prefixes and check it against the model.
+  void CheckRandom(MemTableType type, bool inline_keys) {
+    Options options;
+    options.memtable_type = type;
+    options.memtable_inline_keys = inline_keys;
+    options.memtable_prefix_length = 3;
+    options.memtable_hash_bucket_count = 16;
+    MemTable* mem = new MemTable(icmp_, options);
+    mem->Ref();
+    ASSERT_TRUE(mem->IsEmpty());
+
+    Random rnd(301);
+    Model model;  // Internal key -> value
+    SequenceNumber seq = 1;
+    for (int i = 0; i < 2000; i++) {
+      char buf[20];
+      std::snprintf(buf, sizeof(buf), "k%02d.%03d", rnd.Uniform(20),
+                    rnd.Uniform(100));
+      const ValueType vtype = rnd.OneIn(4) ? kTypeDeletion : kTypeValue;
+      const std::string value =
+          (vtype == kTypeValue) ? buf + std::to_string(i) : std::string();
+      mem->Add(seq, vtype, buf, value);
+      std::string ikey;
+      AppendInternalKey(&ikey, ParsedInternalKey(buf, seq, vtype));
+      model[ikey] = value;
+      seq++;
+
+      // Interleave reads to exercise the vector's incremental sorting.
+      if (rnd.OneIn(200)) {
+        CheckIterator(mem, model);
+      }
+    }
+    ASSERT_TRUE(!mem->IsEmpty());
+    CheckIterator(mem, model);
+
+    // Point lookups see the newest entry of each user key at or below
+    // their sequence number.
+    for (int i = 0; i < 200; i++) {
+      char buf[20];
+      std::snprintf(buf, sizeof(buf), "k%02d.%03d", rnd.Uniform(20),
+                    rnd.Uniform(100));
+      const SequenceNumber snapshot = 1 + rnd.Uniform(static_cast<int>(seq));
+      LookupKey lkey(buf, snapshot);
+      std::string value;
+      Status s;
+      std::vector<std::string> merge_operands;
+      const bool found = mem->Get(lkey, &value, &s, &merge_operands);
+
+      Model::iterator it =
+          model.lower_bound(lkey.internal_key().ToString());
+      ParsedInternalKey parsed;
+      if (it == model.end() || !ParseInternalKey(it->first, &parsed) ||
+          parsed.user_key != Slice(buf)) {
+        ASSERT_TRUE(!found) << buf;
+      } else {
+        ASSERT_TRUE(found) << buf;
+        if (parsed.type == kTypeValue) {
+          ASSERT_LEVELDB_OK(s);
+          ASSERT_EQ(it->second, value);
+        } else {
+          ASSERT_TRUE(s.IsNotFound());
+        }
+      }
+    }
+    mem->Unref();
+  }
+
+  void CheckIterator(MemTable* mem,
+                     const Model& model) {
+    Iterator* iter = mem->NewIterator();
+    Model::const_iterator it = model.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+      ASSERT_TRUE(it != model.end());
+      ASSERT_EQ(it->first, iter->key().ToString());
+      ASSERT_EQ(it->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(it == model.end());
+
+    Model::const_reverse_iterator rit = model.rbegin();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev(), ++rit) {
+      ASSERT_TRUE(rit != model.rend());
+      ASSERT_EQ(rit->first, iter->key().ToString());
+    }
+    ASSERT_TRUE(rit == model.rend());
+
+    if (!model.empty()) {
+      const std::string& middle = std::next(model.begin(),
+                                            model.size() / 2)->first;
+      iter->Seek(middle);
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(middle, iter->key().ToString());
+    }
+    delete iter;
+  }
+
+  InternalKeyComparator icmp_;
+};
+
+TEST_F(MemTableRepTest, Random) {
+  for (MemTableType type : kTypes) {
+    CheckRandom(type, false);
+    CheckRandom(type, true);
+  }
+}
+
+TEST_F(MemTableRepTest, ManyHashBuckets) {
+  Options options;
+  options.memtable_type = kHashSkipListMemTable;
+  options.memtable_prefix_length = 16;
+  options.memtable_hash_bucket_count = 1024;
+  MemTable* mem = new MemTable(icmp_, options);
+  mem->Ref();
+  Random rnd(301);
+  Model model;
+  for (int i = 0; i < 10000; i++) {
+    const std::string key = "k" + std::to_string(rnd.Uniform(100000));
+    const std::string value = std::to_string(i);
+    mem->Add(i + 1, kTypeValue, key, value);
+    std::string ikey;
+    AppendInternalKey(&ikey, ParsedInternalKey(key, i + 1, kTypeValue));
+    model[ikey] = value;
+  }
+  CheckIterator(mem, model);
+  mem->Unref();
+}
+
+TEST_F(MemTableRepTest, RangeTombstones) {
+  for (MemTableType type : kTypes) {
+    Options options;
+    options.memtable_type = type;
+    MemTable* mem = new MemTable(icmp_, options);
+    mem->Ref();
+    mem->Add(1, kTypeValue, "b", "v1");
+    mem->Add(2, kTypeRangeDeletion, "a", "c");
+    mem->Add(3, kTypeValue, "b", "v3");
+    ASSERT_TRUE(!mem->IsEmpty());
+
+    std::string value;
+    Status s;
+    std::vector<std::string> merge_operands;
+    ASSERT_TRUE(mem->Get(LookupKey("b", 3), &value, &s, &merge_operands));
+    ASSERT_LEVELDB_OK(s);
+    ASSERT_EQ("v3", value);
+    ASSERT_TRUE(mem->Get(LookupKey("b", 2), &value, &s, &merge_operands));
+    ASSERT_TRUE(s.IsNotFound());
+    mem->Unref();
+  }
+}
+
+TEST_F(MemTableRepTest, EmptyIterators) {
+  for (MemTableType type : kTypes) {
+    Options options;
+    options.memtable_type = type;
+    MemTable* mem = new MemTable(icmp_, options);
+    mem->Ref();
+    Iterator* iter = mem->NewIterator();
+    iter->SeekToFirst();
+    ASSERT_TRUE(!iter->Valid());
+    iter->SeekToLast();
+    ASSERT_TRUE(!iter->Valid());
+    iter->Seek(InternalKey("a", 1, kTypeValue).Encode());
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+    mem->Unref();
+  }
+}
+
+}  // namespace leveldb
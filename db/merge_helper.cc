@@ -0,0 +1,28 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+Status MergeOperands(const MergeOperator* merge_operator,
+                     const Slice& user_key, const Slice* base,
+                     const std::vector<std::string>& operands,
+                     std::string* result) {
+  if (merge_operator == nullptr) {
+    return Status::NotSupported("merge operand found without merge_operator",
+                                user_key);
+  }
+  std::vector<Slice> oldest_first(operands.rbegin(), operands.rend());
+  std::string merged;
+  if (!merge_operator->FullMerge(user_key, base, oldest_first, &merged)) {
+    return Status::Corruption("merge failed for key", user_key);
+  }
+  result->swap(merged);
+  return Status::OK();
+}
+
+}  // namespace leveldb
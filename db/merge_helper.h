@@ -0,0 +1,29 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class MergeOperator;
+
+// Combine the merge operands of "user_key", given newest first as they are
+// found by lookups, with *base (null if the key has no older value) and
+// store the result in *result.  Fails if "merge_operator" is null or
+// rejects the operands.
+Status MergeOperands(const MergeOperator* merge_operator,
+                     const Slice& user_key, const Slice* base,
+                     const std::vector<std::string>& operands,
+                     std::string* result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
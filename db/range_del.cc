@@ -0,0 +1,262 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <set>
+
+#include "db/memtable.h"
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+void RangeTombstoneList::Add(const Slice& begin, const Slice& end,
+                             SequenceNumber sequence) {
+  auto pos = std::upper_bound(
+      tombstones_.begin(), tombstones_.end(), begin,
+      [this](const Slice& key, const RangeTombstone& t) {
+        return ucmp_->Compare(key, t.begin) < 0;
+      });
+  RangeTombstone t;
+  t.begin = begin.ToString();
+  t.end = end.ToString();
+  t.sequence = sequence;
+  tombstones_.insert(pos, std::move(t));
+  fragmented_ = false;
+}
+
+Status RangeTombstoneList::AddTombstones(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey)) {
+      return Status::Corruption("corrupted range tombstone");
+    }
+    Add(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  return iter->status();
+}
+
+void RangeTombstoneList::Fragment() {
+  if (fragmented_) {
+    return;
+  }
+  fragmented_ = true;
+  fragments_.clear();
+
+  // Every begin and end key bounds a fragment.
+  std::vector<Slice> bounds;
+  for (const RangeTombstone& t : tombstones_) {
+    bounds.push_back(t.begin);
+    bounds.push_back(t.end);
+  }
+  std::sort(bounds.begin(), bounds.end(),
+            [this](const Slice& a, const Slice& b) {
+              return ucmp_->Compare(a, b) < 0;
+            });
+  bounds.erase(std::unique(bounds.begin(), bounds.end(),
+                           [this](const Slice& a, const Slice& b) {
+                             return ucmp_->Compare(a, b) == 0;
+                           }),
+               bounds.end());
+
+  // Sweep the bounds in order, keeping the tombstones that cover the
+  // current fragment ordered by end key.
+  auto end_less = [this](const RangeTombstone* a, const RangeTombstone* b) {
+    return ucmp_->Compare(a->end, b->end) < 0;
+  };
+  std::multiset<const RangeTombstone*, decltype(end_less)> covering(end_less);
+  size_t next = 0;  // Next tombstone in begin key order
+  for (size_t i = 0; i + 1 < bounds.size(); i++) {
+    while (next < tombstones_.size() &&
+           ucmp_->Compare(tombstones_[next].begin, bounds[i]) <= 0) {
+      covering.insert(&tombstones_[next++]);
+    }
+    while (!covering.empty() &&
+           ucmp_->Compare((*covering.begin())->end, bounds[i]) <= 0) {
+      covering.erase(covering.begin());
+    }
+    if (covering.empty()) {
+      continue;
+    }
+
+    std::vector<SequenceNumber> sequences;
+    for (const RangeTombstone* t : covering) {
+      sequences.push_back(t->sequence);
+    }
+    std::sort(sequences.begin(), sequences.end(),
+              std::greater<SequenceNumber>());
+    sequences.erase(std::unique(sequences.begin(), sequences.end()),
+                    sequences.end());
+    if (!fragments_.empty() && fragments_.back().sequences == sequences &&
+        ucmp_->Compare(fragments_.back().end, bounds[i]) == 0) {
+      // Same tombstones as the fragment before: extend it.
+      fragments_.back().end = bounds[i + 1].ToString();
+    } else {
+      TombstoneFragment fragment;
+      fragment.begin = bounds[i].ToString();
+      fragment.end = bounds[i + 1].ToString();
+      fragment.sequences = std::move(sequences);
+      fragments_.push_back(std::move(fragment));
+    }
+  }
+}
+
+void RangeTombstoneList::Insert(const Slice& begin, const Slice& end,
+                                SequenceNumber sequence) {
+  assert(fragmented_);
+  Add(begin, end, sequence);
+  fragmented_ = true;
+
+  std::vector<TombstoneFragment> result;
+  auto add_fragment = [&result](const Slice& fragment_begin,
+                                const Slice& fragment_end,
+                                std::vector<SequenceNumber> sequences) {
+    TombstoneFragment fragment;
+    fragment.begin = fragment_begin.ToString();
+    fragment.end = fragment_end.ToString();
+    fragment.sequences = std::move(sequences);
+    result.push_back(std::move(fragment));
+  };
+  const std::vector<SequenceNumber> alone(1, sequence);
+  // Start of the part of [begin, end) that has no fragment in result yet.
+  std::string next = begin.ToString();
+  for (TombstoneFragment& f : fragments_) {
+    if (ucmp_->Compare(f.end, begin) <= 0) {
+      result.push_back(std::move(f));
+      continue;
+    }
+    if (ucmp_->Compare(f.begin, end) >= 0) {
+      if (ucmp_->Compare(next, end) < 0) {
+        add_fragment(next, end, alone);
+        next = end.ToString();
+      }
+      result.push_back(std::move(f));
+      continue;
+    }
+
+    // "f" overlaps [begin, end): split it at begin and end.
+    if (ucmp_->Compare(f.begin, begin) < 0) {
+      add_fragment(f.begin, begin, f.sequences);
+    } else if (ucmp_->Compare(next, f.begin) < 0) {
+      add_fragment(next, f.begin, alone);
+    }
+    const Slice lo = (ucmp_->Compare(f.begin, begin) < 0) ? begin : f.begin;
+    const Slice hi = (ucmp_->Compare(end, f.end) < 0) ? end : f.end;
+    std::vector<SequenceNumber> sequences = f.sequences;
+    auto pos = std::lower_bound(sequences.begin(), sequences.end(), sequence,
+                                std::greater<SequenceNumber>());
+    if (pos == sequences.end() || *pos != sequence) {
+      sequences.insert(pos, sequence);
+    }
+    add_fragment(lo, hi, std::move(sequences));
+    if (ucmp_->Compare(end, f.end) < 0) {
+      add_fragment(end, f.end, f.sequences);
+    }
+    next = hi.ToString();
+  }
+  if (ucmp_->Compare(next, end) < 0) {
+    add_fragment(next, end, alone);
+  }
+  fragments_.swap(result);
+}
+
+SequenceNumber RangeTombstoneList::VisibleSequence(
+    const TombstoneFragment& fragment, SequenceNumber snapshot) {
+  // The first sequence number not above "snapshot".
+  auto it = std::lower_bound(fragment.sequences.begin(),
+                             fragment.sequences.end(), snapshot,
+                             std::greater<SequenceNumber>());
+  return (it == fragment.sequences.end()) ? 0 : *it;
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  assert(fragmented_);
+  // The last fragment that begins at or before user_key.
+  auto it = std::upper_bound(
+      fragments_.begin(), fragments_.end(), user_key,
+      [this](const Slice& key, const TombstoneFragment& f) {
+        return ucmp_->Compare(key, f.begin) < 0;
+      });
+  if (it == fragments_.begin()) {
+    return 0;
+  }
+  --it;
+  if (ucmp_->Compare(user_key, it->end) >= 0) {
+    return 0;
+  }
+  return VisibleSequence(*it, snapshot);
+}
+
+bool RangeTombstoneList::CoversRange(const Slice& smallest,
+                                     const Slice& largest,
+                                     SequenceNumber snapshot) const {
+  for (const RangeTombstone& t : tombstones_) {
+    if (ucmp_->Compare(t.begin, smallest) > 0) {
+      break;
+    }
+    if (t.sequence <= snapshot && ucmp_->Compare(largest, t.end) < 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+RangeTombstoneList::Cursor::Cursor(const RangeTombstoneList* list)
+    : list_(list), index_(0) {
+  assert(list->fragmented_);
+}
+
+SequenceNumber RangeTombstoneList::Cursor::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) {
+  const std::vector<TombstoneFragment>& fragments = list_->fragments_;
+  const Comparator* const ucmp = list_->ucmp_;
+  while (index_ < fragments.size() &&
+         ucmp->Compare(fragments[index_].end, user_key) <= 0) {
+    index_++;
+  }
+  if (index_ == fragments.size() ||
+      ucmp->Compare(user_key, fragments[index_].begin) < 0) {
+    return 0;
+  }
+  return VisibleSequence(fragments[index_], snapshot);
+}
+
+RangeTombstoneSet::~RangeTombstoneSet() {
+  for (const Cleanup& cleanup : cleanups_) {
+    (*cleanup.function)(cleanup.arg1, cleanup.arg2);
+  }
+}
+
+void RangeTombstoneSet::AddList(const RangeTombstoneList* list,
+                                CleanupFunction function, void* arg1,
+                                void* arg2) {
+  lists_.push_back(list);
+  Cleanup cleanup;
+  cleanup.function = function;
+  cleanup.arg1 = arg1;
+  cleanup.arg2 = arg2;
+  cleanups_.push_back(cleanup);
+}
+
+bool RangeTombstoneSet::ShouldDelete(const Slice& user_key,
+                                     SequenceNumber sequence,
+                                     SequenceNumber snapshot) const {
+  for (MemTable* mem : mems_) {
+    if (mem->MaxCoveringTombstoneSequence(user_key, snapshot) > sequence) {
+      return true;
+    }
+  }
+  for (const RangeTombstoneList* list : lists_) {
+    if (list->ShouldDelete(user_key, sequence, snapshot)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,179 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone deletes every user key in [begin, end) that was written
+// before the tombstone's sequence number.  Tombstones are kept apart from
+// point entries: in a separate skiplist in the memtable and in a "rangedel"
+// meta block in table files.  Either way they are stored as
+// (internal key (begin, sequence, kTypeRangeDeletion), end) pairs, sorted
+// by internal key.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/iterator.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Comparator;
+class MemTable;
+
+struct RangeTombstone {
+  std::string begin;
+  std::string end;
+  SequenceNumber sequence;
+};
+
+// A set of range tombstones gathered from several sources, e.g. all the
+// tombstones visible to a DB iterator or read by a compaction.
+//
+// For lookups the tombstones are split at their begin and end keys into
+// non-overlapping fragments, each listing the sequence numbers of the
+// tombstones that cover it, so that a key is found by binary search.
+// Fragment() builds them once all tombstones are added; after that the
+// const methods may be called from several threads.
+//
+// Lists may be copied, e.g. to Insert() into a copy while other threads
+// still read the original.
+class RangeTombstoneList {
+ public:
+  explicit RangeTombstoneList(const Comparator* user_comparator)
+      : ucmp_(user_comparator), fragmented_(true) {}
+
+  RangeTombstoneList(const RangeTombstoneList&) = default;
+  RangeTombstoneList& operator=(const RangeTombstoneList&) = delete;
+
+  void Add(const Slice& begin, const Slice& end, SequenceNumber sequence);
+
+  // Add a tombstone and split the fragments it overlaps to match, in time
+  // linear in the number of fragments instead of fragmenting them again.
+  // REQUIRES: Fragment() was called after the last Add().
+  void Insert(const Slice& begin, const Slice& end, SequenceNumber sequence);
+
+  // Add all tombstones yielded by "iter".  Does not take ownership.
+  Status AddTombstones(Iterator* iter);
+
+  // Split the tombstones added so far into fragments.  Does nothing if no
+  // tombstone was added since the last call.
+  void Fragment();
+
+  bool empty() const { return tombstones_.empty(); }
+
+  // Tombstones ordered by begin key.
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+  // Return the largest sequence number among the tombstones that cover
+  // "user_key" and are visible at "snapshot", or 0 if there are none.
+  // REQUIRES: Fragment() was called after the last Add().
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+  // Return true if the entry for "user_key" written at "sequence" is
+  // deleted by a tombstone that is visible at "snapshot".
+  // REQUIRES: Fragment() was called after the last Add().
+  bool ShouldDelete(const Slice& user_key, SequenceNumber sequence,
+                    SequenceNumber snapshot) const {
+    return MaxCoveringSequence(user_key, snapshot) > sequence;
+  }
+
+  // Return true if a single tombstone visible at "snapshot" covers every
+  // user key in [smallest, largest].
+  bool CoversRange(const Slice& smallest, const Slice& largest,
+                   SequenceNumber snapshot) const;
+
+  // Answers the same queries for user keys passed in increasing order,
+  // e.g. those of a compaction, by stepping through the fragments along
+  // with the keys instead of searching them.
+  class Cursor {
+   public:
+    // REQUIRES: Fragment() was called after the last Add() to "list".
+    explicit Cursor(const RangeTombstoneList* list);
+
+    Cursor(const Cursor&) = delete;
+    Cursor& operator=(const Cursor&) = delete;
+
+    // REQUIRES: "user_key" is not before the key of the previous call.
+    SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                       SequenceNumber snapshot);
+
+    bool ShouldDelete(const Slice& user_key, SequenceNumber sequence,
+                      SequenceNumber snapshot) {
+      return MaxCoveringSequence(user_key, snapshot) > sequence;
+    }
+
+   private:
+    const RangeTombstoneList* const list_;
+    size_t index_;  // First fragment that does not end before the last key
+  };
+
+ private:
+  // A key range [begin, end) covered by the same tombstones.
+  struct TombstoneFragment {
+    std::string begin;
+    std::string end;
+    std::vector<SequenceNumber> sequences;  // Decreasing
+  };
+
+  // Return the largest sequence number of "fragment" that is visible at
+  // "snapshot", or 0 if there is none.
+  static SequenceNumber VisibleSequence(const TombstoneFragment& fragment,
+                                        SequenceNumber snapshot);
+
+  const Comparator* const ucmp_;
+  std::vector<RangeTombstone> tombstones_;
+  bool fragmented_;  // False if tombstones were added since Fragment()
+  std::vector<TombstoneFragment> fragments_;  // Ordered by begin key
+};
+
+// The range tombstones seen by a DB iterator: those of the memtables and
+// the already fragmented lists of the tables that have any, searched in
+// place instead of being gathered into one list.
+class RangeTombstoneSet {
+ public:
+  RangeTombstoneSet() = default;
+
+  RangeTombstoneSet(const RangeTombstoneSet&) = delete;
+  RangeTombstoneSet& operator=(const RangeTombstoneSet&) = delete;
+
+  // Runs the cleanup functions of the added lists.
+  ~RangeTombstoneSet();
+
+  // Search the tombstones of "mem" as well.  The caller must keep "mem"
+  // alive while the set is in use.
+  void AddMemTable(MemTable* mem) { mems_.push_back(mem); }
+
+  // Search "list" as well; (*function)(arg1, arg2) is called when the set
+  // is destroyed, e.g. to release what keeps "list" alive.
+  // REQUIRES: Fragment() was called after the last Add() to "list".
+  using CleanupFunction = void (*)(void* arg1, void* arg2);
+  void AddList(const RangeTombstoneList* list, CleanupFunction function,
+               void* arg1, void* arg2);
+
+  bool empty() const { return mems_.empty() && lists_.empty(); }
+
+  // Return true if the entry for "user_key" written at "sequence" is
+  // deleted by a tombstone that is visible at "snapshot".
+  bool ShouldDelete(const Slice& user_key, SequenceNumber sequence,
+                    SequenceNumber snapshot) const;
+
+ private:
+  struct Cleanup {
+    CleanupFunction function;
+    void* arg1;
+    void* arg2;
+  };
+
+  std::vector<MemTable*> mems_;
+  std::vector<const RangeTombstoneList*> lists_;
+  std::vector<Cleanup> cleanups_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
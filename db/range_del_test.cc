@@ -0,0 +1,134 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <cstdio>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "leveldb/comparator.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  char buf[10];
+  std::snprintf(buf, sizeof(buf), "%04d", i);
+  return buf;
+}
+
+// The largest sequence number of the tombstones of "list" that cover
+// "user_key" and are visible at "snapshot", found by checking all of them.
+static SequenceNumber ScanCovering(const RangeTombstoneList& list,
+                                   const Slice& user_key,
+                                   SequenceNumber snapshot) {
+  const Comparator* ucmp = BytewiseComparator();
+  SequenceNumber result = 0;
+  for (const RangeTombstone& t : list.tombstones()) {
+    if (t.sequence <= snapshot && t.sequence > result &&
+        ucmp->Compare(t.begin, user_key) <= 0 &&
+        ucmp->Compare(user_key, t.end) < 0) {
+      result = t.sequence;
+    }
+  }
+  return result;
+}
+
+TEST(RangeTombstoneListTest, Empty) {
+  RangeTombstoneList list(BytewiseComparator());
+  list.Fragment();
+  ASSERT_TRUE(list.empty());
+  ASSERT_EQ(0, list.MaxCoveringSequence("a", kMaxSequenceNumber));
+  RangeTombstoneList::Cursor cursor(&list);
+  ASSERT_EQ(0, cursor.MaxCoveringSequence("a", kMaxSequenceNumber));
+}
+
+TEST(RangeTombstoneListTest, Overlapping) {
+  RangeTombstoneList list(BytewiseComparator());
+  list.Add("b", "f", 10);
+  list.Add("d", "h", 20);
+  list.Add("c", "e", 5);
+  list.Fragment();
+
+  ASSERT_EQ(0, list.MaxCoveringSequence("a", kMaxSequenceNumber));
+  ASSERT_EQ(10, list.MaxCoveringSequence("b", kMaxSequenceNumber));
+  ASSERT_EQ(10, list.MaxCoveringSequence("c", kMaxSequenceNumber));
+  ASSERT_EQ(20, list.MaxCoveringSequence("d", kMaxSequenceNumber));
+  ASSERT_EQ(20, list.MaxCoveringSequence("g", kMaxSequenceNumber));
+  ASSERT_EQ(0, list.MaxCoveringSequence("h", kMaxSequenceNumber));
+
+  // Tombstones newer than the snapshot are not visible.
+  ASSERT_EQ(10, list.MaxCoveringSequence("d", 19));
+  ASSERT_EQ(5, list.MaxCoveringSequence("d", 9));
+  ASSERT_EQ(0, list.MaxCoveringSequence("d", 4));
+  ASSERT_EQ(0, list.MaxCoveringSequence("g", 19));
+
+  ASSERT_TRUE(list.ShouldDelete("e", 19, kMaxSequenceNumber));
+  ASSERT_TRUE(!list.ShouldDelete("e", 20, kMaxSequenceNumber));
+  ASSERT_TRUE(!list.ShouldDelete("e", 10, 19));
+
+  // Adding more tombstones needs another Fragment().
+  list.Add("a", "b", 30);
+  list.Fragment();
+  ASSERT_EQ(30, list.MaxCoveringSequence("a", kMaxSequenceNumber));
+  ASSERT_EQ(10, list.MaxCoveringSequence("b", kMaxSequenceNumber));
+}
+
+TEST(RangeTombstoneListTest, Random) {
+  Random rnd(301);
+  for (int run = 0; run < 20; run++) {
+    RangeTombstoneList list(BytewiseComparator());
+    const int num = 1 + rnd.Uniform(50);
+    for (int i = 0; i < num; i++) {
+      const int begin = rnd.Uniform(200);
+      const int end = begin + 1 + rnd.Uniform(50);
+      list.Add(Key(begin), Key(end), 1 + rnd.Uniform(100));
+    }
+    list.Fragment();
+
+    const SequenceNumber snapshot =
+        rnd.OneIn(2) ? kMaxSequenceNumber : rnd.Uniform(100);
+    RangeTombstoneList::Cursor cursor(&list);
+    for (int k = 0; k < 260; k += 1 + rnd.Uniform(3)) {
+      const std::string key = Key(k);
+      const SequenceNumber expected = ScanCovering(list, key, snapshot);
+      ASSERT_EQ(expected, list.MaxCoveringSequence(key, snapshot)) << key;
+      // The cursor sees each key twice, as compactions do for the
+      // entries of one user key.
+      ASSERT_EQ(expected, cursor.MaxCoveringSequence(key, snapshot)) << key;
+      ASSERT_EQ(expected, cursor.MaxCoveringSequence(key, snapshot)) << key;
+    }
+  }
+}
+
+TEST(RangeTombstoneListTest, Insert) {
+  Random rnd(301);
+  for (int run = 0; run < 20; run++) {
+    RangeTombstoneList list(BytewiseComparator());
+    const int num = 1 + rnd.Uniform(50);
+    for (int i = 0; i < num; i++) {
+      const int begin = rnd.Uniform(200);
+      const int end = begin + 1 + rnd.Uniform(50);
+      // Copies keep answering as they did before the insert.
+      RangeTombstoneList copy(list);
+      list.Insert(Key(begin), Key(end), 1 + rnd.Uniform(100));
+      ASSERT_EQ(i, copy.tombstones().size());
+
+      const SequenceNumber snapshot =
+          rnd.OneIn(2) ? kMaxSequenceNumber : rnd.Uniform(100);
+      for (int k = 0; k < 260; k += 1 + rnd.Uniform(3)) {
+        const std::string key = Key(k);
+        ASSERT_EQ(ScanCovering(list, key, snapshot),
+                  list.MaxCoveringSequence(key, snapshot))
+            << key;
+        ASSERT_EQ(ScanCovering(copy, key, snapshot),
+                  copy.MaxCoveringSequence(key, snapshot))
+            << key;
+      }
+    }
+  }
+}
+
+}  // namespace leveldb
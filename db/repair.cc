@@ -177,7 +177,7 @@ class Repairer {
     std::string scratch;
     Slice record;
     WriteBatch batch;
-    MemTable* mem = new MemTable(icmp_);
+    MemTable* mem = new MemTable(icmp_, options_);
     mem->Ref();
     int counter = 0;
     while (reader.ReadRecord(&record, &scratch)) {
@@ -203,7 +203,10 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
+    delete range_del_iter;
     delete iter;
     mem->Unref();
     mem = nullptr;
@@ -268,6 +271,10 @@ class Repairer {
       }
 
       counter++;
+      t.meta.num_entries++;
+      if (parsed.type == kTypeDeletion) {
+        t.meta.num_deletions++;
+      }
       if (empty) {
         empty = false;
         t.meta.smallest.DecodeFrom(key);
@@ -281,6 +288,35 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // Range tombstones extend the key range of the table.
+    iter = table_cache_->NewRangeTombstoneIterator(
+        ReadOptions(), t.meta.number, t.meta.file_size);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      if (!ParseInternalKey(iter->key(), &parsed)) {
+        continue;
+      }
+      InternalKey begin, end;
+      begin.DecodeFrom(iter->key());
+      end.SetFrom(ParsedInternalKey(iter->value(), kMaxSequenceNumber,
+                                    kTypeRangeDeletion));
+      if (empty || icmp_.Compare(begin, t.meta.smallest) < 0) {
+        t.meta.smallest = begin;
+      }
+      if (empty || icmp_.Compare(end, t.meta.largest) > 0) {
+        t.meta.largest = end;
+      }
+      empty = false;
+      t.meta.num_range_deletions++;
+      if (parsed.sequence > t.max_sequence) {
+        t.max_sequence = parsed.sequence;
+      }
+    }
+    if (status.ok() && !iter->status().ok()) {
+      status = iter->status();
+    }
+    delete iter;
+
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
@@ -312,6 +348,13 @@ class Repairer {
       counter++;
     }
     delete iter;
+    iter = table_cache_->NewRangeTombstoneIterator(
+        ReadOptions(), t.meta.number, t.meta.file_size);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      builder->AddRangeTombstone(iter->key(), iter->value());
+      counter++;
+    }
+    delete iter;
 
     ArchiveFile(src);
     if (counter == 0) {
@@ -365,11 +408,19 @@ class Repairer {
     edit_.SetNextFile(next_file_number_);
     edit_.SetLastSequence(max_sequence);
 
+    // Older versions of leveldb cannot read a MANIFEST with entry counts,
+    // so they are only kept if an option uses them.
+    const bool keep_counts =
+        options_.compaction_style == kCompactionStyleLevel &&
+        options_.deletion_compaction_ratio > 0;
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
-      const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+      FileMetaData meta = tables_[i].meta;
+      if (!keep_counts) {
+        meta.num_entries = 0;
+        meta.num_deletions = 0;
+      }
+      edit_.AddFile(0, meta);
     }
 
     // std::fprintf(stderr,
@@ -31,6 +31,7 @@
 #include <cassert>
 #include <cstdlib>
 
+#include "port/port.h"
 #include "util/arena.h"
 #include "util/random.h"
 
@@ -56,6 +57,12 @@ class SkipList {
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
+  // Return "size" bytes of memory that directly follow the links of a new
+  // node, for the contents of the next key to insert.  Comparisons with a
+  // key stored there read the node and the key from the same cache line.
+  // REQUIRES: the next call to Insert() adds a key stored in that memory.
+  char* AllocateKey(size_t size);
+
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
@@ -107,6 +114,9 @@ class SkipList {
   }
 
   Node* NewNode(const Key& key, int height);
+  size_t NodeSize(int height) const {
+    return sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1);
+  }
   int RandomHeight();
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
@@ -142,6 +152,11 @@ class SkipList {
 
   // 用于生成随机数
   Random rnd_;
+
+  // Node returned by AllocateKey() and not yet inserted, and its height.
+  // Only accessed by writers.
+  char* pending_node_;
+  int pending_height_;
 };
 
 // Implementation details follow
@@ -184,12 +199,20 @@ struct SkipList<Key, Comparator>::Node {
 template <typename Key, class Comparator>
 typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::NewNode(
     const Key& key, int height) {
-  char* const node_memory = arena_->AllocateAligned(
-      sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
+  char* const node_memory = arena_->AllocateAligned(NodeSize(height));
   // placement new
   return new (node_memory) Node(key);
 }
 
+template <typename Key, class Comparator>
+char* SkipList<Key, Comparator>::AllocateKey(size_t size) {
+  assert(pending_node_ == nullptr);
+  pending_height_ = RandomHeight();
+  const size_t node_size = NodeSize(pending_height_);
+  pending_node_ = arena_->AllocateAligned(node_size + size);
+  return pending_node_ + node_size;
+}
+
 template <typename Key, class Comparator>
 inline SkipList<Key, Comparator>::Iterator::Iterator(const SkipList* list) {
   list_ = list;
@@ -270,6 +293,10 @@ SkipList<Key, Comparator>::FindGreaterOrEqual(const Key& key,
   int level = GetMaxHeight() - 1;
   while (true) {
     Node* next = x->Next(level);
+    // Fetch the node after next while its key is compared.
+    if (next != nullptr) {
+      port::PrefetchForRead(next->NoBarrier_Next(level));
+    }
     // 从最大level开始跳
     if (KeyIsAfterNode(key, next)) {
       // Keep searching in this list
@@ -336,7 +363,9 @@ SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena* arena)
       arena_(arena),
       head_(NewNode(0 /* any key will do */, kMaxHeight)),
       max_height_(1),
-      rnd_(0xdeadbeef) {
+      rnd_(0xdeadbeef),
+      pending_node_(nullptr),
+      pending_height_(0) {
   for (int i = 0; i < kMaxHeight; i++) {
     head_->SetNext(i, nullptr);
   }
@@ -352,7 +381,8 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
   // Our data structure does not allow duplicate insertion
   assert(x == nullptr || !Equal(key, x->key));
 
-  int height = RandomHeight();
+  const int height =
+      (pending_node_ != nullptr) ? pending_height_ : RandomHeight();
   if (height > GetMaxHeight()) {
     for (int i = GetMaxHeight(); i < height; i++) {
       prev[i] = head_;
@@ -367,7 +397,12 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
     max_height_.store(height, std::memory_order_relaxed);
   }
 
-  x = NewNode(key, height);
+  if (pending_node_ != nullptr) {
+    x = new (pending_node_) Node(key);
+    pending_node_ = nullptr;
+  } else {
+    x = NewNode(key, height);
+  }
   for (int i = 0; i < height; i++) {
     // NoBarrier_SetNext() suffices since we will add a barrier when
     // we publish a pointer to "x" in prev[i].
@@ -5,6 +5,7 @@
 #include "db/skiplist.h"
 
 #include <atomic>
+#include <cstring>
 #include <set>
 
 #include "gtest/gtest.h"
@@ -48,6 +49,33 @@ TEST(SkipTest, Empty) {
   ASSERT_TRUE(!iter.Valid());
 }
 
+TEST(SkipTest, AllocateKey) {
+  Random rnd(301);
+  std::set<Key> keys;
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+  for (int i = 0; i < 1000; i++) {
+    Key key = rnd.Next() % 5000;
+    if (keys.insert(key).second) {
+      if (rnd.OneIn(2)) {
+        // The memory follows the node's links and is left untouched.
+        char* mem = list.AllocateKey(sizeof(Key));
+        std::memcpy(mem, &key, sizeof(Key));
+      }
+      list.Insert(key);
+    }
+  }
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (Key key : keys) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(key, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+}
+
 TEST(SkipTest, InsertAndLookup) {
   const int N = 2000;
   const int R = 5000;
@@ -0,0 +1,117 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+// Entries are stored as internal keys with sequence number zero, which
+// DB::IngestExternalFile() keeps or replaces when the file is ingested.
+struct SstFileWriter::Rep {
+  Rep(const Options& opt)
+      : internal_comparator(opt.comparator),
+        internal_filter_policy(opt.filter_policy),
+        options(opt),
+        file(nullptr),
+        builder(nullptr),
+        file_size(0) {
+    options.comparator = &internal_comparator;
+    if (options.filter_policy != nullptr) {
+      options.filter_policy = &internal_filter_policy;
+    }
+  }
+
+  const InternalKeyComparator internal_comparator;
+  const InternalFilterPolicy internal_filter_policy;
+  Options options;
+  std::string fname;
+  WritableFile* file;
+  TableBuilder* builder;
+  uint64_t file_size;    // Size of the finished file
+  std::string last_key;  // Last user key added
+  std::string buf;       // Scratch space for values with an expiry time
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {}
+
+SstFileWriter::~SstFileWriter() {
+  if (rep_->builder != nullptr) {
+    // Finish() was not called.
+    rep_->builder->Abandon();
+    delete rep_->builder;
+    delete rep_->file;
+    rep_->options.env->RemoveFile(rep_->fname);
+  }
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  if (rep_->builder != nullptr) {
+    return Status::InvalidArgument(fname, "SstFileWriter is already open");
+  }
+  Status s = rep_->options.env->NewWritableFile(fname, &rep_->file);
+  if (s.ok()) {
+    rep_->fname = fname;
+    rep_->builder = new TableBuilder(rep_->options, rep_->file);
+  }
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(r->builder != nullptr);
+  if (r->builder->NumEntries() > 0 &&
+      r->internal_comparator.user_comparator()->Compare(key, r->last_key) <=
+          0) {
+    return Status::InvalidArgument(key, "keys must be added in order");
+  }
+  r->last_key.assign(key.data(), key.size());
+
+  InternalKey ikey(key, 0, kTypeValue);
+  if (r->options.enable_ttl) {
+    r->buf.assign(value.data(), value.size());
+    PutFixed64(&r->buf, 0);
+    r->builder->Add(ikey.Encode(), r->buf);
+  } else {
+    r->builder->Add(ikey.Encode(), value);
+  }
+  return r->builder->status();
+}
+
+Status SstFileWriter::Finish() {
+  Rep* r = rep_;
+  assert(r->builder != nullptr);
+  if (r->builder->NumEntries() == 0) {
+    return Status::InvalidArgument(r->fname, "cannot create an empty file");
+  }
+  Status s = r->builder->Finish();
+  if (s.ok()) {
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  r->file_size = r->builder->FileSize();
+  delete r->builder;
+  r->builder = nullptr;
+  delete r->file;
+  r->file = nullptr;
+  if (!s.ok()) {
+    r->options.env->RemoveFile(r->fname);
+  }
+  return s;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+  return (rep_->builder == nullptr) ? rep_->file_size
+                                    : rep_->builder->FileSize();
+}
+
+}  // namespace leveldb
@@ -5,6 +5,7 @@
 #include "db/table_cache.h"
 
 #include "db/filename.h"
+#include "db/range_del.h"
 
 #include "leveldb/env.h"
 #include "leveldb/table.h"
@@ -16,10 +17,12 @@ namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  RangeTombstoneList* tombstones;  // Null if the table has none
 };
 // 为table cache的LRUCache缓存项注册的删除函数DeleteEntry。
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->tombstones;
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -65,6 +68,31 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       s = Table::Open(options_, file, file_size, &table);
     }
 
+    // Point lookups search the range tombstones of the table, so they
+    // are kept split into fragments while the table is open.
+    RangeTombstoneList* tombstones = nullptr;
+    if (s.ok()) {
+      ReadOptions read_options;
+      read_options.verify_checksums = options_.paranoid_checks;
+      Iterator* iter = table->NewRangeTombstoneIterator(read_options);
+      iter->SeekToFirst();
+      if (iter->Valid()) {
+        tombstones = new RangeTombstoneList(
+            static_cast<const InternalKeyComparator*>(options_.comparator)
+                ->user_comparator());
+        s = tombstones->AddTombstones(iter);
+        tombstones->Fragment();
+      } else {
+        s = iter->status();
+      }
+      delete iter;
+      if (!s.ok()) {
+        delete tombstones;
+        delete table;
+        table = nullptr;
+      }
+    }
+
     if (!s.ok()) {
       assert(table == nullptr);
       delete file;
@@ -74,6 +102,7 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->tombstones = tombstones;
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -105,6 +134,57 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   }
   return result;
 }
+
+Iterator* TableCache::NewRangeTombstoneIterator(const ReadOptions& options,
+                                                uint64_t file_number,
+                                                uint64_t file_size) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+
+  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  Iterator* result = table->NewRangeTombstoneIterator(options);
+  result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  return result;
+}
+Status TableCache::MaxCoveringTombstoneSequence(uint64_t file_number,
+                                               uint64_t file_size,
+                                               const Slice& user_key,
+                                               SequenceNumber snapshot,
+                                               SequenceNumber* sequence) {
+  *sequence = 0;
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeTombstoneList* tombstones =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))->tombstones;
+    if (tombstones != nullptr) {
+      *sequence = tombstones->MaxCoveringSequence(user_key, snapshot);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::AddRangeTombstones(uint64_t file_number,
+                                      uint64_t file_size,
+                                      RangeTombstoneSet* set) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeTombstoneList* tombstones =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))->tombstones;
+    if (tombstones != nullptr) {
+      set->AddList(tombstones, &UnrefEntry, cache_, handle);
+    } else {
+      cache_->Release(handle);
+    }
+  }
+  return s;
+}
+
 // 这是一个查找函数，如果在指定文件中seek 到internal key "k" 找到一个entry，
 // 就调用 (*handle_result)(arg,found_key, found_value).
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
@@ -18,6 +18,7 @@
 namespace leveldb {
 
 class Env;
+class RangeTombstoneSet;
 /**
  * ableCache缓存的是Table对象，每个DB一个，
  * 它内部使用一个LRUCache缓存所有的table对象，实际上其内容是文件编号{file
@@ -27,6 +28,7 @@ class Env;
  */
 class TableCache {
  public:
+  // "options.comparator" must be the InternalKeyComparator of the DB.
   TableCache(const std::string& dbname, const Options& options, int entries);
 
   TableCache(const TableCache&) = delete;
@@ -44,6 +46,25 @@ class TableCache {
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
                         uint64_t file_size, Table** tableptr = nullptr);
 
+  // Return an iterator over the range tombstones of the specified file
+  // (see Table::NewRangeTombstoneIterator).
+  Iterator* NewRangeTombstoneIterator(const ReadOptions& options,
+                                      uint64_t file_number,
+                                      uint64_t file_size);
+
+  // Store in *sequence the largest sequence number among the range
+  // tombstones of the specified file that cover "user_key" and are
+  // visible at "snapshot", or 0 if there are none.
+  Status MaxCoveringTombstoneSequence(uint64_t file_number, uint64_t file_size,
+                                      const Slice& user_key,
+                                      SequenceNumber snapshot,
+                                      SequenceNumber* sequence);
+
+  // Add the fragmented range tombstones of the specified file to *set,
+  // if it has any.  The file stays open until *set is destroyed.
+  Status AddRangeTombstones(uint64_t file_number, uint64_t file_size,
+                            RangeTombstoneSet* set);
+
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
   Status Get(const ReadOptions& options, uint64_t file_number,
@@ -10,7 +10,11 @@
 namespace leveldb {
 
 // Tag numbers for serialized VersionEdit.  These numbers are written to
-// disk and should not be changed.
+// disk and should not be changed.  Older versions of leveldb fail on the
+// tags after kPrevLogNumber, so each is only written when it is needed:
+// kColumnFamily once a column family is created, kFileRangeDeletions for
+// files that hold range tombstones, which they cannot read anyway, and the
+// creation times and deletion counts of files while an option uses them.
 enum Tag {
   kComparator = 1,
   kLogNumber = 2,
@@ -20,7 +24,11 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  kFileCreationTime = 10,
+  kFileRangeDeletions = 11,
+  kColumnFamily = 12,
+  kFileDeletions = 13
 };
 
 void VersionEdit::Clear() {
@@ -37,6 +45,7 @@ void VersionEdit::Clear() {
   compact_pointers_.clear();
   deleted_files_.clear();
   new_files_.clear();
+  new_column_families_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
@@ -81,6 +90,28 @@ void VersionEdit::EncodeTo(std::string* dst) const {
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (f.creation_time != 0) {
+      PutVarint32(dst, kFileCreationTime);
+      PutVarint64(dst, f.number);
+      PutVarint64(dst, f.creation_time);
+    }
+    if (f.num_range_deletions != 0) {
+      PutVarint32(dst, kFileRangeDeletions);
+      PutVarint64(dst, f.number);
+      PutVarint64(dst, f.num_range_deletions);
+    }
+    if (f.num_entries != 0) {
+      PutVarint32(dst, kFileDeletions);
+      PutVarint64(dst, f.number);
+      PutVarint64(dst, f.num_entries);
+      PutVarint64(dst, f.num_deletions);
+    }
+  }
+
+  for (size_t i = 0; i < new_column_families_.size(); i++) {
+    PutVarint32(dst, kColumnFamily);
+    PutVarint32(dst, new_column_families_[i].first);
+    PutLengthPrefixedSlice(dst, new_column_families_[i].second);
   }
 }
 
@@ -93,9 +124,21 @@ static bool GetInternalKey(Slice* input, InternalKey* dst) {
   }
 }
 
+// Return the most recently added new file with the given number, or
+// nullptr if there is none.
+static FileMetaData* FindNewFile(
+    std::vector<std::pair<int, FileMetaData>>* new_files, uint64_t number) {
+  for (auto it = new_files->rbegin(); it != new_files->rend(); ++it) {
+    if (it->second.number == number) {
+      return &it->second;
+    }
+  }
+  return nullptr;
+}
+
 static bool GetLevel(Slice* input, int* level) {
   uint32_t v;
-  if (GetVarint32(input, &v) && v < config::kNumLevels) {
+  if (GetVarint32(input, &v) && v < config::kMaxNumLevels) {
     *level = v;
     return true;
   } else {
@@ -186,6 +229,56 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         }
         break;
 
+      case kFileCreationTime: {
+        uint64_t creation_time;
+        FileMetaData* nf = nullptr;
+        if (GetVarint64(&input, &number) &&
+            GetVarint64(&input, &creation_time) &&
+            (nf = FindNewFile(&new_files_, number)) != nullptr) {
+          nf->creation_time = creation_time;
+        } else {
+          msg = "file creation time";
+        }
+        break;
+      }
+
+      case kFileRangeDeletions: {
+        uint64_t count;
+        FileMetaData* nf = nullptr;
+        if (GetVarint64(&input, &number) && GetVarint64(&input, &count) &&
+            (nf = FindNewFile(&new_files_, number)) != nullptr) {
+          nf->num_range_deletions = count;
+        } else {
+          msg = "file range deletions";
+        }
+        break;
+      }
+
+      case kFileDeletions: {
+        uint64_t entries, deletions;
+        FileMetaData* nf = nullptr;
+        if (GetVarint64(&input, &number) && GetVarint64(&input, &entries) &&
+            GetVarint64(&input, &deletions) && deletions <= entries &&
+            (nf = FindNewFile(&new_files_, number)) != nullptr) {
+          nf->num_entries = entries;
+          nf->num_deletions = deletions;
+        } else {
+          msg = "file deletions";
+        }
+        break;
+      }
+
+      case kColumnFamily: {
+        uint32_t id;
+        if (GetVarint32(&input, &id) && id > 0 &&
+            GetLengthPrefixedSlice(&input, &str)) {
+          new_column_families_.push_back(std::make_pair(id, str.ToString()));
+        } else {
+          msg = "column family";
+        }
+        break;
+      }
+
       default:
         msg = "unknown tag";
         break;
@@ -250,6 +343,26 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.creation_time != 0) {
+      r.append(" @");
+      AppendNumberTo(&r, f.creation_time);
+    }
+    if (f.num_range_deletions != 0) {
+      r.append(" range-deletions:");
+      AppendNumberTo(&r, f.num_range_deletions);
+    }
+    if (f.num_entries != 0) {
+      r.append(" deletions:");
+      AppendNumberTo(&r, f.num_deletions);
+      r.append("/");
+      AppendNumberTo(&r, f.num_entries);
+    }
+  }
+  for (size_t i = 0; i < new_column_families_.size(); i++) {
+    r.append("\n  ColumnFamily: ");
+    AppendNumberTo(&r, new_column_families_[i].first);
+    r.append(" ");
+    r.append(new_column_families_[i].second);
   }
   r.append("\n}\n");
   return r;
@@ -7,6 +7,7 @@
 
 #include "db/dbformat.h"
 #include <set>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -15,7 +16,14 @@ namespace leveldb {
 class VersionSet;
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        creation_time(0),
+        num_range_deletions(0),
+        num_entries(0),
+        num_deletions(0) {}
 
   int refs;  // 还能被seek的次数，低于0就要被compact
 
@@ -26,6 +34,10 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // 最小key
   InternalKey largest;   // 最大key
+  uint64_t creation_time;  // Seconds since the epoch; 0 if unknown
+  uint64_t num_range_deletions;  // Range tombstones stored in the file
+  uint64_t num_entries;    // Point entries in the file; 0 if unknown
+  uint64_t num_deletions;  // Deletion markers among the point entries
 };
 /**
  * 1 当版本间有增量变动时，VersionEdit记录了这种变动； 2
@@ -82,10 +94,30 @@ class VersionEdit {
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add the file described by "f" at the specified level, keeping all of
+  // its persistent metadata (e.g. creation_time, num_range_deletions).
+  void AddFile(int level, const FileMetaData& f) {
+    FileMetaData copy;
+    copy.number = f.number;
+    copy.file_size = f.file_size;
+    copy.smallest = f.smallest;
+    copy.largest = f.largest;
+    copy.creation_time = f.creation_time;
+    copy.num_range_deletions = f.num_range_deletions;
+    copy.num_entries = f.num_entries;
+    copy.num_deletions = f.num_deletions;
+    new_files_.push_back(std::make_pair(level, copy));
+  }
+
   // 从指定的level删除文件
   void RemoveFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
   }
+
+  // Record that the column family "name" was created with the given id.
+  void AddColumnFamily(uint32_t id, const std::string& name) {
+    new_column_families_.push_back(std::make_pair(id, name));
+  }
   // 将信息Encode到一个string中
   void EncodeTo(std::string* dst) const;
   // 从Slice中Decode出DB元信息
@@ -125,6 +157,8 @@ class VersionEdit {
   DeletedFileSet deleted_files_;
   // 新文件集合
   std::vector<std::pair<int, FileMetaData>> new_files_;
+  // 新建的column family (id, name)
+  std::vector<std::pair<uint32_t, std::string>> new_column_families_;
 };
 
 }  // namespace leveldb
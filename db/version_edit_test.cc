@@ -38,4 +38,56 @@ TEST(VersionEditTest, EncodeDecode) {
   TestEncodeDecode(edit);
 }
 
+TEST(VersionEditTest, FileCreationTime) {
+  VersionEdit edit;
+  FileMetaData f;
+  f.number = 7;
+  f.file_size = 100;
+  f.smallest = InternalKey("a", 1, kTypeValue);
+  f.largest = InternalKey("b", 2, kTypeValue);
+  f.creation_time = 1234567890;
+  edit.AddFile(0, f);
+  edit.AddFile(1, 8, 200, f.smallest, f.largest);
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_NE(std::string::npos, parsed.DebugString().find(" @1234567890"));
+}
+
+TEST(VersionEditTest, FileDeletions) {
+  VersionEdit edit;
+  FileMetaData f;
+  f.number = 7;
+  f.file_size = 100;
+  f.smallest = InternalKey("a", 1, kTypeValue);
+  f.largest = InternalKey("b", 2, kTypeDeletion);
+  f.num_entries = 10;
+  f.num_deletions = 4;
+  edit.AddFile(2, f);
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_NE(std::string::npos, parsed.DebugString().find(" deletions:4/10"));
+}
+
+TEST(VersionEditTest, ColumnFamily) {
+  VersionEdit edit;
+  edit.AddColumnFamily(1, "users");
+  edit.AddColumnFamily(2, "");
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_NE(std::string::npos,
+            parsed.DebugString().find("ColumnFamily: 1 users"));
+}
+
 }  // namespace leveldb
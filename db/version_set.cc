@@ -10,6 +10,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include <algorithm>
 #include <cstdio>
@@ -46,9 +47,9 @@ static double MaxBytesForLevel(const Options* options, int level) {
   // the level-0 compaction threshold based on number of files.
 
   // Result for both level-0 and level-1
-  double result = 10. * 1048576.0;
+  double result = static_cast<double>(options->max_bytes_for_level_base);
   while (level > 1) {
-    result *= 10;
+    result *= options->max_bytes_for_level_multiplier;
     level--;
   }
   return result;
@@ -75,7 +76,7 @@ Version::~Version() {
   next_->prev_ = prev_;
 
   // Drop references to files
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < vset_->NumLevels(); level++) {
     for (size_t i = 0; i < files_[level].size(); i++) {
       FileMetaData* f = files_[level][i];
       assert(f->refs > 0);
@@ -261,13 +262,26 @@ void Version::AddIterators(const ReadOptions& options,
    * 创建一个TwoLevelIterator，这就使用了lazy
    * open的机制。
    */
-  for (int level = 1; level < config::kNumLevels; level++) {
+  for (int level = 1; level < vset_->NumLevels(); level++) {
     if (!files_[level].empty()) {
       iters->push_back(NewConcatenatingIterator(options, level));
     }
   }
 }
 
+Status Version::AddRangeTombstones(RangeTombstoneSet* tombstones) {
+  Status s;
+  for (int level = 0; level < vset_->NumLevels() && s.ok(); level++) {
+    for (FileMetaData* f : files_[level]) {
+      if (f->num_range_deletions == 0) continue;
+      s = vset_->table_cache_->AddRangeTombstones(f->number, f->file_size,
+                                                  tombstones);
+      if (!s.ok()) break;
+    }
+  }
+  return s;
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -275,12 +289,15 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerge,  // Found merge operands but no value or deletion yet
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  SequenceNumber seq;  // Sequence number of the entry found, if any
+  std::vector<std::string>* merge_operands;
 };
 }  // namespace
 /**
@@ -293,7 +310,18 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      switch (parsed_key.type) {
+        case kTypeValue:
+          s->state = kFound;
+          break;
+        case kTypeMerge:
+          s->state = kMerge;
+          break;
+        default:
+          s->state = kDeleted;
+          break;
+      }
+      s->seq = parsed_key.sequence;
       if (s->state == kFound) {
         s->value->assign(v.data(), v.size());
       }
@@ -330,23 +358,28 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
     }
   }
 
-  // Search other levels.
-  for (int level = 1; level < config::kNumLevels; level++) {
+  // Search other levels.  The position of the key in each level bounds
+  // the search in the next one.
+  uint32_t left = 0;
+  uint32_t right = file_indexer_.NumFiles(1);
+  for (int level = 1; level < vset_->NumLevels(); level++) {
     size_t num_files = files_[level].size();
-    if (num_files == 0) continue;
-
-    // Binary search to find earliest index whose largest key >= internal_key.
-    uint32_t index = FindFile(vset_->icmp_, files_[level], internal_key);
-    if (index < num_files) {
-      FileMetaData* f = files_[level][index];
-      if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
-        // All of "f" is past any data for user_key
-      } else {
-        if (!(*func)(arg, level, f)) {
-          return;
+    uint32_t index = 0;
+    if (num_files != 0) {
+      // Find earliest index whose largest key >= internal_key.
+      index = file_indexer_.FindFile(level, internal_key, left, right);
+      if (index < num_files) {
+        FileMetaData* f = files_[level][index];
+        if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
+          // All of "f" is past any data for user_key
+        } else {
+          if (!(*func)(arg, level, f)) {
+            return;
+          }
         }
       }
     }
+    file_indexer_.NextLevelBounds(level, index, &left, &right);
   }
 }
 /**
@@ -357,7 +390,8 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
  */
 // 给定key查找value，如果找到保存在val并返回OK。
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    std::string* value, GetStats* stats,
+                    std::vector<std::string>* merge_operands) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
@@ -386,6 +420,7 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
+      state->saver.state = kNotFound;
       state->s = state->vset->table_cache_->Get(*state->options, f->number,
                                                 f->file_size, state->ikey,
                                                 &state->saver, SaveValue);
@@ -393,8 +428,32 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
         state->found = true;
         return false;
       }
+      // A range tombstone in this file hides older entries for the key,
+      // both in this file and in every file searched after it.
+      SequenceNumber tombstone_seq = 0;
+      if (f->num_range_deletions > 0) {
+        state->s = state->vset->table_cache_->MaxCoveringTombstoneSequence(
+            f->number, f->file_size, state->saver.user_key,
+            DecodeFixed64(state->ikey.data() + state->ikey.size() - 8) >> 8,
+            &tombstone_seq);
+        if (!state->s.ok()) {
+          state->found = true;
+          return false;
+        }
+      }
+      if (state->saver.state == kMerge) {
+        state->s = state->ReadMergeOperands(f, tombstone_seq);
+        if (!state->s.ok()) {
+          state->found = true;
+          return false;
+        }
+      } else if (tombstone_seq > 0 && (state->saver.state == kNotFound ||
+                                       state->saver.seq < tombstone_seq)) {
+        state->saver.state = kDeleted;
+      }
       switch (state->saver.state) {
         case kNotFound:
+        case kMerge:
           return true;  // Keep searching in other files
         case kFound:
           state->found = true;
@@ -412,6 +471,44 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       // "control reaches end of non-void function".
       return false;
     }
+
+    // Collect the merge operands for the key in "f", newest first, up to
+    // the value or deletion they apply to, if the file holds it.
+    Status ReadMergeOperands(FileMetaData* f, SequenceNumber tombstone_seq) {
+      Iterator* iter =
+          vset->table_cache_->NewIterator(*options, f->number, f->file_size);
+      for (iter->Seek(ikey); iter->Valid(); iter->Next()) {
+        ParsedInternalKey parsed_key;
+        if (!ParseInternalKey(iter->key(), &parsed_key)) {
+          saver.state = kCorrupt;
+          break;
+        }
+        if (saver.ucmp->Compare(parsed_key.user_key, saver.user_key) != 0) {
+          break;
+        }
+        if (parsed_key.sequence < tombstone_seq) {
+          saver.state = kDeleted;
+          break;
+        }
+        if (parsed_key.type == kTypeMerge) {
+          saver.merge_operands->push_back(iter->value().ToString());
+          continue;
+        }
+        if (parsed_key.type == kTypeValue) {
+          saver.state = kFound;
+          saver.value->assign(iter->value().data(), iter->value().size());
+        } else {
+          saver.state = kDeleted;
+        }
+        break;
+      }
+      if (saver.state == kMerge && tombstone_seq > 0) {
+        saver.state = kDeleted;
+      }
+      Status s = iter->status();
+      delete iter;
+      return s;
+    }
   };
 
   State state;
@@ -428,6 +525,8 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
+  state.saver.seq = 0;
+  state.saver.merge_operands = merge_operands;
 
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 
@@ -495,6 +594,77 @@ bool Version::RecordReadSample(Slice internal_key) {
   return false;
 }
 
+bool Version::FindFileWithEntry(Slice internal_key, FileMetaData** file,
+                                int* level) {
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(internal_key, &ikey)) {
+    return false;
+  }
+
+  struct State {
+    Version* version;
+    Slice internal_key;
+    FileMetaData* file;
+    int level;
+    bool found;
+
+    static void Found(void* arg, const Slice& found_key, const Slice& v) {
+      State* state = reinterpret_cast<State*>(arg);
+      state->found = (state->version->vset_->icmp_.Compare(
+                          found_key, state->internal_key) == 0);
+    }
+
+    static bool Match(void* arg, int level, FileMetaData* f) {
+      State* state = reinterpret_cast<State*>(arg);
+      Status s = state->version->vset_->table_cache_->Get(
+          ReadOptions(), f->number, f->file_size, state->internal_key, state,
+          &State::Found);
+      if (s.ok() && state->found) {
+        state->file = f;
+        state->level = level;
+        return false;
+      }
+      return true;
+    }
+  };
+
+  State state;
+  state.version = this;
+  state.internal_key = internal_key;
+  state.file = nullptr;
+  state.found = false;
+  ForEachOverlapping(ikey.user_key, internal_key, &state, &State::Match);
+  if (state.file == nullptr) {
+    return false;
+  }
+  *file = state.file;
+  *level = state.level;
+  return true;
+}
+
+bool Version::RecordHiddenEntries(Slice internal_key, FileMetaData* f,
+                                  int level) {
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(internal_key, &ikey)) {
+    return false;
+  }
+  // A file in the last level is rewritten on its own, which drops only
+  // the entries hidden by its own deletions.  Otherwise the same scan
+  // would mark it again after every rewrite.
+  if (level == vset_->NumLevels() - 1 && ikey.type != kTypeDeletion) {
+    return false;
+  }
+
+  // Unlike RecordReadSample() a single file is enough: the hidden entries
+  // may all live in it, so the file has to be rewritten, not just moved.
+  if (hidden_file_to_compact_ == nullptr) {
+    hidden_file_to_compact_ = f;
+    hidden_file_to_compact_level_ = level;
+    return true;
+  }
+  return false;
+}
+
 void Version::Ref() { ++refs_; }
 
 void Version::Unref() {
@@ -534,17 +704,23 @@ Compaction，因此如果该SSTable中很多Record是override操作，如果不
    *
    */
   int level = 0;
+  if (vset_->options_->compaction_style != kCompactionStyleLevel) {
+    // Universal and FIFO compaction keep every flush in level-0.
+    return level;
+  }
   if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
     // Push to next level if there is no overlap in next level,
     // and the #bytes overlapping in the level after that are limited.
     InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
     InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
     std::vector<FileMetaData*> overlaps;
-    while (level < config::kMaxMemCompactLevel) {
+    const int max_level =
+        std::min(config::kMaxMemCompactLevel, vset_->NumLevels() - 1);
+    while (level < max_level) {
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
-      if (level + 2 < config::kNumLevels) {
+      if (level + 2 < vset_->NumLevels()) {
         // Check that file does not overlap too many grandparent bytes.
         GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
         const int64_t sum = TotalFileSize(overlaps);
@@ -588,7 +764,7 @@ void Version::GetOverlappingInputs(int level, const InternalKey* begin,
    * key，然后重新开始搜索。
    */
   assert(level >= 0);
-  assert(level < config::kNumLevels);
+  assert(level < vset_->NumLevels());
   inputs->clear();
   Slice user_begin, user_end;
   if (begin != nullptr) {
@@ -629,7 +805,7 @@ void Version::GetOverlappingInputs(int level, const InternalKey* begin,
 
 std::string Version::DebugString() const {
   std::string r;
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < vset_->NumLevels(); level++) {
     // E.g.,
     //   --- level 1 ---
     //   17:123['a' .. 'd']
@@ -690,7 +866,7 @@ class VersionSet::Builder {
 
   VersionSet* vset_;
   Version* base_;
-  LevelState levels_[config::kNumLevels];//存着每个level添加和删除的文件列表
+  LevelState levels_[config::kMaxNumLevels];//存着每个level添加和删除的文件列表
 
  public:
   // Initialize a builder with the files from *base and other info from *vset
@@ -698,7 +874,7 @@ class VersionSet::Builder {
     base_->Ref();
     BySmallestKey cmp;
     cmp.internal_comparator = &vset_->icmp_;
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < config::kMaxNumLevels; level++) {
       levels_[level].added_files = new FileSet(cmp);
     }
   }
@@ -706,7 +882,7 @@ class VersionSet::Builder {
  * 清理levels里面添加的，仅有自己引用的文件。
 */
   ~Builder() {
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < config::kMaxNumLevels; level++) {
       const FileSet* added = levels_[level].added_files;
       std::vector<FileMetaData*> to_unref;
       to_unref.reserve(added->size());
@@ -778,11 +954,26 @@ class VersionSet::Builder {
     }
   }
 
+  // Returns true iff the accumulated state holds a live file at some
+  // level >= num_levels, i.e. the DB cannot be opened with that many levels.
+  bool HasFilesBeyond(int num_levels) const {
+    for (int level = num_levels; level < config::kMaxNumLevels; level++) {
+      const std::set<uint64_t>& deleted = levels_[level].deleted_files;
+      for (FileMetaData* f : base_->files_[level]) {
+        if (deleted.count(f->number) == 0) return true;
+      }
+      for (FileMetaData* f : *levels_[level].added_files) {
+        if (deleted.count(f->number) == 0) return true;
+      }
+    }
+    return false;
+  }
+
   // 把当前的状态存储到v中返回
   void SaveTo(Version* v) {
     BySmallestKey cmp;
     cmp.internal_comparator = &vset_->icmp_;
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < vset_->NumLevels(); level++) {
       // Merge the set of added files with the set of pre-existing files.
       // Drop any deleted files.  Store the result in *v.
       /**
@@ -830,6 +1021,7 @@ class VersionSet::Builder {
       }
 #endif
     }
+    v->file_indexer_.Build(&vset_->icmp_, v->files_, vset_->NumLevels());
   }
   /**
    * 该函数尝试将f加入到levels_[level]文件set中。 要满足两个条件：
@@ -991,6 +1183,9 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     AppendVersion(v);
     log_number_ = edit->log_number_;
     prev_log_number_ = edit->prev_log_number_;
+    for (const auto& family : edit->new_column_families_) {
+      column_families_[family.first] = family.second;
+    }
   } else {
     // 失败了，删除
     delete v;
@@ -1053,6 +1248,7 @@ Status VersionSet::Recover(bool* save_manifest) {
   uint64_t last_sequence = 0;
   uint64_t log_number = 0;
   uint64_t prev_log_number = 0;
+  std::map<uint32_t, std::string> column_families;
   Builder builder(this, current_);
   int read_records = 0;
 
@@ -1108,6 +1304,10 @@ Status VersionSet::Recover(bool* save_manifest) {
         last_sequence = edit.last_sequence_;
         have_last_sequence = true;
       }
+
+      for (const auto& family : edit.new_column_families_) {
+        column_families[family.first] = family.second;
+      }
     }
   }
   delete file;
@@ -1125,6 +1325,11 @@ Status VersionSet::Recover(bool* save_manifest) {
     if (!have_prev_log_number) {
       prev_log_number = 0;
     }
+
+    if (s.ok() && builder.HasFilesBeyond(NumLevels())) {
+      s = Status::InvalidArgument(
+          dbname_, "has table files at a level >= options.num_levels");
+    }
     // 将读取到的log number,
     // prev log number标记为已使用
     MarkFileNumberUsed(prev_log_number);
@@ -1143,6 +1348,7 @@ Status VersionSet::Recover(bool* save_manifest) {
     last_sequence_ = last_sequence;
     log_number_ = log_number;
     prev_log_number_ = prev_log_number;
+    column_families_.swap(column_families);
 
     // See if we can reuse the existing MANIFEST file
     if (ReuseManifest(dscname, current)) {
@@ -1195,21 +1401,87 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
     next_file_number_ = number + 1;
   }
 }
+// 计算每层的目标字节数，保存在level_max_bytes_中。开启
+// level_compaction_dynamic_level_bytes时从最后一层向上推算
+void VersionSet::ComputeLevelMaxBytes(Version* v) {
+  const int last = NumLevels() - 1;
+  // Level-0 is bounded by file count, so its byte target is unused.
+  v->level_max_bytes_[0] = MaxBytesForLevel(options_, 0);
+  if (!options_->level_compaction_dynamic_level_bytes) {
+    for (int level = 1; level <= last; level++) {
+      v->level_max_bytes_[level] = MaxBytesForLevel(options_, level);
+    }
+    return;
+  }
+
+  // Work backwards from the last level so that adjacent levels keep the
+  // configured size ratio no matter how large the database has grown.
+  const double base = static_cast<double>(options_->max_bytes_for_level_base);
+  double target =
+      std::max(static_cast<double>(TotalFileSize(v->files_[last])), base);
+  for (int level = last; level >= 1; level--) {
+    v->level_max_bytes_[level] = target;
+    target = std::max(target / options_->max_bytes_for_level_multiplier, base);
+  }
+}
+
+// 估算为使每层回到目标大小还需要compaction重写的字节数
+void VersionSet::ComputePendingCompactionBytes(Version* v) {
+  v->pending_compaction_bytes_ = 0;
+  if (options_->compaction_style == kCompactionStyleFIFO) {
+    // FIFO compactions only delete files.
+    return;
+  }
+  // Level-0 files are all read and rewritten once they trigger a
+  // compaction, which for leveled compactions rewrites level-1 as well.
+  uint64_t bytes_to_next_level = 0;
+  if (v->files_[0].size() >=
+      static_cast<size_t>(options_->level0_file_num_compaction_trigger)) {
+    bytes_to_next_level = TotalFileSize(v->files_[0]);
+    v->pending_compaction_bytes_ = bytes_to_next_level;
+    if (options_->compaction_style == kCompactionStyleLevel) {
+      v->pending_compaction_bytes_ += TotalFileSize(v->files_[1]);
+    }
+  }
+  if (options_->compaction_style != kCompactionStyleLevel) {
+    return;
+  }
+
+  // Whatever a level holds beyond its target, once the compactions above
+  // it are done, moves to the next level and rewrites the part of that
+  // level it overlaps, assumed to be in proportion to their sizes.
+  for (int level = 1; level < NumLevels() - 1; level++) {
+    const uint64_t level_bytes =
+        TotalFileSize(v->files_[level]) + bytes_to_next_level;
+    const double target = v->level_max_bytes_[level];
+    bytes_to_next_level = 0;
+    if (level_bytes > target) {
+      bytes_to_next_level = level_bytes - static_cast<uint64_t>(target);
+      const uint64_t next_level_bytes = TotalFileSize(v->files_[level + 1]);
+      v->pending_compaction_bytes_ += static_cast<uint64_t>(
+          bytes_to_next_level *
+          (static_cast<double>(next_level_bytes) / level_bytes + 1));
+    }
+  }
+}
+
 /**
  * 该函数依照规则为下次的compaction计算出最适用的level，对于level
  * 0和>0需要分别对待
- * 对于level 0以文件个数计算，kL0_CompactionTrigger默认配置为4
+ * 对于level 0以文件个数计算，level0_file_num_compaction_trigger默认配置为4
  * 对于level>0，根据level内的文件总大小计算
  * 调用VersionSet::Finalize方法来计算每层SSTable是否需要Size
  * Compaction，并选出最需要进行Size Compaction的层作为下次Size
  * Compaction的目标。
  */
 void VersionSet::Finalize(Version* v) {
+  ComputeLevelMaxBytes(v);
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
 
-  for (int level = 0; level < config::kNumLevels - 1; level++) {
+  for (int level = 0; level < NumLevels() - 1; level++) {
     double score;
     if (level == 0) {
       // We treat level-0 specially by bounding the number of files
@@ -1224,12 +1496,24 @@ void VersionSet::Finalize(Version* v) {
       // setting, or very high compression ratios, or lots of
       // overwrites/deletions).
       score = v->files_[level].size() /
-              static_cast<double>(config::kL0_CompactionTrigger);
+              static_cast<double>(options_->level0_file_num_compaction_trigger);
+      if (options_->compaction_style == kCompactionStyleUniversal &&
+          v->files_[level].size() < 2) {
+        // A single run has nothing to be merged with.
+        score = 0;
+      } else if (options_->compaction_style == kCompactionStyleFIFO) {
+        // Level-0 only needs attention once files have to be deleted.
+        const uint64_t level_bytes = TotalFileSize(v->files_[level]);
+        score = 0;
+        if (level_bytes > options_->fifo_max_table_files_size) {
+          score = static_cast<double>(level_bytes) /
+                  std::max<uint64_t>(options_->fifo_max_table_files_size, 1);
+        }
+      }
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score =
-          static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
+      score = static_cast<double>(level_bytes) / v->level_max_bytes_[level];
     }
 
     if (score > best_score) {
@@ -1240,6 +1524,44 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  ComputePendingCompactionBytes(v);
+
+  // Files to rewrite for their deletions or their age.  Deletions stay in
+  // the last level only while snapshots need them, so it is skipped.
+  if (options_->compaction_style == kCompactionStyleLevel) {
+    double best_ratio = 0;
+    for (int level = 0; level < NumLevels(); level++) {
+      for (FileMetaData* f : v->files_[level]) {
+        const uint64_t entries = f->num_entries + f->num_range_deletions;
+        if (options_->deletion_compaction_ratio > 0 &&
+            level + 1 < NumLevels() && entries > 0) {
+          const double ratio =
+              static_cast<double>(f->num_deletions + f->num_range_deletions) /
+              entries;
+          if (ratio >= options_->deletion_compaction_ratio &&
+              ratio > best_ratio) {
+            best_ratio = ratio;
+            v->deletion_file_to_compact_ = f;
+            v->deletion_file_to_compact_level_ = level;
+          }
+        }
+      }
+    }
+  }
+  if (MaxFileAge() > 0) {
+    // Files of unknown age are never rewritten or deleted for their age.
+    for (int level = 0; level < NumLevels(); level++) {
+      for (FileMetaData* f : v->files_[level]) {
+        if (f->creation_time != 0 &&
+            (v->oldest_file_ == nullptr ||
+             f->creation_time < v->oldest_file_->creation_time)) {
+          v->oldest_file_ = f;
+          v->oldest_file_level_ = level;
+        }
+      }
+    }
+  }
   /**
    * 计算完score后，需要等待Size Compaction的触发。Size
    * Compaction的触发发生在后台线程调用的DBImpl::BackgroundCall方法中。
@@ -1254,51 +1576,68 @@ void VersionSet::Finalize(Version* v) {
  */
 Status VersionSet::WriteSnapshot(log::Writer* log) {
   // TODO: Break up into multiple records to reduce memory usage on recovery?
+  VersionEdit edit;
+  AddContents(&edit);
+  std::string record;
+  edit.EncodeTo(&record);
+  return log->AddRecord(record);
+}
 
+void VersionSet::SaveSnapshot(VersionEdit* edit) {
+  AddContents(edit);
+  edit->SetLogNumber(log_number_);
+  edit->SetPrevLogNumber(prev_log_number_);
+  edit->SetNextFile(next_file_number_);
+  edit->SetLastSequence(last_sequence_);
+}
+
+void VersionSet::AddContents(VersionEdit* edit) {
   // Save metadata
-  VersionEdit edit;
-  edit.SetComparatorName(icmp_.user_comparator()->Name());
+  edit->SetComparatorName(icmp_.user_comparator()->Name());
 
   // Save compaction pointers
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < NumLevels(); level++) {
     if (!compact_pointer_[level].empty()) {
       InternalKey key;
       key.DecodeFrom(compact_pointer_[level]);
       // 把level和key加入compact点
-      edit.SetCompactPointer(level, key);
+      edit->SetCompactPointer(level, key);
     }
   }
 
   // Save files
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < NumLevels(); level++) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
       // 把文件添加到新文件集合
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit->AddFile(level, *f);
     }
   }
 
-  std::string record;
-  edit.EncodeTo(&record);
-  return log->AddRecord(record);
+  // Save column families
+  for (const auto& family : column_families_) {
+    edit->AddColumnFamily(family.first, family.second);
+  }
 }
 
 int VersionSet::NumLevelFiles(int level) const {
   assert(level >= 0);
-  assert(level < config::kNumLevels);
+  assert(level < NumLevels());
   return current_->files_[level].size();
 }
 
 const char* VersionSet::LevelSummary(LevelSummaryStorage* scratch) const {
-  // Update code if kNumLevels changes
-  static_assert(config::kNumLevels == 7, "");
-  std::snprintf(
-      scratch->buffer, sizeof(scratch->buffer), "files[ %d %d %d %d %d %d %d ]",
-      int(current_->files_[0].size()), int(current_->files_[1].size()),
-      int(current_->files_[2].size()), int(current_->files_[3].size()),
-      int(current_->files_[4].size()), int(current_->files_[5].size()),
-      int(current_->files_[6].size()));
+  char* p = scratch->buffer;
+  char* limit = scratch->buffer + sizeof(scratch->buffer);
+  p += std::snprintf(p, limit - p, "files[");
+  for (int level = 0; level < NumLevels() && p < limit; level++) {
+    p += std::snprintf(p, limit - p, " %d",
+                       int(current_->files_[level].size()));
+  }
+  if (p < limit) {
+    std::snprintf(p, limit - p, " ]");
+  }
   return scratch->buffer;
 }
 /**
@@ -1306,7 +1645,7 @@ const char* VersionSet::LevelSummary(LevelSummaryStorage* scratch) const {
  */
 uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
   uint64_t result = 0;
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < NumLevels(); level++) {
     const std::vector<FileMetaData*>& files = v->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       if (icmp_.Compare(files[i]->largest, ikey) <= 0) {
@@ -1339,7 +1678,7 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
 void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
   for (Version* v = dummy_versions_.next_; v != &dummy_versions_;
        v = v->next_) {
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < NumLevels(); level++) {
       const std::vector<FileMetaData*>& files = v->files_[level];
       for (size_t i = 0; i < files.size(); i++) {
         live->insert(files[i]->number);
@@ -1350,14 +1689,14 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
 
 int64_t VersionSet::NumLevelBytes(int level) const {
   assert(level >= 0);
-  assert(level < config::kNumLevels);
+  assert(level < NumLevels());
   return TotalFileSize(current_->files_[level]);
 }
 
 int64_t VersionSet::MaxNextLevelOverlappingBytes() {
   int64_t result = 0;
   std::vector<FileMetaData*> overlaps;
-  for (int level = 1; level < config::kNumLevels - 1; level++) {
+  for (int level = 1; level < NumLevels() - 1; level++) {
     for (size_t i = 0; i < current_->files_[level].size(); i++) {
       const FileMetaData* f = current_->files_[level][i];
       current_->GetOverlappingInputs(level + 1, &f->smallest, &f->largest,
@@ -1438,6 +1777,56 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   delete[] list;
   return result;
 }
+Status VersionSet::CollectRangeTombstones(Compaction* c,
+                                          SequenceNumber smallest_snapshot,
+                                          RangeTombstoneList* tombstones) {
+  ReadOptions options;
+  options.verify_checksums = options_->paranoid_checks;
+  options.fill_cache = false;
+
+  Status s;
+  for (FileMetaData* f : c->inputs_[0]) {
+    if (s.ok() && f->num_range_deletions > 0) {
+      Iterator* iter = table_cache_->NewRangeTombstoneIterator(
+          options, f->number, f->file_size);
+      s = tombstones->AddTombstones(iter);
+      delete iter;
+    }
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Everything in "level+1" is older than the tombstones of "level", so a
+  // file whose whole key range is covered holds nothing live.
+  std::vector<FileMetaData*> kept;
+  for (FileMetaData* f : c->inputs_[1]) {
+    if (c->output_level_ == c->level_ + 1 &&
+        tombstones->CoversRange(f->smallest.user_key(), f->largest.user_key(),
+                                smallest_snapshot)) {
+      c->dropped_inputs_.push_back(f);
+    } else {
+      kept.push_back(f);
+    }
+  }
+  c->inputs_[1].swap(kept);
+
+  for (FileMetaData* f : c->inputs_[1]) {
+    if (s.ok() && f->num_range_deletions > 0) {
+      Iterator* iter = table_cache_->NewRangeTombstoneIterator(
+          options, f->number, f->file_size);
+      s = tombstones->AddTombstones(iter);
+      delete iter;
+    }
+  }
+  return s;
+}
+
+// Defined below.
+void AddBoundaryInputs(const InternalKeyComparator& icmp,
+                       const std::vector<FileMetaData*>& level_files,
+                       std::vector<FileMetaData*>* compaction_files);
+
 /**
  *LevelDB在触发Size Compaction时，已知Compaction的起始层级i；
  而LevelDB在触发Seek
@@ -1451,11 +1840,29 @@ Compaction* VersionSet::PickCompaction() {
   // We prefer compactions triggered by too much data in a level over
   // the compactions triggered by seeks.
   const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
+  bool seek_compaction = (current_->file_to_compact_ != nullptr);
+  bool hidden_compaction = (current_->hidden_file_to_compact_ != nullptr);
+  if (options_->compaction_style != kCompactionStyleLevel) {
+    if (options_->compaction_style == kCompactionStyleFIFO) {
+      // Files are deleted oldest first, so only the oldest one's age
+      // matters.
+      if ((size_compaction && current_->compaction_level_ == 0) ||
+          NeedsPeriodicCompaction(current_)) {
+        return PickFIFOCompaction();
+      }
+    } else if (size_compaction && current_->compaction_level_ == 0) {
+      return PickUniversalCompaction();
+    }
+    // Seeks must not push a level-0 run out of the universal layout.
+    seek_compaction =
+        seek_compaction && current_->file_to_compact_level_ > 0;
+    hidden_compaction =
+        hidden_compaction && current_->hidden_file_to_compact_level_ > 0;
+  }
   if (size_compaction) {
     level = current_->compaction_level_;
     assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
+    assert(level + 1 < NumLevels());
     c = new Compaction(options_, level);
 
     // Pick the first file that comes after compact_pointer_[level]
@@ -1475,6 +1882,24 @@ Compaction* VersionSet::PickCompaction() {
     level = current_->file_to_compact_level_;
     c = new Compaction(options_, level);
     c->inputs_[0].push_back(current_->file_to_compact_);
+  } else if (hidden_compaction) {
+    // Moving the file down without rewriting it would keep the entries
+    // its deletions hide.
+    level = current_->hidden_file_to_compact_level_;
+    c = new Compaction(options_, level);
+    c->allow_trivial_move_ = false;
+    c->inputs_[0].push_back(current_->hidden_file_to_compact_);
+  } else if (current_->deletion_file_to_compact_ != nullptr) {
+    // Moving the file down without rewriting it would keep its deletions.
+    level = current_->deletion_file_to_compact_level_;
+    c = new Compaction(options_, level);
+    c->allow_trivial_move_ = false;
+    c->inputs_[0].push_back(current_->deletion_file_to_compact_);
+  } else if (NeedsPeriodicCompaction(current_)) {
+    level = current_->oldest_file_level_;
+    c = new Compaction(options_, level);
+    c->allow_trivial_move_ = false;
+    c->inputs_[0].push_back(current_->oldest_file_);
   } else {
     return nullptr;
   }
@@ -1482,6 +1907,13 @@ Compaction* VersionSet::PickCompaction() {
   c->input_version_ = current_;
   c->input_version_->Ref();
 
+  if (level + 1 == NumLevels()) {
+    // Nothing is below the last level, so it is rewritten in place.
+    c->output_level_ = level;
+    AddBoundaryInputs(icmp_, current_->files_[level], &c->inputs_[0]);
+    return c;
+  }
+
   // Files in level 0 may overlap each other, so pick up all overlapping ones
   if (level == 0) {
     InternalKey smallest, largest;
@@ -1498,6 +1930,140 @@ Compaction* VersionSet::PickCompaction() {
   return c;
 }
 
+Compaction* VersionSet::PickUniversalCompaction() {
+  std::vector<FileMetaData*> runs = current_->files_[0];
+  if (runs.size() < 2) {
+    return nullptr;
+  }
+  // File numbers order the runs by age.  Every compaction below merges a
+  // prefix of the newest runs, so that the output, which takes a newer
+  // number than all of them, still sorts before the older runs.
+  std::sort(runs.begin(), runs.end(), NewestFirst);
+
+  size_t count = 0;
+
+  // Bound space amplification by merging everything once the newer runs
+  // are large compared to the oldest one.
+  uint64_t newer_bytes = 0;
+  for (size_t i = 0; i + 1 < runs.size(); i++) {
+    newer_bytes += runs[i]->file_size;
+  }
+  if (newer_bytes * 100 >=
+      runs.back()->file_size *
+          static_cast<uint64_t>(
+              options_->universal_max_size_amplification_percent)) {
+    count = runs.size();
+  }
+
+  // Otherwise merge the newest runs while the next older run is not much
+  // bigger than what has been picked so far.
+  if (count == 0) {
+    const size_t max_width =
+        static_cast<size_t>(options_->universal_max_merge_width);
+    uint64_t picked_bytes = runs[0]->file_size;
+    size_t n = 1;
+    while (n < runs.size() && n < max_width &&
+           runs[n]->file_size * 100 <=
+               picked_bytes * (100 + options_->universal_size_ratio)) {
+      picked_bytes += runs[n]->file_size;
+      n++;
+    }
+    if (n >= static_cast<size_t>(options_->universal_min_merge_width)) {
+      count = n;
+    }
+  }
+
+  // Otherwise merge just enough of the newest runs to get back under the
+  // level-0 compaction trigger.
+  if (count == 0) {
+    const size_t trigger =
+        static_cast<size_t>(options_->level0_file_num_compaction_trigger);
+    count = (runs.size() >= trigger) ? runs.size() - trigger + 2 : 2;
+    count = std::min(count, runs.size());
+  }
+
+  Compaction* c = new Compaction(options_, 0);
+  c->output_level_ = 0;
+  c->output_number_ = NewFileNumber();
+  // Universal runs are never split into multiple files.
+  c->max_output_file_size_ = std::numeric_limits<uint64_t>::max();
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  c->inputs_[0].assign(runs.begin(), runs.begin() + count);
+  c->older_runs_.assign(runs.begin() + count, runs.end());
+  return c;
+}
+
+bool VersionSet::IsExpired(const FileMetaData* f, uint64_t now) const {
+  // Files of unknown age (e.g. written by an older release) never expire.
+  return options_->fifo_ttl_seconds > 0 && f->creation_time != 0 &&
+         now >= f->creation_time + options_->fifo_ttl_seconds;
+}
+
+void VersionSet::SetNewFileStats(FileMetaData* f) const {
+  f->creation_time = (MaxFileAge() > 0) ? env_->NowMicros() / 1000000 : 0;
+  if (options_->compaction_style != kCompactionStyleLevel ||
+      options_->deletion_compaction_ratio <= 0) {
+    f->num_entries = 0;
+    f->num_deletions = 0;
+  }
+}
+
+uint64_t VersionSet::MaxFileAge() const {
+  switch (options_->compaction_style) {
+    case kCompactionStyleLevel:
+      return options_->periodic_compaction_seconds;
+    case kCompactionStyleFIFO:
+      return options_->fifo_ttl_seconds;
+    default:
+      return 0;
+  }
+}
+
+uint64_t VersionSet::NextFileAgeDue() const {
+  if (current_->oldest_file_ == nullptr) {
+    return 0;
+  }
+  return current_->oldest_file_->creation_time + MaxFileAge();
+}
+
+bool VersionSet::NeedsPeriodicCompaction(const Version* v) const {
+  if (v->oldest_file_ == nullptr) {
+    return false;
+  }
+  const uint64_t now = env_->NowMicros() / 1000000;
+  return now >= v->oldest_file_->creation_time + MaxFileAge();
+}
+
+Compaction* VersionSet::PickFIFOCompaction() {
+  std::vector<FileMetaData*> files = current_->files_[0];
+  std::sort(files.begin(), files.end(), NewestFirst);
+
+  uint64_t total_bytes = TotalFileSize(files);
+  const uint64_t now = env_->NowMicros() / 1000000;
+  Compaction* c = nullptr;
+  // Delete from the oldest file until the rest fit in the size limit and
+  // none of them has expired.
+  while (!files.empty()) {
+    FileMetaData* f = files.back();
+    if (total_bytes <= options_->fifo_max_table_files_size &&
+        !IsExpired(f, now)) {
+      break;
+    }
+    if (c == nullptr) {
+      c = new Compaction(options_, 0);
+      c->output_level_ = 0;
+      c->deletion_only_ = true;
+      c->input_version_ = current_;
+      c->input_version_->Ref();
+    }
+    c->inputs_[0].push_back(f);
+    total_bytes -= f->file_size;
+    files.pop_back();
+  }
+  return c;
+}
+
 // Finds the largest key in a vector of files. Returns true if files is not
 // empty.
 bool FindLargestKey(const InternalKeyComparator& icmp,
@@ -1627,7 +2193,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
 
   // Compute the set of grandparent files that overlap this compaction
   // (parent == level+1; grandparent == level+2)
-  if (level + 2 < config::kNumLevels) {
+  if (level + 2 < NumLevels()) {
     current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
                                    &c->grandparents_);
   }
@@ -1641,13 +2207,24 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
 }
 
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
-                                     const InternalKey* end) {
+                                     const InternalKey* end, bool in_place) {
   std::vector<FileMetaData*> inputs;
   current_->GetOverlappingInputs(level, begin, end, &inputs);
   if (inputs.empty()) {
     return nullptr;
   }
 
+  if (in_place) {
+    assert(level > 0);
+    Compaction* c = new Compaction(options_, level);
+    c->output_level_ = level;
+    c->input_version_ = current_;
+    c->input_version_->Ref();
+    AddBoundaryInputs(icmp_, current_->files_[level], &inputs);
+    c->inputs_[0] = inputs;
+    return c;
+  }
+
   // Avoid compacting too much in one shot in case the range is large.
   // But we cannot do this for level-0 since level-0 files can overlap
   // and we must not pick one file and drop another older file if the
@@ -1675,12 +2252,16 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
 
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
+      output_level_(level + 1),
+      output_number_(0),
+      deletion_only_(false),
+      allow_trivial_move_(true),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
       grandparent_index_(0),
       seen_key_(false),
       overlapped_bytes_(0) {
-  for (int i = 0; i < config::kNumLevels; i++) {
+  for (int i = 0; i < config::kMaxNumLevels; i++) {
     level_ptrs_[i] = 0;
   }
 }
@@ -1703,7 +2284,9 @@ move的SSTable下一次参与Major Compaction时其合并开销会非常大。
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
+  return (allow_trivial_move_ && output_level_ != level_ &&
+          num_input_files(0) == 1 &&
+          num_input_files(1) == 0 &&
           TotalFileSize(grandparents_) <=
               MaxGrandParentOverlapBytes(vset->options_));
 }
@@ -1716,12 +2299,22 @@ void Compaction::AddInputDeletions(
       edit->RemoveFile(level_ + which, inputs_[which][i]->number);
     }
   }
+  for (FileMetaData* f : dropped_inputs_) {
+    edit->RemoveFile(level_ + 1, f->number);
+  }
 }
 
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  for (FileMetaData* f : older_runs_) {
+    if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+        user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
+      return false;
+    }
+  }
+  for (int lvl = output_level_ + 1; lvl < input_version_->vset_->NumLevels();
+       lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
     while (level_ptrs_[lvl] < files.size()) {
       FileMetaData* f = files[level_ptrs_[lvl]];
@@ -1739,6 +2332,23 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+bool Compaction::IsBaseLevelForRange(const Slice& begin, const Slice& end) {
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  for (FileMetaData* f : older_runs_) {
+    if (user_cmp->Compare(end, f->smallest.user_key()) >= 0 &&
+        user_cmp->Compare(begin, f->largest.user_key()) <= 0) {
+      return false;
+    }
+  }
+  for (int lvl = output_level_ + 1; lvl < input_version_->vset_->NumLevels();
+       lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
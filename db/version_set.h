@@ -16,6 +16,7 @@
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
 #include "db/dbformat.h"
+#include "db/file_indexer.h"
 #include "db/version_edit.h"
 #include <map>
 #include <set>
@@ -33,6 +34,8 @@ class Writer;
 class Compaction;
 class Iterator;
 class MemTable;
+class RangeTombstoneList;
+class RangeTombstoneSet;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -66,11 +69,17 @@ class Version {
 
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Add the range tombstones of all files in this version to *tombstones.
+  // The files stay open until *tombstones is destroyed.
+  Status AddRangeTombstones(RangeTombstoneSet* tombstones);
+
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
+  // Merge operands newer than the value or deletion found are appended to
+  // *merge_operands, newest first.
   // REQUIRES: lock is not held
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, std::vector<std::string>* merge_operands);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -83,6 +92,21 @@ class Version {
   // REQUIRES: lock is held
   bool RecordReadSample(Slice key);
 
+  // Store in *file and *level the file that holds the entry with the
+  // specified internal key.  Returns false if no file holds it, e.g.
+  // because it is still in a memtable.  Reads the files, so the lock need
+  // not be held; the caller must hold a reference to this version.
+  bool FindFileWithEntry(Slice key, FileMetaData** file, int* level);
+
+  // Record that an iterator skipped many consecutive hidden entries
+  // (deletion markers and the entries they hide) of "f", in "level", up to
+  // the entry with the specified internal key, and mark "f" for compaction
+  // unless that would not drop them.  The caller makes sure that no
+  // snapshot keeps them.  Returns true if a new compaction may need to be
+  // triggered.
+  // REQUIRES: lock is held
+  bool RecordHiddenEntries(Slice key, FileMetaData* f, int level);
+
   // Reference count management (so Versions do not disappear out from
   // under live iterators)
   void Ref();
@@ -124,8 +148,15 @@ class Version {
         refs_(0),
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
+        hidden_file_to_compact_(nullptr),
+        hidden_file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        pending_compaction_bytes_(0),
+        deletion_file_to_compact_(nullptr),
+        deletion_file_to_compact_level_(-1),
+        oldest_file_(nullptr),
+        oldest_file_level_(-1) {}
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -151,19 +182,44 @@ class Version {
   int refs_;          // 此version的引用
 
   // sstable文件列表
-  std::vector<FileMetaData*> files_[config::kNumLevels];
+  std::vector<FileMetaData*> files_[config::kMaxNumLevels];
+
+  // Speeds up finding the file of a level > 0 that may hold a key.
+  // Built in VersionSet::Builder::SaveTo().
+  FileIndexer file_indexer_;
 
   // 下一个要compact的文件
   FileMetaData* file_to_compact_;
   // 下一个应该compact的level
   int file_to_compact_level_;
 
+  // File whose deletions hide many entries that iterators skip, set by
+  // RecordHiddenEntries().  It is rewritten rather than moved down.
+  FileMetaData* hidden_file_to_compact_;
+  int hidden_file_to_compact_level_;
+
   // 下一个应该compact的level和compaction分数.分数 < 1 说明compaction并不紧迫.
   // 这些字段在Finalize()中初始化
 
   double compaction_score_;
   //// 下一个应该compact的level
   int compaction_level_;
+
+  // Target size in bytes for each level.  Computed in Finalize().
+  double level_max_bytes_[config::kMaxNumLevels];
+
+  // Bytes compactions are behind by; see
+  // VersionSet::PendingCompactionBytes().  Computed in Finalize().
+  uint64_t pending_compaction_bytes_;
+
+  // File with the largest share of deletions above
+  // options_->deletion_compaction_ratio, and the file written longest
+  // ago when files have an age limit (see VersionSet::MaxFileAge()).
+  // Computed in Finalize().
+  FileMetaData* deletion_file_to_compact_;
+  int deletion_file_to_compact_level_;
+  FileMetaData* oldest_file_;
+  int oldest_file_level_;
 };
 /**
  * 除了通过Version管理所有的sstable文件外，
@@ -207,12 +263,21 @@ class VersionSet {
     }
   }
 
+  // Return the number of levels configured for this DB.
+  int NumLevels() const { return options_->num_levels; }
+
   // Return the number of Table files at the specified level.
   int NumLevelFiles(int level) const;
 
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
+  // Return an estimate of the number of bytes compactions have to read
+  // and write to bring every level under its target.
+  uint64_t PendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
 
@@ -232,6 +297,16 @@ class VersionSet {
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
+  // Store the current contents in *edit together with the log, next file
+  // and last sequence numbers, so that a descriptor holding only *edit
+  // recovers the current version.
+  void SaveSnapshot(VersionEdit* edit);
+
+  // Return the column families recorded in the MANIFEST, keyed by id.
+  const std::map<uint32_t, std::string>& column_families() const {
+    return column_families_;
+  }
+
   // Pick level and inputs for a new compaction.
   // Returns nullptr if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
@@ -241,9 +316,11 @@ class VersionSet {
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
-  // the result.
+  // the result.  If "in_place", all the overlapping files are rewritten
+  // into the same level, which must be at least 1 and have no data in
+  // the next level for the range.
   Compaction* CompactRange(int level, const InternalKey* begin,
-                           const InternalKey* end);
+                           const InternalKey* end, bool in_place);
 
   // Return the maximum overlapping data (in bytes) at next level for any
   // file at a level >= 1.
@@ -253,10 +330,39 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
+  // Add the range tombstones of the compaction inputs of "*c" to
+  // *tombstones.  Input files from "level+1" that lie entirely inside a
+  // tombstone from "level" that is visible at smallest_snapshot are
+  // removed from the inputs: they are deleted without being read.
+  // Must be called before MakeInputIterator().
+  Status CollectRangeTombstones(Compaction* c,
+                                SequenceNumber smallest_snapshot,
+                                RangeTombstoneList* tombstones);
+
+  // Seconds after a file is written at which it is due for a compaction:
+  // options_->fifo_ttl_seconds for FIFO compactions, which delete it, and
+  // options_->periodic_compaction_seconds for leveled ones, which rewrite
+  // it.  0 if files have no age limit.
+  uint64_t MaxFileAge() const;
+
+  // Set the creation time of *f, a file written now, and clear its entry
+  // counts unless options_->deletion_compaction_ratio uses them.  Older
+  // versions of leveldb cannot read a MANIFEST that records either, so the
+  // creation time is only set if MaxFileAge() is non-zero.
+  void SetNewFileStats(FileMetaData* f) const;
+
+  // Return the time, in seconds since the epoch, at which the oldest file
+  // of the current version is due for a compaction by its age, or 0 if no
+  // file is.
+  uint64_t NextFileAgeDue() const;
+
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
+    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr) ||
+           (v->hidden_file_to_compact_ != nullptr) ||
+           (v->deletion_file_to_compact_ != nullptr) ||
+           NeedsPeriodicCompaction(v);
   }
 
   // Add all files listed in any live version to *live.
@@ -284,6 +390,14 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // Fill in v->level_max_bytes_ from the options and, in dynamic mode,
+  // from the size of v's last level.
+  void ComputeLevelMaxBytes(Version* v);
+
+  // Fill in v->pending_compaction_bytes_.
+  // REQUIRES: v->level_max_bytes_ is computed.
+  void ComputePendingCompactionBytes(Version* v);
+
   void GetRange(const std::vector<FileMetaData*>& inputs, InternalKey* smallest,
                 InternalKey* largest);
 
@@ -293,9 +407,27 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Pick a universal compaction over the level-0 runs of current_, or
+  // return nullptr if no runs need merging.
+  Compaction* PickUniversalCompaction();
+
+  // Pick the oldest level-0 files of current_ that exceed the FIFO size
+  // or age limits, or return nullptr if there are none.
+  Compaction* PickFIFOCompaction();
+
+  // Return true if f was written more than options_->fifo_ttl_seconds ago.
+  bool IsExpired(const FileMetaData* f, uint64_t now) const;
+
+  // Whether the oldest file of v is due for a periodic compaction, or for
+  // deletion by a FIFO compaction.
+  bool NeedsPeriodicCompaction(const Version* v) const;
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
+  // Add the current contents to *edit
+  void AddContents(VersionEdit* edit);
+
   void AppendVersion(Version* v);
   //=== 第一组，直接来自于DBImple，构造函数传入
   Env* const env_;  // 操作系统封装
@@ -309,6 +441,7 @@ class VersionSet {
   uint64_t last_sequence_;
   uint64_t log_number_;       // log编号
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
+  std::map<uint32_t, std::string> column_families_;  // id -> name
 
   //=== 第三组，menifest文件相关
   // Opened lazily
@@ -320,7 +453,7 @@ class VersionSet {
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
   // level下一次compaction的开始key，空字符串或者合法的InternalKey
-  std::string compact_pointer_[config::kNumLevels];
+  std::string compact_pointer_[config::kMaxNumLevels];
 };
 
 // 记录者关于compact的信息
@@ -345,6 +478,14 @@ Compaction确定Compaction范围的方法与实现。
   // and "level+1" will be merged to produce a set of "level+1" files.
   int level() const { return level_; }
 
+  // Return the level the output files are placed in.  This is "level+1"
+  // except for universal compactions, which write back to level-0.
+  int output_level() const { return output_level_; }
+
+  // Number reserved for the first output file, or 0 if output file
+  // numbers are allocated as the files are opened.
+  uint64_t output_number() const { return output_number_; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
@@ -358,6 +499,9 @@ Compaction确定Compaction范围的方法与实现。
   // Maximum size of files to build during this compaction.
   uint64_t MaxOutputFileSize() const { return max_output_file_size_; }
 
+  // Is this a compaction that only deletes its input files (FIFO)?
+  bool IsDeletionOnly() const { return deletion_only_; }
+
   // Is this a trivial compaction that can be implemented by just
   // moving a single input file to the next level (no merging or splitting)
   bool IsTrivialMove() const;
@@ -370,6 +514,9 @@ Compaction确定Compaction范围的方法与实现。
   // in levels greater than "level+1".
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Like IsBaseLevelForKey(), but for every user key in [begin, end].
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end);
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
@@ -385,6 +532,10 @@ Compaction确定Compaction范围的方法与实现。
   Compaction(const Options* options, int level);
 
   int level_;
+  int output_level_;
+  uint64_t output_number_;
+  bool deletion_only_;
+  bool allow_trivial_move_;  // False if the inputs must be rewritten
   uint64_t max_output_file_size_;
   Version* input_version_;
   VersionEdit edit_;
@@ -404,13 +555,21 @@ Compaction确定Compaction范围的方法与实现。
   int64_t overlapped_bytes_;  // Bytes of overlap between current output
                               // and grandparent files
 
+  // Level-0 runs older than the inputs of a universal compaction.  They
+  // may still hold older entries for the keys being compacted.
+  std::vector<FileMetaData*> older_runs_;
+
+  // Files of "level_+1" entirely covered by a range tombstone from the
+  // "level_" inputs.  They are deleted along with the inputs but not read.
+  std::vector<FileMetaData*> dropped_inputs_;
+
   // State for implementing IsBaseLevelForKey
 
   // level_ptrs_ holds indices into input_version_->levels_: our state
   // is that we are positioned at one of the file ranges for each
   // higher level than the ones involved in this compaction (i.e. for
   // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
+  size_t level_ptrs_[config::kMaxNumLevels];
 };
 
 }  // namespace leveldb
@@ -7,14 +7,20 @@
 //    count: fixed32
 //    data: record[count]
 // record :=
+//    [kColumnFamilyTag id: varint32] operation
+// operation :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeRangeDeletion varstring varstring |
+//    kTypeMerge varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
 
 #include "leveldb/write_batch.h"
 
+#include <algorithm>
+
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
@@ -26,12 +32,23 @@ namespace leveldb {
 // WriteBatch header has an 8-byte sequence number followed by a 4-byte count.
 static const size_t kHeader = 12;
 
+// Prefix of the records that belong to a column family other than the
+// default one.  Not a ValueType, so it never reaches a memtable.
+static const char kColumnFamilyTag = 0x10;
+
 WriteBatch::WriteBatch() { Clear(); }
 
 WriteBatch::~WriteBatch() = default;
 
 WriteBatch::Handler::~Handler() = default;
 
+void WriteBatch::Handler::DeleteRange(const Slice& begin_key,
+                                      const Slice& end_key) {}
+
+void WriteBatch::Handler::Merge(const Slice& key, const Slice& value) {}
+
+void WriteBatch::Handler::SetColumnFamily(uint32_t column_family_id) {}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -48,10 +65,23 @@ Status WriteBatch::Iterate(Handler* handler) const {
   input.remove_prefix(kHeader);
   Slice key, value;
   int found = 0;
+  uint32_t column_family = 0;
   while (!input.empty()) {
     found++;
     char tag = input[0];
     input.remove_prefix(1);
+    uint32_t record_column_family = 0;
+    if (tag == kColumnFamilyTag) {
+      if (!GetVarint32(&input, &record_column_family) || input.empty()) {
+        return Status::Corruption("bad WriteBatch column family");
+      }
+      tag = input[0];
+      input.remove_prefix(1);
+    }
+    if (record_column_family != column_family) {
+      column_family = record_column_family;
+      handler->SetColumnFamily(column_family);
+    }
     switch (tag) {
       case kTypeValue:
         if (GetLengthPrefixedSlice(&input, &key) &&
@@ -68,6 +98,22 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->DeleteRange(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
+      case kTypeMerge:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->Merge(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
@@ -108,6 +154,56 @@ void WriteBatch::Delete(const Slice& key) {
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::DeleteRange(const Slice& begin_key, const Slice& end_key) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin_key);
+  PutLengthPrefixedSlice(&rep_, end_key);
+}
+
+void WriteBatch::Merge(const Slice& key, const Slice& value) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeMerge));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+// Column family id of "column_family"; null is the default column family.
+static uint32_t ColumnFamilyId(ColumnFamilyHandle* column_family) {
+  return (column_family == nullptr) ? 0 : column_family->GetID();
+}
+
+void WriteBatch::Put(ColumnFamilyHandle* column_family, const Slice& key,
+                     const Slice& value) {
+  WriteBatchInternal::TagColumnFamily(this, ColumnFamilyId(column_family));
+  Put(key, value);
+}
+
+void WriteBatch::Delete(ColumnFamilyHandle* column_family, const Slice& key) {
+  WriteBatchInternal::TagColumnFamily(this, ColumnFamilyId(column_family));
+  Delete(key);
+}
+
+void WriteBatch::DeleteRange(ColumnFamilyHandle* column_family,
+                             const Slice& begin_key, const Slice& end_key) {
+  WriteBatchInternal::TagColumnFamily(this, ColumnFamilyId(column_family));
+  DeleteRange(begin_key, end_key);
+}
+
+void WriteBatch::Merge(ColumnFamilyHandle* column_family, const Slice& key,
+                       const Slice& value) {
+  WriteBatchInternal::TagColumnFamily(this, ColumnFamilyId(column_family));
+  Merge(key, value);
+}
+
+void WriteBatchInternal::TagColumnFamily(WriteBatch* b,
+                                         uint32_t column_family_id) {
+  if (column_family_id != 0) {
+    b->rep_.push_back(kColumnFamilyTag);
+    PutVarint32(&b->rep_, column_family_id);
+  }
+}
+
 void WriteBatch::Append(const WriteBatch& source) {
   WriteBatchInternal::Append(this, &source);
 }
@@ -116,24 +212,96 @@ namespace {
 class MemTableInserter : public WriteBatch::Handler {
  public:
   SequenceNumber sequence_;
-  MemTable* mem_;
+  MemTable* mem_;  // Memtable of the current column family, or null
+  const std::vector<MemTable*>* memtables_;
+  Status status_;
 
+  void SetColumnFamily(uint32_t column_family_id) override {
+    if (column_family_id < memtables_->size()) {
+      mem_ = (*memtables_)[column_family_id];
+    } else {
+      mem_ = nullptr;
+      if (status_.ok()) {
+        status_ = Status::InvalidArgument("unknown column family");
+      }
+    }
+  }
   void Put(const Slice& key, const Slice& value) override {
-    mem_->Add(sequence_, kTypeValue, key, value);
+    if (mem_ != nullptr) mem_->Add(sequence_, kTypeValue, key, value);
     sequence_++;
   }
   void Delete(const Slice& key) override {
-    mem_->Add(sequence_, kTypeDeletion, key, Slice());
+    if (mem_ != nullptr) mem_->Add(sequence_, kTypeDeletion, key, Slice());
+    sequence_++;
+  }
+  void DeleteRange(const Slice& begin_key, const Slice& end_key) override {
+    if (mem_ != nullptr) {
+      mem_->Add(sequence_, kTypeRangeDeletion, begin_key, end_key);
+    }
+    sequence_++;
+  }
+  void Merge(const Slice& key, const Slice& value) override {
+    if (mem_ != nullptr) mem_->Add(sequence_, kTypeMerge, key, value);
     sequence_++;
   }
 };
 }  // namespace
 
 Status WriteBatchInternal::InsertInto(const WriteBatch* b, MemTable* memtable) {
+  return InsertInto(b, std::vector<MemTable*>(1, memtable));
+}
+
+Status WriteBatchInternal::InsertInto(const WriteBatch* b,
+                                      const std::vector<MemTable*>& memtables) {
   MemTableInserter inserter;
   inserter.sequence_ = WriteBatchInternal::Sequence(b);
-  inserter.mem_ = memtable;
-  return b->Iterate(&inserter);
+  inserter.mem_ = memtables[0];
+  inserter.memtables_ = &memtables;
+  Status s = b->Iterate(&inserter);
+  if (s.ok()) {
+    s = inserter.status_;
+  }
+  return s;
+}
+
+namespace {
+class ColumnFamilyCollector : public WriteBatch::Handler {
+ public:
+  uint32_t current_ = 0;
+  uint32_t max_id_ = 0;
+  std::vector<bool>* column_families_;
+
+  void SetColumnFamily(uint32_t column_family_id) override {
+    current_ = column_family_id;
+    max_id_ = std::max(max_id_, column_family_id);
+  }
+  void Put(const Slice& key, const Slice& value) override { Record(); }
+  void Delete(const Slice& key) override { Record(); }
+  void DeleteRange(const Slice& begin_key, const Slice& end_key) override {
+    Record();
+  }
+  void Merge(const Slice& key, const Slice& value) override { Record(); }
+
+ private:
+  void Record() {
+    if (column_families_ != nullptr) {
+      if (current_ >= column_families_->size()) {
+        column_families_->resize(current_ + 1);
+      }
+      (*column_families_)[current_] = true;
+    }
+  }
+};
+}  // namespace
+
+Status WriteBatchInternal::ColumnFamilies(const WriteBatch* b,
+                                          uint32_t* max_id,
+                                          std::vector<bool>* column_families) {
+  ColumnFamilyCollector collector;
+  collector.column_families_ = column_families;
+  Status s = b->Iterate(&collector);
+  *max_id = collector.max_id_;
+  return s;
 }
 
 void WriteBatchInternal::SetContents(WriteBatch* b, const Slice& contents) {
@@ -147,4 +315,45 @@ void WriteBatchInternal::Append(WriteBatch* dst, const WriteBatch* src) {
   dst->rep_.append(src->rep_.data() + kHeader, src->rep_.size() - kHeader);
 }
 
+namespace {
+class ExpiryAppender : public WriteBatch::Handler {
+ public:
+  WriteBatch* batch_;
+  uint64_t expiry_;
+  uint32_t column_family_ = 0;
+  std::string buf_;
+
+  void SetColumnFamily(uint32_t column_family_id) override {
+    column_family_ = column_family_id;
+  }
+  void Put(const Slice& key, const Slice& value) override {
+    buf_.assign(value.data(), value.size());
+    PutFixed64(&buf_, expiry_);
+    WriteBatchInternal::TagColumnFamily(batch_, column_family_);
+    batch_->Put(key, buf_);
+  }
+  void Delete(const Slice& key) override {
+    WriteBatchInternal::TagColumnFamily(batch_, column_family_);
+    batch_->Delete(key);
+  }
+  void DeleteRange(const Slice& begin_key, const Slice& end_key) override {
+    WriteBatchInternal::TagColumnFamily(batch_, column_family_);
+    batch_->DeleteRange(begin_key, end_key);
+  }
+  void Merge(const Slice& key, const Slice& value) override {
+    WriteBatchInternal::TagColumnFamily(batch_, column_family_);
+    batch_->Merge(key, value);
+  }
+};
+}  // namespace
+
+Status WriteBatchInternal::AppendWithExpiry(WriteBatch* dst,
+                                            const WriteBatch* src,
+                                            uint64_t expiry) {
+  ExpiryAppender appender;
+  appender.batch_ = dst;
+  appender.expiry_ = expiry;
+  return src->Iterate(&appender);
+}
+
 }  // namespace leveldb
@@ -5,6 +5,8 @@
 #ifndef STORAGE_LEVELDB_DB_WRITE_BATCH_INTERNAL_H_
 #define STORAGE_LEVELDB_DB_WRITE_BATCH_INTERNAL_H_
 
+#include <vector>
+
 #include "db/dbformat.h"
 #include "leveldb/write_batch.h"
 
@@ -35,9 +37,29 @@ class WriteBatchInternal {
 
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
+  // Make the next record added to "batch" belong to the column family
+  // with the given id.  Does nothing for the default column family, id 0.
+  static void TagColumnFamily(WriteBatch* batch, uint32_t column_family_id);
+
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // Insert the records of each column family into "memtables[id]".  Records
+  // of column families whose entry is null are skipped.
+  static Status InsertInto(const WriteBatch* batch,
+                           const std::vector<MemTable*>& memtables);
+
+  // Store in *max_id the largest id of the column families "batch" has
+  // records for, 0 if none.  If "column_families" is non-null, also set
+  // (*column_families)[id] for each of them, growing it as needed.
+  static Status ColumnFamilies(const WriteBatch* batch, uint32_t* max_id,
+                               std::vector<bool>* column_families);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
+
+  // Copy the updates of "src" into "dst", appending the expiry time
+  // "expiry" to every value.  See kValueExpiryLength.
+  static Status AppendWithExpiry(WriteBatch* dst, const WriteBatch* src,
+                                 uint64_t expiry);
 };
 
 }  // namespace leveldb
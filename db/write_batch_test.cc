@@ -37,11 +37,35 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeRangeDeletion:
+        break;
+      case kTypeMerge:
+        state.append("Merge(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(iter->value().ToString());
+        state.append(")");
+        count++;
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
   }
   delete iter;
+  iter = mem->NewRangeTombstoneIterator();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    EXPECT_TRUE(ParseInternalKey(iter->key(), &ikey));
+    EXPECT_EQ(kTypeRangeDeletion, ikey.type);
+    state.append("DeleteRange(");
+    state.append(ikey.user_key.ToString());
+    state.append(", ");
+    state.append(iter->value().ToString());
+    state.append(")@");
+    state.append(NumberToString(ikey.sequence));
+    count++;
+  }
+  delete iter;
   if (!s.ok()) {
     state.append("ParseError()");
   } else if (count != WriteBatchInternal::Count(b)) {
@@ -72,6 +96,148 @@ TEST(WriteBatchTest, Multiple) {
       PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, DeleteRange) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.DeleteRange(Slice("b"), Slice("g"));
+  batch.DeleteRange(Slice("a"), Slice("c"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ(
+      "Put(foo, bar)@100"
+      "DeleteRange(a, c)@102"
+      "DeleteRange(b, g)@101",
+      PrintContents(&batch));
+}
+
+TEST(WriteBatchTest, Merge) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.Merge(Slice("foo"), Slice("baz"));
+  batch.Merge(Slice("box"), Slice("boo"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ(
+      "Merge(box, boo)@102"
+      "Merge(foo, baz)@101"
+      "Put(foo, bar)@100",
+      PrintContents(&batch));
+}
+
+namespace {
+class TestColumnFamily : public ColumnFamilyHandle {
+ public:
+  explicit TestColumnFamily(uint32_t id) : id_(id) {}
+  const std::string& GetName() const override { return name_; }
+  uint32_t GetID() const override { return id_; }
+
+ private:
+  const uint32_t id_;
+  const std::string name_;
+};
+
+class ColumnFamilyRecorder : public WriteBatch::Handler {
+ public:
+  void Put(const Slice& key, const Slice& value) override {
+    state_.append("Put(" + key.ToString() + ", " + value.ToString() + ")");
+  }
+  void Delete(const Slice& key) override {
+    state_.append("Delete(" + key.ToString() + ")");
+  }
+  void SetColumnFamily(uint32_t column_family_id) override {
+    state_.append("CF(" + NumberToString(column_family_id) + ")");
+  }
+
+  std::string state_;
+};
+}  // namespace
+
+TEST(WriteBatchTest, ColumnFamily) {
+  TestColumnFamily one(1), two(2);
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.Put(&one, Slice("foo"), Slice("one"));
+  batch.Delete(&two, Slice("box"));
+  batch.Put(&two, Slice("baz"), Slice("two"));
+  batch.Put(nullptr, Slice("baz"), Slice("boo"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(5, WriteBatchInternal::Count(&batch));
+
+  ColumnFamilyRecorder recorder;
+  ASSERT_TRUE(batch.Iterate(&recorder).ok());
+  ASSERT_EQ(
+      "Put(foo, bar)CF(1)Put(foo, one)CF(2)Delete(box)Put(baz, two)"
+      "CF(0)Put(baz, boo)",
+      recorder.state_);
+
+  // A single memtable only takes the default column family.
+  ASSERT_EQ(
+      "Put(baz, boo)@104"
+      "Put(foo, bar)@100"
+      "ParseError()",
+      PrintContents(&batch));
+
+  InternalKeyComparator cmp(BytewiseComparator());
+  std::vector<MemTable*> memtables;
+  for (int i = 0; i < 3; i++) {
+    memtables.push_back(new MemTable(cmp));
+    memtables.back()->Ref();
+  }
+  ASSERT_TRUE(WriteBatchInternal::InsertInto(&batch, memtables).ok());
+  const char* expected[3][2] = {
+      {"bar", "boo"}, {"one", "NOT_FOUND"}, {"NOT_FOUND", "two"}};
+  for (int i = 0; i < 3; i++) {
+    const char* keys[2] = {"foo", "baz"};
+    for (int k = 0; k < 2; k++) {
+      std::string value;
+      Status s;
+      if (!memtables[i]->Get(LookupKey(keys[k], 200), &value, &s, nullptr) ||
+          !s.ok()) {
+        value = "NOT_FOUND";
+      }
+      ASSERT_EQ(expected[i][k], value) << i << " " << keys[k];
+    }
+    memtables[i]->Unref();
+  }
+
+  // A null memtable skips its column family.
+  memtables.assign(3, nullptr);
+  memtables[0] = new MemTable(cmp);
+  memtables[0]->Ref();
+  ASSERT_TRUE(WriteBatchInternal::InsertInto(&batch, memtables).ok());
+  memtables[0]->Unref();
+}
+
+TEST(WriteBatchTest, ColumnFamilies) {
+  TestColumnFamily two(2), four(4);
+  WriteBatch batch;
+  uint32_t max_id;
+  std::vector<bool> column_families;
+  ASSERT_TRUE(
+      WriteBatchInternal::ColumnFamilies(&batch, &max_id, &column_families)
+          .ok());
+  ASSERT_EQ(0, max_id);
+  ASSERT_TRUE(column_families.empty());
+
+  batch.Put(&four, Slice("foo"), Slice("bar"));
+  batch.Delete(&two, Slice("box"));
+  ASSERT_TRUE(
+      WriteBatchInternal::ColumnFamilies(&batch, &max_id, &column_families)
+          .ok());
+  ASSERT_EQ(4, max_id);
+  ASSERT_EQ(std::vector<bool>({false, false, true, false, true}),
+            column_families);
+
+  batch.Put(Slice("baz"), Slice("boo"));
+  column_families.clear();
+  ASSERT_TRUE(
+      WriteBatchInternal::ColumnFamilies(&batch, &max_id, &column_families)
+          .ok());
+  ASSERT_EQ(4, max_id);
+  ASSERT_EQ(std::vector<bool>({true, false, true, false, true}),
+            column_families);
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
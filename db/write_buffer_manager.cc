@@ -0,0 +1,108 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/write_buffer_manager.h"
+
+#include <atomic>
+#include <vector>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+// Memory is charged to the cache in units of this many bytes, each held
+// by a pinned entry without value.
+static const size_t kCacheChargeUnit = 256 << 10;
+
+static void DeleteNothing(const Slice& key, void* value) {}
+
+struct WriteBufferManager::Rep {
+  Rep(size_t buffer_size, Cache* cache)
+      : buffer_size(buffer_size), cache(cache), memory_usage(0) {}
+
+  struct Charge {
+    Cache::Handle* handle;
+    uint64_t id;
+  };
+
+  // Make the cache entries cover the current memory usage.
+  void UpdateCacheCharge() {
+    MutexLock l(&mutex);
+    const size_t usage = memory_usage.load(std::memory_order_relaxed);
+    while (charges.size() * kCacheChargeUnit < usage) {
+      Charge charge;
+      charge.id = cache->NewId();
+      char key[8];
+      EncodeFixed64(key, charge.id);
+      charge.handle = cache->Insert(Slice(key, sizeof(key)), nullptr,
+                                    kCacheChargeUnit, &DeleteNothing);
+      charges.push_back(charge);
+    }
+    while (!charges.empty() &&
+           (charges.size() - 1) * kCacheChargeUnit >= usage) {
+      ReleaseLastCharge();
+    }
+  }
+
+  void ReleaseLastCharge() EXCLUSIVE_LOCKS_REQUIRED(mutex) {
+    const Charge charge = charges.back();
+    charges.pop_back();
+    cache->Release(charge.handle);
+    // Erase the entry too, so that the charge is gone at once instead of
+    // when the entry is evicted.
+    char key[8];
+    EncodeFixed64(key, charge.id);
+    cache->Erase(Slice(key, sizeof(key)));
+  }
+
+  const size_t buffer_size;
+  Cache* const cache;
+  std::atomic<size_t> memory_usage;
+
+  port::Mutex mutex;
+  std::vector<Charge> charges GUARDED_BY(mutex);
+};
+
+WriteBufferManager::WriteBufferManager(size_t buffer_size, Cache* cache)
+    : rep_(new Rep(buffer_size, cache)) {}
+
+WriteBufferManager::~WriteBufferManager() {
+  if (rep_->cache != nullptr) {
+    MutexLock l(&rep_->mutex);
+    while (!rep_->charges.empty()) {
+      rep_->ReleaseLastCharge();
+    }
+  }
+  delete rep_;
+}
+
+size_t WriteBufferManager::buffer_size() const { return rep_->buffer_size; }
+
+size_t WriteBufferManager::memory_usage() const {
+  return rep_->memory_usage.load(std::memory_order_relaxed);
+}
+
+bool WriteBufferManager::ShouldFlush() const {
+  return rep_->buffer_size > 0 && memory_usage() > rep_->buffer_size;
+}
+
+void WriteBufferManager::ReserveMem(size_t bytes) {
+  rep_->memory_usage.fetch_add(bytes, std::memory_order_relaxed);
+  if (rep_->cache != nullptr) {
+    rep_->UpdateCacheCharge();
+  }
+}
+
+void WriteBufferManager::FreeMem(size_t bytes) {
+  rep_->memory_usage.fetch_sub(bytes, std::memory_order_relaxed);
+  if (rep_->cache != nullptr) {
+    rep_->UpdateCacheCharge();
+  }
+}
+
+}  // namespace leveldb
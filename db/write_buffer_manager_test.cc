@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/write_buffer_manager.h"
+
+#include "gtest/gtest.h"
+#include "leveldb/cache.h"
+
+namespace leveldb {
+
+TEST(WriteBufferManagerTest, ShouldFlush) {
+  WriteBufferManager manager(1000);
+  ASSERT_EQ(1000, manager.buffer_size());
+  manager.ReserveMem(600);
+  ASSERT_TRUE(!manager.ShouldFlush());
+  manager.ReserveMem(600);
+  ASSERT_EQ(1200, manager.memory_usage());
+  ASSERT_TRUE(manager.ShouldFlush());
+  manager.FreeMem(600);
+  ASSERT_TRUE(!manager.ShouldFlush());
+  manager.FreeMem(600);
+  ASSERT_EQ(0, manager.memory_usage());
+
+  // A zero budget only accounts for memory.
+  WriteBufferManager unbounded(0);
+  unbounded.ReserveMem(1 << 30);
+  ASSERT_TRUE(!unbounded.ShouldFlush());
+  unbounded.FreeMem(1 << 30);
+}
+
+TEST(WriteBufferManagerTest, ChargeCache) {
+  Cache* cache = NewLRUCache(64 << 20);
+  {
+    WriteBufferManager manager(0, cache);
+    manager.ReserveMem(1);
+    ASSERT_GE(cache->TotalCharge(), 1);
+    manager.ReserveMem(10 << 20);
+    const size_t charged = cache->TotalCharge();
+    ASSERT_GE(charged, (10 << 20) + 1);
+    ASSERT_LE(charged, (11 << 20));
+    manager.FreeMem(10 << 20);
+    ASSERT_LT(cache->TotalCharge(), charged);
+    manager.FreeMem(1);
+    ASSERT_EQ(0, cache->TotalCharge());
+    manager.ReserveMem(5 << 20);
+  }
+  // Released when the manager is destroyed.
+  ASSERT_EQ(0, cache->TotalCharge());
+  delete cache;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,35 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+
+namespace leveldb {
+
+void WriteController::SetDelayedWriteRate(uint64_t rate) {
+  if (rate_ == 0) {
+    // Writes made while not delayed are not owed for.
+    next_write_micros_ = 0;
+  }
+  rate_ = rate;
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros) const {
+  if (rate_ == 0 || next_write_micros_ <= now_micros) {
+    return 0;
+  }
+  return next_write_micros_ - now_micros;
+}
+
+void WriteController::Charge(uint64_t bytes, uint64_t now_micros) {
+  if (rate_ == 0) {
+    return;
+  }
+  // Time not used by earlier writes is not saved up for later ones.
+  next_write_micros_ = std::max(next_write_micros_, now_micros) +
+                       static_cast<uint64_t>(bytes * 1e6 / rate_);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,48 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A WriteController spaces out writes so that they average a given number
+// of bytes per second.  Each write adds the time its bytes take at that
+// rate to a schedule, and the next write waits until the schedule has
+// caught up with the clock.  Writes that come slower than the rate never
+// wait.
+//
+// Thread safety: requires external synchronization.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <cstdint>
+
+namespace leveldb {
+
+class WriteController {
+ public:
+  WriteController() : rate_(0), next_write_micros_(0) {}
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // Delay writes to "rate" bytes per second.  Zero stops delaying them.
+  void SetDelayedWriteRate(uint64_t rate);
+
+  uint64_t delayed_write_rate() const { return rate_; }
+
+  bool IsDelayed() const { return rate_ > 0; }
+
+  // Return the number of microseconds a write made at "now_micros" has
+  // to wait for the earlier ones to stay under the rate.
+  uint64_t GetDelay(uint64_t now_micros) const;
+
+  // Account for a write of "bytes" made at "now_micros".
+  void Charge(uint64_t bytes, uint64_t now_micros);
+
+ private:
+  uint64_t rate_;               // Bytes per second, or zero
+  uint64_t next_write_micros_;  // When the charged writes are paid for
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
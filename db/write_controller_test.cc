@@ -0,0 +1,55 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+TEST(WriteControllerTest, NotDelayed) {
+  WriteController controller;
+  ASSERT_TRUE(!controller.IsDelayed());
+  controller.Charge(1 << 20, 1000);
+  ASSERT_EQ(0, controller.GetDelay(1000));
+}
+
+TEST(WriteControllerTest, Rate) {
+  WriteController controller;
+  controller.SetDelayedWriteRate(1 << 20);  // 1MB/s
+  ASSERT_TRUE(controller.IsDelayed());
+  ASSERT_EQ(1 << 20, controller.delayed_write_rate());
+
+  // Half a megabyte takes half a second.
+  controller.Charge(1 << 19, 1000000);
+  ASSERT_EQ(500000, controller.GetDelay(1000000));
+  ASSERT_EQ(100000, controller.GetDelay(1400000));
+  ASSERT_EQ(0, controller.GetDelay(1500000));
+
+  // Writes charged before the schedule caught up queue behind it.
+  controller.Charge(1 << 19, 1200000);
+  ASSERT_EQ(800000, controller.GetDelay(1200000));
+
+  // A slower rate spaces the remaining writes further apart.
+  controller.SetDelayedWriteRate(1 << 18);
+  controller.Charge(1 << 18, 2000000);
+  ASSERT_EQ(1000000, controller.GetDelay(2000000));
+}
+
+TEST(WriteControllerTest, IdleTimeIsNotSaved) {
+  WriteController controller;
+  controller.SetDelayedWriteRate(1 << 20);
+  controller.Charge(1 << 20, 0);
+  // Long after the first write, a second one is only charged for itself.
+  controller.Charge(1 << 20, 5000000);
+  ASSERT_EQ(1000000, controller.GetDelay(5000000));
+
+  // Stopping the delay forgets what was owed.
+  controller.SetDelayedWriteRate(0);
+  ASSERT_EQ(0, controller.GetDelay(5000000));
+  controller.SetDelayedWriteRate(1 << 20);
+  ASSERT_EQ(0, controller.GetDelay(5000000));
+}
+
+}  // namespace leveldb
@@ -355,6 +355,21 @@ class InMemoryEnv : public EnvWrapper {
     return Status::OK();
   }
 
+  Status LinkFile(const std::string& src, const std::string& target) override {
+    MutexLock lock(&mutex_);
+    if (file_map_.find(src) == file_map_.end()) {
+      return Status::IOError(src, "File not found");
+    }
+    if (file_map_.find(target) != file_map_.end()) {
+      return Status::IOError(target, "File exists");
+    }
+
+    FileState* file = file_map_[src];
+    file->Ref();
+    file_map_[target] = file;
+    return Status::OK();
+  }
+
   Status LockFile(const std::string& fname, FileLock** lock) override {
     *lock = new FileLock;
     return Status::OK();
@@ -74,6 +74,15 @@ TEST_F(MemEnvTest, Basics) {
   ASSERT_LEVELDB_OK(env_->GetFileSize("/dir/g", &file_size));
   ASSERT_EQ(8, file_size);
 
+  // Check that linking works.
+  ASSERT_TRUE(!env_->LinkFile("/dir/non_existent", "/dir/h").ok());
+  ASSERT_LEVELDB_OK(env_->LinkFile("/dir/g", "/dir/h"));
+  ASSERT_TRUE(!env_->LinkFile("/dir/g", "/dir/h").ok());
+  ASSERT_LEVELDB_OK(env_->RemoveFile("/dir/g"));
+  ASSERT_LEVELDB_OK(env_->GetFileSize("/dir/h", &file_size));
+  ASSERT_EQ(8, file_size);
+  ASSERT_LEVELDB_OK(env_->RenameFile("/dir/h", "/dir/g"));
+
   // Check that opening non-existent file fails.
   SequentialFile* seq_file;
   RandomAccessFile* rand_file;
@@ -0,0 +1,93 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A BackupEngine keeps a series of backups of a DB in a directory.
+// Table files are immutable, so a table file that is part of several
+// backups is copied only once: each backup copies only the table files
+// that no earlier backup has, plus a small MANIFEST and CURRENT file for
+// the DB and each of its column families.
+//
+// A BackupEngine is not thread-safe: concurrent calls must use external
+// synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
+#define STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class DB;
+class Env;
+
+struct LEVELDB_EXPORT BackupEngineOptions {
+  // Create a BackupEngineOptions object with default values for all fields.
+  BackupEngineOptions();
+
+  // Use the specified object to interact with the environment,
+  // e.g. to read the DB files and write the backup files.
+  // Default: Env::Default()
+  Env* env;
+
+  // Number of threads VerifyBackup() uses to check the files of a backup.
+  int max_background_operations = 4;
+};
+
+struct LEVELDB_EXPORT BackupInfo {
+  uint32_t backup_id;
+  int64_t timestamp;  // Seconds since the epoch
+  uint64_t size;      // Combined size of the files of the backup
+  uint32_t number_files;
+};
+
+class LEVELDB_EXPORT BackupEngine {
+ public:
+  // Open the backups in the directory "backup_dir", creating it if
+  // missing.  Stores a pointer to a heap-allocated BackupEngine in
+  // *backup_engine and returns OK on success.  Stores nullptr in
+  // *backup_engine and returns a non-OK status on error.  The caller
+  // should delete *backup_engine when it is no longer needed.
+  //
+  // Removes the files of incomplete backups and files that no backup
+  // uses any more.
+  static Status Open(const BackupEngineOptions& options,
+                     const std::string& backup_dir,
+                     BackupEngine** backup_engine);
+
+  BackupEngine() = default;
+
+  BackupEngine(const BackupEngine&) = delete;
+  BackupEngine& operator=(const BackupEngine&) = delete;
+
+  virtual ~BackupEngine();
+
+  // Back up the current state of "db", including its column families,
+  // and store the id of the new backup in *backup_id.  The memtables of
+  // "db" are flushed first, so the backup needs no log file.  Returns
+  // NotSupported if "db" does not implement DB::GetLiveFiles().
+  virtual Status CreateNewBackup(DB* db, uint32_t* backup_id) = 0;
+
+  // Store information about every backup in *backup_info, oldest first.
+  virtual void GetBackupInfo(std::vector<BackupInfo>* backup_info) = 0;
+
+  // Delete a backup, and the files that only it uses.
+  virtual Status DeleteBackup(uint32_t backup_id) = 0;
+
+  // Check the size and checksum of every file of a backup.
+  virtual Status VerifyBackup(uint32_t backup_id) = 0;
+
+  // Copy a backup to the directory "db_dir", which must not contain a
+  // DB, so that it can be opened with the column families it had.
+  virtual Status RestoreDBFromBackup(uint32_t backup_id,
+                                     const std::string& db_dir) = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
@@ -0,0 +1,49 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A CompactionFilter lets the application drop or rewrite values while
+// compactions copy them to new table files, e.g. to garbage collect data
+// that is no longer needed or to migrate values to a new format without
+// an extra pass over the database.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Slice;
+
+class LEVELDB_EXPORT CompactionFilter {
+ public:
+  enum Decision {
+    kKeep,         // Keep the value unchanged
+    kRemove,       // Delete the key
+    kChangeValue,  // Replace the value with *new_value
+  };
+
+  virtual ~CompactionFilter();
+
+  // Return the name of this filter.  Used for logging only: the info log
+  // records it each time the DB is opened.
+  virtual const char* Name() const = 0;
+
+  // Called for the newest value of "key" each time it is compacted into
+  // "level", unless a snapshot can still read it.  Older values of the key and
+  // deletion markers are never passed in.  Removing the value also hides
+  // any older values of the key in the database.
+  //
+  // May be called concurrently from several threads, so implementations
+  // must be thread-safe.
+  virtual Decision Filter(int level, const Slice& key,
+                          const Slice& existing_value,
+                          std::string* new_value) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
@@ -7,6 +7,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -18,6 +20,7 @@ namespace leveldb {
 static const int kMajorVersion = 1;
 static const int kMinorVersion = 23;
 
+struct IngestExternalFileOptions;
 struct Options;
 struct ReadOptions;
 struct WriteOptions;
@@ -31,6 +34,46 @@ class LEVELDB_EXPORT Snapshot {
   virtual ~Snapshot();
 };
 
+// Handle to a column family of a DB: a separate key space with its own
+// memtables, sstables and options that shares the write-ahead log, the
+// sequence numbers and the snapshots of its DB.  Handles are owned by the
+// DB and stay valid until the DB is deleted.
+class LEVELDB_EXPORT ColumnFamilyHandle {
+ public:
+  virtual ~ColumnFamilyHandle();
+
+  virtual const std::string& GetName() const = 0;
+
+  // Id of the column family, as recorded in WriteBatch.  The default
+  // column family, which holds the keys written without a handle, is 0.
+  virtual uint32_t GetID() const = 0;
+};
+
+// Name and options of a column family to open with DB::Open.
+struct LEVELDB_EXPORT ColumnFamilyDescriptor {
+  ColumnFamilyDescriptor() = default;
+  ColumnFamilyDescriptor(const std::string& n, const Options& o)
+      : name(n), options(o) {}
+
+  std::string name;
+  Options options;
+};
+
+// The files of the current state of a DB or of one of its column
+// families, see DB::GetLiveFiles().
+struct LEVELDB_EXPORT LiveFiles {
+  uint32_t column_family_id = 0;  // 0 for the DB itself
+  std::string dbname;             // Directory of the files
+  // Names of the table files, relative to dbname
+  std::vector<std::string> table_files;
+  // A descriptor record that recovers the table files without any log,
+  // and the number of its MANIFEST file
+  std::string descriptor;
+  uint64_t descriptor_number = 0;
+  // Owned by the DB: keeps the table files from deletion
+  void* pinned = nullptr;
+};
+
 // A range of keys
 struct LEVELDB_EXPORT Range {
   Range() = default;
@@ -53,6 +96,14 @@ class LEVELDB_EXPORT DB {
   static Status Open(const Options& options, const std::string& name,
                      DB** dbptr);
 
+  // Open the database with the specified "name" and the column families
+  // in "column_families", creating those that do not exist yet.  Every
+  // column family of the database must be listed.  On success stores a
+  // handle for each column family in *handles, in the same order.
+  static Status Open(const Options& options, const std::string& name,
+                     const std::vector<ColumnFamilyDescriptor>& column_families,
+                     std::vector<ColumnFamilyHandle*>* handles, DB** dbptr);
+
   DB() = default;
 
   DB(const DB&) = delete;
@@ -72,6 +123,20 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for every key in the range
+  // [begin_key, end_key).  Returns OK on success, and a non-OK status on
+  // error.  It is not an error if the range is empty.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin_key, const Slice& end_key);
+
+  // Combine "value" with the current value of "key" using
+  // Options::merge_operator.  Returns OK on success, and a non-OK status
+  // on error.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options, const Slice& key,
+                       const Slice& value);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -121,6 +186,16 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.num-immutable-mem-table" - returns the number of full
+  //     memtables waiting to be written to level-0.
+  //  "leveldb.estimate-pending-compaction-bytes" - returns an estimate of
+  //     the number of bytes compactions have to read and write before
+  //     every level is under its target size.  Writes are slowed down and
+  //     stopped as it crosses Options::soft_pending_compaction_bytes_limit
+  //     and hard_pending_compaction_bytes_limit.
+  //  "leveldb.write-stall-stats" - returns a multi-line string with the
+  //     number of writes slowed down or stopped and the time they lost
+  //     for each cause, and the rate writes are held to, 0 if none.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -145,6 +220,68 @@ class LEVELDB_EXPORT DB {
   // Therefore the following call will compact the entire database:
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  // Like CompactRange() above, with "options" choosing how deep the range
+  // is compacted and whether automatic compactions may run meanwhile.
+  // CompactRange(begin, end) uses target_level -1, kBottommostLevelSkip
+  // and no exclusive_manual_compaction.
+  virtual Status CompactRange(const CompactRangeOptions& options,
+                              const Slice* begin, const Slice* end);
+
+  // Write the memtable to a table file, so that the log that holds its
+  // entries is no longer needed.  Does nothing if the memtable is empty.
+  virtual Status Flush(const FlushOptions& options);
+
+  // Add the table file "file", built with an SstFileWriter, to the DB.
+  // Its entries become visible atomically and are newer than any
+  // earlier write; snapshots taken before do not see them.  Writes wait
+  // while the file is added.
+  virtual Status IngestExternalFile(const IngestExternalFileOptions& options,
+                                    const std::string& file);
+
+  // Create an openable copy of the DB, with its column families, in the
+  // new directory "checkpoint_dir".  The memtables are flushed first, and
+  // table files are hard linked when the Env supports it, else copied.
+  // Writes wait only while the memtables are flushed.
+  virtual Status CreateCheckpoint(const std::string& checkpoint_dir);
+
+  // Flush the memtables of the DB and its column families and store the
+  // files of their current state in *live, the DB first.  The table
+  // files are not deleted until ReleaseLiveFiles(live) is called.
+  virtual Status GetLiveFiles(std::vector<LiveFiles>* live);
+  virtual void ReleaseLiveFiles(std::vector<LiveFiles>* live);
+
+  // Create a column family named "name" with the given options and store
+  // its handle in *handle.  Column families cannot be dropped.
+  virtual Status CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle);
+
+  // Same as the methods above, for the column family "column_family".
+  // Updates of several column families are made atomic by writing them
+  // with one WriteBatch.
+  virtual Status Put(const WriteOptions& options,
+                     ColumnFamilyHandle* column_family, const Slice& key,
+                     const Slice& value);
+  virtual Status Delete(const WriteOptions& options,
+                        ColumnFamilyHandle* column_family, const Slice& key);
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family, const Slice& key,
+                     std::string* value);
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family);
+  virtual bool GetProperty(ColumnFamilyHandle* column_family,
+                           const Slice& property, std::string* value);
+  virtual void CompactRange(ColumnFamilyHandle* column_family,
+                            const Slice* begin, const Slice* end);
+  virtual Status CompactRange(const CompactRangeOptions& options,
+                              ColumnFamilyHandle* column_family,
+                              const Slice* begin, const Slice* end);
+  virtual Status Flush(const FlushOptions& options,
+                       ColumnFamilyHandle* column_family);
+  virtual Status IngestExternalFile(ColumnFamilyHandle* column_family,
+                                    const IngestExternalFileOptions& options,
+                                    const std::string& file);
 };
 
 // Destroy the contents of the specified database.
@@ -168,6 +168,13 @@ class LEVELDB_EXPORT Env {
   virtual Status RenameFile(const std::string& src,
                             const std::string& target) = 0;
 
+  // Create target as a hard link to the existing file src.  Fails if
+  // target exists.
+  //
+  // The default implementation returns an IsNotSupportedError error;
+  // callers must be prepared to copy the file instead.
+  virtual Status LinkFile(const std::string& src, const std::string& target);
+
   // Lock the specified file.  Used to prevent concurrent access to
   // the same db by multiple processes.  On failure, stores nullptr in
   // *lock and returns non-OK.
@@ -377,6 +384,9 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status RenameFile(const std::string& s, const std::string& t) override {
     return target_->RenameFile(s, t);
   }
+  Status LinkFile(const std::string& s, const std::string& t) override {
+    return target_->LinkFile(s, t);
+  }
   Status LockFile(const std::string& f, FileLock** l) override {
     return target_->LockFile(f, l);
   }
@@ -0,0 +1,43 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator turns read-modify-write updates such as counter
+// increments or appends into blind writes: DB::Merge() records an operand
+// for a key, and the operands are combined with the key's value only when
+// the key is read or compacted.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // The name of the operator.  Used for logging only: the info log records
+  // it each time the DB is opened.
+  virtual const char* Name() const = 0;
+
+  // Apply "operands" (oldest first) to "existing_value", which is null if
+  // the key had no value before the first operand, and store the result
+  // in *new_value.  Return false if the operands cannot be applied; the
+  // read or compaction then fails with a Corruption error.
+  //
+  // May be called concurrently from several threads, so implementations
+  // must be thread-safe.
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -6,17 +6,21 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
 
 #include "leveldb/export.h"
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
 class Snapshot;
+class WriteBufferManager;
 
 // DB contents are stored in a set of blocks, each of which holds a
 // sequence of key,value pairs.  Each block may be compressed before
@@ -30,6 +34,45 @@ enum CompressionType {
   kZstdCompression = 0x2,
 };
 
+// How table files are chosen for background compaction.
+enum CompactionStyle {
+  // Files are organized into levels of exponentially increasing size and
+  // each compaction merges a level-L file into the overlapping level-L+1
+  // files.  Good read and space amplification.
+  kCompactionStyleLevel = 0,
+  // Each level-0 file is a sorted run and compactions merge runs of
+  // similar size into a single new level-0 run.  Much lower write
+  // amplification at the cost of higher read and space amplification.
+  kCompactionStyleUniversal = 1,
+  // All files stay in level-0 and are never merged.  The oldest files are
+  // deleted once the total size or the file age exceeds its limit.  Meant
+  // for logs and time-series data that are only kept for a while.
+  kCompactionStyleFIFO = 2,
+};
+
+// Whether DB::CompactRange() rewrites the files of the deepest level that
+// holds keys of the range, which no other level is compacted into.
+enum BottommostLevelCompaction {
+  kBottommostLevelSkip = 0,
+  // Only if a compaction filter or enable_ttl may drop entries.
+  kBottommostLevelIfHaveCompactionFilter = 1,
+  kBottommostLevelForce = 2,
+};
+
+// The data structure that holds the entries of a memtable.
+enum MemTableType {
+  // A skiplist, kept sorted as entries are added.  Good for all workloads.
+  kSkipListMemTable = 0,
+  // A hash table of skiplists keyed by the first memtable_prefix_length
+  // bytes of the user key.  Inserts and point lookups only search the
+  // skiplist of their key's prefix, but iterators merge all of them.
+  kHashSkipListMemTable = 1,
+  // An unsorted vector that is sorted when it is read, usually once when
+  // it is flushed.  The fastest choice for bulk loads.  Reads of the
+  // mutable memtable sort all entries added since the previous read.
+  kVectorMemTable = 2,
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct LEVELDB_EXPORT Options {
   // Create an Options object with default values for all fields.
@@ -76,12 +119,62 @@ struct LEVELDB_EXPORT Options {
   // on disk) before converting to a sorted on-disk file.
   //
   // Larger values increase performance, especially during bulk loads.
-  // Up to two write buffers may be held in memory at the same time,
-  // so you may wish to adjust this parameter to control memory usage.
+  // Up to max_write_buffer_number write buffers may be held in memory at
+  // the same time, so you may wish to adjust this parameter to control
+  // memory usage.
   // Also, a larger write buffer will result in a longer recovery time
   // the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // Maximum number of write buffers, the one being filled included.  Full
+  // write buffers wait in memory until they are written to level-0; writes
+  // stall only when this many are full.  Larger values absorb bursts that
+  // come faster than the buffers can be written out.
+  int max_write_buffer_number = 2;
+
+  // Column families share the log of their DB, so a family that is
+  // rarely written keeps every log since its last flush alive.  Once the
+  // logs still needed add up to more than this many bytes, a memtable
+  // switch also switches the memtables of the families that need older
+  // logs than the one it closes.  0 means four times write_buffer_size
+  // times max_write_buffer_number.  Only the DB's own value is used.
+  uint64_t max_total_wal_size = 0;
+
+  // If true, all full write buffers waiting when a write to level-0 starts
+  // are merged into a single file.  Otherwise each one gets its own file.
+  bool merge_write_buffers = true;
+
+  // If non-null, bounds the memory of the memtables of this database
+  // together with those of every other database sharing the object; see
+  // leveldb/write_buffer_manager.h.  write_buffer_size still bounds each
+  // memtable.  Column families use the manager of their database unless
+  // they set their own.
+  WriteBufferManager* write_buffer_manager = nullptr;
+
+  // Data structure of the memtables; see MemTableType above.
+  MemTableType memtable_type = kSkipListMemTable;
+
+  // kHashSkipListMemTable: number of leading bytes of the user key that
+  // select its skiplist, and the number of hash buckets.
+  size_t memtable_prefix_length = 8;
+  size_t memtable_hash_bucket_count = 1024;
+
+  // If true, each memtable entry is stored right after the links of its
+  // skiplist node, so that comparing with it during a search touches one
+  // cache line instead of two.  Ignored by kVectorMemTable.
+  bool memtable_inline_keys = false;
+
+  // If non-zero, memtables allocate memory in chunks of this many bytes
+  // mapped with huge pages, or with transparent huge pages if none are
+  // reserved, which reduces TLB misses with large write buffers.  Should
+  // be the system's huge page size, e.g. 2MB, and well below
+  // write_buffer_size; it is ignored if larger than a quarter of it.
+  size_t memtable_huge_page_size = 0;
+
+  // If not negative, the huge page chunks of the memtables are bound to
+  // this NUMA node where supported.
+  int memtable_numa_node = -1;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -105,6 +198,14 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // EXPERIMENTAL: If true, new tables also store a piecewise linear model
+  // of the position of keys in their index block, which point lookups
+  // use to narrow the search in the index block.  This only helps if the
+  // comparator orders keys like their bytes and the keys of a table are
+  // spread evenly, e.g. fixed-width big-endian integers.  Tables written
+  // with this option can be read by any version that knows meta blocks.
+  bool learned_index = false;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -115,6 +216,101 @@ struct LEVELDB_EXPORT Options {
   // initially populating a large database.
   size_t max_file_size = 2 * 1024 * 1024;
 
+  // Number of levels in the LSM tree.  Clipped to the range [2, 20].
+  //
+  // REQUIRES: No table files exist at a level >= num_levels in an
+  // existing database; DB::Open fails with InvalidArgument otherwise.
+  int num_levels = 7;
+
+  // Level-0 compaction is started when there are this many level-0 files.
+  int level0_file_num_compaction_trigger = 4;
+
+  // Soft limit on the number of level-0 files.  Writes are slowed down
+  // once this many files exist.  Raised to
+  // level0_file_num_compaction_trigger if it is smaller.
+  int level0_slowdown_writes_trigger = 8;
+
+  // Maximum number of level-0 files.  Writes stop at this point until
+  // compaction catches up.  Raised to level0_slowdown_writes_trigger if
+  // it is smaller.
+  int level0_stop_writes_trigger = 12;
+
+  // Once level-0 holds level0_slowdown_writes_trigger files, or compactions
+  // are soft_pending_compaction_bytes_limit bytes behind, writes are slowed
+  // down to this many bytes per second.  The rate falls further, down to a
+  // sixteenth of it, as the number of level-0 files approaches
+  // level0_stop_writes_trigger or the bytes behind approach
+  // hard_pending_compaction_bytes_limit.
+  uint64_t delayed_write_rate = 16 << 20;
+
+  // Number of bytes compactions may be behind before writes are slowed
+  // down, and before writes stop until compactions catch up.  Zero
+  // disables a limit.  See DB::GetProperty() for how far behind they are.
+  uint64_t soft_pending_compaction_bytes_limit = 64ull << 30;
+  uint64_t hard_pending_compaction_bytes_limit = 256ull << 30;
+
+  // Maximum total size of the files in level-1.  The limit for level L > 1
+  // is max_bytes_for_level_base * max_bytes_for_level_multiplier^(L-1).
+  size_t max_bytes_for_level_base = 10 * 1024 * 1024;
+
+  // Growth factor between the size limits of successive levels.  Must be
+  // at least 1.
+  double max_bytes_for_level_multiplier = 10;
+
+  // If true, level size targets are derived from the actual size of the
+  // last level rather than growing upwards from max_bytes_for_level_base:
+  // the last level's target is its current size and each level above it
+  // is max_bytes_for_level_multiplier times smaller, but never smaller
+  // than max_bytes_for_level_base.  This keeps the ratio between adjacent
+  // levels close to the multiplier for large databases and so reduces
+  // write amplification.
+  bool level_compaction_dynamic_level_bytes = false;
+
+  // Compaction strategy; see CompactionStyle above.  Universal compaction
+  // keeps new data in level-0 and starts once
+  // level0_file_num_compaction_trigger runs have accumulated.
+  CompactionStyle compaction_style = kCompactionStyleLevel;
+
+  // Universal compaction: a run is added to the runs being merged if its
+  // size is at most (100 + universal_size_ratio) percent of the combined
+  // size of the newer runs already picked.
+  int universal_size_ratio = 1;
+
+  // Universal compaction: minimum and maximum number of runs merged by a
+  // single size-ratio compaction.
+  int universal_min_merge_width = 2;
+  int universal_max_merge_width = 1000;
+
+  // Universal compaction: once the runs other than the oldest add up to
+  // this percentage of the oldest run's size, all runs are merged into
+  // one to bound space amplification.
+  int universal_max_size_amplification_percent = 200;
+
+  // FIFO compaction: once the table files add up to more than this many
+  // bytes, the oldest files are deleted.
+  uint64_t fifo_max_table_files_size = 1024 * 1024 * 1024;
+
+  // FIFO compaction: if non-zero, table files written more than this many
+  // seconds ago are deleted, also while nothing is written to the DB.
+  // Files written while it is 0 have no recorded age and are kept.
+  uint64_t fifo_ttl_seconds = 0;
+
+  // Level compaction: a file outside the last level is compacted once
+  // deletion markers and range tombstones make up at least this fraction
+  // of its entries, so that they move down to where they can be dropped
+  // instead of slowing down reads of their key range.  0 disables.
+  // Files written while it is 0 have no recorded deletion counts and are
+  // only compacted for their range tombstones.
+  double deletion_compaction_ratio = 0;
+
+  // Level compaction: if non-zero, table files written more than this
+  // many seconds ago are rewritten, so that deletions, expired values and
+  // the compaction filter also apply to data that is no longer written.
+  // Files of the last level are rewritten in place, also while nothing is
+  // written to the DB.  Files written while it is 0 have no recorded age
+  // and are not rewritten.
+  uint64_t periodic_compaction_seconds = 0;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -145,6 +341,25 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If true, every value is stored together with an expiry time, set from
+  // WriteOptions::ttl_seconds when it is written.  Expired values are not
+  // returned by Get() or iterators and are discarded by compactions.
+  //
+  // REQUIRES: The same setting is used for every open of a database, as
+  // the stored values are laid out differently in this mode.
+  bool enable_ttl = false;
+
+  // If non-null, compactions pass values through this filter, which may
+  // keep, remove or rewrite them.  See leveldb/compaction_filter.h.
+  const CompactionFilter* compaction_filter = nullptr;
+
+  // Combines the operands written by DB::Merge() with the value of their
+  // key.  Must be set to read keys that have merge operands, with an
+  // operator that interprets them the same way as when they were written.
+  //
+  // REQUIRES: enable_ttl is false.
+  const MergeOperator* merge_operator = nullptr;
 };
 
 // Options that control read operations
@@ -183,6 +398,42 @@ struct LEVELDB_EXPORT WriteOptions {
   // with sync==true has similar crash semantics to a "write()"
   // system call followed by "fsync()".
   bool sync = false;
+
+  // Only used if Options::enable_ttl is set.  Values written with these
+  // options expire this many seconds after the write; 0 means never.
+  uint64_t ttl_seconds = 0;
+};
+
+// Options that control DB::IngestExternalFile()
+struct LEVELDB_EXPORT IngestExternalFileOptions {
+  // If true, the file is renamed into the database instead of copied when
+  // possible.  The caller must not use the file afterwards.
+  bool move_files = false;
+};
+
+// Options that control DB::Flush()
+struct LEVELDB_EXPORT FlushOptions {
+  // If true, Flush() returns once the memtable is written to a table
+  // file.  Otherwise it only switches to a new memtable and leaves the
+  // write to the background thread.
+  bool wait = true;
+};
+
+// Options that control DB::CompactRange()
+struct LEVELDB_EXPORT CompactRangeOptions {
+  // If true, no automatic compaction runs until the manual compaction is
+  // done.  Otherwise automatic compactions may run between its steps.
+  bool exclusive_manual_compaction = true;
+
+  // The keys of the range are compacted down to this level and the
+  // levels below it are left alone.  -1 means the deepest level that
+  // holds keys of the range.  Must be less than Options::num_levels.
+  int target_level = -1;
+
+  // See BottommostLevelCompaction.  Applies when target_level is -1 or
+  // the deepest level that holds keys of the range.
+  BottommostLevelCompaction bottommost_level_compaction =
+      kBottommostLevelIfHaveCompactionFilter;
 };
 
 }  // namespace leveldb
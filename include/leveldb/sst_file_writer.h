@@ -0,0 +1,67 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table file outside of any database, which can
+// then be bulk loaded into a database with DB::IngestExternalFile().
+// Keys must be added in increasing order.
+//
+// Multiple threads can invoke const methods on an SstFileWriter without
+// external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same SstFileWriter must use
+// external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SstFileWriter {
+ public:
+  // Create a writer for files to be ingested into databases opened with
+  // "options".  The comparator, filter policy, block and compression
+  // settings and enable_ttl must match those of the database.
+  explicit SstFileWriter(const Options& options);
+
+  SstFileWriter(const SstFileWriter&) = delete;
+  SstFileWriter& operator=(const SstFileWriter&) = delete;
+
+  // Abandons the file if Finish() has not been called.
+  ~SstFileWriter();
+
+  // Create the file "fname" and prepare to add entries to it.
+  Status Open(const std::string& fname);
+
+  // Add "key" with "value" to the file.  If enable_ttl is set, the value
+  // never expires.
+  // REQUIRES: Open() succeeded and Finish() has not been called.
+  // REQUIRES: key is after any previously added key according to the
+  // comparator; otherwise InvalidArgument is returned.
+  Status Put(const Slice& key, const Slice& value);
+
+  // Finish building the file and sync and close it.  Fails if no entry
+  // was added.
+  // REQUIRES: Open() succeeded and Finish() has not been called.
+  Status Finish();
+
+  // Size of the file generated so far.  If invoked after a successful
+  // Finish() call, returns the size of the final generated file.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+
+  Rep* rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
@@ -56,6 +56,10 @@ class LEVELDB_EXPORT Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the range tombstones stored in the table,
+  // which NewIterator() does not return.  Empty if there are none.
+  Iterator* NewRangeTombstoneIterator(const ReadOptions&) const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -81,6 +85,7 @@ class LEVELDB_EXPORT Table {
 
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadLearnedIndex(const Slice& handle_value);
 
   Rep* const rep_;
 };
@@ -51,6 +51,14 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add a range tombstone to the table being constructed.  Range
+  // tombstones are kept in their own meta block and are not returned by
+  // Table::NewIterator().
+  // REQUIRES: key is after any previously added range tombstone key
+  // according to comparator.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeTombstone(const Slice& key, const Slice& value);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -72,7 +80,7 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Abandon();
 
-  // Number of calls to Add() so far.
+  // Number of calls to Add() so far.  Range tombstones are not counted.
   uint64_t NumEntries() const;
 
   // Size of the file generated so far.  If invoked after a successful
@@ -21,6 +21,7 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 #define STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 
+#include <cstdint>
 #include <string>
 
 #include "leveldb/export.h"
@@ -28,6 +29,7 @@
 
 namespace leveldb {
 
+class ColumnFamilyHandle;
 class Slice;
 
 class LEVELDB_EXPORT WriteBatch {
@@ -37,6 +39,14 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // The default implementation ignores range deletions.
+    virtual void DeleteRange(const Slice& begin_key, const Slice& end_key);
+    // The default implementation ignores merge operands.
+    virtual void Merge(const Slice& key, const Slice& value);
+    // Called before the next record when it belongs to a different column
+    // family than the previous one.  Records start in the default column
+    // family, id 0.  The default implementation does nothing.
+    virtual void SetColumnFamily(uint32_t column_family_id);
   };
 
   WriteBatch();
@@ -53,6 +63,26 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase every mapping whose key is in the range ["begin_key", "end_key").
+  // Does nothing if "begin_key" is not before "end_key".
+  void DeleteRange(const Slice& begin_key, const Slice& end_key);
+
+  // Combine "value" with the current value of "key" using the database's
+  // Options::merge_operator.  The merge happens lazily, when the key is
+  // read or compacted.
+  void Merge(const Slice& key, const Slice& value);
+
+  // Same as above, for the column family "column_family".  A null
+  // "column_family" is the default column family.  All updates of a batch
+  // are applied atomically, whichever column families they belong to.
+  void Put(ColumnFamilyHandle* column_family, const Slice& key,
+           const Slice& value);
+  void Delete(ColumnFamilyHandle* column_family, const Slice& key);
+  void DeleteRange(ColumnFamilyHandle* column_family, const Slice& begin_key,
+                   const Slice& end_key);
+  void Merge(ColumnFamilyHandle* column_family, const Slice& key,
+             const Slice& value);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
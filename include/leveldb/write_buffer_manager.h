@@ -0,0 +1,57 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A WriteBufferManager bounds the memory used by the memtables of all the
+// databases that share it through Options::write_buffer_manager.  Once
+// they use more than the budget, a database flushes its largest memtable
+// on its next write.
+//
+// A WriteBufferManager has internal synchronization and may be shared by
+// any number of databases and threads.  It must outlive the databases
+// that use it.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
+#define STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Cache;
+
+class LEVELDB_EXPORT WriteBufferManager {
+ public:
+  // Flush memtables once they use more than "buffer_size" bytes in total.
+  // Zero only accounts for their memory.  If "cache" is non-null, the
+  // memory is also charged to it, so that a single Cache bounds both the
+  // cached blocks and the memtables.
+  explicit WriteBufferManager(size_t buffer_size, Cache* cache = nullptr);
+
+  WriteBufferManager(const WriteBufferManager&) = delete;
+  WriteBufferManager& operator=(const WriteBufferManager&) = delete;
+
+  ~WriteBufferManager();
+
+  size_t buffer_size() const;
+
+  // Bytes used by the live memtables of all databases.
+  size_t memory_usage() const;
+
+  // Returns true if the memtables use more than buffer_size() bytes.
+  bool ShouldFlush() const;
+
+  // Account for "bytes" of memtable memory being allocated or released.
+  void ReserveMem(size_t bytes);
+  void FreeMem(size_t bytes);
+
+ private:
+  struct Rep;
+  Rep* const rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
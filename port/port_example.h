@@ -51,6 +51,10 @@ class CondVar {
   // REQUIRES: this thread holds *mu
   void Wait();
 
+  // Like Wait(), but also returns once "micros" microseconds have passed.
+  // REQUIRES: this thread holds *mu
+  void TimedWait(uint64_t micros);
+
   // If there are some threads waiting, wake up at least one of them.
   void Signal();
 
@@ -114,6 +118,19 @@ bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg);
 // the newly extended CRC value (which may also be zero).
 uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size);
 
+// Map "size" bytes of zeroed memory backed by huge pages, or by
+// transparent huge pages if none are reserved.  If "numa_node" is not
+// negative, the memory is bound to that NUMA node where supported.
+// Returns nullptr if huge pages are not supported by this port.
+char* MapHugePages(size_t size, int numa_node);
+
+// Release memory returned by MapHugePages(size, ...).
+void UnmapHugePages(char* addr, size_t size);
+
+// Hint that the memory at "addr" will be read soon.  "addr" may be any
+// value, including nullptr.  Does nothing if prefetching is not supported.
+void PrefetchForRead(const void* addr);
+
 }  // namespace port
 }  // namespace leveldb
 
@@ -32,8 +32,14 @@
 #define ZSTD_STATIC_LINKING_ONLY  // For ZSTD_compressionParameters.
 #include <zstd.h>
 #endif  // HAVE_ZSTD
+#if HAVE_MAP_HUGETLB
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // HAVE_MAP_HUGETLB
 
 #include <cassert>
+#include <chrono>  // NOLINT
 #include <condition_variable>  // NOLINT
 #include <cstddef>
 #include <cstdint>
@@ -79,6 +85,11 @@ class CondVar {
     cv_.wait(lock);
     lock.release();
   }
+  void TimedWait(uint64_t micros) {
+    std::unique_lock<std::mutex> lock(mu_->mu_, std::adopt_lock);
+    cv_.wait_for(lock, std::chrono::microseconds(micros));
+    lock.release();
+  }
   void Signal() { cv_.notify_one(); }
   void SignalAll() { cv_.notify_all(); }
 
@@ -217,6 +228,61 @@ inline uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size) {
 #endif  // HAVE_CRC32C
 }
 
+inline char* MapHugePages(size_t size, int numa_node) {
+#if HAVE_MAP_HUGETLB
+  void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (addr == MAP_FAILED) {
+    // No huge pages are reserved; ask for transparent huge pages instead.
+    addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+      return nullptr;
+    }
+#if defined(MADV_HUGEPAGE)
+    ::madvise(addr, size, MADV_HUGEPAGE);
+#endif  // defined(MADV_HUGEPAGE)
+  }
+#if defined(SYS_mbind)
+  if (numa_node >= 0 && numa_node < 64) {
+    // Nothing was touched yet, so every page is placed on the node.  The
+    // binding is only a hint: failures are ignored.
+    const unsigned long node_mask = 1ul << numa_node;
+    const int kMpolBind = 2;  // MPOL_BIND in <linux/mempolicy.h>
+    ::syscall(SYS_mbind, addr, size, kMpolBind, &node_mask,
+              sizeof(node_mask) * 8 + 1, 0);
+  }
+#else
+  (void)numa_node;
+#endif  // defined(SYS_mbind)
+  return static_cast<char*>(addr);
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)size;
+  (void)numa_node;
+  return nullptr;
+#endif  // HAVE_MAP_HUGETLB
+}
+
+inline void UnmapHugePages(char* addr, size_t size) {
+#if HAVE_MAP_HUGETLB
+  ::munmap(addr, size);
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)addr;
+  (void)size;
+#endif  // HAVE_MAP_HUGETLB
+}
+
+inline void PrefetchForRead(const void* addr) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(addr, 0 /* read */, 1 /* low temporal locality */);
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)addr;
+#endif
+}
+
 }  // namespace port
 }  // namespace leveldb
 
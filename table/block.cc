@@ -8,6 +8,7 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <vector>
 
 #include "leveldb/comparator.h"
@@ -84,6 +85,9 @@ class Block::Iter : public Iterator {
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
   uint32_t restart_index_;  // Index of restart block in which current_ falls
+  // Restart points expected to hold the target of the first Seek()
+  uint32_t hint_left_;
+  uint32_t hint_right_;
   std::string key_;
   Slice value_;
   Status status_;
@@ -102,6 +106,20 @@ class Block::Iter : public Iterator {
     return DecodeFixed32(data_ + restarts_ + index * sizeof(uint32_t));
   }
 
+  // Store the key at restart point "index" in *key.  Returns false if
+  // the entry is corrupted.
+  bool GetRestartKey(uint32_t index, Slice* key) {
+    uint32_t shared, non_shared, value_length;
+    const char* key_ptr =
+        DecodeEntry(data_ + GetRestartPoint(index), data_ + restarts_,
+                    &shared, &non_shared, &value_length);
+    if (key_ptr == nullptr || (shared != 0)) {
+      return false;
+    }
+    *key = Slice(key_ptr, non_shared);
+    return true;
+  }
+
   void SeekToRestartPoint(uint32_t index) {
     key_.clear();
     restart_index_ = index;
@@ -114,14 +132,17 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, uint32_t hint_left, uint32_t hint_right)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
         current_(restarts_),
-        restart_index_(num_restarts_) {
+        restart_index_(num_restarts_),
+        hint_left_(hint_left),
+        hint_right_(hint_right) {
     assert(num_restarts_ > 0);
+    assert(hint_left_ <= hint_right_ && hint_right_ < num_restarts_);
   }
 
   bool Valid() const override { return current_ < restarts_; }
@@ -182,20 +203,30 @@ class Block::Iter : public Iterator {
         // We're seeking to the key we're already at.
         return;
       }
+    } else if (hint_left_ != 0 || hint_right_ + 1 != num_restarts_) {
+      // Use the hint if the key at hint_left_ is < target and the one
+      // after hint_right_ is not.
+      Slice key;
+      if ((hint_left_ == 0 || (GetRestartKey(hint_left_, &key) &&
+                               Compare(key, target) < 0)) &&
+          (hint_right_ + 1 == num_restarts_ ||
+           (GetRestartKey(hint_right_ + 1, &key) &&
+            Compare(key, target) >= 0))) {
+        left = hint_left_;
+        right = hint_right_;
+      }
+      // Later seeks search all restart points.
+      hint_left_ = 0;
+      hint_right_ = num_restarts_ - 1;
     }
 
     while (left < right) {
       uint32_t mid = (left + right + 1) / 2;
-      uint32_t region_offset = GetRestartPoint(mid);
-      uint32_t shared, non_shared, value_length;
-      const char* key_ptr =
-          DecodeEntry(data_ + region_offset, data_ + restarts_, &shared,
-                      &non_shared, &value_length);
-      if (key_ptr == nullptr || (shared != 0)) {
+      Slice mid_key;
+      if (!GetRestartKey(mid, &mid_key)) {
         CorruptionError();
         return;
       }
-      Slice mid_key(key_ptr, non_shared);
       if (Compare(mid_key, target) < 0) {
         // Key at "mid" is smaller than "target".  Therefore all
         // blocks before "mid" are uninteresting.
@@ -278,6 +309,11 @@ class Block::Iter : public Iterator {
 };
 
 Iterator* Block::NewIterator(const Comparator* comparator) {
+  return NewIterator(comparator, 0, std::numeric_limits<uint32_t>::max());
+}
+
+Iterator* Block::NewIterator(const Comparator* comparator, uint32_t left,
+                             uint32_t right) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
@@ -285,7 +321,10 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   if (num_restarts == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    right = std::min(right, num_restarts - 1);
+    left = std::min(left, right);
+    return new Iter(comparator, data_, restart_offset_, num_restarts, left,
+                    right);
   }
 }
 
@@ -28,6 +28,13 @@ class Block {
   size_t size() const { return size_; }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Like NewIterator(), but the first Seek() expects the last restart
+  // point with a key < target in [left, right] and binary-searches only
+  // those.  The hint is checked with at most two key comparisons, and
+  // all restart points are searched if it is wrong.
+  Iterator* NewIterator(const Comparator* comparator, uint32_t left,
+                        uint32_t right);
+
  private:
   class Iter;
 
@@ -0,0 +1,185 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/learned_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "util/coding.h"
+
+namespace leveldb {
+
+// The eight bytes of "key" after the first "prefix_length" ones as a
+// big-endian number, padded with zeros.  Keys in bytewise order map to
+// non-decreasing numbers.
+static uint64_t MapKey(const Slice& key, size_t prefix_length) {
+  uint64_t result = 0;
+  for (size_t i = 0; i < sizeof(result); i++) {
+    result <<= 8;
+    if (prefix_length + i < key.size()) {
+      result |= static_cast<uint8_t>(key[prefix_length + i]);
+    }
+  }
+  return result;
+}
+
+void LearnedIndexBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+Slice LearnedIndexBuilder::Finish() {
+  result_.clear();
+  const size_t num_keys = start_.size();
+  if (num_keys == 0) {
+    return Slice();
+  }
+  start_.push_back(keys_.size());  // Simplify length computation
+  std::vector<Slice> keys;
+  keys.reserve(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    keys.emplace_back(keys_.data() + start_[i], start_[i + 1] - start_[i]);
+  }
+
+  size_t prefix_length = keys[0].size();
+  for (size_t i = 1; i < num_keys; i++) {
+    size_t j = 0;
+    while (j < prefix_length && j < keys[i].size() &&
+           keys[i][j] == keys[0][j]) {
+      j++;
+    }
+    prefix_length = j;
+  }
+  std::vector<uint64_t> mapped;
+  mapped.reserve(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    mapped.push_back(MapKey(keys[i], prefix_length));
+  }
+  if (mapped.back() < mapped.front()) {
+    // The comparator does not order keys like their bytes.
+    keys_.clear();
+    start_.clear();
+    return Slice();
+  }
+  // Keys with the same user key but different sequence numbers can map
+  // out of order; treat them as equal.
+  for (size_t i = 1; i < num_keys; i++) {
+    mapped[i] = std::max(mapped[i], mapped[i - 1]);
+  }
+
+  // Grow each segment while some slope predicts the position of all of
+  // its keys within kMaxError ("shrinking cone").
+  std::string segments;
+  uint32_t num_segments = 0;
+  const double kInfinity = std::numeric_limits<double>::infinity();
+  size_t first = 0;
+  double min_slope = 0;
+  double max_slope = kInfinity;
+  for (size_t i = 1; i <= num_keys; i++) {
+    if (i < num_keys) {
+      const double dy = static_cast<double>(i - first);
+      if (mapped[i] == mapped[first]) {
+        if (dy <= kMaxError) {
+          continue;
+        }
+      } else {
+        const double dx = static_cast<double>(mapped[i] - mapped[first]);
+        const double lo = std::max(min_slope, (dy - kMaxError) / dx);
+        const double hi = std::min(max_slope, (dy + kMaxError) / dx);
+        if (lo <= hi) {
+          min_slope = lo;
+          max_slope = hi;
+          continue;
+        }
+      }
+    }
+    const double slope = (max_slope == kInfinity)
+                             ? min_slope
+                             : (min_slope + max_slope) / 2;
+    uint64_t slope_bits;
+    std::memcpy(&slope_bits, &slope, sizeof(slope_bits));
+    PutFixed64(&segments, mapped[first]);
+    PutFixed32(&segments, static_cast<uint32_t>(first));
+    PutFixed64(&segments, slope_bits);
+    num_segments++;
+    first = i;
+    min_slope = 0;
+    max_slope = kInfinity;
+  }
+
+  PutLengthPrefixedSlice(&result_, Slice(keys[0].data(), prefix_length));
+  PutVarint32(&result_, kMaxError);
+  PutVarint32(&result_, static_cast<uint32_t>(num_keys));
+  PutVarint32(&result_, num_segments);
+  result_.append(segments);
+  keys_.clear();
+  start_.clear();
+  return Slice(result_);
+}
+
+LearnedIndexReader::LearnedIndexReader(const Slice& contents)
+    : max_error_(0), num_keys_(0) {
+  Slice input = contents;
+  Slice prefix;
+  uint32_t num_segments;
+  if (!GetLengthPrefixedSlice(&input, &prefix) ||
+      !GetVarint32(&input, &max_error_) || !GetVarint32(&input, &num_keys_) ||
+      !GetVarint32(&input, &num_segments) ||
+      input.size() != num_segments * 20ull) {
+    return;  // Unusable model
+  }
+  prefix_.assign(prefix.data(), prefix.size());
+  segments_.resize(num_segments);
+  const char* p = input.data();
+  for (Segment& segment : segments_) {
+    segment.first_key = DecodeFixed64(p);
+    segment.position = DecodeFixed32(p + 8);
+    const uint64_t slope_bits = DecodeFixed64(p + 12);
+    std::memcpy(&segment.slope, &slope_bits, sizeof(segment.slope));
+    p += 20;
+  }
+}
+
+bool LearnedIndexReader::Predict(const Slice& key, uint32_t* left,
+                                 uint32_t* right) const {
+  if (segments_.empty() || num_keys_ == 0) {
+    return false;
+  }
+  // Keys without the shared prefix map below or above all others.
+  uint64_t x;
+  const int r = Slice(key.data(), std::min(key.size(), prefix_.size()))
+                    .compare(prefix_);
+  if (r < 0) {
+    x = 0;
+  } else if (r > 0) {
+    x = std::numeric_limits<uint64_t>::max();
+  } else {
+    x = MapKey(key, prefix_.size());
+  }
+  // Last segment whose first key is <= x, or the first one.
+  std::vector<Segment>::const_iterator segment = std::upper_bound(
+      segments_.begin(), segments_.end(), x,
+      [](uint64_t x, const Segment& s) { return x < s.first_key; });
+  if (segment != segments_.begin()) {
+    --segment;
+  }
+  double predicted = segment->position;
+  if (x > segment->first_key) {
+    predicted += segment->slope * static_cast<double>(x - segment->first_key);
+  }
+
+  // The first key >= "key" is within max_error_ of the prediction, so the
+  // last key < "key" is at most one position further back.
+  const double last = num_keys_ - 1;
+  const double lo = std::floor(predicted) - max_error_ - 1;
+  const double hi = std::ceil(predicted) + max_error_;
+  *left = static_cast<uint32_t>(std::min(std::max(lo, 0.0), last));
+  *right = static_cast<uint32_t>(std::min(std::max(hi, 0.0), last));
+  return true;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,83 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A learned index block is stored near the end of a Table file when
+// Options::learned_index is set.  It holds a piecewise linear model of
+// the position of every key in the index block, which point lookups use
+// to narrow the binary search over the index block.
+//
+// Keys are mapped to numbers by reading the eight bytes that follow the
+// prefix shared by all keys of the index block as a big-endian integer.
+// Each segment of the model predicts the position of a run of
+// consecutive keys within kMaxError.  Predictions are only hints: the
+// index block checks them and searches all of its keys if they are wrong.
+
+#ifndef STORAGE_LEVELDB_TABLE_LEARNED_INDEX_H_
+#define STORAGE_LEVELDB_TABLE_LEARNED_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LearnedIndexBuilder {
+ public:
+  // Largest difference between the predicted and the actual position of
+  // a key of the index block.
+  static const uint32_t kMaxError = 4;
+
+  LearnedIndexBuilder() = default;
+
+  LearnedIndexBuilder(const LearnedIndexBuilder&) = delete;
+  LearnedIndexBuilder& operator=(const LearnedIndexBuilder&) = delete;
+
+  // Add the key for the next entry of the index block: the last key of
+  // the data block the entry points to, or any key between it and the
+  // entry's own key.
+  void AddKey(const Slice& key);
+
+  // Return the contents of the learned index block.  Returns an empty
+  // slice if the keys are clearly not in bytewise order, in which case no
+  // model can help.
+  Slice Finish();
+
+ private:
+  std::string keys_;           // Flattened key contents
+  std::vector<size_t> start_;  // Offset of each key in keys_
+  std::string result_;
+};
+
+class LearnedIndexReader {
+ public:
+  // Parse "contents", which need not stay live.
+  explicit LearnedIndexReader(const Slice& contents);
+
+  LearnedIndexReader(const LearnedIndexReader&) = delete;
+  LearnedIndexReader& operator=(const LearnedIndexReader&) = delete;
+
+  // Store in [*left, *right] the positions in the index block among which
+  // the last key < "key" is expected.  Returns false if the model is
+  // unusable.
+  bool Predict(const Slice& key, uint32_t* left, uint32_t* right) const;
+
+ private:
+  struct Segment {
+    uint64_t first_key;  // Mapped first key of the segment
+    uint32_t position;   // Position of that key in the index block
+    double slope;        // Positions per mapped key unit
+  };
+
+  std::string prefix_;  // Prefix all keys share
+  uint32_t max_error_;
+  uint32_t num_keys_;
+  std::vector<Segment> segments_;  // Ordered by first_key
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_LEARNED_INDEX_H_
@@ -0,0 +1,99 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/learned_index.h"
+
+#include "gtest/gtest.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+// A 16-byte big-endian encoding of "high" and "low".
+static std::string Key128(uint64_t high, uint64_t low) {
+  std::string result;
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    result.push_back(static_cast<char>(high >> shift));
+  }
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    result.push_back(static_cast<char>(low >> shift));
+  }
+  return result;
+}
+
+// Check that the position of the last key < keys[i] is predicted.
+static void CheckPredictions(const LearnedIndexReader& reader,
+                             const std::vector<std::string>& keys) {
+  for (size_t i = 0; i < keys.size(); i++) {
+    uint32_t left, right;
+    ASSERT_TRUE(reader.Predict(keys[i], &left, &right));
+    const uint32_t expected = (i == 0) ? 0 : i - 1;
+    ASSERT_LE(left, expected) << i;
+    ASSERT_LE(expected, right) << i;
+    ASSERT_LE(right - left, 2 * LearnedIndexBuilder::kMaxError + 2);
+  }
+}
+
+TEST(LearnedIndexTest, Empty) {
+  LearnedIndexBuilder builder;
+  ASSERT_TRUE(builder.Finish().empty());
+  LearnedIndexReader reader((Slice()));
+  uint32_t left, right;
+  ASSERT_TRUE(!reader.Predict("foo", &left, &right));
+}
+
+TEST(LearnedIndexTest, EvenlySpacedKeys) {
+  LearnedIndexBuilder builder;
+  std::vector<std::string> keys;
+  Random rnd(301);
+  for (uint64_t i = 0; i < 1000; i++) {
+    keys.push_back(Key128(42, i * 1000 + rnd.Uniform(100)));
+    builder.AddKey(keys.back());
+  }
+  Slice contents = builder.Finish();
+  // A single segment covers all keys.
+  ASSERT_LT(contents.size(), 50);
+  LearnedIndexReader reader(contents);
+  CheckPredictions(reader, keys);
+
+  // Keys past the ends are predicted at the first and last positions.
+  uint32_t left, right;
+  ASSERT_TRUE(reader.Predict(Key128(41, 0), &left, &right));
+  ASSERT_EQ(0, left);
+  ASSERT_TRUE(reader.Predict(Key128(43, 0), &left, &right));
+  ASSERT_EQ(999, right);
+}
+
+TEST(LearnedIndexTest, SkewedKeys) {
+  LearnedIndexBuilder builder;
+  std::vector<std::string> keys;
+  Random rnd(301);
+  uint64_t low = 0;
+  for (int i = 0; i < 2000; i++) {
+    low += 1 + rnd.Skewed(30);
+    keys.push_back(Key128(7, low));
+    builder.AddKey(keys.back());
+  }
+  LearnedIndexReader reader(builder.Finish());
+  CheckPredictions(reader, keys);
+}
+
+TEST(LearnedIndexTest, ShortKeys) {
+  LearnedIndexBuilder builder;
+  std::vector<std::string> keys = {"a", "ab", "abc", "b", "ba", "c"};
+  for (const std::string& key : keys) {
+    builder.AddKey(key);
+  }
+  LearnedIndexReader reader(builder.Finish());
+  CheckPredictions(reader, keys);
+}
+
+TEST(LearnedIndexTest, UnorderedKeys) {
+  // Keys that a comparator other than the bytewise one sorted.
+  LearnedIndexBuilder builder;
+  builder.AddKey("b");
+  builder.AddKey("a");
+  ASSERT_TRUE(builder.Finish().empty());
+}
+
+}  // namespace leveldb
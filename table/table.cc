@@ -13,6 +13,7 @@
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/learned_index.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
@@ -22,6 +23,7 @@ struct Table::Rep {
   ~Rep() {
     delete filter;
     delete[] filter_data;
+    delete learned_index;
     delete index_block;
   }
 
@@ -34,6 +36,8 @@ struct Table::Rep {
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  LearnedIndexReader* learned_index;  // Null if the table has none
+  std::string range_del_handle;  // Encoded handle; empty if no tombstones
 };
 /**
  * 打开sstable文件
@@ -82,6 +86,7 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
     rep->filter = nullptr;
+    rep->learned_index = nullptr;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   }
@@ -99,12 +104,12 @@ void Table::ReadMeta(const Footer& footer) {
   /**
    * filter policy好像就是最大key最小key判断在哪个block
    */
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
+  // An empty block holds just its restart array: one restart point and
+  // the restart count.
+  if (footer.metaindex_handle().size() <= 2 * sizeof(uint32_t)) {
+    return;  // No meta blocks
   }
 
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
@@ -118,12 +123,22 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    // 找到里面的filter键类型
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      // 找到里面的filter键类型
+      ReadFilter(iter->value());
+    }
+  }
+  iter->Seek("learnedindex");
+  if (iter->Valid() && iter->key() == Slice("learnedindex")) {
+    ReadLearnedIndex(iter->value());
+  }
+  iter->Seek("rangedel");
+  if (iter->Valid() && iter->key() == Slice("rangedel")) {
+    rep_->range_del_handle = iter->value().ToString();
   }
   delete iter;
   delete meta;
@@ -154,6 +169,27 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   // 初始化rep的filter
 }
 
+void Table::ReadLearnedIndex(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, handle, &block).ok()) {
+    return;
+  }
+  // The reader copies the model, so the block is not needed afterwards.
+  rep_->learned_index = new LearnedIndexReader(block.data);
+  if (block.heap_allocated) {
+    delete[] block.data.data();
+  }
+}
+
 Table::~Table() { delete rep_; }
 
 static void DeleteBlock(void* arg, void* ignored) {
@@ -249,6 +285,14 @@ Iterator* Table::NewIterator(const ReadOptions& options) const {
       &Table::BlockReader, const_cast<Table*>(this), options);
 }
 
+Iterator* Table::NewRangeTombstoneIterator(const ReadOptions& options) const {
+  if (rep_->range_del_handle.empty()) {
+    return NewEmptyIterator();
+  }
+  return BlockReader(const_cast<Table*>(this), options,
+                     rep_->range_del_handle);
+}
+
 
 /**
  * 
@@ -257,7 +301,15 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter;
+  uint32_t left, right;
+  if (rep_->learned_index != nullptr &&
+      rep_->learned_index->Predict(k, &left, &right)) {
+    iiter = rep_->index_block->NewIterator(rep_->options.comparator, left,
+                                           right);
+  } else {
+    iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  }
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
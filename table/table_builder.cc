@@ -14,6 +14,7 @@
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/learned_index.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -27,11 +28,13 @@ struct TableBuilder::Rep {
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
+        range_del_block(&options),
         num_entries(0),
         closed(false),
         filter_block(opt.filter_policy == nullptr
                          ? nullptr
                          : new FilterBlockBuilder(opt.filter_policy)),
+        learned_index(opt.learned_index ? new LearnedIndexBuilder : nullptr),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
@@ -43,10 +46,12 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
   std::string last_key;
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  LearnedIndexBuilder* learned_index;  // Sees every key of index_block
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -73,6 +78,7 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->learned_index;
   delete rep_;
 }
 
@@ -102,6 +108,10 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
 
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
+    if (r->learned_index != nullptr) {
+      // Shortened separators would scatter the keys the model sees.
+      r->learned_index->AddKey(r->last_key);
+    }
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
     std::string handle_encoding;
     r->pending_handle.EncodeTo(&handle_encoding);
@@ -223,6 +233,13 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
 
 Status TableBuilder::status() const { return rep_->status; }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_del_block.Add(key, value);
+}
+
 Status TableBuilder::Finish() {
   Rep* r = rep_;
   Flush();
@@ -234,7 +251,8 @@ Status TableBuilder::Finish() {
    * 表明该sstable已经关闭，不能再添加k/v对。
    */
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle,
+      range_del_block_handle, learned_index_handle;
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
@@ -244,6 +262,25 @@ Status TableBuilder::Finish() {
   /**
    * 写入filter block到文件中。
    */
+
+  // The last index entry is only added below, so the model needs it now.
+  bool has_learned_index = false;
+  if (ok() && r->learned_index != nullptr) {
+    if (r->pending_index_entry) {
+      r->learned_index->AddKey(r->last_key);
+    }
+    Slice contents = r->learned_index->Finish();
+    if (!contents.empty()) {
+      WriteRawBlock(contents, kNoCompression, &learned_index_handle);
+      has_learned_index = true;
+    }
+  }
+
+  // Write range tombstone block
+  const bool has_range_del = !r->range_del_block.empty();
+  if (ok() && has_range_del) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
   // Write metaindex block
   /**
    * S3 写入meta index block到文件中。
@@ -254,7 +291,10 @@ Status TableBuilder::Finish() {
    * block，可以根据filter名字快速定位到filter的数据区。
    */
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    // Meta block names are ordered bytewise, see Table::ReadMeta().
+    Options meta_index_options = r->options;
+    meta_index_options.comparator = BytewiseComparator();
+    BlockBuilder meta_index_block(&meta_index_options);
     if (r->filter_block != nullptr) {
       // Add mapping from "filter.Name" to location of filter data
       std::string key = "filter.";
@@ -263,6 +303,18 @@ Status TableBuilder::Finish() {
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (has_learned_index) {
+      // Add mapping from "learnedindex" to location of the model
+      std::string handle_encoding;
+      learned_index_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("learnedindex", handle_encoding);
+    }
+    if (has_range_del) {
+      // Add mapping from "rangedel" to location of the range tombstones
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("rangedel", handle_encoding);
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
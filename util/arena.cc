@@ -4,6 +4,8 @@
 
 #include "util/arena.h"
 
+#include "port/port.h"
+
 namespace leveldb {
 
 static const int kBlockSize = 4096;
@@ -11,17 +13,28 @@ static const int kBlockSize = 4096;
  * arena分配就是大的超过四分之一去new
  * 小的去用上次剩下的++len
 */
-Arena::Arena()
-    : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
+Arena::Arena() : Arena(0, -1) {}
+
+Arena::Arena(size_t huge_page_size, int numa_node)
+    : huge_page_size_(huge_page_size),
+      numa_node_(numa_node),
+      alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      memory_usage_(0) {}
 
 Arena::~Arena() {
   for (size_t i = 0; i < blocks_.size(); i++) {
     delete[] blocks_[i];
   }
+  for (char* block : huge_blocks_) {
+    port::UnmapHugePages(block, huge_page_size_);
+  }
 }
 
 char* Arena::AllocateFallback(size_t bytes) {
-  if (bytes > kBlockSize / 4) {
+  const size_t block_size = (huge_page_size_ > 0) ? huge_page_size_
+                                                  : kBlockSize;
+  if (bytes > block_size / 4) {
     //大块内存直接分配
     // Object is more than a quarter of our block size.  Allocate it separately
     // to avoid wasting too much space in leftover bytes.
@@ -30,8 +43,9 @@ char* Arena::AllocateFallback(size_t bytes) {
   }
 //小的切割着分
   // We waste the remaining space in the current block.
-  alloc_ptr_ = AllocateNewBlock(kBlockSize);
-  alloc_bytes_remaining_ = kBlockSize;
+  alloc_ptr_ = (huge_page_size_ > 0) ? AllocateHugeBlock()
+                                     : AllocateNewBlock(kBlockSize);
+  alloc_bytes_remaining_ = block_size;
 
   char* result = alloc_ptr_;
   alloc_ptr_ += bytes;
@@ -70,4 +84,15 @@ char* Arena::AllocateNewBlock(size_t block_bytes) {
   return result;
 }
 
+char* Arena::AllocateHugeBlock() {
+  char* result = port::MapHugePages(huge_page_size_, numa_node_);
+  if (result == nullptr) {
+    return AllocateNewBlock(huge_page_size_);
+  }
+  huge_blocks_.push_back(result);
+  memory_usage_.fetch_add(huge_page_size_ + sizeof(char*),
+                          std::memory_order_relaxed);
+  return result;
+}
+
 }  // namespace leveldb
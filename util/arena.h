@@ -17,6 +17,11 @@ class Arena {
  public:
   Arena();
 
+  // Allocate memory from blocks of "huge_page_size" bytes mapped with huge
+  // pages, bound to NUMA node "numa_node" unless it is negative.  Falls
+  // back to ordinary blocks of that size where huge pages are unavailable.
+  Arena(size_t huge_page_size, int numa_node);
+
   Arena(const Arena&) = delete;
   Arena& operator=(const Arena&) = delete;
 
@@ -37,6 +42,11 @@ class Arena {
  private:
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
+  char* AllocateHugeBlock();
+
+  // Zero for ordinary blocks
+  const size_t huge_page_size_;
+  const int numa_node_;
 
   // Allocation state
   char* alloc_ptr_;
@@ -45,6 +55,9 @@ class Arena {
   // 存储new分配的内存块
   std::vector<char*> blocks_;
 
+  // Blocks from port::MapHugePages(), of huge_page_size_ bytes each
+  std::vector<char*> huge_blocks_;
+
   // Total memory usage of the arena.
   std::atomic<size_t> memory_usage_;
 };
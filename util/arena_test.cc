@@ -4,6 +4,8 @@
 
 #include "util/arena.h"
 
+#include <cstring>
+
 #include "gtest/gtest.h"
 #include "util/random.h"
 
@@ -58,4 +60,30 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+TEST(ArenaTest, HugePages) {
+  const size_t kHugePageSize = 2 << 20;
+  for (int numa_node : {-1, 0}) {
+    Arena arena(kHugePageSize, numa_node);
+    std::vector<std::pair<size_t, char*>> allocated;
+    Random rnd(301);
+    size_t bytes = 0;
+    for (int i = 0; i < 100000; i++) {
+      const size_t s = 1 + (rnd.OneIn(1000) ? rnd.Uniform(1 << 20)
+                                            : rnd.Uniform(100));
+      char* r = rnd.OneIn(2) ? arena.AllocateAligned(s) : arena.Allocate(s);
+      std::memset(r, i % 256, s);
+      bytes += s;
+      allocated.push_back(std::make_pair(s, r));
+      ASSERT_GE(arena.MemoryUsage(), bytes);
+    }
+    ASSERT_GE(arena.MemoryUsage(), kHugePageSize);
+    for (size_t i = 0; i < allocated.size(); i++) {
+      const char* p = allocated[i].second;
+      for (size_t b = 0; b < allocated[i].first; b++) {
+        ASSERT_EQ(int(p[b]) & 0xff, i % 256);
+      }
+    }
+  }
+}
+
 }  // namespace leveldb
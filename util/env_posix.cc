@@ -653,6 +653,13 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status LinkFile(const std::string& from, const std::string& to) override {
+    if (::link(from.c_str(), to.c_str()) != 0) {
+      return PosixError(from, errno);
+    }
+    return Status::OK();
+  }
+
   Status LockFile(const std::string& filename, FileLock** lock) override {
     *lock = nullptr;
 